@@ -45,3 +45,7 @@
 #define GID_WPSSCTRL            45
 #define GID_WHM_HANDLER         46
 #define GID_RCVRY_MONITOR       47
+#define GID_SHBUF               48
+#define GID_LOGFMT              49
+#define GID_CAPTURE             50
+#define GID_SCDBIN              51
@@ -38,6 +38,9 @@
 #include "mtlkcontainer.h"
 
 #include "fshlpr.h"
+#include "osal_utest.h"
+#include "rtlog_app_utest.h"
+#include "log_utest.h"
 
 #ifdef CPTCFG_IWLWAV_ENABLE_OBJPOOL
 #include "mtlk_objpool.h"
@@ -76,9 +79,14 @@ static pthread_t         signal_thread;
 static mtlk_osal_event_t close_evt;
 static BOOL              close_evt_set      = FALSE;
 static int               close_status       = 0;
+static mtlk_container_t *volatile running_container = NULL;
 
 static BOOL dut_mode = FALSE;
 
+#ifdef CONFIG_WAVE_RTLOG_REMOTE
+static uint32 rtlog_async_flush_ms = 0; /* synchronous delivery */
+#endif
+
 static char *recovery_script_path = NULL;
 static const char _DRVHLPR_SCRIPT_CMD_START[]   = "fw_crash";
 static const char _DRVHLPR_SCRIPT_CMD_STOP[]    = "fw_recovery_end";
@@ -103,6 +111,11 @@ static uint32            mem_alarm_limit    = 0;
 static uint32            mem_alarm_type     = MAT_PRINT_ALLOC_INFO_ONCE;
 static volatile BOOL     mem_alarm_fired    = FALSE;
 static volatile uint32   mem_alarm_prints   = 0;
+static uint32            mem_sample_bytes   = 0;
+static uint32            mem_sample_report  = 0; /* sec */
+
+#define MEM_SAMPLE_NOF_TOP     10
+#define MEM_SAMPLE_MAX_REPORT  (24 * 60 * 60) /* sec */
 #endif
 
 static volatile BOOL     term_signal_noticed = FALSE;
@@ -118,8 +131,15 @@ static volatile BOOL     term_signal_noticed = FALSE;
  */
 typedef enum {
   MTLK_FS_COMPONENT_IDX,
+#ifdef CPTCFG_IWLWAV_ENABLE_OBJPOOL
+  MTLK_MEM_SAMPLE_COMPONENT_IDX,
+#endif
 } mtlk_drvhelper_components_idx;
 
+#ifdef CPTCFG_IWLWAV_ENABLE_OBJPOOL
+static const mtlk_component_api_t mem_sample_api;
+#endif
+
 /*
  * Components of driver helper
  */
@@ -128,6 +148,12 @@ static mtlk_component_t drvhelper_components[] = {
     .api  = &irb_fs_hlpr_api,
     .name = "fs_hlpr"
   },
+#ifdef CPTCFG_IWLWAV_ENABLE_OBJPOOL
+  {
+    .api  = &mem_sample_api,
+    .name = "mem_smpl"
+  },
+#endif
 };
 
 #ifdef CPTCFG_IWLWAV_ENABLE_OBJPOOL
@@ -155,6 +181,32 @@ print_mem_alloc_dump (void)
   mem_leak_dbg_print_allocators_info(_print_mem_alloc_dump, 
                                      HANDLE_T(0));
 }
+
+static mtlk_handle_t __MTLK_IFUNC
+_mem_sample_start (void)
+{
+  return HANDLE_T(1); /* no context */
+}
+
+/* Prints the top sampled allocators every mem_sample_report seconds */
+static uint32 __MTLK_IFUNC
+_mem_sample_iterate (mtlk_handle_t ctx)
+{
+  if (!mem_sample_bytes || !mem_sample_report)
+    return MTLK_COMPONENT_NO_DEADLINE;
+
+  mem_leak_dbg_print_top_allocators(_print_mem_alloc_dump, HANDLE_T(0),
+                                    MEM_SAMPLE_NOF_TOP);
+
+  return MIN(mem_sample_report, MEM_SAMPLE_MAX_REPORT) * 1000;
+}
+
+static const mtlk_component_api_t
+mem_sample_api = {
+  _mem_sample_start,
+  _mem_sample_iterate,
+  NULL
+};
 #endif
 
 static void
@@ -165,6 +217,8 @@ initiate_app_shutdown (int status)
 
   close_status = status;
   mtlk_osal_event_set(&close_evt);
+  if (running_container)
+    mtlk_container_wakeup(running_container);
   close_evt_set = TRUE;
 }
 
@@ -277,8 +331,13 @@ install_memory_alarm (BOOL set)
     memory_alarm_info.usr_ctx = HANDLE_T(0);
 
     mtlk_objpool_set_memory_alarm(&g_objpool, &memory_alarm_info);
+    mem_leak_dbg_set_sampling(mem_sample_bytes);
   }
   else {
+    if (mem_sample_bytes)
+      mem_leak_dbg_print_top_allocators(_print_mem_alloc_dump, HANDLE_T(0),
+                                        MEM_SAMPLE_NOF_TOP);
+    mem_leak_dbg_set_sampling(0);
     mtlk_objpool_set_memory_alarm(&g_objpool, NULL);
   }
 }
@@ -547,6 +606,41 @@ static const struct mtlk_argv_param_info_ex param_mem_alarm_type = {
   "           3 - print allocations once and assert",
   MTLK_ARGV_PTYPE_OPTIONAL
 };
+
+static const struct mtlk_argv_param_info_ex param_mem_sample_bytes = {
+  {
+    NULL,
+    "mem-sample-bytes",
+    MTLK_ARGV_PINFO_FLAG_HAS_INT_DATA
+  },
+  "sample one in this number of bytes allocated instead of tracking\n"
+  "           every allocation (no memory alarm then)",
+  MTLK_ARGV_PTYPE_OPTIONAL
+};
+
+static const struct mtlk_argv_param_info_ex param_mem_sample_report = {
+  {
+    NULL,
+    "mem-sample-report",
+    MTLK_ARGV_PINFO_FLAG_HAS_INT_DATA
+  },
+  "print the top sampled allocators every this number of seconds\n"
+  "           (on exit only by default)",
+  MTLK_ARGV_PTYPE_OPTIONAL
+};
+#endif
+
+#ifdef CONFIG_WAVE_RTLOG_REMOTE
+static const struct mtlk_argv_param_info_ex param_rtlog_async = {
+  {
+    NULL,
+    "rtlog-async",
+    MTLK_ARGV_PINFO_FLAG_HAS_INT_DATA
+  },
+  "queue the remote log messages and send them in batches every\n"
+  "           this number of ms (sent one by one by default)",
+  MTLK_ARGV_PTYPE_OPTIONAL
+};
 #endif
 
 static const struct mtlk_argv_param_info_ex param_dut = {
@@ -581,6 +675,11 @@ _print_help (const char *app_name)
 #ifdef CPTCFG_IWLWAV_ENABLE_OBJPOOL
     &param_mem_alarm_limit,
     &param_mem_alarm_type,
+    &param_mem_sample_bytes,
+    &param_mem_sample_report,
+#endif
+#ifdef CONFIG_WAVE_RTLOG_REMOTE
+    &param_rtlog_async,
 #endif
     &param_dut,
     &param_help
@@ -664,7 +763,7 @@ process_commandline (int argc, char *argv[])
     uint32 v = mtlk_argv_parser_param_get_uint_val(param, (uint32)-1);
     mtlk_argv_parser_param_release(param);
     if (v != (uint32)-1) {
-      debug = v;
+      mtlk_log_set_levels((int)v, debug_remote);
     }
     else {
       ELOG_V("Invalid debug-level!");
@@ -711,6 +810,26 @@ process_commandline (int argc, char *argv[])
       goto end;
     }
   }
+
+  param = mtlk_argv_parser_param_get(&argv_parser, &param_mem_sample_bytes.info);
+  if (param) {
+    mem_sample_bytes = mtlk_argv_parser_param_get_uint_val(param, mem_sample_bytes);
+    mtlk_argv_parser_param_release(param);
+  }
+
+  param = mtlk_argv_parser_param_get(&argv_parser, &param_mem_sample_report.info);
+  if (param) {
+    mem_sample_report = mtlk_argv_parser_param_get_uint_val(param, mem_sample_report);
+    mtlk_argv_parser_param_release(param);
+  }
+#endif
+
+#ifdef CONFIG_WAVE_RTLOG_REMOTE
+  param = mtlk_argv_parser_param_get(&argv_parser, &param_rtlog_async.info);
+  if (param) {
+    rtlog_async_flush_ms = mtlk_argv_parser_param_get_uint_val(param, MTLK_RTLOG_APP_ASYNC_DEF_FLUSH_MS);
+    mtlk_argv_parser_param_release(param);
+  }
 #endif
 
   param = mtlk_argv_parser_param_get(&argv_parser, &param_dut.info);
@@ -887,6 +1006,9 @@ MTLK_INIT_STEPS_LIST_BEGIN(drvhlpr_main)
   MTLK_INIT_STEPS_LIST_ENTRY(drvhlpr_main, START_SIGNALS_THREAD)
   MTLK_INIT_STEPS_LIST_ENTRY(drvhlpr_main, INSTALL_SIGACTIONS)
   MTLK_INIT_STEPS_LIST_ENTRY(drvhlpr_main, PARSE_CMD_LINE)
+#ifdef CONFIG_WAVE_RTLOG_REMOTE
+  MTLK_INIT_STEPS_LIST_ENTRY(drvhlpr_main, RTLOG_APP_ASYNC)
+#endif
 #ifdef CPTCFG_IWLWAV_ENABLE_OBJPOOL
   MTLK_INIT_STEPS_LIST_ENTRY(drvhlpr_main, INSTALL_MEMORY_ALARM)
 #endif
@@ -948,8 +1070,8 @@ _drvhlpr_register_components (drvhlpr_main_t *_drvhlpr)
   int i;
 
   for (i = 0; i < ARRAY_SIZE(drvhelper_components); ++i) {
-    /* FS helper available in dud mode only, and vice versa */
-    if ((TRUE == dut_mode) != (MTLK_FS_COMPONENT_IDX == i)) {
+    /* FS helper available in dud mode only, the others in both modes */
+    if ((MTLK_FS_COMPONENT_IDX == i) && (TRUE != dut_mode)) {
       WLOG_V("Drvhlpr is not in DUT mode. Ignore component fs_hlpr.");
       continue;
     }
@@ -1010,6 +1132,10 @@ _drvhlpr_main_cleanup (drvhlpr_main_t *_drvhlpr)
 #ifdef CPTCFG_IWLWAV_ENABLE_OBJPOOL
     MTLK_CLEANUP_STEP(drvhlpr_main, INSTALL_MEMORY_ALARM, MTLK_OBJ_PTR(_drvhlpr),
                       install_memory_alarm, (FALSE));
+#endif
+#ifdef CONFIG_WAVE_RTLOG_REMOTE
+    MTLK_CLEANUP_STEP(drvhlpr_main, RTLOG_APP_ASYNC, MTLK_OBJ_PTR(_drvhlpr),
+                      mtlk_rtlog_app_async_stop, ());
 #endif
     MTLK_CLEANUP_STEP(drvhlpr_main, PARSE_CMD_LINE, MTLK_OBJ_PTR(_drvhlpr),
                       MTLK_NOACTION, ());
@@ -1051,6 +1177,11 @@ _drvhlpr_main_init (drvhlpr_main_t *_drvhlpr, int argc, char *argv[])
                    _install_sigactions, ());
     MTLK_INIT_STEP(drvhlpr_main, PARSE_CMD_LINE, MTLK_OBJ_PTR(_drvhlpr),
                    process_commandline, (argc, argv));
+#ifdef CONFIG_WAVE_RTLOG_REMOTE
+    MTLK_INIT_STEP_IF(0 != rtlog_async_flush_ms, drvhlpr_main, RTLOG_APP_ASYNC, MTLK_OBJ_PTR(_drvhlpr),
+                      mtlk_rtlog_app_async_start, (MTLK_RTLOG_APP_ASYNC_DEF_SLOTS,
+                                                   rtlog_async_flush_ms));
+#endif
 #ifdef CPTCFG_IWLWAV_ENABLE_OBJPOOL
     MTLK_INIT_STEP_VOID(drvhlpr_main, INSTALL_MEMORY_ALARM, MTLK_OBJ_PTR(_drvhlpr),
                         install_memory_alarm, (TRUE));
@@ -1102,11 +1233,19 @@ main (int argc, char *argv[])
     goto end;
   }
 
+  run_osal_atomic_utest();
+  run_container_utest();
+  run_irba_utest();
+  run_rtlog_app_utest();
+  run_log_utest();
+
+  running_container = &drvhlpr.container;
   do {
     close_status = EVENT_DO_NOTHING;
     mtlk_osal_event_reset(&close_evt);
     mtlk_container_run(&drvhlpr.container, &close_evt);
   } while (close_status == EVENT_REQ_RESTART);
+  running_container = NULL;
   retval = close_status;
 
   _drvhlpr_main_cleanup(&drvhlpr);
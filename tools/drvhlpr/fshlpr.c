@@ -32,6 +32,7 @@
     To remove code after CRC generation on EEPROM data originator.
 */
 #if defined(EEPROM_CRC_ON_DRVHLPR)
+#include "mtlk_crc32.h"
 #include "fshlpr_utest.h"
 #endif /* defined(EEPROM_CRC_ON_DRVHLPR) */
 
@@ -45,31 +46,6 @@ static const mtlk_guid_t IRBE_FILE_SAVE = MTLK_IRB_GUID_FILE_SAVE;
 static char file_saver[100];
 
 #ifdef EEPROM_CRC_ON_DRVHLPR
-/* NOTE: For temporal solution we can use unoptimized version */
-static uint32
-_crc32 (uint32 crc, uint8 const *p, uint32 len)
-{
-/*
- * There are multiple 16-bit CRC polynomials in common use, but this is
- * *the* standard CRC-32 polynomial, first popularized by Ethernet.
- * x^32+x^26+x^23+x^22+x^16+x^12+x^11+x^10+x^8+x^7+x^5+x^4+x^2+x^1+x^0
- */
-#define CRCPOLY_LE 0xedb88320
-
-  int i;
-
-  while (len--)
-  {
-    crc ^= *p++;
-    for (i = 0; i < 8; i++)
-      crc = (crc >> 1) ^ ((crc & 1) ? CRCPOLY_LE : 0);
-  }
-
-  eeprom_utest_step(CRC_DONE);
-
-  return crc;
-}
-
 #define CIS_SECTION_HEADER_SIZE 2
 
 /**
@@ -271,8 +247,8 @@ _eeprom_crc_append(void **buffer, int *size)
   EEPROM_PUT8(EEPROM_CIS_CRC_LEN);
 
   /* Do CRC calculation */
-  crc = _crc32(~0L, dst, p - dst);
-  crc ^= ~0L;
+  crc = mtlk_crc32(dst, p - dst);
+  eeprom_utest_step(CRC_DONE);
 
   ILOG1_DD("FS HLPR: Calculate CRC32 [0x%08x] for EEPROM data [%d]",
            crc, p - dst);
@@ -29,6 +29,7 @@
 
 #include "dataex.h"
 #include "mtlkirba.h"
+#include "mtlk_crc32.h"
 
 #include "fshlpr_utest.h"
 
@@ -209,6 +210,141 @@ static eeprom_utest_t eeprom_utest_array[] =
   {NULL, 0, NULL, 0, 0}
 };
 
+/* -== CRC32 check values ==- */
+typedef struct {
+  const char *in;
+  uint32      crc;
+} crc32_utest_t;
+
+static const crc32_utest_t crc32_utest_array[] =
+{
+  {"",                                            0x00000000},
+  {"a",                                           0xe8b7be43},
+  {"abc",                                         0x352441c2},
+  {"123456789",                                   0xcbf43926},
+  {"message digest",                              0x20159d7f},
+  {"abcdefghijklmnopqrstuvwxyz",                  0x4c2750bd},
+  {"The quick brown fox jumps over the lazy dog", 0x414fa339},
+  {"ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789", 0x1fc2e6d2},
+  {"12345678901234567890123456789012345678901234567890123456789012345678901234567890", 0x7ca94a72},
+  /* NOTE: Should be last one */
+  {NULL, 0}
+};
+
+/* Reference: the bitwise CRC32 used before */
+static uint32
+_crc32_bitwise (uint32 crc, uint8 const *p, uint32 len)
+{
+  int i;
+
+  while (len--)
+  {
+    crc ^= *p++;
+    for (i = 0; i < 8; i++)
+      crc = (crc >> 1) ^ ((crc & 1) ? 0xedb88320 : 0);
+  }
+
+  return crc;
+}
+
+static BOOL
+_crc32_utest (void)
+{
+  const crc32_utest_t *v;
+  uint32 off, len;
+  BOOL   pased = TRUE;
+
+  ILOG0_S("FS HLPR: CRC32 unit tests, %s", mtlk_crc32_get_impl_name());
+
+  for (v = crc32_utest_array; NULL != v->in; v++)
+  {
+    uint32 crc = mtlk_crc32(v->in, strlen(v->in));
+
+    if (crc != v->crc)
+    {
+      ELOG_SDD("FS HLPR: Wrong CRC32 of \"%s\" [0x%08x], expected [0x%08x]", v->in, crc, v->crc);
+      pased = FALSE;
+    }
+  }
+
+  /* Every length and misalignment on either side of the 8 and 64 bytes
+   * blocks, whole and in two parts */
+  for (len = 0; len < 0x10; len++)
+    tmb_buffer[len] = (uint8)(len * 0x3b + 0x11);
+  for (; len < sizeof(tmb_buffer); len++)
+    tmb_buffer[len] = (uint8)(tmb_buffer[len - 0x10] * 0x6d + len);
+
+  for (off = 0; off < 8; off++)
+  {
+    for (len = 0; len <= sizeof(tmb_buffer) - 8; len += (len < 0x120) ? 1 : 0x3d)
+    {
+      uint8 const *p = tmb_buffer + off;
+      uint32 ref = _crc32_bitwise(~0U, p, len);
+
+      if (mtlk_crc32_update(~0U, p, len) != ref ||
+          mtlk_crc32_update_sw(~0U, p, len) != ref ||
+          mtlk_crc32_update(mtlk_crc32_update(~0U, p, len / 3), p + len / 3, len - len / 3) != ref)
+      {
+        ELOG_DD("FS HLPR: Wrong CRC32 of [%d] bytes at offset [%d]", len, off);
+        pased = FALSE;
+      }
+    }
+  }
+
+  ILOG0_S("FS HLPR: CRC32 unit tests %s", (TRUE == pased) ? "SUCCEED" : "FAILED");
+
+  return pased;
+}
+
+#define CRC32_BENCH_BYTES   (256 * 1024 * 1024) /* per measurement */
+
+/* MB/s of crc32_update over blocks of len bytes of tmb_buffer */
+static uint32
+_crc32_bench_run (uint32 (__MTLK_IFUNC *crc32_update)(uint32, const void *, uint32),
+                  uint32 len, uint32 *crc)
+{
+  mtlk_osal_timestamp_t start;
+  uint32 elapsed_ms;
+  uint32 i;
+
+  start = mtlk_osal_timestamp();
+  for (i = 0; i < CRC32_BENCH_BYTES / len; i++)
+  {
+    *crc = crc32_update(*crc, tmb_buffer, len);
+  }
+  elapsed_ms = mtlk_osal_timestamp_to_ms(mtlk_osal_timestamp() - start);
+
+  return (uint32)(((uint64)(CRC32_BENCH_BYTES / len) * len * 1000 / (1024 * 1024)) / MAX(elapsed_ms, 1));
+}
+
+/* Throughput of the table driven CRC32 against the hardware assisted one
+ * (the same one when the CPU has no CRC instructions) */
+static BOOL
+_crc32_benchmark (void)
+{
+  static const uint32 lens[] = { 16, 64, 512, sizeof(tmb_buffer) & ~7U };
+  uint32 crc_sw = ~0U, crc_hw = ~0U;
+  uint32 i;
+
+  for (i = 0; i < ARRAY_SIZE(lens); i++)
+  {
+    uint32 sw = _crc32_bench_run(mtlk_crc32_update_sw, lens[i], &crc_sw);
+    uint32 hw = _crc32_bench_run(mtlk_crc32_update, lens[i], &crc_hw);
+
+    ILOG0_DDSD("FS HLPR: CRC32 of %u bytes blocks: slicing-by-8 %u MB/s, %s %u MB/s",
+               lens[i], sw, mtlk_crc32_get_impl_name(), hw);
+  }
+
+  /* Same input, so the chains must end the same */
+  if (crc_sw != crc_hw)
+  {
+    ELOG_DD("FS HLPR: CRC32 benchmark results differ [0x%08x] [0x%08x]", crc_sw, crc_hw);
+    return FALSE;
+  }
+
+  return TRUE;
+}
+
 static int
 _data_validate(uint8 const *buff, uint32 size)
 {
@@ -268,6 +404,12 @@ run_eeprom_crc_utest(
 
   MTLK_ASSERT(_file_save_handler);
 
+  if (!_crc32_utest())
+    all_pased = FALSE;
+
+  if (!_crc32_benchmark())
+    all_pased = FALSE;
+
   ILOG0_V("FS HLPR: Start EEPROM unit tests");
 
   while (NULL != p->in)
@@ -149,6 +149,18 @@ static const struct mtlk_argv_param_info_ex param_no_files_to_keep =  {
   MTLK_ARGV_PTYPE_OPTIONAL
 };
 
+#ifdef CONFIG_WAVE_RTLOG_REMOTE
+static const struct mtlk_argv_param_info_ex param_rtlog_async =  {
+  {
+    NULL,
+    "rtlog_async",
+    MTLK_ARGV_PINFO_FLAG_HAS_INT_DATA
+  },
+  "Send the remote log messages in batches every this number of ms",
+  MTLK_ARGV_PTYPE_OPTIONAL
+};
+#endif
+
 
 static BOOL _safe_system_cmd_string (const char * string, int size){
   int i;
@@ -856,6 +868,9 @@ _print_help (const char *app_name)
     &param_path,
     &param_offline_dump,
     &param_no_files_to_keep,
+#ifdef CONFIG_WAVE_RTLOG_REMOTE
+    &param_rtlog_async,
+#endif
   };
   const char *app_fname = strrchr(app_name, '/');
   char  version[MAX_FILE_NAME_SIZE];
@@ -1231,6 +1246,17 @@ main(int argc, char *argv[])
     }
   }
 
+#ifdef CONFIG_WAVE_RTLOG_REMOTE
+  param = mtlk_argv_parser_param_get(&argv_parser, &param_rtlog_async.info);
+  if (param) {
+    uint32 flush_ms = mtlk_argv_parser_param_get_uint_val(param, MTLK_RTLOG_APP_ASYNC_DEF_FLUSH_MS);
+    mtlk_argv_parser_param_release(param);
+
+    /* Not fatal: the messages are sent synchronously then */
+    mtlk_rtlog_app_async_start(MTLK_RTLOG_APP_ASYNC_DEF_SLOTS, flush_ms);
+  }
+#endif
+
 #if !CONFIG_USE_DWPAL_DAEMON
   /* get interface name for the selected card */
   sprintf_res = sprintf_s(sys_cmd, sizeof(sys_cmd), "line=`/bin/cat /proc/net/mtlk/topology | "
@@ -1320,5 +1346,9 @@ end:
 
   ILOG0_V("Dump handler is exiting...");
 
+#ifdef CONFIG_WAVE_RTLOG_REMOTE
+  mtlk_rtlog_app_async_stop();
+#endif
+
   return res;
 }
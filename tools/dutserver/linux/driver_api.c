@@ -32,6 +32,7 @@
 
 #include <sys/stat.h>
 #include <fcntl.h>
+#include <stdarg.h>
 
 #define LOG_LOCAL_GID   GID_DUT_SRV_DRIVER_API
 #define LOG_LOCAL_FID   1
@@ -97,6 +98,36 @@ static const struct mtlk_argv_param_info_ex param_help = {
   MTLK_ARGV_PTYPE_OPTIONAL
 };
 
+#ifdef CPTCFG_IWLWAV_ENABLE_OBJPOOL
+static const struct mtlk_argv_param_info_ex param_mem_sample_bytes = {
+  {
+    NULL,
+    "mem-sample-bytes",
+    MTLK_ARGV_PINFO_FLAG_HAS_INT_DATA
+  },
+  "sample one in this number of bytes allocated instead of tracking\n"
+  "           every allocation",
+  MTLK_ARGV_PTYPE_OPTIONAL
+};
+
+static const struct mtlk_argv_param_info_ex param_mem_sample_report = {
+  {
+    NULL,
+    "mem-sample-report",
+    MTLK_ARGV_PINFO_FLAG_HAS_INT_DATA
+  },
+  "print the top sampled allocators every this number of seconds\n"
+  "           (on exit only by default)",
+  MTLK_ARGV_PTYPE_OPTIONAL
+};
+
+#define _DUT_MEM_SAMPLE_NOF_TOP     10
+#define _DUT_MEM_SAMPLE_MAX_REPORT  (24 * 60 * 60) /* sec */
+
+static uint32 _dut_api_mem_sample_bytes  = 0;
+static uint32 _dut_api_mem_sample_report = 0; /* sec */
+#endif
+
 typedef struct _dut_api_t
 {
   struct
@@ -120,6 +151,10 @@ _dut_api_help (const char *app_name)
 {
   const struct mtlk_argv_param_info_ex *all_params[] = {
     &param_script,
+#ifdef CPTCFG_IWLWAV_ENABLE_OBJPOOL
+    &param_mem_sample_bytes,
+    &param_mem_sample_report,
+#endif
     &param_help
   };
   const char *app_fname = strrchr(app_name, '/');
@@ -171,6 +206,20 @@ _dut_api_process_commandline (int argc, char *argv[])
     }
   }
 
+#ifdef CPTCFG_IWLWAV_ENABLE_OBJPOOL
+  param = mtlk_argv_parser_param_get(&argv_parser, &param_mem_sample_bytes.info);
+  if (param) {
+    _dut_api_mem_sample_bytes = mtlk_argv_parser_param_get_uint_val(param, _dut_api_mem_sample_bytes);
+    mtlk_argv_parser_param_release(param);
+  }
+
+  param = mtlk_argv_parser_param_get(&argv_parser, &param_mem_sample_report.info);
+  if (param) {
+    _dut_api_mem_sample_report = mtlk_argv_parser_param_get_uint_val(param, _dut_api_mem_sample_report);
+    mtlk_argv_parser_param_release(param);
+  }
+#endif
+
   res = MTLK_ERR_OK;
 
 end:
@@ -185,6 +234,56 @@ end:
   return res;
 }
 
+#ifdef CPTCFG_IWLWAV_ENABLE_OBJPOOL
+static int __MTLK_IFUNC
+_dut_api_print_mem_sample (mtlk_handle_t printf_ctx,
+                           const char   *format,
+                           ...)
+{
+  int     res;
+  va_list valst;
+  char    buf[512];
+
+  va_start(valst, format);
+  res = vsnprintf(buf, sizeof(buf), format, valst);
+  va_end(valst);
+
+  ILOG0_S("%s", buf);
+
+  return res;
+}
+
+void __MTLK_IFUNC
+dut_api_mem_sample_start(void)
+{
+  mem_leak_dbg_set_sampling(_dut_api_mem_sample_bytes);
+}
+
+uint32 __MTLK_IFUNC
+dut_api_mem_sample_report_period(void)
+{
+  if (!_dut_api_mem_sample_bytes)
+    return 0;
+
+  return MIN(_dut_api_mem_sample_report, _DUT_MEM_SAMPLE_MAX_REPORT);
+}
+
+void __MTLK_IFUNC
+dut_api_mem_sample_report(void)
+{
+  if (_dut_api_mem_sample_bytes)
+    mem_leak_dbg_print_top_allocators(_dut_api_print_mem_sample, HANDLE_T(0),
+                                      _DUT_MEM_SAMPLE_NOF_TOP);
+}
+
+void __MTLK_IFUNC
+dut_api_mem_sample_stop(void)
+{
+  dut_api_mem_sample_report();
+  mem_leak_dbg_set_sampling(0);
+}
+#endif
+
 static void __MTLK_IFUNC
 _dut_api_irba_rm_handler (mtlk_irba_t   *irba,  mtlk_handle_t  context)
 {
@@ -587,8 +686,8 @@ dut_api_send_dut_core_command(
   } 
   else 
   {
-    res = mtlk_irba_call_drv(g_the_dut_api.irba_connections[hw_idx].irba,
-                           p_cmd, (void*) data, length);
+    res = mtlk_irba_call_drv_inplace(g_the_dut_api.irba_connections[hw_idx].irba,
+                                     p_cmd, (void*) data, length);
     if (res != MTLK_ERR_OK)
     {
       ELOG_D("DUT: Failed to send DUT FW request, error %d", res);
@@ -629,6 +728,38 @@ dut_api_send_drv_command(uint8_t *data, int length, int hw_idx)
   return res;
 }
 
+int __MTLK_IFUNC
+dut_api_send_fw_command_inplace(uint8_t *data, int length, int hw_idx)
+{
+  int res;
+
+  MTLK_ASSERT(dut_api_is_connected_to_hw(hw_idx));
+
+  res = mtlk_irba_call_drv_inplace(g_the_dut_api.irba_connections[hw_idx].irba,
+                                   &_IRBE_DUT_FW_CMD, (void*) data, length);
+  if (res != MTLK_ERR_OK)
+  {
+    ELOG_D("DUT: Failed to send DUT FW request, error %d", res);
+  }
+  return res;
+}
+
+int __MTLK_IFUNC
+dut_api_send_drv_command_inplace(uint8_t *data, int length, int hw_idx)
+{
+  int res;
+
+  MTLK_ASSERT(dut_api_is_connected_to_hw(hw_idx));
+
+  res = mtlk_irba_call_drv_inplace(g_the_dut_api.irba_connections[hw_idx].irba,
+                                   &_IRBE_DUT_DRV_CMD, (void*) data, length);
+  if (res != MTLK_ERR_OK)
+  {
+    ELOG_D("DUT: Failed to send DUT DRV request, error %d", res);
+  }
+  return res;
+}
+
 int __MTLK_IFUNC
 dut_api_send_platform_command(uint8_t *data, int length, int hw_idx)
 {
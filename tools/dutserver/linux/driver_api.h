@@ -42,6 +42,14 @@ dut_api_send_fw_command(uint8_t *data, int length, int hw_idx);
 int __MTLK_IFUNC
 dut_api_send_drv_command(uint8_t *data, int length, int hw_idx);
 
+/* Same as above without copying the data, which must be preceded by
+ * MTLK_IRBA_CALL_HEADROOM bytes (see mtlk_irba_call_drv_inplace) */
+int __MTLK_IFUNC
+dut_api_send_fw_command_inplace(uint8_t *data, int length, int hw_idx);
+
+int __MTLK_IFUNC
+dut_api_send_drv_command_inplace(uint8_t *data, int length, int hw_idx);
+
 int __MTLK_IFUNC
 dut_api_send_platform_command(uint8_t *data, int length, int hw_idx);
 
@@ -51,4 +59,21 @@ dut_api_eeprom_data_on_flash_prepare(uint32 size, int hw_idx);
 BOOL __MTLK_IFUNC
 dut_api_is_connected_to_hw(int hw_idx);
 
+#ifdef CPTCFG_IWLWAV_ENABLE_OBJPOOL
+/* Allocations sampling (--mem-sample-bytes), see mem_leak_dbg_set_sampling */
+void __MTLK_IFUNC
+dut_api_mem_sample_start(void);
+
+/* Prints the top sampled allocators and switches the sampling off */
+void __MTLK_IFUNC
+dut_api_mem_sample_stop(void);
+
+/* --mem-sample-report, sec (0 - on stop only) */
+uint32 __MTLK_IFUNC
+dut_api_mem_sample_report_period(void);
+
+void __MTLK_IFUNC
+dut_api_mem_sample_report(void);
+#endif
+
 #endif /* __DRIVER_API_H__ */
@@ -37,6 +37,7 @@ typedef struct _dutResetParamsCompat
 
 #define DUT_MAX_PROGMODEL_NAME_LEN 256
 
+/* The data is passed in place, see dut_api_send_fw_command_inplace */
 int __MTLK_IFUNC
 dut_api_send_dut_core_command(dutDriverMessagesId_e in_msg_id, 
       const char *data, int length, int hw_idx);
@@ -223,7 +224,7 @@ _dut_msg_clbk_c100 (int dutIndex, uint8_t* data, size_t length, size_t *out_leng
     return FALSE;
   }
 
-  res = dut_api_send_fw_command(data, length, dutIndex);
+  res = dut_api_send_fw_command_inplace(data, length, dutIndex);
   if (MTLK_ERR_OK != res)
   {
     ELOG_D("Failed to send C100 message, error %d", res);
@@ -245,7 +246,7 @@ _dut_msg_clbk_drv(int dutIndex, uint8_t* data, size_t length, size_t *out_length
     return FALSE;
   }
 
-  res = dut_api_send_drv_command(data, length, dutIndex);
+  res = dut_api_send_drv_command_inplace(data, length, dutIndex);
   if (MTLK_ERR_OK != res)
   {
     ELOG_D("Failed to send DRV message, error %d", res);
@@ -14,6 +14,7 @@
 #include "mtlkinc.h"
 #include "compat.h"
 #include "driver_api.h"
+#include "mtlkirba.h"
 #include "dut_host_if.h"
 #include "dut_msg_clbk.h"
 #include "sockets.h"
@@ -33,8 +34,12 @@ typedef struct DutContext_t
   int signal_fd;
   int server_fd;
   int client_fd;
+  int mem_sample_fd; /* Top sampled allocators report timer */
   uint32_t client_ip_address;
-  uint8_t buffer[DUT_MSG_MAX_MESSAGE_LENGTH];
+  /* Requests are passed to the driver in place: any of them may start at
+   * buffer and needs the headroom in front of it */
+  uint8_t buffer_space[MTLK_IRBA_CALL_HEADROOM + DUT_MSG_MAX_MESSAGE_LENGTH];
+  uint8_t *buffer;
   size_t bufferLength;
 } DutContext_t;
 
@@ -101,7 +106,7 @@ BOOL handle_response(const uint8_t* buffer, size_t length, void *arg)
 void handle_incoming_data(struct DutContext_t *ctx)
 {
   // Receive data and append it to existing data (if any)
-  int bytesReceived = receive_data(ctx->client_fd, &ctx->buffer[ctx->bufferLength], sizeof(ctx->buffer) - ctx->bufferLength);
+  int bytesReceived = receive_data(ctx->client_fd, &ctx->buffer[ctx->bufferLength], DUT_MSG_MAX_MESSAGE_LENGTH - ctx->bufferLength);
 
   if (bytesReceived < 0)
   {
@@ -160,7 +165,9 @@ BOOL dut_server_run()
     .signal_fd = INVALID_SOCKET,
     .server_fd = INVALID_SOCKET,
     .client_fd = INVALID_SOCKET,
+    .mem_sample_fd = INVALID_SOCKET,
     .client_ip_address = 0,
+    .buffer = &ctx.buffer_space[MTLK_IRBA_CALL_HEADROOM],
     .bufferLength = 0,
   };
 
@@ -178,6 +185,15 @@ BOOL dut_server_run()
   ok = ok && create_epoll(&ctx.epoll_fd);
   ok = ok && add_fd_to_epoll(ctx.epoll_fd, ctx.signal_fd, EPOLLIN);
   ok = ok && add_fd_to_epoll(ctx.epoll_fd, ctx.server_fd, EPOLLERR | EPOLLIN);
+
+#ifdef CPTCFG_IWLWAV_ENABLE_OBJPOOL
+  dut_api_mem_sample_start();
+  if (dut_api_mem_sample_report_period())
+  {
+    ok = ok && setup_periodic_timer(&ctx.mem_sample_fd, dut_api_mem_sample_report_period());
+    ok = ok && add_fd_to_epoll(ctx.epoll_fd, ctx.mem_sample_fd, EPOLLIN);
+  }
+#endif
   
   while (ok && (! done))
   {
@@ -235,6 +251,14 @@ BOOL dut_server_run()
           handle_incoming_data(&ctx);
           processed = TRUE;
         }
+#ifdef CPTCFG_IWLWAV_ENABLE_OBJPOOL
+        else if (fd == ctx.mem_sample_fd)
+        {
+          ok = ack_periodic_timer(ctx.mem_sample_fd);
+          dut_api_mem_sample_report();
+          processed = TRUE;
+        }
+#endif
       }
 
       if (!processed)
@@ -245,6 +269,10 @@ BOOL dut_server_run()
     }
   }
     
+#ifdef CPTCFG_IWLWAV_ENABLE_OBJPOOL
+  dut_api_mem_sample_stop();
+  close_fd(&ctx.mem_sample_fd);
+#endif
   close_fd(&ctx.client_fd);
   close_fd(&ctx.server_fd);
   close_fd(&ctx.signal_fd);
@@ -17,6 +17,7 @@
 
 #include <signal.h>
 #include <sys/signalfd.h>
+#include <sys/timerfd.h>
 #include <netinet/tcp.h> // For TCP_NODELAY
 #include <sys/ioctl.h>
 
@@ -338,6 +339,49 @@ BOOL setup_termination_signals(int *signal_fd)
   return TRUE;
 }
 
+BOOL setup_periodic_timer(int *timer_fd, uint32_t period_sec)
+{
+  if (timer_fd == NULL)
+  {
+    ELOG_V("Invalid parameter: pointer to file descriptor cannot be NULL");
+    return FALSE;
+  }
+
+  struct itimerspec spec =
+  {
+    .it_interval = { .tv_sec = period_sec },
+    .it_value = { .tv_sec = period_sec },
+  };
+
+  *timer_fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK);
+  if (*timer_fd == INVALID_SOCKET)
+  {
+    ELOG_S("Failed to create timer descriptor: %s", strerror(errno));
+    return FALSE;
+  }
+
+  if (timerfd_settime(*timer_fd, 0, &spec, NULL) == -1)
+  {
+    ELOG_S("Failed to set timer: %s", strerror(errno));
+    close_fd(timer_fd);
+    return FALSE;
+  }
+
+  return TRUE;
+}
+
+BOOL ack_periodic_timer(int timer_fd)
+{
+  uint64_t expirations;
+
+  if (read(timer_fd, &expirations, sizeof(expirations)) != sizeof(expirations))
+  {
+    return (errno == EAGAIN);
+  }
+
+  return TRUE;
+}
+
 BOOL ignore_sigpipe()
 {
   struct sigaction act = 
@@ -41,6 +41,8 @@ BOOL remove_fd_from_epoll(int epoll_fd, int fd);
 BOOL wait_epoll(int epoll_fd, int *fd, uint32_t *events);
 
 BOOL setup_termination_signals(int *signal_fd);
+BOOL setup_periodic_timer(int *timer_fd, uint32_t period_sec);
+BOOL ack_periodic_timer(int timer_fd);
 
 BOOL ignore_sigpipe();
 
@@ -15,7 +15,6 @@
 #define __LOGEVT_H__
 
 #include <string>
-#include <istream>
 #include <vector>
 #include <sstream>
 #include <iomanip>
@@ -27,8 +26,6 @@ using namespace std;
 
 class CLogEvt
 {
-  friend istream &operator>> (istream &is, CLogEvt &evt);
-
   class exc_bad_evt_hdr : public exc_basic
   {
   public:
@@ -39,12 +36,13 @@ class CLogEvt
     }
   };
 
-  class exc_bad_data_type : public exc_basic
+  class exc_bad_evt_data : public exc_basic
   {
   public:
-    exc_bad_data_type (uint8 dtype) {
+    exc_bad_evt_data (uint8 oid, uint8 gid, uint16 fid, uint16 lid) {
       ostringstream ss;
-      ss << "Unknown LOG event data type: " << dtype;
+      ss << "Corrupted LOG event data: " << 
+        (int) oid << ":" << (int) gid << ":" << (int) fid << ":" << (int) lid;
       m_str = ss.str();
     }
   };
@@ -56,6 +54,9 @@ public:
   string   GetSrcString(const CLogFmtDB &fmt_db) const;
   string   GetDstString(const CLogFmtDB &fmt_db) const;
   string   GetMsgString(const CLogFmtDB &fmt_db) const;
+  /* Formats the message into buf (reused across events), returns its length */
+  size_t   FormatMsg(const CLogFmtDB &fmt_db, vector<char> &buf) const;
+  size_t   FormatMsg(CLogFmtCache &fmt_cache, vector<char> &buf) const;
   uint32   GetTS(void) const {
     return m_ts;
   }
@@ -78,8 +79,13 @@ public:
     return m_has_data;
   }
 
+  /* Parses the event record at p in place, so the event is valid as long
+   * as the record memory is. Returns the record size or 0 if fewer than
+   * avail bytes are needed (the required number is put to need). */
+  size_t   Attach(const char *p, size_t avail, size_t &need);
+
 protected:
-  void     Read(istream &in_s);
+  size_t   FormatMsg(const logfmt_prog_t *prog, vector<char> &buf) const;
 
   bool                 m_has_data;
   uint32               m_ts;
@@ -89,63 +95,8 @@ protected:
   uint16               m_lid;
   uint8                m_wlanif;
   bool                 m_reversed;
-  
-  mutable vector<int8> m_buffer;
-};
-
-istream &operator>> (istream &is, CLogEvt &evt);
-
-class CLogEvtFmt
-{
-  class exc_bad_format : public exc_basic
-  {
-  public:
-    exc_bad_format (string &fmt, size_t offs, uint32 param) {
-      ostringstream ss;
-      ss << "Invalid format string= '" << fmt << "' offset=" << offs <<" param=" << param;
-      m_str = ss.str();
-    }
-    exc_bad_format (string &fmt, size_t offs, const char *str) {
-      ostringstream ss;
-      ss << "Invalid format string= '" << fmt << "' offset=" << offs <<" param='" << str << "'";
-      m_str = ss.str();
-    }
-    exc_bad_format (string &fmt, size_t offs, const void *) {
-      ostringstream ss;
-      ss << "Invalid format string= '" << fmt << "' offset=" << offs <<" param is binary data";
-      m_str = ss.str();
-    }
-  };
-public:
-  CLogEvtFmt(const CLogEvt &evt)
-    : m_evt(evt)
-    , m_in_progress(false)
-    , m_offset(0)
-  { }
-
-  ~CLogEvtFmt() 
-  { }
-  
-  void BeginFormat(const CLogFmtDB &fmt_db);
-  template<typename T> 
-    void PutParam(const T& val);
-  void EndFormat(void);
-  
-  string &GetFormatResult(void) {
-    return m_res;
-  }
-
-protected:
-  bool TryProcessOwnExtension(const string& val_format, const int8 &val);
-  bool TryProcessOwnExtension(const string& val_format, const int32 &val);
-  bool TryProcessOwnExtension(const string& val_format, const int64 &val);
-  bool TryProcessOwnExtension(const string& val_format, const void *val);
- 
-  const CLogEvt &m_evt;
-  string         m_format;
-  bool           m_in_progress;
-  size_t         m_offset;
-  string         m_res;
+  const char          *m_data;
+  uint32               m_dsize;
 };
 
 #endif // __LOGEVT_H__
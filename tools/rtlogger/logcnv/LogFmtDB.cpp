@@ -15,6 +15,7 @@
 #include "LogFmtDB.h"
 
 #include <fstream>
+#include <new>
 
 using namespace std;
 
@@ -24,23 +25,24 @@ using namespace std;
                                            (((uint64)(uint8)(gid)) << 32)  | \
                                            (((uint64)(uint16)(fid)) << 16) | \
                                            ((uint64)(uint16)(lid)))
-
-string
-replace_all(const string &source, const string &victim, const string &replacement)
-{
-  string answer = source;
-  string::size_type j = 0;
-
-  while ((j = answer.find(victim, j)) != std::string::npos )
-    answer.replace(j, victim.length(), replacement);
-  return answer;
-}
+#define FMTS_KEY_INVALID             (~(uint64)0)
 
 void 
 CLogFmtDB::Read (string &fname)
 {
   ifstream ifs;
 
+  if (scdbin_is_binary(fname.c_str())) {
+    scdbin_t bin;
+    int      res = scdbin_open(&bin, fname.c_str());
+
+    if (res != MTLK_ERR_OK) {
+      throw bad_scd_file(fname, res);
+    }
+    bins.push_back(bin);
+    return;
+  }
+
   ifs.exceptions(ifstream::badbit); /* An error happened. */
 
   ifs.open(fname.c_str());
@@ -55,8 +57,11 @@ CLogFmtDB::Read (string &fname)
     uint32 val;
     bool   fmt_read;
     string fmt_str;
+    vector<char> fmt;
 
-    ifs >> record_type;
+    /* Stop at the end of file: unget() below clears eofbit */
+    if (!(ifs >> record_type))
+      break;
 
     switch (record_type) {
     case 'O':
@@ -109,10 +114,20 @@ CLogFmtDB::Read (string &fname)
         }
       }
       if (fmt_read) {
-        fmt_str = replace_all(fmt_str, "\"\"", "");
-        if (!fmts.insert(pair<uint64, string> (MAKE_FMTS_KEY(oid, gid, fid, lid), fmt_str.c_str())).second) {
+        /* Decoded the same way as by logserver */
+        fmt.assign(fmt_str.begin(), fmt_str.end());
+        fmt.push_back('\0');
+        if (logfmt_decode(&fmt[0]) != 0) {
+          throw bad_scd_file(fname, oid, gid, fid, lid, fmt_str);
+        }
+        if (fmts.count(MAKE_FMTS_KEY(oid, gid, fid, lid))) {
           throw bad_scd_file(oid, gid, fid, lid, buf);
         }
+        logfmt_prog_t *prog = logfmt_compile(&fmt[0]);
+        if (!prog) {
+          throw bad_alloc();
+        }
+        fmts[MAKE_FMTS_KEY(oid, gid, fid, lid)] = prog;
       }
       break;
     default:
@@ -122,19 +137,137 @@ CLogFmtDB::Read (string &fname)
   }
 }
 
+void
+CLogFmtDB::Reset (void)
+{
+  for (map<uint64, logfmt_prog_t *>::iterator it = fmts.begin(); it != fmts.end(); ++it) {
+    logfmt_free(it->second);
+  }
+  fmts.clear();
+
+  for (size_t i = 0; i < bins.size(); i++) {
+    scdbin_close(&bins[i]);
+  }
+  bins.clear();
+}
+
+void
+CLogFmtDB::Write (const string &fname) const
+{
+  vector<scdbin_rec_t> recs[SCDBIN_NOF_SECTIONS];
+  scdbin_rec_t        *recs_ptr[SCDBIN_NOF_SECTIONS];
+  uint32               nof_recs[SCDBIN_NOF_SECTIONS];
+  scdbin_rec_t         rec;
+  int                  res;
+
+  for (map<uint8, string>::const_iterator it = orgs.begin(); it != orgs.end(); ++it) {
+    rec.key  = SCDBIN_ORG_KEY(it->first);
+    rec.data = it->second.c_str();
+    rec.size = (uint32)it->second.size() + 1;
+    recs[SCDBIN_ORGS].push_back(rec);
+  }
+  for (map<uint16, string>::const_iterator it = grps.begin(); it != grps.end(); ++it) {
+    rec.key  = SCDBIN_GRP_KEY(it->first >> 8, it->first & 0xFF);
+    rec.data = it->second.c_str();
+    rec.size = (uint32)it->second.size() + 1;
+    recs[SCDBIN_GRPS].push_back(rec);
+  }
+  for (map<uint64, logfmt_prog_t *>::const_iterator it = fmts.begin(); it != fmts.end(); ++it) {
+    uint8  oid = (uint8)(it->first >> 40);
+    uint8  gid = (uint8)(it->first >> 32);
+    uint16 fid = (uint16)(it->first >> 16);
+    uint16 lid = (uint16)it->first;
+
+    /* Keys are packed as in the event header */
+    rec.key = SCDBIN_FMT_KEY(oid, gid, fid, lid);
+    if (MTLK_BFIELD_GET(rec.key, LOG_INFO_W0_OID) != oid ||
+        MTLK_BFIELD_GET(rec.key, LOG_INFO_W0_GID) != gid ||
+        MTLK_BFIELD_GET(rec.key, LOG_INFO_W0_FID) != fid ||
+        MTLK_BFIELD_GET(rec.key, LOG_INFO_W0_LID) != lid) {
+      throw bad_scd_file(fname, oid, gid, fid, lid);
+    }
+    rec.data = it->second;
+    rec.size = logfmt_prog_size(it->second);
+    recs[SCDBIN_FMTS].push_back(rec);
+  }
+  /* Compiled files are merged as is */
+  for (size_t i = 0; i < bins.size(); i++) {
+    for (int sect = 0; sect < SCDBIN_NOF_SECTIONS; sect++) {
+      for (uint32 j = 0; j < bins[i].nof_ents[sect]; j++) {
+        rec.key  = bins[i].ents[sect][j].key;
+        rec.data = bins[i].data + bins[i].ents[sect][j].off;
+        rec.size = bins[i].ents[sect][j].size;
+        recs[sect].push_back(rec);
+      }
+    }
+  }
+
+  for (int sect = 0; sect < SCDBIN_NOF_SECTIONS; sect++) {
+    recs_ptr[sect] = recs[sect].empty() ? NULL : &recs[sect][0];
+    nof_recs[sect] = (uint32)recs[sect].size();
+  }
+
+  res = scdbin_write(fname.c_str(), recs_ptr, nof_recs);
+  if (res != MTLK_ERR_OK) {
+    throw bad_scd_file(fname, res);
+  }
+}
+
 void
 CLogFmtDB::GetFormat (uint8 oid, uint8 gid, uint16 fid, uint16 lid, string &res) const
 {
-  map<uint64, string>::const_iterator it = fmts.find(MAKE_FMTS_KEY(oid, gid, fid, lid));
+  const logfmt_prog_t *prog = GetFormatProg(oid, gid, fid, lid);
 
-  if (it != fmts.end()) {
-    res = it->second;
+  if (prog) {
+    res = logfmt_get_format(prog);
   }
   else {
     res.clear();
   }
 }
 
+const logfmt_prog_t *
+CLogFmtDB::GetFormatProg (uint8 oid, uint8 gid, uint16 fid, uint16 lid) const
+{
+  map<uint64, logfmt_prog_t *>::const_iterator it = fmts.find(MAKE_FMTS_KEY(oid, gid, fid, lid));
+
+  if (it != fmts.end()) {
+    return it->second;
+  }
+
+  for (size_t i = 0; i < bins.size(); i++) {
+    const logfmt_prog_t *prog = scdbin_get_prog(&bins[i], oid, gid, fid, lid);
+    if (prog) {
+      return prog;
+    }
+  }
+
+  return NULL;
+}
+
+CLogFmtCache::CLogFmtCache (const CLogFmtDB &fmt_db)
+  : m_fmt_db(fmt_db)
+{
+  for (size_t i = 0; i < FMT_CACHE_SIZE; i++) {
+    m_cache[i].key  = FMTS_KEY_INVALID;
+    m_cache[i].prog = NULL;
+  }
+}
+
+const logfmt_prog_t *
+CLogFmtCache::GetFormatProg (uint8 oid, uint8 gid, uint16 fid, uint16 lid)
+{
+  uint64           key = MAKE_FMTS_KEY(oid, gid, fid, lid);
+  fmt_cache_entry &ent = m_cache[(lid ^ (fid << 4) ^ (gid << 6) ^ (oid << 3)) % FMT_CACHE_SIZE];
+
+  if (ent.key != key) {
+    ent.key  = key;
+    ent.prog = m_fmt_db.GetFormatProg(oid, gid, fid, lid);
+  }
+
+  return ent.prog;
+}
+
 void
 CLogFmtDB::GetOrgName (uint8 oid, string &res) const
 {
@@ -142,10 +275,18 @@ CLogFmtDB::GetOrgName (uint8 oid, string &res) const
 
   if (it != orgs.end()) {
     res = it->second;
+    return;
   }
-  else {
-    res.clear();
+
+  for (size_t i = 0; i < bins.size(); i++) {
+    const char *name = scdbin_get_org_name(&bins[i], oid);
+    if (name) {
+      res = name;
+      return;
+    }
   }
+
+  res.clear();
 }
 
 void
@@ -155,8 +296,16 @@ CLogFmtDB::GetGrpName (uint8 oid, uint8 gid, string &res) const
 
   if (it != grps.end()) {
     res = it->second;
+    return;
   }
-  else {
-    res.clear();
+
+  for (size_t i = 0; i < bins.size(); i++) {
+    const char *name = scdbin_get_grp_name(&bins[i], oid, gid);
+    if (name) {
+      res = name;
+      return;
+    }
   }
+
+  res.clear();
 }
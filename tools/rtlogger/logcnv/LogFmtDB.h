@@ -16,10 +16,13 @@
 
 #include <map>
 #include <string>
+#include <vector>
 
 using namespace std;
 
 #include "aux_utils.h"
+#include "logfmt.h"
+#include "scdbin.h"
 
 class CLogFmtDB
 {
@@ -50,22 +53,78 @@ class CLogFmtDB
         (int) oid << ":" << (int) gid << ":" << (int) fid << ":" << (int) lid << ":'" << str << "'";
        m_str = ss.str();
     }
+    bad_scd_file(const string &fname, uint8 oid, uint8 gid, uint16 fid, uint16 lid) {
+      ostringstream ss;
+      ss << fname << ": format IDs out of range: " <<
+        (int) oid << ":" << (int) gid << ":" << (int) fid << ":" << (int) lid;
+       m_str = ss.str();
+    }
+    bad_scd_file(const string &fname, uint8 oid, uint8 gid, uint16 fid, uint16 lid,
+                 const string &str) {
+      ostringstream ss;
+      ss << fname << ": bad escape sequence in format: " <<
+        (int) oid << ":" << (int) gid << ":" << (int) fid << ":" << (int) lid << ":'" << str << "'";
+       m_str = ss.str();
+    }
+    bad_scd_file(const string &fname, int err) {
+      ostringstream ss;
+      ss << fname << ": " << scdbin_get_error_text(err);
+       m_str = ss.str();
+    }
   };
 public:
-  CLogFmtDB() { }
-  virtual ~CLogFmtDB() { }
-  void         Reset(void) {
-    fmts.clear();
+  CLogFmtDB() {;}
+  virtual ~CLogFmtDB() {
+    Reset();
   }
+  void         Reset(void);
+  /* Either a text or a compiled (binary) string-file */
   void Read(string &fname);
+  /* Compiles the string-files read so far into a binary one */
+  void Write(const string &fname) const;
   void GetFormat(uint8 oid, uint8 gid, uint16 fid, uint16 lid, string &res) const;
+  const logfmt_prog_t *GetFormatProg(uint8 oid, uint8 gid, uint16 fid, uint16 lid) const;
   void GetOrgName(uint8 oid, string &res) const;
   void GetGrpName(uint8 oid, uint8 gid, string &res) const;
 
 protected:
   map<uint8, string>  orgs;
   map<uint16, string> grps;
-  map<uint64, string> fmts;
+  /* Format strings are compiled once when read */
+  map<uint64, logfmt_prog_t *> fmts;
+  /* Compiled string-files, mapped as they are */
+  vector<scdbin_t> bins;
+
+private:
+  /* Owns the compiled formats */
+  CLogFmtDB(const CLogFmtDB &);
+  CLogFmtDB &operator= (const CLogFmtDB &);
+};
+
+/* Direct-mapped cache of format lookups: events of a log mostly come
+ * from a small working set of formats. The DB itself is only read, so
+ * each converting thread can have its own cache over a shared DB, which
+ * must not be changed while the cache is in use.
+ */
+class CLogFmtCache
+{
+public:
+  CLogFmtCache(const CLogFmtDB &fmt_db);
+
+  const CLogFmtDB &GetDB(void) const {
+    return m_fmt_db;
+  }
+  const logfmt_prog_t *GetFormatProg(uint8 oid, uint8 gid, uint16 fid, uint16 lid);
+
+protected:
+  enum { FMT_CACHE_SIZE = 1024 };
+  struct fmt_cache_entry {
+    uint64               key;
+    const logfmt_prog_t *prog;
+  };
+
+  const CLogFmtDB &m_fmt_db;
+  fmt_cache_entry  m_cache[FMT_CACHE_SIZE];
 };
 
 #endif // __LOGFMTDB_H__
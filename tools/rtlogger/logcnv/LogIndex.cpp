@@ -0,0 +1,290 @@
+/******************************************************************************
+
+         Copyright (c) 2020, MaxLinear, Inc.
+         Copyright 2016 - 2020 Intel Corporation
+         Copyright 2015 - 2016 Lantiq Beteiligungs-GmbH & Co. KG
+         Copyright 2009 - 2014 Lantiq Deutschland GmbH
+         Copyright 2007 - 2008 Infineon Technologies AG
+
+  For licensing information, see the file 'LICENSE' in the root folder of
+  this software module.
+
+*******************************************************************************/
+
+#include "mtlkinc.h"
+#include "LogIndex.h"
+#include "logsrv_protocol.h"
+
+#include <fstream>
+#include <iostream>
+#include <cstdio>
+#include <sys/stat.h>
+
+#define LOG_INDEX_MAGIC      0x58434C4C /* "LLCX" */
+#define LOG_INDEX_VERSION    1
+#define LOG_INDEX_SUFFIX     ".lcx"
+#define CAPTURE_INDEX_SUFFIX ".idx"
+
+/* Span of the log described by an index entry */
+#define LOG_INDEX_SPAN_SIZE  (64 * 1024)
+
+CLogFilter::CLogFilter ()
+  : m_from(0),
+    m_to((uint32)-1),
+    m_oid_set(false),
+    m_gid_set(false)
+{
+  memset(m_oid_map, 0xFF, sizeof(m_oid_map));
+  memset(m_gid_map, 0xFF, sizeof(m_gid_map));
+}
+
+void
+CLogFilter::AddOID (uint8 oid)
+{
+  MTLK_ASSERT(oid < MAX_OID);
+
+  if (!m_oid_set) {
+    memset(m_oid_map, 0, sizeof(m_oid_map));
+    m_oid_set = true;
+  }
+  SetBit(m_oid_map, oid);
+}
+
+void
+CLogFilter::AddGID (uint8 gid)
+{
+  MTLK_ASSERT(gid < MAX_GID);
+
+  if (!m_gid_set) {
+    memset(m_gid_map, 0, sizeof(m_gid_map));
+    m_gid_set = true;
+  }
+  SetBit(m_gid_map, gid);
+}
+
+bool
+CLogFilter::IsSet (void) const
+{
+  return m_from != 0 || m_to != (uint32)-1 || m_oid_set || m_gid_set;
+}
+
+bool
+CLogFilter::MatchAny (uint32 min_ts, uint32 max_ts,
+                      const uint32 *oid_map, const uint32 *gid_map) const
+{
+  bool oid_match = false;
+  bool gid_match = false;
+
+  if (max_ts < m_from || min_ts > m_to) {
+    return false;
+  }
+
+  for (size_t i = 0; i < ARRAY_SIZE(m_oid_map) && !oid_match; i++) {
+    oid_match = (oid_map[i] & m_oid_map[i]) != 0;
+  }
+  for (size_t i = 0; i < ARRAY_SIZE(m_gid_map) && !gid_match; i++) {
+    gid_match = (gid_map[i] & m_gid_map[i]) != 0;
+  }
+
+  return oid_match && gid_match;
+}
+
+string
+CLogIndex::GetFileName (const string &log_fname)
+{
+  return log_fname + LOG_INDEX_SUFFIX;
+}
+
+void
+CLogIndex::Open (const CLogReader &in)
+{
+  string      fname = GetFileName(in.GetFileName());
+  struct stat st;
+  hdr_t       hdr;
+
+  MTLK_ASSERT(in.IsMapped() && in.IsFile());
+
+  if (LoadCapture(in.GetFileName() + CAPTURE_INDEX_SUFFIX, in)) {
+    return;
+  }
+
+  if (stat(in.GetFileName().c_str(), &st) != 0) {
+    throw exc_index("Can't get input file status", in.GetFileName());
+  }
+
+  memset(&hdr, 0, sizeof(hdr));
+  hdr.magic     = LOG_INDEX_MAGIC;
+  hdr.version   = LOG_INDEX_VERSION;
+  hdr.log_size  = (uint64)st.st_size;
+  hdr.log_mtime = (int64)st.st_mtime;
+
+  if (Load(fname, hdr)) {
+    return;
+  }
+
+  Build(in);
+  hdr.nof_spans = m_spans.size();
+  Save(fname, hdr);
+}
+
+bool
+CLogIndex::Load (const string &fname, const hdr_t &expected)
+{
+  ifstream f(fname.c_str(), ios::in | ios::binary);
+  hdr_t    hdr;
+
+  if (!f.read((char *)&hdr, sizeof(hdr)) ||
+      hdr.magic != expected.magic || hdr.version != expected.version ||
+      hdr.log_size != expected.log_size || hdr.log_mtime != expected.log_mtime ||
+      hdr.nof_spans > hdr.log_size) {
+    return false;
+  }
+
+  m_spans.resize((size_t)hdr.nof_spans);
+  if (!m_spans.empty() &&
+      !f.read((char *)&m_spans[0], m_spans.size() * sizeof(span_t))) {
+    m_spans.clear();
+    return false;
+  }
+
+  return true;
+}
+
+/* The index of a capture segment describes its blocks in the decoded
+ * stream, which is what the reader provides */
+bool
+CLogIndex::LoadCapture (const string &fname, const CLogReader &in)
+{
+  ifstream f(fname.c_str(), ios::in | ios::binary);
+  uint64   next = in.GetOffset();
+  uint64   end  = in.GetOffset() + in.Size();
+  span_t   span;
+  struct logsrv_capture_idx_hdr   hdr;
+  struct logsrv_capture_idx_entry entry;
+
+  if (!f.read((char *)&hdr, sizeof(hdr)) ||
+      ntohl(hdr.magic) != LOGSRV_CAPTURE_IDX_MAGIC ||
+      ntohs(hdr.version) != LOGSRV_CAPTURE_IDX_VERSION) {
+    return false;
+  }
+
+  m_spans.clear();
+  memset(&span, 0xFF, sizeof(span));
+
+  /* The blocks follow each other from the first event on */
+  while (f.read((char *)&entry, sizeof(entry))) {
+    span.offset = ntohl(entry.raw_offset);
+    span.size   = ntohl(entry.raw_size);
+    span.min_ts = ntohl(entry.min_ts);
+    span.max_ts = ntohl(entry.max_ts);
+    if (span.offset != next || span.size > end - next) {
+      m_spans.clear();
+      return false;
+    }
+    m_spans.push_back(span);
+    next += span.size;
+  }
+
+  /* Events written after the index was copied are always converted */
+  if (next < end) {
+    span.offset = next;
+    span.size   = end - next;
+    span.min_ts = 0;
+    span.max_ts = (uint32)-1;
+    m_spans.push_back(span);
+  }
+
+  return true;
+}
+
+void
+CLogIndex::Build (const CLogReader &in)
+{
+  const char *data = in.Data();
+  size_t      size = in.Size();
+  size_t      off  = 0;
+  CLogEvt     evt;
+  span_t      span;
+
+  m_spans.clear();
+
+  while (off < size) {
+    size_t need;
+    size_t len = 0;
+
+    memset(&span, 0, sizeof(span));
+    span.offset = in.GetOffset() + off;
+    span.min_ts = (uint32)-1;
+
+    try {
+      while (span.size < LOG_INDEX_SPAN_SIZE &&
+             (len = evt.Attach(data + off, size - off, need)) != 0) {
+        span.min_ts = MIN(span.min_ts, evt.GetTS());
+        span.max_ts = MAX(span.max_ts, evt.GetTS());
+        CLogFilter::SetBit(span.oid_map, evt.GetOID());
+        CLogFilter::SetBit(span.gid_map, evt.GetGID());
+        span.size += len;
+        off += len;
+      }
+    }
+    catch (const exception &) {
+      len = 0;
+    }
+
+    if (span.size) {
+      m_spans.push_back(span);
+    }
+    if (!len && off < size) {
+      /* A bad or truncated event: the rest is always converted, so it's
+       * reported the same way as without the index */
+      memset(&span, 0xFF, sizeof(span));
+      span.offset = in.GetOffset() + off;
+      span.size   = size - off;
+      span.min_ts = 0;
+      m_spans.push_back(span);
+      break;
+    }
+  }
+}
+
+void
+CLogIndex::Save (const string &fname, const hdr_t &hdr) const
+{
+  string   tmp_fname = fname + ".tmp";
+  ofstream f(tmp_fname.c_str(), ios::out | ios::binary | ios::trunc);
+
+  f.write((const char *)&hdr, sizeof(hdr));
+  if (!m_spans.empty()) {
+    f.write((const char *)&m_spans[0], m_spans.size() * sizeof(span_t));
+  }
+  f.close();
+
+  /* The index is an optimization only: the log is converted anyway */
+  if (!f || rename(tmp_fname.c_str(), fname.c_str()) != 0) {
+    remove(tmp_fname.c_str());
+    cerr << "Warning: can't write index file " << fname << endl;
+  }
+}
+
+void
+CLogIndex::Select (const CLogFilter &filter, vector<region_t> &regions) const
+{
+  regions.clear();
+
+  for (size_t i = 0; i < m_spans.size(); i++) {
+    const span_t &span = m_spans[i];
+
+    if (!filter.MatchAny(span.min_ts, span.max_ts, span.oid_map, span.gid_map)) {
+      continue;
+    }
+
+    /* Adjacent spans are converted at once */
+    if (!regions.empty() &&
+        regions.back().first + regions.back().second == span.offset) {
+      regions.back().second += span.size;
+    }
+    else {
+      regions.push_back(region_t(span.offset, span.size));
+    }
+  }
+}
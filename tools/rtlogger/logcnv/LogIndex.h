@@ -0,0 +1,132 @@
+/******************************************************************************
+
+         Copyright (c) 2020, MaxLinear, Inc.
+         Copyright 2016 - 2020 Intel Corporation
+         Copyright 2015 - 2016 Lantiq Beteiligungs-GmbH & Co. KG
+         Copyright 2009 - 2014 Lantiq Deutschland GmbH
+         Copyright 2007 - 2008 Infineon Technologies AG
+
+  For licensing information, see the file 'LICENSE' in the root folder of
+  this software module.
+
+*******************************************************************************/
+
+#ifndef __LOGINDEX_H__
+#define __LOGINDEX_H__
+
+#include <string>
+#include <vector>
+#include <utility>
+
+using namespace std;
+
+#include "logdefs.h"
+#include "aux_utils.h"
+#include "LogEvt.h"
+#include "LogReader.h"
+
+/* Events to be converted */
+class CLogFilter
+{
+public:
+  CLogFilter();
+
+  void SetFrom(uint32 ts) {
+    m_from = ts;
+  }
+  void SetTo(uint32 ts) {
+    m_to = ts;
+  }
+  void AddOID(uint8 oid);
+  void AddGID(uint8 gid);
+  /* Not every event is converted */
+  bool IsSet(void) const;
+
+  bool Match(const CLogEvt &evt) const {
+    return evt.GetTS() >= m_from && evt.GetTS() <= m_to &&
+           TestBit(m_oid_map, evt.GetOID()) && TestBit(m_gid_map, evt.GetGID());
+  }
+  /* May any event with these attributes match */
+  bool MatchAny(uint32 min_ts, uint32 max_ts,
+                const uint32 *oid_map, const uint32 *gid_map) const;
+
+  static bool TestBit(const uint32 *map, uint32 n) {
+    return (map[n / 32] >> (n % 32)) & 1;
+  }
+  static void SetBit(uint32 *map, uint32 n) {
+    map[n / 32] |= 1U << (n % 32);
+  }
+
+protected:
+  uint32 m_from;
+  uint32 m_to;
+  bool   m_oid_set;
+  bool   m_gid_set;
+  uint32 m_oid_map[MAX_OID / 32];
+  uint32 m_gid_map[MAX_GID / 32];
+};
+
+/* Index sidecar of a log file: the timestamp range and the OIDs/GIDs of
+ * the events in every span of about LOG_INDEX_SPAN_SIZE bytes, so only
+ * the spans that may contain the requested events are converted.
+ * The index is built by a scan of the event headers the first time it's
+ * needed and kept next to the log as <log>.lcx. It is rebuilt whenever
+ * the log size or modification time change.
+ * The <segment>.idx index written by logserver along with a capture
+ * segment is used instead if there is one: its spans are the capture
+ * blocks, selected by their timestamps only.
+ */
+class CLogIndex
+{
+  class exc_index : public exc_basic
+  {
+  public:
+    exc_index (const string &what, const string &fname) {
+      ostringstream ss;
+      ss << what << ": " << fname;
+      m_str = ss.str();
+    }
+  };
+
+public:
+  /* File offset and size */
+  typedef pair<uint64, uint64> region_t;
+
+  CLogIndex() {;}
+
+  /* Loads the index of the log open by reader, builds and saves it if
+   * missing or stale. The reader must be at the first event. */
+  void Open(const CLogReader &in);
+  /* Regions of the log that may contain the events matching filter */
+  void Select(const CLogFilter &filter, vector<region_t> &regions) const;
+
+  static string GetFileName(const string &log_fname);
+
+protected:
+#pragma pack(push,1)
+  struct span_t {
+    uint64 offset;
+    uint64 size;
+    uint32 min_ts;
+    uint32 max_ts;
+    uint32 oid_map[MAX_OID / 32];
+    uint32 gid_map[MAX_GID / 32];
+  };
+  struct hdr_t {
+    uint32 magic;
+    uint32 version;
+    uint64 log_size;
+    int64  log_mtime;
+    uint64 nof_spans;
+  };
+#pragma pack(pop)
+
+  bool Load(const string &fname, const hdr_t &expected);
+  bool LoadCapture(const string &fname, const CLogReader &in);
+  void Build(const CLogReader &in);
+  void Save(const string &fname, const hdr_t &hdr) const;
+
+  vector<span_t> m_spans;
+};
+
+#endif // __LOGINDEX_H__
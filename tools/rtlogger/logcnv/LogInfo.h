@@ -15,7 +15,6 @@
 #define __LOG_INFO_H__
 
 #include <string>
-#include <istream>
 #include <sstream>
 #include <iomanip>
 
@@ -28,8 +27,6 @@ using namespace std;
 
 class CLogInfo
 {
-  friend istream &operator>> (istream &is, CLogInfo &info);
-
   class exc_bad_info_magic : public exc_basic
   {
   public:
@@ -67,19 +64,9 @@ public:
   ~CLogInfo() 
   { }
 
-protected:
-  void Read (istream &in_s) {
-    try {
-      in_s.read((char *)&m_info, sizeof(m_info));
-    }
-    catch (const ios_base::failure &/*ex*/) {
-      if (in_s.eof()) {
-        /* EOF is not an error in our case */
-        return;
-      }
-      /* Other stream error */
-      throw; /* throw this exception up */
-    }
+  /* Parses the log info header that starts the log */
+  void Parse (const char *p) {
+    memcpy(&m_info, p, sizeof(m_info));
 
     m_info.magic = ntohl(m_info.magic);
     if (m_info.magic != LOGSRV_INFO_MAGIC) {
@@ -99,13 +86,12 @@ protected:
     m_info.log_ver_minor = ntohs(m_info.log_ver_minor);
   }
 
+  static size_t GetSize (void) {
+    return sizeof(struct logsrv_info);
+  }
+
+protected:
   struct logsrv_info m_info;
 };
 
-istream &operator>> (istream &is, CLogInfo &info)
-{
-  info.Read(is);
-  return is;
-}
-
 #endif /* __LOG_INFO_H__ */
@@ -0,0 +1,354 @@
+/******************************************************************************
+
+         Copyright (c) 2020, MaxLinear, Inc.
+         Copyright 2016 - 2020 Intel Corporation
+         Copyright 2015 - 2016 Lantiq Beteiligungs-GmbH & Co. KG
+         Copyright 2009 - 2014 Lantiq Deutschland GmbH
+         Copyright 2007 - 2008 Infineon Technologies AG
+
+  For licensing information, see the file 'LICENSE' in the root folder of
+  this software module.
+
+*******************************************************************************/
+
+#include "mtlkinc.h"
+#include "LogReader.h"
+#include "logsrv_protocol.h"
+
+#include <iostream>
+
+#ifndef WIN32
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <errno.h>
+#endif
+#ifdef HAVE_LZ4
+#include <lz4.h>
+#endif
+#ifdef HAVE_ZSTD
+#include <zstd.h>
+#endif
+
+/* Chunk read at once from non-mappable inputs */
+#define LOG_READ_CHUNK_SIZE  (1024 * 1024)
+
+/* Sanity limit of the capture segment blocks */
+#define LOG_CAPTURE_MAX_BLOCK_SIZE  (64 * 1024 * 1024)
+
+/* Indexed by LOGSRV_CAPTURE_CODEC_... */
+static const char *capture_codec_names[] = {
+  "none",
+  "lz4",
+  "zstd"
+};
+
+CLogReader::CLogReader ()
+  : m_file(NULL),
+    m_eof(false),
+    m_data(NULL),
+    m_size(0),
+    m_pos(0),
+    m_mapped(NULL),
+    m_mapped_size(0),
+    m_decoded(false)
+{
+
+}
+
+CLogReader::~CLogReader ()
+{
+  Close();
+}
+
+void
+CLogReader::Close (void)
+{
+#ifndef WIN32
+  if (m_mapped) {
+    munmap(m_mapped, m_mapped_size);
+    m_mapped = NULL;
+  }
+#endif
+  if (m_file && m_file != stdin) {
+    fclose(m_file);
+  }
+  m_file = NULL;
+  m_data = NULL;
+  m_size = 0;
+  m_pos  = 0;
+  m_eof  = false;
+  m_decoded = false;
+  m_buf.clear();
+}
+
+bool
+CLogReader::Map (void)
+{
+#ifndef WIN32
+  struct stat st;
+  void       *p;
+  int         fd = fileno(m_file);
+
+  if (fstat(fd, &st) != 0 || !S_ISREG(st.st_mode) ||
+      st.st_size == 0 || (uint64)st.st_size != (size_t)st.st_size) {
+    return false;
+  }
+
+  p = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  if (p == MAP_FAILED) {
+    /* E.g. no address space for a huge file on a 32-bit host */
+    return false;
+  }
+  madvise(p, (size_t)st.st_size, MADV_SEQUENTIAL);
+
+  m_mapped      = p;
+  m_mapped_size = (size_t)st.st_size;
+  m_data        = (const char *)p;
+  m_size        = m_mapped_size;
+  m_eof         = true;
+  return true;
+#else
+  return false;
+#endif
+}
+
+void
+CLogReader::Open (const string &fname, bool map)
+{
+  Close();
+
+  m_fname = fname;
+  m_file  = fopen(fname.c_str(), "rb");
+  if (!m_file) {
+    throw exc_io("Can't open input file", fname);
+  }
+
+  /* Fall back to reading through a buffer if the file can't be mapped */
+  if (map) {
+    Map();
+  }
+  CheckCapture();
+}
+
+void
+CLogReader::OpenStdin (void)
+{
+  Close();
+
+  m_fname = "<stdin>";
+  m_file  = stdin;
+  CheckCapture();
+}
+
+void
+CLogReader::SetWindow (size_t offset, size_t len)
+{
+  MTLK_ASSERT(IsMapped());
+  MTLK_ASSERT(m_decoded ? (offset <= m_buf.size() && len <= m_buf.size() - offset) :
+                          (offset <= m_mapped_size && len <= m_mapped_size - offset));
+
+  m_pos  = offset;
+  m_size = offset + len;
+}
+
+size_t
+CLogReader::ReadSome (char *buf, size_t len)
+{
+#ifndef WIN32
+  /* Unlike fread(), returns what a pipe has got so far instead of
+   * waiting for the whole buffer to fill up */
+  ssize_t n;
+
+  do {
+    n = read(fileno(m_file), buf, len);
+  } while (n < 0 && errno == EINTR);
+
+  if (n < 0) {
+    throw exc_io("Can't read input file", m_fname);
+  }
+  return (size_t)n;
+#else
+  size_t n = fread(buf, 1, len, m_file);
+
+  if (n == 0 && ferror(m_file)) {
+    throw exc_io("Can't read input file", m_fname);
+  }
+  return n;
+#endif
+}
+
+bool
+CLogReader::Require (size_t len)
+{
+  while (Size() < len) {
+    size_t avail = Size();
+    size_t n;
+
+    if (m_eof) {
+      return false;
+    }
+
+    /* Move the unconsumed tail to the beginning of the buffer */
+    if (m_buf.size() < len + LOG_READ_CHUNK_SIZE) {
+      vector<char> buf(len + LOG_READ_CHUNK_SIZE);
+      if (avail) {
+        memcpy(&buf[0], Data(), avail);
+      }
+      m_buf.swap(buf);
+    }
+    else if (avail && m_pos) {
+      memmove(&m_buf[0], Data(), avail);
+    }
+    m_data = &m_buf[0];
+    m_size = avail;
+    m_pos  = 0;
+
+    n = ReadSome(&m_buf[m_size], m_buf.size() - m_size);
+    m_size += n;
+    if (n == 0) {
+      m_eof = true;
+    }
+  }
+
+  return true;
+}
+
+/* Reads the rest of the input into m_buf */
+void
+CLogReader::ReadAll (void)
+{
+  vector<char> buf(Data(), Data() + Size());
+  size_t       size = buf.size();
+  size_t       n;
+
+  do {
+    if (buf.size() - size < LOG_READ_CHUNK_SIZE) {
+      buf.resize(MAX(buf.size() * 2, size + LOG_READ_CHUNK_SIZE));
+    }
+    n = ReadSome(&buf[size], buf.size() - size);
+    size += n;
+  } while (n);
+
+  buf.resize(size);
+  m_buf.swap(buf);
+  m_data = &m_buf[0];
+  m_size = m_buf.size();
+  m_pos  = 0;
+  m_eof  = true;
+}
+
+/* Decodes a compressed capture segment, other inputs are left as is */
+void
+CLogReader::CheckCapture (void)
+{
+  uint32 magic;
+
+  if (!Require(sizeof(struct logsrv_capture_seg_hdr))) {
+    return;
+  }
+  memcpy(&magic, Data(), sizeof(magic));
+  if (ntohl(magic) != LOGSRV_CAPTURE_SEG_MAGIC) {
+    return;
+  }
+
+  if (!m_mapped) {
+    ReadAll();
+  }
+  DecodeCapture();
+}
+
+void
+CLogReader::DecodeCapture (void)
+{
+  const char   *p   = Data();
+  const char   *end = Data() + Size();
+  vector<char>  out;
+  uint32        block_size;
+  struct logsrv_capture_seg_hdr seg_hdr;
+  struct logsrv_capture_blk_hdr blk_hdr;
+
+  memcpy(&seg_hdr, p, sizeof(seg_hdr));
+  p += sizeof(seg_hdr);
+  block_size = ntohl(seg_hdr.block_size);
+  if (block_size > LOG_CAPTURE_MAX_BLOCK_SIZE) {
+    throw exc_io("Corrupted capture segment header", m_fname);
+  }
+
+  while ((size_t)(end - p) >= sizeof(blk_hdr)) {
+    size_t raw_size;
+    size_t stored_size;
+    size_t at = out.size();
+
+    memcpy(&blk_hdr, p, sizeof(blk_hdr));
+    raw_size    = ntohl(blk_hdr.raw_size);
+    stored_size = ntohl(blk_hdr.stored_size);
+    if (raw_size > block_size) {
+      throw exc_io("Corrupted capture block", m_fname);
+    }
+    /* The block being written when the segment was copied */
+    if (stored_size > (size_t)(end - p) - sizeof(blk_hdr)) {
+      break;
+    }
+    p += sizeof(blk_hdr);
+
+    out.resize(at + raw_size);
+    DecodeBlock(blk_hdr.codec, p, stored_size, &out[at], raw_size);
+    p += stored_size;
+  }
+
+  if (p != end) {
+    cerr << "Warning: truncated block at the end of the capture segment, "
+         << (end - p) << " byte(s) ignored" << endl;
+  }
+
+#ifndef WIN32
+  if (m_mapped) {
+    munmap(m_mapped, m_mapped_size);
+    m_mapped = NULL;
+  }
+#endif
+  m_buf.swap(out);
+  m_data    = m_buf.empty() ? NULL : &m_buf[0];
+  m_size    = m_buf.size();
+  m_pos     = 0;
+  m_eof     = true;
+  m_decoded = true;
+}
+
+void
+CLogReader::DecodeBlock (uint8 codec, const char *src, size_t src_size,
+                         char *dst, size_t dst_size)
+{
+  switch (codec) {
+  case LOGSRV_CAPTURE_CODEC_NONE:
+    if (src_size == dst_size) {
+      memcpy(dst, src, src_size);
+      return;
+    }
+    break;
+#ifdef HAVE_LZ4
+  case LOGSRV_CAPTURE_CODEC_LZ4:
+    if (LZ4_decompress_safe(src, dst, (int)src_size, (int)dst_size) == (int)dst_size) {
+      return;
+    }
+    break;
+#endif
+#ifdef HAVE_ZSTD
+  case LOGSRV_CAPTURE_CODEC_ZSTD:
+    if (ZSTD_decompress(dst, dst_size, src, src_size) == dst_size) {
+      return;
+    }
+    break;
+#endif
+  default:
+    if (codec < ARRAY_SIZE(capture_codec_names)) {
+      throw exc_io(string("Capture segment compressed with ") +
+                   capture_codec_names[codec] + ", not supported by this build",
+                   m_fname);
+    }
+    break;
+  }
+
+  throw exc_io("Corrupted capture block", m_fname);
+}
@@ -0,0 +1,111 @@
+/******************************************************************************
+
+         Copyright (c) 2020, MaxLinear, Inc.
+         Copyright 2016 - 2020 Intel Corporation
+         Copyright 2015 - 2016 Lantiq Beteiligungs-GmbH & Co. KG
+         Copyright 2009 - 2014 Lantiq Deutschland GmbH
+         Copyright 2007 - 2008 Infineon Technologies AG
+
+  For licensing information, see the file 'LICENSE' in the root folder of
+  this software module.
+
+*******************************************************************************/
+
+#ifndef __LOGREADER_H__
+#define __LOGREADER_H__
+
+#include <string>
+#include <vector>
+#include <cstdio>
+#include <sstream>
+
+using namespace std;
+
+#include "aux_utils.h"
+
+/* Log input. Regular files are memory mapped and walked in place, other
+ * inputs (stdin, pipes) are read through a buffer. Either way the caller
+ * gets contiguous bytes that stay valid until the next Consume()/Require().
+ * Compressed logserver capture segments are decoded whole on open, the
+ * caller gets the stream they were compressed from.
+ */
+class CLogReader
+{
+  class exc_io : public exc_basic
+  {
+  public:
+    exc_io (const string &what, const string &fname) {
+      ostringstream ss;
+      ss << what << ": " << fname;
+      m_str = ss.str();
+    }
+  };
+
+public:
+  CLogReader();
+  ~CLogReader();
+
+  /* map = false reads the file through the buffer, as a pipe is */
+  void Open(const string &fname, bool map = true);
+  void OpenStdin(void);
+
+  /* Makes at least len bytes available at Data(), false if the input
+   * ends before */
+  bool Require(size_t len);
+  const char *Data(void) const {
+    return m_data + m_pos;
+  }
+  size_t Size(void) const {
+    return m_size - m_pos;
+  }
+  void Consume(size_t len) {
+    m_pos += len;
+  }
+  /* The whole input is available at Data() */
+  bool IsMapped(void) const {
+    return m_mapped != NULL || m_decoded;
+  }
+  /* Read from a named file rather than stdin */
+  bool IsFile(void) const {
+    return m_file != NULL && m_file != stdin;
+  }
+  const string &GetFileName(void) const {
+    return m_fname;
+  }
+  /* Mapped input only: the offset of Data() in the file, or in the
+   * decoded stream of a compressed capture segment */
+  size_t GetOffset(void) const {
+    return m_pos;
+  }
+  /* Mapped input only: restricts the input to len bytes at offset */
+  void SetWindow(size_t offset, size_t len);
+
+protected:
+  void Close(void);
+  bool Map(void);
+  size_t ReadSome(char *buf, size_t len);
+  void ReadAll(void);
+  void CheckCapture(void);
+  void DecodeCapture(void);
+  void DecodeBlock(uint8 codec, const char *src, size_t src_size,
+                   char *dst, size_t dst_size);
+
+  string       m_fname;
+  FILE        *m_file;
+  bool         m_eof;
+  /* Mapped file or m_buf contents */
+  const char  *m_data;
+  size_t       m_size;
+  size_t       m_pos;
+  void        *m_mapped;
+  size_t       m_mapped_size;
+  /* m_buf holds the whole decoded input */
+  bool         m_decoded;
+  vector<char> m_buf;
+
+private:
+  CLogReader(const CLogReader &);
+  CLogReader &operator= (const CLogReader &);
+};
+
+#endif // __LOGREADER_H__
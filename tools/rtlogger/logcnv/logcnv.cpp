@@ -28,10 +28,14 @@
 #include "LogInfo.h"
 #include "LogEvt.h"
 #include "LogFmtDB.h"
+#include "LogReader.h"
+#include "LogIndex.h"
 
 #include "pcapdefs.h"
 #include <stdexcept>
 #include <fstream>
+#include <cerrno>
+#include <cstdlib>
 
 using namespace std;
 
@@ -39,6 +43,7 @@ using namespace std;
 #define MTLK_LOGGER_SNAPLEN  65535
 
 #define SCD_FILES_DELIM      ","
+#define FILTER_LIST_DELIM    ","
 
 static const pcap_hdr_t log_pcap_hdr = 
 {
@@ -91,6 +96,29 @@ static const ParamInfo paramInFile(CCmdLine::ParamName("i", "input"),
 static const ParamInfo paramOutFile(CCmdLine::ParamName("o", "output"),
                                     "Output file (default: stdout)",
                                     "file");
+static const ParamInfo paramThreads(CCmdLine::ParamName("t", "threads"),
+                                    "Number of conversion threads (default: 1)",
+                                    "N");
+static const ParamInfo paramFrom(CCmdLine::ParamName("b", "from"),
+                                 "Convert events with timestamps starting from",
+                                 "ts");
+static const ParamInfo paramTo(CCmdLine::ParamName("e", "to"),
+                               "Convert events with timestamps up to (inclusive)",
+                               "ts");
+static const ParamInfo paramOIDs(CCmdLine::ParamName("r", "oid"),
+                                 "Convert events of these originators only",
+                                 "oid1[,oid2[,...]]");
+static const ParamInfo paramGIDs(CCmdLine::ParamName("g", "gid"),
+                                 "Convert events of these groups only",
+                                 "gid1[,gid2[,...]]");
+static const ParamInfo paramCompile(CCmdLine::ParamName("c", "compile"),
+                                    "Compile the string-files into a binary one "
+                                    "(used as the -s one, it's loaded much faster) and exit",
+                                    "file");
+static const ParamInfo paramBench(CCmdLine::ParamName("m", "bench-input"),
+                                  "Convert the input file memory mapped, then read through "
+                                  "a buffer, check both give the same output, print the times "
+                                  "and exit (the output is discarded)");
 
 #define stream_enable_exceptions(s) (s).exceptions(ios::badbit | ios::failbit)
 
@@ -102,7 +130,14 @@ ShowUsage (void)
                                          &paramStringFiles,
                                          &paramPCapOut,
                                          &paramInFile,
-                                         &paramOutFile};
+                                         &paramOutFile,
+                                         &paramThreads,
+                                         &paramFrom,
+                                         &paramTo,
+                                         &paramOIDs,
+                                         &paramGIDs,
+                                         &paramCompile,
+                                         &paramBench};
 
   CHelpScreen HelpScreen;
 
@@ -117,24 +152,274 @@ ShowUsage (void)
   cerr << HelpScreen.GetHelp();
 }
 
+/* Input converted by a single thread at once */
+#define LOG_CHUNK_SIZE       (4 * 1024 * 1024)
+
 static void
-WriteString (string& str, ostream &out_s)
+PutString (string &out, const char *str, size_t len)
 {
-  uint16 size = str.length() + 1;
+  uint16 size = len + 1;
   uint16 sz_h = HOST_TO_NET16(size);
-  out_s.write((const char *)&sz_h, sizeof(sz_h));
-  out_s.write(str.c_str(), size);
+  out.append((const char *)&sz_h, sizeof(sz_h));
+  out.append(str, len);
+  out.push_back('\0');
+}
+
+/* Converts a run of whole events to text or PCAP records. Every converting
+ * thread has a chunk of its own, while the format DB is shared.
+ */
+class CLogChunk
+{
+public:
+  CLogChunk(const CLogFmtDB &fmt_db, const CLogFilter &filter, bool pcap_out)
+    : m_fmt_cache(fmt_db),
+      m_filter(filter),
+      m_pcap_out(pcap_out),
+      m_data(NULL),
+      m_size(0)
+  {
+
+  }
+
+  void Set(const char *data, size_t size) {
+    m_data = data;
+    m_size = size;
+    m_out.clear();
+    m_error.clear();
+  }
+  /* Never throws, conversion errors are kept for the output stage */
+  void Convert(void);
+  /* Writes the conversion result, throws the conversion error if any */
+  void Output(ostream &out_s);
+
+protected:
+  void ConvertEvt(void);
+
+  CLogFmtCache      m_fmt_cache;
+  const CLogFilter &m_filter;
+  bool              m_pcap_out;
+  CLogEvt      m_evt;
+  vector<char> m_msg_buf;
+  const char  *m_data;
+  size_t       m_size;
+  string       m_out;
+  string       m_error;
+
+private:
+  CLogChunk(const CLogChunk &);
+  CLogChunk &operator= (const CLogChunk &);
+};
+
+void
+CLogChunk::ConvertEvt (void)
+{
+  size_t msg_len = m_evt.FormatMsg(m_fmt_cache, m_msg_buf);
+
+  if (!m_pcap_out) {
+    char ts_buf[16];
+    int  ts_len = snprintf(ts_buf, sizeof(ts_buf), "[%010u] ", m_evt.GetTS());
+
+    m_out.append(ts_buf, ts_len);
+    m_out.append(&m_msg_buf[0], msg_len);
+    m_out.append("'\n", 2);
+  }
+  else {
+    const CLogFmtDB &fmt_db = m_fmt_cache.GetDB();
+    string           src = m_evt.GetSrcString(fmt_db);
+    string           dst = m_evt.GetDstString(fmt_db);
+    pcaprec_hdr_t    pcaprec_hdr;
+    mtlklog_hdr_t    mtlklog_hdr;
+
+    pcaprec_hdr.ts_sec = m_evt.GetTS()/1000;
+    pcaprec_hdr.ts_usec = (m_evt.GetTS()%1000) * 1000;
+    pcaprec_hdr.incl_len = 
+      pcaprec_hdr.orig_len = sizeof(mtlklog_hdr_t) + 
+      sizeof(uint16) + src.length() + 1 + 
+      sizeof(uint16) + dst.length() + 1 + 
+      sizeof(uint16) + msg_len + 1;
+    m_out.append((const char *)&pcaprec_hdr, sizeof(pcaprec_hdr_t));
+    mtlklog_hdr.oid = m_evt.GetOID();
+    mtlklog_hdr.gid = m_evt.GetGID();
+    mtlklog_hdr.fid = HOST_TO_NET16(m_evt.GetFID());
+    mtlklog_hdr.lid = HOST_TO_NET16(m_evt.GetLID());
+    mtlklog_hdr.wlanif = m_evt.GetWLANIF();
+    m_out.append((const char *)&mtlklog_hdr, sizeof(mtlklog_hdr));
+    PutString(m_out, src.c_str(), src.length());
+    PutString(m_out, dst.c_str(), dst.length());
+    PutString(m_out, &m_msg_buf[0], msg_len);
+  }
+}
+
+void
+CLogChunk::Convert (void)
+{
+  size_t off = 0;
+
+  /* The events before a bad one are still output, like they are
+   * when converting sequentially */
+  try {
+    while (off < m_size) {
+      size_t need;
+      size_t len = m_evt.Attach(m_data + off, m_size - off, need);
+
+      MTLK_ASSERT(len != 0);
+      if (m_filter.Match(m_evt)) {
+        ConvertEvt();
+      }
+      off += len;
+    }
+  }
+  catch (const exception &ex) {
+    m_error = ex.what();
+  }
+}
+
+void
+CLogChunk::Output (ostream &out_s)
+{
+  out_s.write(m_out.data(), m_out.size());
+  if (!m_error.empty()) {
+    throw runtime_error(m_error);
+  }
+}
+
+static int32 __MTLK_IFUNC
+ConvertChunkThread (mtlk_handle_t context)
+{
+  HANDLE_T_PTR(CLogChunk, context)->Convert();
+  return MTLK_ERR_OK;
+}
+
+static void
+ConvertLog (CLogReader &in, ostream &out_s, vector<CLogChunk *> &chunks)
+{
+  vector<mtlk_osal_thread_t> threads(chunks.size());
+  vector<bool>               running(chunks.size());
+  CLogEvt                    log_evt;
+
+  for (;;) {
+    size_t n    = 0;
+    size_t off  = 0;
+    size_t need = 0;
+    bool   stop = false;
+
+    /* Each thread needs a full chunk to be worth running. A single thread
+     * takes whatever has been read so far, so live input keeps streaming. */
+    if (chunks.size() > 1) {
+      in.Require(chunks.size() * LOG_CHUNK_SIZE);
+    }
+
+    /* Split the available input into chunks on event boundaries */
+    while (n < chunks.size() && !stop) {
+      size_t start = off;
+
+      try {
+        while (off - start < LOG_CHUNK_SIZE) {
+          size_t len = log_evt.Attach(in.Data() + off, in.Size() - off, need);
+          if (!len) {
+            stop = true;
+            break;
+          }
+          off += len;
+        }
+      }
+      catch (const exception &) {
+        /* Convert what precedes the bad header first, the next round
+         * starts with it and reports it */
+        if (!off) {
+          throw;
+        }
+        stop = true;
+      }
+
+      if (off == start) {
+        break;
+      }
+      chunks[n++]->Set(in.Data() + start, off - start);
+    }
+
+    if (!n) {
+      if (in.Require(need)) {
+        continue;
+      }
+      if (in.Size()) {
+        cerr << "Warning: truncated event at the end of the log, "
+             << in.Size() << " byte(s) ignored" << endl;
+      }
+      break;
+    }
+
+    /* The first chunk is converted by this thread, the rest in parallel.
+     * A chunk whose thread can't be started is converted here as well. */
+    for (size_t i = 1; i < n; i++) {
+      running[i] = (mtlk_osal_thread_init(&threads[i]) == MTLK_ERR_OK &&
+                    mtlk_osal_thread_run(&threads[i], ConvertChunkThread,
+                                         HANDLE_T(chunks[i])) == MTLK_ERR_OK);
+    }
+    chunks[0]->Convert();
+    for (size_t i = 1; i < n; i++) {
+      if (running[i]) {
+        int32 res;
+        mtlk_osal_thread_wait(&threads[i], &res);
+        mtlk_osal_thread_cleanup(&threads[i]);
+      }
+      else {
+        chunks[i]->Convert();
+      }
+    }
+
+    /* Output in the original order */
+    for (size_t i = 0; i < n; i++) {
+      chunks[i]->Output(out_s);
+    }
+
+    /* The chunks refer to the reader's memory up to here */
+    in.Consume(off);
+  }
+}
+
+/* Converts only the parts of a log file that may contain the requested
+ * events, according to its index */
+static void
+ConvertLogIndexed (CLogReader &in, ostream &out_s, vector<CLogChunk *> &chunks,
+                   const CLogFilter &filter)
+{
+  CLogIndex                    index;
+  vector<CLogIndex::region_t>  regions;
+
+  index.Open(in);
+  index.Select(filter, regions);
+
+  for (size_t i = 0; i < regions.size(); i++) {
+    in.SetWindow((size_t)regions[i].first, (size_t)regions[i].second);
+    ConvertLog(in, out_s, chunks);
+  }
+}
+
+static void
+CompileStringFiles (vector<string> &scd_files, const string &fname)
+{
+  CLogFmtDB fmt_db;
+
+  for (vector<string>::iterator it = scd_files.begin(); it != scd_files.end(); ++it) {
+    fmt_db.Read(*it);
+  }
+
+  fmt_db.Write(fname);
 }
 
 static void
-ProcessLog (istream &in_s, ostream &out_s, vector<string> &scd_files, bool pcap_out)
+ProcessLog (CLogReader &in, ostream &out_s, vector<string> &scd_files, bool pcap_out,
+            size_t nof_threads, const CLogFilter &filter)
 {
   CLogInfo  log_info;
   CLogFmtDB fmt_db;
-  pcaprec_hdr_t pcaprec_hdr;
-  mtlklog_hdr_t mtlklog_hdr;
 
-  in_s >> log_info;
+  /* An empty log is not an error */
+  if (in.Require(CLogInfo::GetSize())) {
+    log_info.Parse(in.Data());
+    in.Consume(CLogInfo::GetSize());
+  }
 
   for (vector<string>::iterator it = scd_files.begin(); it != scd_files.end(); ++it) {
     fmt_db.Read(*it);
@@ -145,36 +430,223 @@ ProcessLog (istream &in_s, ostream &out_s, vector<string> &scd_files, bool pcap_
     out_s.write((const char *)&log_pcap_hdr, sizeof(log_pcap_hdr));
   }
 
-  while (!in_s.eof()) {
-    CLogEvt log_evt;
+  /* Reused for all the input to keep their buffers allocated */
+  vector<CLogChunk *> chunks;
+
+  try {
+    for (size_t i = 0; i < nof_threads; i++) {
+      chunks.push_back(new CLogChunk(fmt_db, filter, pcap_out));
+    }
+    /* Other inputs are filtered event by event */
+    if (filter.IsSet() && in.IsMapped() && in.IsFile()) {
+      ConvertLogIndexed(in, out_s, chunks, filter);
+    }
+    else {
+      ConvertLog(in, out_s, chunks);
+    }
+  }
+  catch (...) {
+    for (size_t i = 0; i < chunks.size(); i++) {
+      delete chunks[i];
+    }
+    throw;
+  }
+
+  for (size_t i = 0; i < chunks.size(); i++) {
+    delete chunks[i];
+  }
+}
+
+/* Output of the input benchmark: counts and hashes the data instead */
+class CHashBuf : public streambuf
+{
+public:
+  CHashBuf()
+    : m_size(0),
+      m_hash(2166136261U)
+  {
+
+  }
+
+  uint64 GetSize(void) const {
+    return m_size;
+  }
+  uint32 GetHash(void) const {
+    return m_hash;
+  }
+
+protected:
+  virtual int_type overflow(int_type c) {
+    if (!traits_type::eq_int_type(c, traits_type::eof())) {
+      char ch = traits_type::to_char_type(c);
+      Add(&ch, 1);
+    }
+    return traits_type::not_eof(c);
+  }
+  virtual streamsize xsputn(const char *s, streamsize n) {
+    Add(s, (size_t)n);
+    return n;
+  }
+
+  /* FNV-1a */
+  void Add(const char *s, size_t n) {
+    for (size_t i = 0; i < n; i++) {
+      m_hash = (m_hash ^ (uint8)s[i]) * 16777619U;
+    }
+    m_size += n;
+  }
+
+  uint64 m_size;
+  uint32 m_hash;
+};
+
+/* Best of a few rounds, the first one may read the file from the disk */
+#define BENCH_NOF_ROUNDS  3
+
+/* Walks the events of the input without converting them */
+static uint64
+WalkLog (CLogReader &in)
+{
+  CLogEvt log_evt;
+  uint64  nof_events = 0;
+
+  if (in.Require(CLogInfo::GetSize())) {
+    in.Consume(CLogInfo::GetSize());
+  }
+
+  for (;;) {
+    size_t need = 0;
+    size_t len  = log_evt.Attach(in.Data(), in.Size(), need);
 
-    in_s >> log_evt;
-    if (log_evt.HasData()) {
-      if (!pcap_out) {
-        out_s << "[" << setw(10) << setfill('0') << log_evt.GetTS() << setfill(' ') << setw(0) << "] " << log_evt.GetMsgString(fmt_db) << "'" << endl;
+    if (!len) {
+      if (!in.Require(need)) {
+        break;
       }
-      else {
-        string src = log_evt.GetSrcString(fmt_db);
-        string dst = log_evt.GetDstString(fmt_db);
-        string msg = log_evt.GetMsgString(fmt_db);
-
-        pcaprec_hdr.ts_sec = log_evt.GetTS()/1000;
-        pcaprec_hdr.ts_usec = (log_evt.GetTS()%1000) * 1000;
-        pcaprec_hdr.incl_len = 
-          pcaprec_hdr.orig_len = sizeof(mtlklog_hdr_t) + 
-          sizeof(uint16) + src.length() + 1 + 
-          sizeof(uint16) + dst.length() + 1 + 
-          sizeof(uint16) + msg.length() + 1;
-        out_s.write((const char *)&pcaprec_hdr, sizeof(pcaprec_hdr_t));
-        mtlklog_hdr.oid = log_evt.GetOID();
-        mtlklog_hdr.gid = log_evt.GetGID();
-        mtlklog_hdr.fid = HOST_TO_NET16(log_evt.GetFID());
-        mtlklog_hdr.lid = HOST_TO_NET16(log_evt.GetLID());
-        mtlklog_hdr.wlanif = log_evt.GetWLANIF();
-        out_s.write((const char *)&mtlklog_hdr, sizeof(mtlklog_hdr));
-        WriteString(src, out_s);
-        WriteString(dst, out_s);
-        WriteString(msg, out_s);
+      continue;
+    }
+    in.Consume(len);
+    nof_events++;
+  }
+
+  return nof_events;
+}
+
+static void
+BenchOpen (CLogReader &in, const string &fname, bool map)
+{
+  in.Open(fname, map);
+  if (map && !in.IsMapped()) {
+    throw logic_error("Can't memory map the input file: " + fname);
+  }
+}
+
+static string
+BenchRate (uint64 size, uint32 ms)
+{
+  ostringstream ss;
+
+  ss << ms << " ms, " << (size * 1000 / (ms ? ms : 1)) / (1024 * 1024) << " MB/s";
+  return ss.str();
+}
+
+/* Reads, then converts the input file memory mapped and buffered: the
+ * event count and the output must be the same */
+static bool
+BenchInput (const string &fname, vector<string> &scd_files, bool pcap_out,
+            size_t nof_threads, const CLogFilter &filter)
+{
+  static const char *mode_names[] = { "memory mapped", "buffered" };
+  uint64   nof_events[ARRAY_SIZE(mode_names)];
+  uint64   out_sizes[ARRAY_SIZE(mode_names)];
+  uint32   out_hashes[ARRAY_SIZE(mode_names)];
+  uint64   in_size = 0;
+  bool     pased = true;
+
+  for (size_t mode = 0; mode < ARRAY_SIZE(mode_names); mode++) {
+    uint32 read_ms = (uint32)-1;
+    uint32 cnv_ms  = (uint32)-1;
+
+    for (int round = 0; round < BENCH_NOF_ROUNDS; round++) {
+      CLogReader            in;
+      CHashBuf              buf;
+      ostream               out_s(&buf);
+      mtlk_osal_timestamp_t start = mtlk_osal_timestamp();
+      uint32                ms;
+
+      BenchOpen(in, fname, mode == 0);
+      nof_events[mode] = WalkLog(in);
+      ms = mtlk_osal_timestamp_to_ms(mtlk_osal_timestamp() - start);
+      read_ms = MIN(read_ms, ms);
+      if (mode == 0) {
+        in_size = in.GetOffset();
+      }
+
+      stream_enable_exceptions(out_s);
+      start = mtlk_osal_timestamp();
+      BenchOpen(in, fname, mode == 0);
+      ProcessLog(in, out_s, scd_files, pcap_out, nof_threads, filter);
+      ms = mtlk_osal_timestamp_to_ms(mtlk_osal_timestamp() - start);
+      cnv_ms = MIN(cnv_ms, ms);
+
+      out_sizes[mode]  = buf.GetSize();
+      out_hashes[mode] = buf.GetHash();
+    }
+
+    cout << mode_names[mode] << ": read " << BenchRate(in_size, read_ms)
+         << ", convert " << BenchRate(in_size, cnv_ms) << endl;
+  }
+
+  for (size_t mode = 1; mode < ARRAY_SIZE(mode_names); mode++) {
+    if (nof_events[mode] != nof_events[0] ||
+        out_sizes[mode] != out_sizes[0] || out_hashes[mode] != out_hashes[0]) {
+      pased = false;
+    }
+  }
+  cout << nof_events[0] << " events, " << out_sizes[0] << " bytes output, input benchmark "
+       << (pased ? "SUCCEED" : "FAILED") << endl;
+
+  return pased;
+}
+
+static uint32
+ParseUint (const string &str, uint32 max_val, const char *what)
+{
+  const char   *p = str.c_str();
+  char         *end;
+  unsigned long val;
+
+  errno = 0;
+  val = strtoul(p, &end, 0);
+  if (str.empty() || *end || errno || val > max_val || str[0] == '-') {
+    throw logic_error(string("Invalid ") + what + ": " + str);
+  }
+
+  return (uint32)val;
+}
+
+static void
+ParseFilter (CCmdLine &cmdLine, CLogFilter &filter)
+{
+  if (cmdLine.isCmdLineParam(paramFrom)) {
+    filter.SetFrom(ParseUint(cmdLine.getParamValue(paramFrom), (uint32)-1, "timestamp"));
+  }
+  if (cmdLine.isCmdLineParam(paramTo)) {
+    filter.SetTo(ParseUint(cmdLine.getParamValue(paramTo), (uint32)-1, "timestamp"));
+  }
+
+  if (cmdLine.isCmdLineParam(paramOIDs)) {
+    CStrTokenizer tok(cmdLine.getParamValue(paramOIDs));
+    for (CStrTokenizer::token_itr t = tok.begin(FILTER_LIST_DELIM); t; ++t) {
+      if (!t.get().empty()) {
+        filter.AddOID((uint8)ParseUint(t.get(), MAX_OID - 1, "OID"));
+      }
+    }
+  }
+  if (cmdLine.isCmdLineParam(paramGIDs)) {
+    CStrTokenizer tok(cmdLine.getParamValue(paramGIDs));
+    for (CStrTokenizer::token_itr t = tok.begin(FILTER_LIST_DELIM); t; ++t) {
+      if (!t.get().empty()) {
+        filter.AddGID((uint8)ParseUint(t.get(), MAX_GID - 1, "GID"));
       }
     }
   }
@@ -218,21 +690,43 @@ int main(int argc, char* argv[])
       throw logic_error("At least one string-file (.scd) must be specified!");
     }
 
-    istream *in_s  = &cin;
-    ostream *out_s = &cout;
-    ifstream in_f;
-    ofstream out_f;
-    string   fName;
-    bool     pcap_out = cmdLine.isCmdLineParam(paramPCapOut);
+    string binStringFile = cmdLine.getParamValue(paramCompile);
+    if (!binStringFile.empty()) {
+      CompileStringFiles(scd_files, binStringFile);
+      return MAIN_SUCCESS;
+    }
+
+    CLogReader in;
+    ostream   *out_s = &cout;
+    ofstream   out_f;
+    string     fName;
+    bool       pcap_out = cmdLine.isCmdLineParam(paramPCapOut);
+    int        nof_threads = 1;
+    CLogFilter filter;
+
+    if (cmdLine.isCmdLineParam(paramThreads)) {
+      nof_threads = cmdLine.getIntParamValue(paramThreads);
+      if (nof_threads < 1) {
+        throw logic_error("Number of threads must be a positive number!");
+      }
+    }
+
+    ParseFilter(cmdLine, filter);
 
     fName = cmdLine.getParamValue(paramInFile);
+    if (cmdLine.isCmdLineParam(paramBench)) {
+      if (fName.empty()) {
+        throw logic_error("The input benchmark needs an input file!");
+      }
+      return BenchInput(fName, scd_files, pcap_out, (size_t)nof_threads, filter) ?
+             MAIN_SUCCESS : MAIN_KNOWN_ERROR;
+    }
+
     if (!fName.empty()) {
-      stream_enable_exceptions(in_f);
-      in_f.open(fName.c_str(), ios::in | ios::binary);
-      in_s = &in_f;
+      in.Open(fName);
     }
     else {
-      stream_enable_exceptions(cin);
+      in.OpenStdin();
 #ifdef WIN32
       /* Without _setmode() Windows replaces end-of-lines and breaks the data */
       if (_setmode(_fileno(stdin), _O_BINARY) == -1) {
@@ -257,7 +751,7 @@ int main(int argc, char* argv[])
 #endif
     }
 
-    ProcessLog(*in_s, *out_s, scd_files, pcap_out);
+    ProcessLog(in, *out_s, scd_files, pcap_out, (size_t)nof_threads, filter);
   }
   catch (const exception& ex) {
     cerr << "Error occurred:" << endl << "\t" 
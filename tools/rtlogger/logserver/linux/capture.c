@@ -0,0 +1,603 @@
+/******************************************************************************
+
+         Copyright (c) 2020, MaxLinear, Inc.
+         Copyright 2016 - 2020 Intel Corporation
+         Copyright 2015 - 2016 Lantiq Beteiligungs-GmbH & Co. KG
+         Copyright 2009 - 2014 Lantiq Deutschland GmbH
+         Copyright 2007 - 2008 Infineon Technologies AG
+
+  For licensing information, see the file 'LICENSE' in the root folder of
+  this software module.
+
+*******************************************************************************/
+
+/*
+ *
+ *
+ * On-disk capture of the driver events
+ *
+ */
+
+#include "mtlkinc.h"
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <sys/uio.h>
+#include <arpa/inet.h>
+#ifdef HAVE_LZ4
+#include <lz4.h>
+#endif
+#ifdef HAVE_ZSTD
+#include <zstd.h>
+#endif
+
+#include "logsrv_utils.h"
+#include "capture.h"
+#include "logsrv_protocol.h"
+
+#define LOG_LOCAL_GID   GID_CAPTURE
+#define LOG_LOCAL_FID   1
+
+/* Digits of the segment number in the file name */
+#define CAPTURE_SEQ_DIGITS  6
+
+/* Fastest zstd level: the capture must keep up with the driver */
+#define CAPTURE_ZSTD_LEVEL  1
+
+typedef struct _capture_t
+{
+  BOOL opened;
+  capture_cfg_t cfg;
+  char *fname;                    /* room for the segment file names */
+  size_t fname_size;
+
+  /* Current segment */
+  uint32 seq;
+  int seg_fd;
+  int idx_fd;
+  uint32 seg_offset;              /* in the file */
+  uint32 raw_offset;              /* in the decoded stream */
+  mtlk_osal_timestamp_t seg_start;
+
+  /* Pending block */
+  unsigned char *blk;
+  uint32 blk_len;
+  struct logsrv_capture_idx_entry blk_idx; /* host order */
+  mtlk_osal_timestamp_t blk_start;
+
+  /* Compressed block */
+  char *zbuf;
+  uint32 zbuf_size;
+#ifdef HAVE_ZSTD
+  ZSTD_CCtx *zctx;
+#endif
+} capture_t;
+
+static capture_t capture = { FALSE };
+
+BOOL
+capture_codec_supported (uint32 codec)
+{
+  switch (codec) {
+  case LOGSRV_CAPTURE_CODEC_NONE:
+    return TRUE;
+#ifdef HAVE_LZ4
+  case LOGSRV_CAPTURE_CODEC_LZ4:
+    return TRUE;
+#endif
+#ifdef HAVE_ZSTD
+  case LOGSRV_CAPTURE_CODEC_ZSTD:
+    return TRUE;
+#endif
+  default:
+    return FALSE;
+  }
+}
+
+/* Writes the whole iovec array */
+static int
+capture_writev (int fd, struct iovec *iov, int nof_iov)
+{
+  ssize_t ret;
+
+  while (nof_iov) {
+    ret = writev(fd, iov, nof_iov);
+    if (ret < 0) {
+      if (errno == EINTR)
+        continue;
+      return -1;
+    }
+    while (nof_iov && (size_t)ret >= iov->iov_len) {
+      ret -= iov->iov_len;
+      ++iov;
+      --nof_iov;
+    }
+    if (nof_iov) {
+      iov->iov_base = (char *) iov->iov_base + ret;
+      iov->iov_len -= ret;
+    }
+  }
+
+  return 0;
+}
+
+static int
+capture_write_buf (int fd, const void *data, size_t len)
+{
+  struct iovec iov;
+
+  iov.iov_base = (void *) data;
+  iov.iov_len  = len;
+  return capture_writev(fd, &iov, 1);
+}
+
+static const char *
+capture_seg_name (uint32 seq, BOOL idx)
+{
+  snprintf(capture.fname, capture.fname_size, "%s.%0*u%s",
+           capture.cfg.path, CAPTURE_SEQ_DIGITS, seq, idx ? ".idx" : "");
+  return capture.fname;
+}
+
+/* Compresses the pending block into zbuf.
+ * Returns the compressed size, 0 if it should be stored as is. */
+static uint32
+capture_blk_compress (void)
+{
+  size_t stored = 0;
+
+  switch (capture.cfg.codec) {
+#ifdef HAVE_LZ4
+  case LOGSRV_CAPTURE_CODEC_LZ4:
+  {
+    int ret = LZ4_compress_default((const char *) capture.blk, capture.zbuf,
+                                   (int)capture.blk_len, (int)capture.zbuf_size);
+    stored = (ret > 0) ? (size_t)ret : 0;
+    break;
+  }
+#endif
+#ifdef HAVE_ZSTD
+  case LOGSRV_CAPTURE_CODEC_ZSTD:
+    stored = ZSTD_compressCCtx(capture.zctx, capture.zbuf, capture.zbuf_size,
+                               capture.blk, capture.blk_len, CAPTURE_ZSTD_LEVEL);
+    if (ZSTD_isError(stored))
+      stored = 0;
+    break;
+#endif
+  default:
+    break;
+  }
+
+  /* Incompressible data is stored as is */
+  if (stored >= capture.blk_len)
+    stored = 0;
+  return (uint32)stored;
+}
+
+static int
+capture_seq_cmp (const void *a, const void *b)
+{
+  uint32 x = *(const uint32 *)a;
+  uint32 y = *(const uint32 *)b;
+
+  return (x > y) - (x < y);
+}
+
+/* Numbers of the segments found in the directory, in ascending order.
+ * Returns how many there are, -1 on error. */
+static int
+capture_list_segs (uint32 **pseqs)
+{
+  const char *base = strrchr(capture.cfg.path, '/');
+  char *dir_name;
+  size_t base_len;
+  struct dirent *ent;
+  DIR *dir;
+  uint32 *seqs = NULL;
+  uint32 *new_seqs;
+  int nof_seqs = 0;
+  int max_seqs = 0;
+  int res = -1;
+
+  if (base) {
+    dir_name = strndup(capture.cfg.path, base - capture.cfg.path + 1);
+    ++base;
+  } else {
+    dir_name = strdup(".");
+    base = capture.cfg.path;
+  }
+  if (!dir_name) {
+    ELOG_V("Out of memory");
+    return -1;
+  }
+
+  dir = opendir(dir_name);
+  if (!dir) {
+    ELOG_SS("%s: %s", dir_name, strerror(errno));
+    free(dir_name);
+    return -1;
+  }
+  free(dir_name);
+
+  base_len = strlen(base);
+  while (NULL != (ent = readdir(dir))) {
+    const char *num = ent->d_name + base_len + 1;
+    const char *p;
+
+    if (strncmp(ent->d_name, base, base_len) || ent->d_name[base_len] != '.')
+      continue;
+    for (p = num; *p >= '0' && *p <= '9'; p++)
+      ;
+    if (p - num < CAPTURE_SEQ_DIGITS || *p)
+      continue;
+
+    if (nof_seqs == max_seqs) {
+      max_seqs = max_seqs ? max_seqs * 2 : 16;
+      new_seqs = (uint32 *) realloc(seqs, max_seqs * sizeof(*seqs));
+      if (!new_seqs) {
+        ELOG_V("Out of memory");
+        goto end;
+      }
+      seqs = new_seqs;
+    }
+    seqs[nof_seqs++] = (uint32)strtoul(num, NULL, 10);
+  }
+
+  qsort(seqs, nof_seqs, sizeof(*seqs), capture_seq_cmp);
+  *pseqs = seqs;
+  seqs = NULL;
+  res = nof_seqs;
+
+end:
+  closedir(dir);
+  free(seqs);
+  return res;
+}
+
+/* Removes all but the latest nof_segments segments, including the ones
+ * left by previous runs whatever their numbers are */
+static void
+capture_trim (void)
+{
+  uint32 *seqs = NULL;
+  int nof_seqs;
+  int i;
+
+  if (!capture.cfg.nof_segments)
+    return;
+
+  nof_seqs = capture_list_segs(&seqs);
+  for (i = 0; i < nof_seqs - (int)capture.cfg.nof_segments; i++) {
+    if (0 != unlink(capture_seg_name(seqs[i], FALSE)))
+      WLOG_SS("%s: %s", capture.fname, strerror(errno));
+    /* Segments of older versions have no index */
+    if (0 != unlink(capture_seg_name(seqs[i], TRUE)) && errno != ENOENT)
+      WLOG_SS("%s: %s", capture.fname, strerror(errno));
+  }
+
+  free(seqs);
+}
+
+static void
+capture_seg_close (void)
+{
+  if (capture.seg_fd >= 0)
+    close(capture.seg_fd);
+  if (capture.idx_fd >= 0)
+    close(capture.idx_fd);
+  capture.seg_fd = -1;
+  capture.idx_fd = -1;
+}
+
+static int
+capture_seg_open (void)
+{
+  struct logsrv_capture_idx_hdr idx_hdr;
+  struct logsrv_capture_seg_hdr seg_hdr;
+  struct logsrv_capture_blk_hdr blk_hdr;
+  struct logsrv_info info;
+  struct iovec iov[3];
+  int nof_iov = 0;
+  int i;
+
+  capture_seg_close();
+  ++capture.seq;
+
+  capture.seg_fd = open(capture_seg_name(capture.seq, FALSE),
+                        O_WRONLY | O_CREAT | O_TRUNC, 0644);
+  if (capture.seg_fd < 0)
+    goto error;
+  capture.idx_fd = open(capture_seg_name(capture.seq, TRUE),
+                        O_WRONLY | O_CREAT | O_TRUNC, 0644);
+  if (capture.idx_fd < 0)
+    goto error;
+
+  idx_hdr.magic   = htonl(LOGSRV_CAPTURE_IDX_MAGIC);
+  idx_hdr.version = htons(LOGSRV_CAPTURE_IDX_VERSION);
+  idx_hdr.flags   = htons(capture.cfg.codec ? LOGSRV_CAPTURE_IDX_COMPRESSED : 0);
+  if (0 != capture_write_buf(capture.idx_fd, &idx_hdr, sizeof(idx_hdr)))
+    goto error;
+
+  /* The same stream as the one sent to the clients */
+  info.magic         = htonl(LOGSRV_INFO_MAGIC);
+  info.size          = htonl(sizeof(info));
+  info.log_ver_major = htons(RTLOGGER_VER_MAJOR);
+  info.log_ver_minor = htons(RTLOGGER_VER_MINOR);
+
+  /* Compressed segments hold it as the first block, stored as is */
+  if (capture.cfg.codec) {
+    seg_hdr.magic      = htonl(LOGSRV_CAPTURE_SEG_MAGIC);
+    seg_hdr.block_size = htonl(CAPTURE_BLOCK_SIZE);
+    iov[nof_iov].iov_base = &seg_hdr;
+    iov[nof_iov].iov_len  = sizeof(seg_hdr);
+    ++nof_iov;
+
+    memset(&blk_hdr, 0, sizeof(blk_hdr));
+    blk_hdr.raw_size    = htonl(sizeof(info));
+    blk_hdr.stored_size = htonl(sizeof(info));
+    blk_hdr.codec       = LOGSRV_CAPTURE_CODEC_NONE;
+    iov[nof_iov].iov_base = &blk_hdr;
+    iov[nof_iov].iov_len  = sizeof(blk_hdr);
+    ++nof_iov;
+  }
+  iov[nof_iov].iov_base = &info;
+  iov[nof_iov].iov_len  = sizeof(info);
+  ++nof_iov;
+
+  capture.seg_offset = 0;
+  for (i = 0; i < nof_iov; i++)
+    capture.seg_offset += (uint32)iov[i].iov_len;
+  capture.raw_offset = sizeof(info);
+
+  if (0 != capture_writev(capture.seg_fd, iov, nof_iov))
+    goto error;
+  capture.seg_start = mtlk_osal_timestamp();
+
+  capture_trim();
+
+  ILOG1_D("Capture segment %u started", capture.seq);
+  return 0;
+
+error:
+  ELOG_SS("%s: %s", capture.fname, strerror(errno));
+  return -1;
+}
+
+/* Whether the block of stored_size bytes should start a new segment */
+static BOOL
+capture_seg_expired (uint32 stored_size)
+{
+  if (capture.seg_fd < 0)
+    return TRUE;
+  if (capture.raw_offset == sizeof(struct logsrv_info))
+    return FALSE;
+  if (capture.cfg.segment_size &&
+      capture.seg_offset + stored_size > capture.cfg.segment_size)
+    return TRUE;
+  if (capture.cfg.segment_time &&
+      mtlk_osal_timestamp() - capture.seg_start >=
+        (mtlk_osal_timestamp_t)capture.cfg.segment_time * MS_PER_S)
+    return TRUE;
+
+  return FALSE;
+}
+
+static void
+capture_stop (void)
+{
+  ELOG_V("Capture stopped");
+  capture_seg_close();
+  capture.opened = FALSE;
+}
+
+static void
+capture_blk_write (void)
+{
+  struct logsrv_capture_blk_hdr blk_hdr;
+  struct logsrv_capture_idx_entry idx;
+  struct iovec iov[2];
+  int nof_iov = 0;
+  uint32 stored = 0;
+  uint32 size;
+
+  if (!capture.blk_len)
+    return;
+
+  if (capture.cfg.codec) {
+    stored = capture_blk_compress();
+
+    memset(&blk_hdr, 0, sizeof(blk_hdr));
+    blk_hdr.raw_size    = htonl(capture.blk_len);
+    blk_hdr.stored_size = htonl(stored ? stored : capture.blk_len);
+    blk_hdr.codec       = stored ? (uint8)capture.cfg.codec :
+                                   LOGSRV_CAPTURE_CODEC_NONE;
+    iov[nof_iov].iov_base = &blk_hdr;
+    iov[nof_iov].iov_len  = sizeof(blk_hdr);
+    ++nof_iov;
+  }
+  if (stored) {
+    iov[nof_iov].iov_base = capture.zbuf;
+    iov[nof_iov].iov_len  = stored;
+  } else {
+    iov[nof_iov].iov_base = capture.blk;
+    iov[nof_iov].iov_len  = capture.blk_len;
+  }
+  ++nof_iov;
+
+  size = (uint32)iov[0].iov_len + ((nof_iov > 1) ? (uint32)iov[1].iov_len : 0);
+
+  if (capture_seg_expired(size) && 0 != capture_seg_open()) {
+    capture_stop();
+    goto end;
+  }
+
+  idx.min_ts     = htonl(capture.blk_idx.min_ts);
+  idx.max_ts     = htonl(capture.blk_idx.max_ts);
+  idx.offset     = htonl(capture.seg_offset);
+  idx.raw_offset = htonl(capture.raw_offset);
+  idx.raw_size   = htonl(capture.blk_len);
+  idx.nof_events = htonl(capture.blk_idx.nof_events);
+
+  /* The index entry follows the block, so it never refers past the data */
+  if (0 != capture_writev(capture.seg_fd, iov, nof_iov) ||
+      0 != capture_write_buf(capture.idx_fd, &idx, sizeof(idx))) {
+    ELOG_SS("%s: %s", capture_seg_name(capture.seq, FALSE), strerror(errno));
+    capture_stop();
+    goto end;
+  }
+  capture.seg_offset += size;
+  capture.raw_offset += capture.blk_len;
+
+end:
+  capture.blk_len = 0;
+}
+
+int
+capture_open (const capture_cfg_t *cfg)
+{
+  int res = -1;
+
+  uint32 *seqs = NULL;
+  int nof_seqs;
+
+  ASSERT(!capture.opened);
+
+  memset(&capture, 0, sizeof(capture));
+  capture.cfg    = *cfg;
+  capture.seg_fd = -1;
+  capture.idx_fd = -1;
+
+  if (!capture_codec_supported(cfg->codec)) {
+    ELOG_D("Capture codec %u is not supported", cfg->codec);
+    goto end;
+  }
+
+  capture.fname_size = strlen(cfg->path) + sizeof(".idx") + 16;
+  capture.fname = (char *) malloc(capture.fname_size);
+  capture.blk = (unsigned char *) malloc(CAPTURE_BLOCK_SIZE);
+  if (!capture.fname || !capture.blk) {
+    ELOG_V("Out of memory");
+    goto end;
+  }
+
+  switch (cfg->codec) {
+#ifdef HAVE_LZ4
+  case LOGSRV_CAPTURE_CODEC_LZ4:
+    capture.zbuf_size = (uint32)LZ4_compressBound(CAPTURE_BLOCK_SIZE);
+    break;
+#endif
+#ifdef HAVE_ZSTD
+  case LOGSRV_CAPTURE_CODEC_ZSTD:
+    capture.zbuf_size = (uint32)ZSTD_compressBound(CAPTURE_BLOCK_SIZE);
+    capture.zctx = ZSTD_createCCtx();
+    if (!capture.zctx) {
+      ELOG_V("Out of memory");
+      goto end;
+    }
+    break;
+#endif
+  default:
+    break;
+  }
+  if (capture.zbuf_size) {
+    capture.zbuf = (char *) malloc(capture.zbuf_size);
+    if (!capture.zbuf) {
+      ELOG_V("Out of memory");
+      goto end;
+    }
+  }
+
+  /* Segments of a previous run are kept */
+  nof_seqs = capture_list_segs(&seqs);
+  if (nof_seqs < 0)
+    goto end;
+  capture.seq = nof_seqs ? seqs[nof_seqs - 1] : 0;
+  free(seqs);
+
+  if (0 != capture_seg_open())
+    goto end;
+
+  capture.opened = TRUE;
+  res = 0;
+
+end:
+  if (res != 0)
+    capture_close();
+  return res;
+}
+
+void
+capture_close (void)
+{
+  if (capture.opened)
+    capture_blk_write();
+
+  capture_seg_close();
+  free(capture.fname);
+  free(capture.blk);
+  free(capture.zbuf);
+  capture.fname = NULL;
+  capture.blk = NULL;
+  capture.zbuf = NULL;
+#ifdef HAVE_ZSTD
+  ZSTD_freeCCtx(capture.zctx);
+  capture.zctx = NULL;
+#endif
+  capture.opened = FALSE;
+}
+
+void
+capture_write (const unsigned char *pkt, uint32 pktlen)
+{
+  mtlk_log_event_t log_evt;
+
+  if (!capture.opened)
+    return;
+
+  ASSERT(pktlen >= sizeof(log_evt) && pktlen <= CAPTURE_BLOCK_SIZE);
+  wave_memcpy(&log_evt, sizeof(log_evt), pkt, sizeof(log_evt));
+
+  if (capture.blk_len + pktlen > CAPTURE_BLOCK_SIZE) {
+    capture_blk_write();
+    if (!capture.opened)
+      return;
+  }
+
+  if (!capture.blk_len) {
+    capture.blk_idx.min_ts     = log_evt.timestamp;
+    capture.blk_idx.max_ts     = log_evt.timestamp;
+    capture.blk_idx.nof_events = 0;
+    capture.blk_start = mtlk_osal_timestamp();
+  }
+
+  wave_memcpy(capture.blk + capture.blk_len, CAPTURE_BLOCK_SIZE - capture.blk_len,
+              pkt, pktlen);
+  capture.blk_len += pktlen;
+  capture.blk_idx.min_ts = MIN(capture.blk_idx.min_ts, log_evt.timestamp);
+  capture.blk_idx.max_ts = MAX(capture.blk_idx.max_ts, log_evt.timestamp);
+  ++capture.blk_idx.nof_events;
+}
+
+int
+capture_timeout (void)
+{
+  mtlk_osal_timestamp_t elapsed;
+
+  if (!capture.opened || !capture.blk_len)
+    return -1;
+
+  elapsed = mtlk_osal_timestamp() - capture.blk_start;
+  if (elapsed >= CAPTURE_FLUSH_INTERVAL_MS)
+    return 0;
+  return (int)(CAPTURE_FLUSH_INTERVAL_MS - elapsed);
+}
+
+void
+capture_tick (void)
+{
+  if (capture_timeout() == 0)
+    capture_blk_write();
+}
@@ -0,0 +1,65 @@
+/******************************************************************************
+
+         Copyright (c) 2020, MaxLinear, Inc.
+         Copyright 2016 - 2020 Intel Corporation
+         Copyright 2015 - 2016 Lantiq Beteiligungs-GmbH & Co. KG
+         Copyright 2009 - 2014 Lantiq Deutschland GmbH
+         Copyright 2007 - 2008 Infineon Technologies AG
+
+  For licensing information, see the file 'LICENSE' in the root folder of
+  this software module.
+
+*******************************************************************************/
+
+/*
+ *
+ *
+ * On-disk capture of the driver events
+ *
+ */
+
+#ifndef __CAPTURE_H__
+#define __CAPTURE_H__
+
+#include "compat.h"
+
+/* The raw event stream is written to segment files <path>.NNNNNN, a new
+ * segment being started when the current one gets too large or too old.
+ * Numbering continues after the segments left by a previous run, and
+ * only the latest nof_segments found in the directory are kept.
+ *
+ * Events are gathered into blocks of whole events, a block being written
+ * when full or CAPTURE_FLUSH_INTERVAL_MS after its first event. Blocks
+ * are compressed with the configured codec, if any, and indexed by their
+ * event timestamps. See logsrv_protocol.h for the segment and index
+ * layouts, which logcnv reads.
+ */
+
+#define CAPTURE_BLOCK_SIZE        (128 * 1024)
+#define CAPTURE_FLUSH_INTERVAL_MS 1000
+
+typedef struct _capture_cfg_t
+{
+  const char *path;
+  uint32 segment_size;  /* bytes, 0 - unlimited */
+  uint32 segment_time;  /* seconds, 0 - unlimited */
+  uint32 nof_segments;  /* 0 - keep all */
+  uint32 codec;         /* LOGSRV_CAPTURE_CODEC_... */
+} capture_cfg_t;
+
+/* Codecs are only available if built with their libraries */
+BOOL capture_codec_supported(uint32 codec);
+
+int  capture_open(const capture_cfg_t *cfg);
+void capture_close(void);
+
+/* Takes a whole event. A write failure stops the capture. */
+void capture_write(const unsigned char *pkt, uint32 pktlen);
+
+/* Milliseconds until the pending block is due to be written,
+ * -1 if nothing is pending */
+int  capture_timeout(void);
+/* Writes the pending block if due */
+void capture_tick(void);
+
+#endif // !__CAPTURE_H__
@@ -11,6 +11,7 @@
 
 *******************************************************************************/
 
+
 /*
  * 
  *
@@ -24,6 +25,9 @@
 #include <stdlib.h>
 #include <string.h>
 #include <unistd.h>
+#include <sys/uio.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
 
 #include "logsrv_utils.h"
 #include "cqueue.h"
@@ -44,6 +48,7 @@
 ** cqueue_max_size - returns maximum data size a queue can hold.
 ** cqueue_empty - returns true if queue is empty.
 ** cqueue_full - returns true if no space left in queue.
+** cqueue_peek - returns a pointer to contiguous queue data.
 ** cqueue_get - gets data from queue.
 ** cqueue_pop_front - removes data at the front of queue.
 ** cqueue_push_back - copies data to the end of queue.
@@ -52,144 +57,184 @@
 ** cqueue_reserve - increase queue size preserving the data.
 ** cqueue_debug_dump - for debug-printing of queue contents.
 **                     Note: use CQUEUE_DEBUG_DUMP macro instead.
+**
+** The size of a queue is always a power of 2, and head/tail are free
+** running byte counters: data size is (tail - head) and the position in
+** the buffer is (counter & mask), so there's no "empty vs full" ambiguity.
+**
+** Queues of at least a page are mapped twice back-to-back when memfd is
+** available, so data[max_size..2*max_size) aliases data[0..max_size) and
+** any span of queued data is contiguous in memory. Otherwise wrapped
+** spans are handled with two-part copies and readv()/writev().
 ******************************************************************************/
 
-static int begin_reached_end(cqueue_t *pqueue);
+#if defined(__NR_memfd_create) && defined(MAP_FIXED)
+#define CQUEUE_MIRROR_SUPPORTED
+#endif
 
-void
-cqueue_init (cqueue_t *pqueue)
+static uint32
+cqueue_roundup_pow2 (uint32 size)
 {
-  pqueue->overflow_state = 0;
-  pqueue->data = NULL;
-  pqueue->max_size = 0;
-  pqueue->begin_idx = 0;
-  pqueue->end_idx = 0;
-  pqueue->is_empty = 1;
+  uint32 res = 1;
+
+  while (res < size)
+    res <<= 1;
+
+  return res;
 }
 
-int
-cqueue_reset (cqueue_t *pqueue, int max_size)
+#ifdef CQUEUE_MIRROR_SUPPORTED
+/* Maps 'size' bytes twice into adjacent virtual memory, NULL on failure */
+static char *
+cqueue_mirror_alloc (uint32 size)
 {
-  int result = 0;
-
-  pqueue->overflow_state = 0;
-  if (pqueue->max_size != max_size) {
-    // In case anything happens during initialization, treat the queue as empty
-    pqueue->max_size = 0;
-    if (pqueue->data) {
-      free(pqueue->data);
-      pqueue->data = NULL;
-    }
-
-    pqueue->data = (char *) malloc(max_size);
-    if (!pqueue->data) {
-      ELOG_V("Out of memory");
-      result = -1;
-    } else {
-      pqueue->max_size = max_size;
-    }
+  char *addr = MAP_FAILED;
+  char *res = NULL;
+  int fd;
+
+  if (size < (uint32)sysconf(_SC_PAGESIZE))
+    return NULL;
+
+  fd = (int)syscall(__NR_memfd_create, "cqueue", 0);
+  if (fd < 0)
+    return NULL;
+
+  if (0 != ftruncate(fd, size))
+    goto end;
+
+  /* Reserve the address range, then map the file over both halves */
+  addr = (char *) mmap(NULL, 2 * size, PROT_NONE,
+                       MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (addr == MAP_FAILED)
+    goto end;
+
+  if (MAP_FAILED == mmap(addr, size, PROT_READ | PROT_WRITE,
+                         MAP_SHARED | MAP_FIXED, fd, 0) ||
+      MAP_FAILED == mmap(addr + size, size, PROT_READ | PROT_WRITE,
+                         MAP_SHARED | MAP_FIXED, fd, 0)) {
+    munmap(addr, 2 * size);
+    goto end;
   }
-  pqueue->begin_idx = 0;
-  pqueue->end_idx = 0;
-  pqueue->is_empty = 1;
 
-  return result;
+  res = addr;
+
+end:
+  close(fd);
+  return res;
 }
+#endif
 
-void
-cqueue_cleanup (cqueue_t *pqueue)
+static int
+cqueue_alloc (cqueue_t *pqueue, uint32 max_size)
 {
+#ifdef CQUEUE_MIRROR_SUPPORTED
+  pqueue->data = cqueue_mirror_alloc(max_size);
   if (pqueue->data) {
-    free(pqueue->data);
-    pqueue->data = NULL;
+    pqueue->mirrored = 1;
+    goto end;
   }
+#endif
+
+  pqueue->data = (char *) malloc(max_size);
+  if (!pqueue->data) {
+    ELOG_V("Out of memory");
+    return -1;
+  }
+  pqueue->mirrored = 0;
+
+#ifdef CQUEUE_MIRROR_SUPPORTED
+end:
+#endif
+  pqueue->max_size = max_size;
+  pqueue->mask = max_size - 1;
+  return 0;
 }
 
-int
-cqueue_space_left (cqueue_t *pqueue)
+static void
+cqueue_free (cqueue_t *pqueue)
 {
-  if (pqueue->is_empty)
-    return pqueue->max_size;
-  // XXXX - free space, .... - data
-  if (pqueue->begin_idx < pqueue->end_idx) {
-    // [XXXX<begin>....<end>XXXX]
-    return pqueue->begin_idx + (pqueue->max_size - pqueue->end_idx);
-  }
-  // begin >= end
-  // [....<end>XXXX<begin>....]
-  return pqueue->begin_idx - pqueue->end_idx;
+  if (!pqueue->data)
+    return;
+
+#ifdef CQUEUE_MIRROR_SUPPORTED
+  if (pqueue->mirrored)
+    munmap(pqueue->data, 2 * pqueue->max_size);
+  else
+#endif
+    free(pqueue->data);
+
+  pqueue->data = NULL;
+  pqueue->max_size = 0;
+  pqueue->mask = 0;
+  pqueue->mirrored = 0;
+}
+
+void
+cqueue_init (cqueue_t *pqueue)
+{
+  memset(pqueue, 0, sizeof(*pqueue));
 }
 
 int
-cqueue_size (cqueue_t *pqueue)
+cqueue_reset (cqueue_t *pqueue, int max_size)
 {
-  //return pqueue->max_size - cqueue_space_left(pqueue);
+  uint32 size = cqueue_roundup_pow2(max_size);
 
-  if (pqueue->is_empty)
+  pqueue->head = 0;
+  pqueue->tail = 0;
+
+  if (pqueue->max_size == size)
     return 0;
 
-  // XXXX - free space, .... - data
-  if (pqueue->begin_idx < pqueue->end_idx) {
-    // [XXXX<begin>....<end>XXXX]
-    return pqueue->end_idx - pqueue->begin_idx;
-  }
-  // begin >= end
-  // [....<end>XXXX<begin>....]
-  return pqueue->end_idx + (pqueue->max_size - pqueue->begin_idx);
+  cqueue_free(pqueue);
+  return cqueue_alloc(pqueue, size);
 }
 
-int
-cqueue_max_size (cqueue_t *pqueue)
+void
+cqueue_cleanup (cqueue_t *pqueue)
 {
-  return pqueue->max_size;
+  cqueue_free(pqueue);
 }
 
-int
-cqueue_empty (cqueue_t *pqueue)
+/* Copies 'len' bytes at queue position 'pos' out of the buffer */
+static void
+cqueue_copy_out (cqueue_t *pqueue, uint32 pos, uint32 len, unsigned char *data)
 {
-  return pqueue->is_empty;
+  uint32 idx = pos & pqueue->mask;
+  uint32 first = MIN(len, pqueue->max_size - idx);
+
+  if (!len)
+    return;
+  if (pqueue->mirrored)
+    first = len;
+
+  wave_memcpy(data, len, &pqueue->data[idx], first);
+  if (first < len)
+    wave_memcpy(data + first, len - first, pqueue->data, len - first);
 }
 
-int
-cqueue_full (cqueue_t *pqueue)
+const unsigned char *
+cqueue_peek (cqueue_t *pqueue, int offset, int len, unsigned char *bounce)
 {
-  return cqueue_space_left(pqueue) == 0;
+  uint32 idx = (pqueue->head + offset) & pqueue->mask;
+
+  ASSERT(offset >= 0 && len >= 0);
+  ASSERT((uint32)(offset + len) <= cqueue_size(pqueue));
+
+  if (pqueue->mirrored || idx + len <= pqueue->max_size)
+    return (const unsigned char *) &pqueue->data[idx];
+
+  cqueue_copy_out(pqueue, pqueue->head + offset, len, bounce);
+  return bounce;
 }
 
 void
-cqueue_get(cqueue_t *pqueue, int offset, int len, unsigned char *data)
+cqueue_get (cqueue_t *pqueue, int offset, int len, unsigned char *data)
 {
-#ifdef CPTCFG_IWLWAV_DEBUG
-  int sz = cqueue_size(pqueue);
-  ASSERT(offset >= 0 && offset <= sz);
-  ASSERT(len >= 0 && len <= sz - offset);
-  ILOG9_DDD("offset=%d, len=%d, sz=%d", offset, len, sz);
-#endif
-  // Take offset into account:
-  int offset_begin_idx = pqueue->begin_idx + offset;
-  if (offset_begin_idx > pqueue->max_size)
-    offset_begin_idx -= pqueue->max_size;
-
-  // XXXX - free space, .... - data
-  if (offset_begin_idx < pqueue->end_idx) {
-    // [XXXX<begin>....<end>XXXX]
-    wave_memcpy(data, len, &pqueue->data[offset_begin_idx], len);
-  } else {
-    // begin >= end
-    // [....<end>XXXX<begin>....]
-    int datalen_at_the_end =
-      pqueue->max_size - offset_begin_idx;
-    unsigned int to_copy = MIN(len, datalen_at_the_end);
-    if (to_copy > 0)
-      wave_memcpy(data, len, &pqueue->data[offset_begin_idx], to_copy);
-    if (len == to_copy) { // We're copying lesser data than available at the end
-      // Everything was copied
-    } else {
-      // Wraparound and continue copying
-      unsigned int bytes_remaining = len - to_copy;
-      wave_memcpy(data + to_copy, bytes_remaining, pqueue->data, bytes_remaining);
-    }
-  }
+  ASSERT(offset >= 0 && len >= 0);
+  ASSERT((uint32)(offset + len) <= cqueue_size(pqueue));
+
+  cqueue_copy_out(pqueue, pqueue->head + offset, len, data);
 }
 
 void
@@ -197,191 +242,110 @@ cqueue_pop_front (cqueue_t *pqueue, int len)
 {
   ASSERT(cqueue_size(pqueue) >= len);
 
-  // XXXX - free space, .... - data
-  if (pqueue->begin_idx < pqueue->end_idx) {
-    // [XXXX<begin>....<end>XXXX]
-    pqueue->begin_idx += len;
-  } else {
-    // begin >= end
-    // [....<end>XXXX<begin>....]
-    unsigned int end_space_left = pqueue->max_size - pqueue->end_idx;
-    unsigned int to_skip = MIN(len, end_space_left);
-    if (len == to_skip) { // end_space_left > size we're going to skip
-      // No wrap around
-      pqueue->begin_idx += to_skip;
-    } else { // (to_skip is end_space_left) < len
-      // Wrap around and skip remaining bytes at the beginning
-      pqueue->begin_idx = len - to_skip;
-    }
-  }
-  if (begin_reached_end(pqueue)) {
-    pqueue->begin_idx = 0;
-    pqueue->end_idx = 0;
-    pqueue->is_empty = 1;
-  }
+  pqueue->head += len;
 }
 
 void
 cqueue_push_back (cqueue_t *pqueue, unsigned char *data, int len)
 {
+  uint32 idx = pqueue->tail & pqueue->mask;
+  uint32 first = MIN((uint32)len, pqueue->max_size - idx);
+
   ASSERT(cqueue_space_left(pqueue) >= len);
   ASSERT(len > 0);
-  // XXXX - free space, .... - data
-  if (pqueue->begin_idx < pqueue->end_idx) {
-    // [XXXX<begin>....<end>XXXX]
-    unsigned int end_space_left = pqueue->max_size - pqueue->end_idx;
-    unsigned int to_write = MIN(len, end_space_left);
-    if (to_write > 0) {
-      wave_memcpy(&pqueue->data[pqueue->end_idx], (pqueue->max_size - pqueue->end_idx), data, to_write);
-    }
-    if (len == to_write) {
-      // Everything was copied
-      pqueue->end_idx += to_write;
-    } else {
-      // Wrap around and write bytes for which there were no space at the tail
-      unsigned int bytes_remaining = len - to_write;
-      wave_memcpy(pqueue->data, pqueue->max_size, data + to_write, bytes_remaining);
-      pqueue->end_idx = bytes_remaining;
-    }
-  } else {
-    // begin >= end
-    // [....<end>XXXX<begin>....]
-    if (pqueue->is_empty)
-      pqueue->is_empty = 0;
-    wave_memcpy(&pqueue->data[pqueue->end_idx], (pqueue->max_size - pqueue->end_idx), data, len);
-    pqueue->end_idx += len;
-  }
+
+  if (pqueue->mirrored)
+    first = len;
+
+  wave_memcpy(&pqueue->data[idx], first, data, first);
+  if (first < len)
+    wave_memcpy(pqueue->data, len - first, data + first, len - first);
+
+  pqueue->tail += len;
+}
+
+/* Describes 'len' bytes at queue position 'pos', returns number of iovecs */
+static int
+cqueue_iov (cqueue_t *pqueue, uint32 pos, uint32 len, struct iovec *iov)
+{
+  uint32 idx = pos & pqueue->mask;
+  uint32 first = MIN(len, pqueue->max_size - idx);
+
+  if (pqueue->mirrored)
+    first = len;
+
+  iov[0].iov_base = &pqueue->data[idx];
+  iov[0].iov_len  = first;
+  if (first == len)
+    return 1;
+
+  iov[1].iov_base = pqueue->data;
+  iov[1].iov_len  = len - first;
+  return 2;
 }
 
 int
 cqueue_read (cqueue_t *pqueue, int fd)
 {
-  int ret;
-  ILOG9_DD("cqueue_read: begin_idx=%d, end_idx=%d", pqueue->begin_idx,
-    pqueue->end_idx);
-  // XXXX - free space, .... - data
-  if (pqueue->begin_idx < pqueue->end_idx) {
-    // [XXXX<begin>....<end>XXXX]
-    unsigned int end_space_left = pqueue->max_size - pqueue->end_idx;
-    if (end_space_left > 0) {
-      ret = read(fd, &pqueue->data[pqueue->end_idx], end_space_left);
-      ILOG9_D("cqueue_read: read returned %d", ret);
-      if (ret <= 0)
-        return ret;
-      pqueue->end_idx += ret;
-      pqueue->is_empty = 0;
-      if (ret < end_space_left) {
-        // Everything was read
-        return 1;
-      }
-    }
-    // Wrap around and continue reading (if there's space in buffer)
-    if (pqueue->begin_idx > 0) {
-      ret = read(fd, pqueue->data, pqueue->begin_idx);
-      if (ret <= 0)
-        return ret;
-      pqueue->end_idx = ret;
-      pqueue->is_empty = 0;
-    }
-  } else {
-    // begin >= end
-    // [....<end>XXXX<begin>....]
-    unsigned int to_read;
-    if (pqueue->is_empty)
-      to_read = pqueue->max_size;
-    else
-      to_read = pqueue->begin_idx - pqueue->end_idx;
-
-    if (to_read > 0) {
-      ret = read(fd, &pqueue->data[pqueue->end_idx], to_read);
-      if (ret <= 0)
-        return ret;
-      pqueue->is_empty = 0;
-      pqueue->end_idx += ret;
-    }
-  }
+  struct iovec iov[2];
+  int nof_iov;
+  ssize_t ret;
+
+  ILOG9_DD("cqueue_read: head=%u, tail=%u", pqueue->head, pqueue->tail);
+  if (cqueue_full(pqueue))
+    return 1;
+
+  nof_iov = cqueue_iov(pqueue, pqueue->tail, cqueue_space_left(pqueue), iov);
+  ret = readv(fd, iov, nof_iov);
+  ILOG9_D("cqueue_read: readv returned %d", (int)ret);
+  if (ret <= 0)
+    return (int)ret;
+
+  pqueue->tail += (uint32)ret;
   return 1;
 }
 
 int
 cqueue_write (cqueue_t *pqueue, int fd)
 {
-  int ret;
-  ILOG9_DD("cqueue_write: begin_idx=%d, end_idx=%d", pqueue->begin_idx,
-    pqueue->end_idx);
+  struct iovec iov[2];
+  int nof_iov;
+  ssize_t ret;
+
+  ILOG9_DD("cqueue_write: head=%u, tail=%u", pqueue->head, pqueue->tail);
   ASSERT(!cqueue_empty(pqueue));
 
-  if (pqueue->begin_idx == pqueue->max_size)
-    pqueue->begin_idx = 0;
-
-  // XXXX - free space, .... - data
-  if (pqueue->begin_idx < pqueue->end_idx) {
-    // [XXXX<begin>....<end>XXXX]
-    ret = write(fd, &pqueue->data[pqueue->begin_idx], 
-        pqueue->end_idx - pqueue->begin_idx);
-    ILOG9_D("cqueue_write: write returned %d", ret);
-    if (ret <= 0)
-      return ret;
-    pqueue->begin_idx += ret;
-    ILOG9_DDD("cqueue_write: begin_idx=%d, end_idx=%d, begin_reached_end=%d",
-        pqueue->begin_idx, pqueue->end_idx, begin_reached_end(pqueue));
-    if (begin_reached_end(pqueue)) {
-      pqueue->begin_idx = 0;
-      pqueue->end_idx = 0;
-      pqueue->is_empty = 1;
-    }
-  } else {
-    // begin >= end
-    // [....<end>XXXX<begin>....]
-    ret = write(fd, &pqueue->data[pqueue->begin_idx],
-        pqueue->max_size - pqueue->begin_idx);
-    ILOG9_D("cqueue_write: write returned %d", ret);
-    if (ret <= 0)
-      return ret;
-    pqueue->begin_idx += ret;
-    // Other data will be processed by a next call
-    ILOG9_DDD("cqueue_write: begin_idx=%d, end_idx=%d, begin_reached_end=%d",
-        pqueue->begin_idx, pqueue->end_idx, begin_reached_end(pqueue));
-    if (begin_reached_end(pqueue)) {
-      pqueue->begin_idx = 0;
-      pqueue->end_idx = 0;
-      pqueue->is_empty = 1;
-    } else {
-      // This call will perform a wraparound and write the rest of data
-      return cqueue_write(pqueue, fd);
-    }
-  }
+  nof_iov = cqueue_iov(pqueue, pqueue->head, cqueue_size(pqueue), iov);
+  ret = writev(fd, iov, nof_iov);
+  ILOG9_D("cqueue_write: writev returned %d", (int)ret);
+  if (ret <= 0)
+    return (int)ret;
+
+  pqueue->head += (uint32)ret;
   return 1;
 }
 
-int cqueue_reserve (cqueue_t *pqueue, int max_size)
+int
+cqueue_reserve (cqueue_t *pqueue, int max_size)
 {
-  if (max_size <= pqueue->max_size)
+  cqueue_t newq;
+  uint32 size = cqueue_roundup_pow2(max_size);
+  uint32 len = cqueue_size(pqueue);
+
+  if (size <= pqueue->max_size)
     return 0;
 
-  void *newdata = realloc(pqueue->data, max_size);
-  if (!newdata) {
-    ELOG_V("Out of memory");
+  cqueue_init(&newq);
+  if (0 != cqueue_alloc(&newq, size))
     return -1;
-  }
-  pqueue->data = (char *) newdata;
-
-  // XXXX - free space, .... - data
-  if (pqueue->begin_idx < pqueue->end_idx) {
-    // [XXXX<begin>....<end>XXXX]
-    // No need to move data
-  } else {
-    // begin > end
-    // [....<end>XXXX<begin>....]
-    // Move data after <begin> to new end of queue:
-    int size_diff = max_size - pqueue->max_size;
-    memmove(&pqueue->data[pqueue->begin_idx + size_diff],
-      &pqueue->data[pqueue->begin_idx],
-      pqueue->max_size - pqueue->begin_idx);
-
-    pqueue->begin_idx = pqueue->begin_idx + size_diff;
-  }
-  pqueue->max_size = max_size;
+
+  // Data is moved to the beginning of the new buffer
+  if (len)
+    cqueue_copy_out(pqueue, pqueue->head, len, (unsigned char *) newq.data);
+  newq.tail = len;
+
+  cqueue_free(pqueue);
+  *pqueue = newq;
   return 0;
 }
 
@@ -398,12 +362,14 @@ errdump(char *pdata, unsigned int len)
 void
 cqueue_debug_dump (const char *qname, cqueue_t *pqueue, int binary)
 {
-  int begin_idx;
+  struct iovec iov[2];
+  int nof_iov;
+  int i;
 
   if (debug < 9)
     return;
 
-  if (pqueue->begin_idx == pqueue->end_idx) {
+  if (cqueue_empty(pqueue)) {
     ILOG9_S("%s: queue is empty", qname);
     return;
   }
@@ -411,50 +377,15 @@ cqueue_debug_dump (const char *qname, cqueue_t *pqueue, int binary)
   ILOG9_S("%s:", qname);
   fprintf(stderr, "[[[");
 
-  // XXXX - free space, .... - data
-  begin_idx = pqueue->begin_idx;
-  if (begin_idx > pqueue->end_idx) {
-    // [....<end>XXXX<begin>....]
-    int datalen = pqueue->max_size - begin_idx;
-    if (datalen) {
-      if (!binary) {
-        fwrite(&pqueue->data[begin_idx],
-          sizeof(char), datalen, stderr);
-      } else {
-        errdump(&pqueue->data[begin_idx], datalen);
-      }
-      begin_idx += datalen;
-    }
-    if (begin_idx == pqueue->max_size)
-      begin_idx = 0;
-  }
-
-  if (begin_idx < pqueue->end_idx) {
-    // [XXXX<begin>....<end>XXXX]
-    int datalen =
-      pqueue->end_idx - begin_idx;
-    if (datalen) {
-      if (!binary) {
-        fwrite(&pqueue->data[begin_idx],
-          sizeof(char), datalen, stderr);
-      } else {
-        errdump(&pqueue->data[begin_idx], datalen);
-      }
-      //begin_idx += datalen;
+  nof_iov = cqueue_iov(pqueue, pqueue->head, cqueue_size(pqueue), iov);
+  for (i = 0; i < nof_iov; i++) {
+    if (!binary) {
+      fwrite(iov[i].iov_base, sizeof(char), iov[i].iov_len, stderr);
+    } else {
+      errdump((char *) iov[i].iov_base, iov[i].iov_len);
     }
   }
 
   fprintf(stderr, "]]]\n");
 }
 #endif // CPTCFG_IWLWAV_DEBUG
-
-static int
-begin_reached_end(cqueue_t *pqueue)
-{
-  if (pqueue->begin_idx == pqueue->end_idx)
-    return 1;
-  if (pqueue->begin_idx == pqueue->max_size && pqueue->end_idx == 0)
-    return 1;
-  return 0;
-}
-
@@ -32,22 +32,50 @@
 
 typedef struct _cqueue_t
 {
-  int overflow_state;
   char *data;
-  int max_size;
-  int begin_idx;
-  int end_idx;
-  int is_empty;
+  uint32 max_size;  /* always a power of 2 */
+  uint32 mask;
+  uint32 head;      /* free running: bytes ever removed */
+  uint32 tail;      /* free running: bytes ever added */
+  int mirrored;     /* data is mapped twice, see cqueue.c */
 } cqueue_t;
 
 void cqueue_init (cqueue_t *pqueue);
 int cqueue_reset (cqueue_t *pqueue, int max_size);
 void cqueue_cleanup (cqueue_t *pqueue);
-int cqueue_space_left (cqueue_t *pqueue);
-int cqueue_size (cqueue_t *pqueue);
-int cqueue_max_size (cqueue_t *pqueue);
-int cqueue_empty (cqueue_t *pqueue);
-int cqueue_full (cqueue_t *pqueue);
+
+static __INLINE int
+cqueue_size (cqueue_t *pqueue)
+{
+  return (int)(pqueue->tail - pqueue->head);
+}
+
+static __INLINE int
+cqueue_space_left (cqueue_t *pqueue)
+{
+  return (int)pqueue->max_size - cqueue_size(pqueue);
+}
+
+static __INLINE int
+cqueue_max_size (cqueue_t *pqueue)
+{
+  return (int)pqueue->max_size;
+}
+
+static __INLINE int
+cqueue_empty (cqueue_t *pqueue)
+{
+  return pqueue->tail == pqueue->head;
+}
+
+static __INLINE int
+cqueue_full (cqueue_t *pqueue)
+{
+  return cqueue_size(pqueue) == (int)pqueue->max_size;
+}
+
+const unsigned char *cqueue_peek (cqueue_t *pqueue, int offset, int len,
+                                  unsigned char *bounce);
 void cqueue_get (cqueue_t *pqueue, int offset, int len, unsigned char *data);
 void cqueue_pop_front (cqueue_t *pqueue, int len);
 void cqueue_push_back (cqueue_t *pqueue, unsigned char *data, int len);
@@ -31,16 +31,85 @@
 #define LOG_LOCAL_GID   GID_DB
 #define LOG_LOCAL_FID   1
 
-struct scd_entry *scd_data = NULL;
+#define SCD_DB_INITIAL_SLOTS  1024 /* must be a power of 2 */
 
-static int scd_entry_push_back(int oid, int gid, int fid, int lid, char *text);
-static int scd_destroy(void);
+/* Packed key: same bit layout as info_w0 of mtlk_log_event_t with the
+ * EXP bit cleared, so an all-ones value can never be a valid key. */
+#define SCD_KEY(oid, gid, fid, lid) LOG_MAKE_INFO_W0(0, (lid), (oid), (gid), (fid))
+#define SCD_KEY_EMPTY               ((uint32)-1)
+
+/* Polling period while waiting for readers of a replaced snapshot */
+#define SCD_GRACE_POLL_MS           1
+
+/* Current snapshot. Readers announce themselves in the counter of the
+ * current epoch; publishing flips the epoch and waits for the counter
+ * of the previous one to drain, then nobody can refer to the replaced
+ * snapshot anymore. */
+static struct scd_db * volatile scd_current = NULL;
+static mtlk_atomic_t scd_epoch;
+static mtlk_atomic_t scd_readers[2];
+
+static int scd_db_grow(struct scd_db *db, uint32 nof_slots);
+
+static __INLINE uint32
+scd_key_hash(uint32 key, uint32 nof_slots)
+{
+  /* Multiplicative hashing: nof_slots is a power of 2. The index is
+   * taken from the high bits of the product, the low ones depend on
+   * the low bits of the key only and would leave the LID out. */
+  return (key * 2654435761U) >> (__builtin_clz(nof_slots) + 1);
+}
+
+static struct scd_entry *
+scd_db_find_slot(const struct scd_db *db, uint32 key)
+{
+  uint32 mask = db->nof_slots - 1;
+  uint32 idx  = scd_key_hash(key, db->nof_slots);
+
+  /* Load factor is kept below 1/2, so an empty slot always exists */
+  while (db->slots[idx].key != key && db->slots[idx].key != SCD_KEY_EMPTY)
+    idx = (idx + 1) & mask;
+
+  return &db->slots[idx];
+}
+
+static int
+scd_db_grow(struct scd_db *db, uint32 nof_slots)
+{
+  struct scd_entry *old_slots = db->slots;
+  uint32 old_nof_slots = db->nof_slots;
+  uint32 i;
+
+  db->slots = (struct scd_entry *) malloc(nof_slots * sizeof(struct scd_entry));
+  if (!db->slots) {
+    ELOG_V("Out of memory");
+    db->slots = old_slots;
+    return -1;
+  }
+  for (i = 0; i < nof_slots; i++) {
+    db->slots[i].key  = SCD_KEY_EMPTY;
+    db->slots[i].prog = NULL;
+  }
+  db->nof_slots = nof_slots;
+
+  for (i = 0; i < old_nof_slots; i++) {
+    if (old_slots[i].key != SCD_KEY_EMPTY)
+      *scd_db_find_slot(db, old_slots[i].key) = old_slots[i];
+  }
+  free(old_slots);
+
+  return 0;
+}
 
 int
 db_init(void)
 {
   int rslt = 0;
 
+  mtlk_osal_atomic_set(&scd_epoch, 0);
+  mtlk_osal_atomic_set(&scd_readers[0], 0);
+  mtlk_osal_atomic_set(&scd_readers[1], 0);
+
   return rslt;
 }
 
@@ -49,112 +118,288 @@ db_destroy(void)
 {
   int rslt = 0;
 
-  if (0 != scd_destroy()) {
-    rslt = -1;
-    goto cleanup;
-  }
+  /* No readers are left by now */
+  scd_db_free(scd_current);
+  scd_current = NULL;
 
-cleanup:
   return rslt;
 }
 
+struct scd_db *
+scd_db_create(void)
+{
+  struct scd_db *db;
 
-int
-db_register_scd_entry(int oid, int gid, int fid, int lid, char *text)
+  db = (struct scd_db *) malloc(sizeof(struct scd_db));
+  if (!db) {
+    ELOG_V("Out of memory");
+    return NULL;
+  }
+  memset(db, 0, sizeof(*db));
+
+  if (0 != scd_db_grow(db, SCD_DB_INITIAL_SLOTS)) {
+    free(db);
+    return NULL;
+  }
+
+  return db;
+}
+
+void
+scd_db_free(struct scd_db *db)
 {
-  int rslt = 0;
-  struct scd_entry *ent;
+  uint32 i;
 
-  for (ent = scd_data; ent; ent = ent->next) {
-    if (ent->oid == oid && ent->gid == gid && ent->fid == fid && ent->lid == lid) {
-      ELOG_DDDD("Duplicate text entry found for OID/GID/FID/LID combination: %d,%d,%d,%d",
-          oid, gid, fid, lid);
-      rslt = -1;
-      goto cleanup;
-    }
+  if (!db)
+    return;
+
+  for (i = 0; i < db->nof_slots; i++)
+    logfmt_free(db->slots[i].prog);
+
+  scdbin_close(&db->bin);
+  free(db->slots);
+  free(db);
+}
+
+struct scd_db *
+scd_db_open_bin(const char *fname)
+{
+  struct scd_db *db;
+  int res;
+
+  db = (struct scd_db *) malloc(sizeof(struct scd_db));
+  if (!db) {
+    ELOG_V("Out of memory");
+    return NULL;
   }
+  memset(db, 0, sizeof(*db));
 
-  if (0 != scd_entry_push_back(oid, gid, fid, lid, text)) {
-    rslt = -1;
-    goto cleanup;
+  res = scdbin_open(&db->bin, fname);
+  if (res != MTLK_ERR_OK) {
+    ELOG_SS("%s: cannot load: %s", fname, scdbin_get_error_text(res));
+    free(db);
+    return NULL;
   }
+  db->nof_entries = db->bin.nof_ents[SCDBIN_FMTS];
 
-cleanup:
-  return rslt;
+  return db;
 }
 
-static int
-scd_entry_push_back(int oid, int gid, int fid, int lid, char *text)
+int
+scd_db_add(struct scd_db *db, int oid, int gid, int fid, int lid, const char *text)
 {
   int rslt = 0;
+  uint32 key = SCD_KEY(oid, gid, fid, lid);
   struct scd_entry *ent;
 
-  ent = (struct scd_entry *) malloc(sizeof(struct scd_entry));
-  if (!ent) {
-    ELOG_V("Out of memory");
+  if (MTLK_BFIELD_GET(key, LOG_INFO_W0_OID) != oid ||
+      MTLK_BFIELD_GET(key, LOG_INFO_W0_GID) != gid ||
+      MTLK_BFIELD_GET(key, LOG_INFO_W0_FID) != fid ||
+      MTLK_BFIELD_GET(key, LOG_INFO_W0_LID) != lid) {
+    ELOG_DDDD("OID/GID/FID/LID combination out of range: %d,%d,%d,%d",
+        oid, gid, fid, lid);
+    rslt = -1;
+    goto cleanup;
+  }
+
+  if (2 * (db->nof_entries + 1) > db->nof_slots) {
+    if (0 != scd_db_grow(db, 2 * db->nof_slots)) {
+      rslt = -1;
+      goto cleanup;
+    }
+  }
+
+  ent = scd_db_find_slot(db, key);
+  if (ent->key == key) {
+    ELOG_DDDD("Duplicate text entry found for OID/GID/FID/LID combination: %d,%d,%d,%d",
+        oid, gid, fid, lid);
     rslt = -1;
     goto cleanup;
   }
-  memset(ent, 0, sizeof(*ent));
 
-  ent->oid = oid;
-  ent->gid = gid;
-  ent->fid = fid;
-  ent->lid = lid;
-  ent->text = strdup(text);
-  if (!ent->text) {
+  ent->prog = logfmt_compile(text);
+  if (!ent->prog) {
     ELOG_V("Out of memory");
     rslt = -1;
     goto cleanup;
   }
+  ent->key = key;
+  ++db->nof_entries;
 
-  ent->next = scd_data;
-  scd_data = ent;
   ILOG2_DDDS("Text added to SCD db (gid %d, fid %d, lid %d): %s",
       gid, fid, lid, text);
 
 cleanup:
-  if (rslt != 0) {
-    if (ent) {
-      if (ent->text)
-        free(ent->text);
-      free(ent);
-    }
-  }
   return rslt;
 }
 
-char *
-scd_get_text(int oid, int gid, int fid, int lid)
+const logfmt_prog_t *
+scd_db_get_prog(const struct scd_db *db, int oid, int gid, int fid, int lid)
 {
-  struct scd_entry *ent;
+  if (!db)
+    return NULL;
 
-  for (ent = scd_data; ent; ent = ent->next)
-    if (ent->oid == oid &&
-        ent->gid == gid &&
-        ent->fid == fid &&
-        ent->lid == lid)
-      return ent->text;
+  if (db->bin.data)
+    return scdbin_get_prog(&db->bin, oid, gid, fid, lid);
 
-  return NULL;
+  return scd_db_find_slot(db, SCD_KEY(oid, gid, fid, lid))->prog;
 }
 
-static int
-scd_destroy(void)
+const char *
+scd_db_get_text(const struct scd_db *db, int oid, int gid, int fid, int lid)
 {
-  int rslt = 0;
-  struct scd_entry *pnext;
+  const logfmt_prog_t *prog = scd_db_get_prog(db, oid, gid, fid, lid);
+
+  return prog ? logfmt_get_format(prog) : NULL;
+}
+
+const struct scd_db *
+db_scd_acquire(uint32 *token)
+{
+  uint32 epoch;
+
+  /* Retry if the epoch has been flipped before the reader got counted:
+   * the publisher may not be waiting for this counter anymore */
+  for (;;) {
+    epoch = mtlk_osal_atomic_get(&scd_epoch);
+    mtlk_osal_atomic_inc(&scd_readers[epoch & 1]);
+    if (mtlk_osal_atomic_get(&scd_epoch) == epoch)
+      break;
+    mtlk_osal_atomic_dec(&scd_readers[epoch & 1]);
+  }
 
-  while (scd_data) {
-    pnext = scd_data->next;
+  *token = epoch & 1;
+  return scd_current;
+}
+
+void
+db_scd_release(uint32 token)
+{
+  mtlk_osal_atomic_dec(&scd_readers[token]);
+}
+
+void
+db_scd_publish(struct scd_db *db)
+{
+  struct scd_db *old;
+  uint32 epoch;
 
-    free(scd_data->text);
-    free(scd_data);
+  /* The swap is a full barrier: the snapshot is complete before it can
+   * be seen, and the new epoch is seen after the new snapshot */
+  do {
+    old = scd_current;
+    db->version = old ? old->version + 1 : 1;
+  } while (!__sync_bool_compare_and_swap(&scd_current, old, db));
+  epoch = mtlk_osal_atomic_inc(&scd_epoch) - 1;
 
-    scd_data = pnext;
+  while (mtlk_osal_atomic_get(&scd_readers[epoch & 1]) != 0)
+    mtlk_osal_msleep(SCD_GRACE_POLL_MS);
+
+  scd_db_free(old);
+
+  ILOG0_DD("SCD db version %u published: %u entries", db->version, db->nof_entries);
+}
+
+#ifdef RUN_DB_UTEST
+
+#define DB_UTEST_NOF_ENTRIES  (64 * 1024)
+#define DB_UTEST_NOF_ROUNDS   32
+/* Odd stride, the lookups don't follow the registration order */
+#define DB_UTEST_STRIDE       40503
+
+/* Entries spread the way SCD files do: many LIDs per file */
+static void
+_db_utest_key (uint32 i, BOOL miss, int *oid, int *gid, int *fid, int *lid)
+{
+  *lid = (int)(i % 256) + (miss ? 256 : 0);
+  *fid = (int)(i / 256) % 8;
+  *gid = (int)(i / 2048) % 32;
+  *oid = (int)(i / 65536);
+}
+
+/* Looks up every entry once per round, returns the number found */
+static uint32
+_db_utest_lookup (const struct scd_db *db, BOOL miss)
+{
+  uint32 nof_found = 0;
+  uint32 round;
+  uint32 i;
+  int oid, gid, fid, lid;
+
+  for (round = 0; round < DB_UTEST_NOF_ROUNDS; round++) {
+    for (i = 0; i < DB_UTEST_NOF_ENTRIES; i++) {
+      _db_utest_key((i * DB_UTEST_STRIDE) % DB_UTEST_NOF_ENTRIES, miss, &oid, &gid, &fid, &lid);
+      if (scd_db_get_prog(db, oid, gid, fid, lid))
+        nof_found++;
+    }
   }
 
-  return rslt;
+  return nof_found;
 }
 
+/* SCD lookups per second, for present and absent entries. Uses a
+ * private database, the published one is not touched. */
+BOOL
+run_db_utest(void)
+{
+  struct scd_db *db;
+  mtlk_osal_timestamp_t start;
+  uint32 elapsed_ms;
+  uint32 kps[2];
+  uint32 nof_found[2];
+  BOOL pased = TRUE;
+  char text[32];
+  const char *found;
+  uint32 i;
+  int oid, gid, fid, lid;
+
+  db = scd_db_create();
+  if (!db) {
+    ELOG_V("SCD db unit tests: out of memory");
+    return FALSE;
+  }
+
+  for (i = 0; i < DB_UTEST_NOF_ENTRIES; i++) {
+    _db_utest_key(i, FALSE, &oid, &gid, &fid, &lid);
+    snprintf(text, sizeof(text), "SCD text %u: %%d", i);
+    if (0 != scd_db_add(db, oid, gid, fid, lid, text)) {
+      pased = FALSE;
+      goto end;
+    }
+  }
+
+  /* Every entry is found with its own text, absent ones aren't */
+  for (i = 0; i < DB_UTEST_NOF_ENTRIES; i++) {
+    _db_utest_key(i, FALSE, &oid, &gid, &fid, &lid);
+    snprintf(text, sizeof(text), "SCD text %u: %%d", i);
+    found = scd_db_get_text(db, oid, gid, fid, lid);
+    if (!found || strcmp(found, text)) {
+      ELOG_DDDD("SCD db: wrong text for %d,%d,%d,%d", oid, gid, fid, lid);
+      pased = FALSE;
+    }
+    _db_utest_key(i, TRUE, &oid, &gid, &fid, &lid);
+    if (scd_db_get_text(db, oid, gid, fid, lid)) {
+      ELOG_DDDD("SCD db: unexpected text for %d,%d,%d,%d", oid, gid, fid, lid);
+      pased = FALSE;
+    }
+  }
+
+  for (i = 0; i < 2; i++) {
+    start = mtlk_osal_timestamp();
+    nof_found[i] = _db_utest_lookup(db, (BOOL)i);
+    elapsed_ms = mtlk_osal_timestamp_to_ms(mtlk_osal_timestamp() - start);
+    kps[i] = DB_UTEST_NOF_ENTRIES * DB_UTEST_NOF_ROUNDS / MAX(elapsed_ms, 1);
+  }
+  if (nof_found[0] != DB_UTEST_NOF_ENTRIES * DB_UTEST_NOF_ROUNDS || nof_found[1] != 0)
+    pased = FALSE;
+
+  ILOG0_DDDDS("SCD db: %u entries in %u slots, %u Klookups/s present, %u Klookups/s absent %s",
+             db->nof_entries, db->nof_slots, kps[0], kps[1],
+             (TRUE == pased) ? "SUCCEED" : "FAILED");
+
+end:
+  scd_db_free(db);
+  return pased;
+}
 
+#endif /* RUN_DB_UTEST */
@@ -23,24 +23,59 @@
 #ifndef __DB_H__
 #define __DB_H__
 
+#include "logfmt.h"
+#include "scdbin.h"
+
+/* SCD texts are kept in an open-addressing hash table keyed by the
+ * (OID, GID, FID, LID) combination packed the same way as info_w0 of
+ * the log event header. Both registration and lookup are O(1).
+ * The texts are kept compiled, ready for formatting events.
+ * A compiled (binary) SCD file is mapped and used as is instead.
+ */
 struct scd_entry
 {
-  int oid;
-  int gid;
-  int fid;
-  int lid;
-  char *text;
-
-  struct scd_entry *next;
+  uint32 key;
+  logfmt_prog_t *prog;
 };
 
-extern struct scd_entry *scd_data;
+struct scd_db
+{
+  struct scd_entry *slots;
+  uint32 nof_slots;   /* always a power of 2 */
+  uint32 nof_entries;
+  uint32 version;     /* assigned when published */
+  scdbin_t bin;       /* mapped file, bin.data is NULL if none */
+};
 
 int db_init(void);
 int db_destroy(void);
-int db_register_scd_entry(int oid, int gid, int fid, int lid, char *text);
 
-char *scd_get_text(int oid, int gid, int fid, int lid);
+/* Building a database. It's immutable once published. */
+struct scd_db *scd_db_create(void);
+void scd_db_free(struct scd_db *db);
+int scd_db_add(struct scd_db *db, int oid, int gid, int fid, int lid, const char *text);
+/* Database of a compiled SCD file */
+struct scd_db *scd_db_open_bin(const char *fname);
+
+const char *scd_db_get_text(const struct scd_db *db, int oid, int gid, int fid, int lid);
+const logfmt_prog_t *scd_db_get_prog(const struct scd_db *db, int oid, int gid, int fid, int lid);
+
+/* The current database is replaced as a whole by an atomic pointer swap.
+ * Readers in any thread get the current snapshot without locking, it
+ * stays valid until released and must be released soon: publishing
+ * waits for the readers of the previous snapshot before freeing it.
+ * There must be a single publishing thread at a time.
+ */
+const struct scd_db *db_scd_acquire(uint32 *token);
+void db_scd_release(uint32 token);
+void db_scd_publish(struct scd_db *db);
+
+#ifdef RUN_DB_UTEST
+/* SCD hash lookup throughput */
+BOOL run_db_utest(void);
+#else
+#define run_db_utest()
+#endif
 
 #endif // !__DB_H__
 
@@ -25,7 +25,11 @@
 #include <sys/time.h>
 #include <sys/types.h>
 #include <sys/socket.h>
+#include <sys/epoll.h>
 #include <sys/wait.h>
+#include <sys/inotify.h>
+#include <poll.h>
+#include <limits.h>
 #include <netinet/in.h>
 #include <arpa/inet.h>
 #include <unistd.h>
@@ -43,6 +47,7 @@
 #include "proto_drv.h"
 #include "proto_lg.h"
 #include "db.h"
+#include "capture.h"
 #include "logsrv_protocol.h"
 #include "mtlkerr.h"
 #include "argv_parser.h"
@@ -70,25 +75,79 @@
 #define IN_Q_RESIZE_STEP  4096
 
 // Note: outgoing data packets cannot be larger than OUT_Q_MAX_SIZE
+// Queue sizes are rounded up to a power of 2 by cqueue
 #define OUT_Q_SIZE        32768
-#define OUT_Q_MAX_SIZE    524800
+#define OUT_Q_MAX_SIZE    524288
 #define OUT_Q_RESIZE_STEP 65536
 
 #define PARSE_EVENT_Q_SIZE 32768
+// Must hold the largest driver packet
+#define RAW_FILTER_Q_SIZE  131072
+
+// Output of the events parsed from one driver read is gathered into
+// records of up to this size before being queued
+#define EVT_REC_FLUSH_SIZE  16384
+
+#define CAPTURE_SEGMENT_SIZE_DEFAULT (4096 * 1024)
+
+// Events taken from the kernel per epoll_wait() call
+#define EPOLL_MAX_EVENTS  64
+// Reads from the driver per loop pass, so clients are not starved
+#define DATASOURCE_MAX_READS 16
+// Reading period of a driver device that can't be polled
+#define DATASOURCE_POLL_MS   10
 
 #define LG_DEFAULT_PORT   2008
 
+// Commands to the SCD reload thread
+#define SCD_RELOAD_CMD_RELOAD 'r'
+#define SCD_RELOAD_CMD_STOP   's'
+
 // ---------------
 // Data structures
 // ---------------
 
+// What to do when a client doesn't read its output fast enough.
+// Clients may request their own with MSGID_REQ_CONFIG.
+typedef enum
+{
+  OVERFLOW_DROP_NEWEST = LG_OVERFLOW_DROP_NEWEST, // discard data that doesn't fit
+  OVERFLOW_DROP_OLDEST = LG_OVERFLOW_DROP_OLDEST, // discard queued data that wasn't sent yet
+  OVERFLOW_DISCONNECT  = LG_OVERFLOW_DISCONNECT   // close the connection
+} overflow_policy_t;
+
 typedef struct _con_data_t
 {
   int sock;
   struct sockaddr_in sockaddr;
 
   cqueue_t in_q;
-  cqueue_t out_q;
+  cqueue_t out_q;        /* raw data read from the driver */
+  shbuf_queue_t out_bufs; /* shared buffers, always sent before out_q */
+
+  /* Edge-triggered readiness: set by epoll events, cleared when the
+   * socket would block */
+  int readable;
+  int writable;
+  int failed;
+
+  /* Slow consumer accounting */
+  overflow_policy_t overflow_policy;
+  uint32 nof_dropped;     /* records dropped since connected */
+  uint32 dropped_bytes;
+  uint32 gap_dropped;     /* records dropped since the last overflow marker */
+  uint32 gap_bytes;
+  uint32 out_hwm;         /* output queue high-water mark, bytes */
+
+  /* Events requested by the client */
+  lg_filter_t filter;
+  shbuf_t *evt_rec;       /* pending records of the filtered events */
+
+  /* Event boundaries of the raw data in out_q: the header being
+   * collected or the data left of the current event */
+  mtlk_log_event_t raw_hdr;
+  uint32 raw_hdr_len;
+  uint32 raw_skip;
 
   struct _con_data_t *next;
 } con_data_t;
@@ -100,15 +159,30 @@ typedef struct _con_data_t
 static rtlog_app_info_t rtlog_info_data;
 #endif
 
+static int epoll_fd = -1;
+static int log_cdev_readable = 0;
+/* The device is in the epoll set, otherwise it's read periodically */
+static int log_cdev_polled = 0;
+
+/* epoll user data of the descriptors that are not connections */
+static char epoll_tag_mother;
+static char epoll_tag_cdev;
+
 // ----------------
 // Global variables
 // ----------------
 
 int parse_events = 0;
 cqueue_t parse_event_q;
+/* Raw driver data is read here instead of out_q while the client
+ * filters the events */
+cqueue_t raw_filter_q;
+/* Record shared by the connections taking every event */
+static shbuf_t *evt_rec = NULL;
 
 int log_to_console = 0;
 int log_to_syslog = 0;
+int log_to_capture = 0;
 int text_protocol = 0;
 
 char *syslog_id = IWLWAV_RTLOG_APP_NAME_LOGSERVER;
@@ -125,11 +199,29 @@ int log_cdev_error_state = 0;
 const char *scd_filename = NULL;
 
 volatile int terminated = 0;
+int scd_reload_pipe_fd[2] = { -1, -1 };
 int deadlock_ctr = 0;
 con_data_t *pcon_list = NULL;
 
 BOOL read_enabled = TRUE;
 
+static overflow_policy_t overflow_policy = OVERFLOW_DROP_NEWEST;
+
+static capture_cfg_t capture_cfg = {
+  NULL, CAPTURE_SEGMENT_SIZE_DEFAULT, 0, 0, LOGSRV_CAPTURE_CODEC_NONE
+};
+static const char *overflow_policy_names[] = {
+  "drop-newest",
+  "drop-oldest",
+  "disconnect"
+};
+/* Indexed by LOGSRV_CAPTURE_CODEC_... */
+static const char *capture_codec_names[] = {
+  "none",
+  "lz4",
+  "zstd"
+};
+
 /* ---------------------
    Forward declarations
   --------------------- */
@@ -138,6 +230,7 @@ static void update_datasource(void);
 static void close_datasource(void);
 static void con_close(con_data_t *pcon);
 static int send_enqueue(con_data_t *pcon, unsigned char *data, size_t len);
+static int send_enqueue_buf(con_data_t *pcon, shbuf_t *buf);
 
 // ---------------
 // Local functions
@@ -197,8 +290,11 @@ accept_connections(int mother_socket)
 
     pcon->sock = s;
     pcon->sockaddr = sockaddr;
+    pcon->overflow_policy = overflow_policy;
+    lg_filter_init(&pcon->filter);
     cqueue_init(&pcon->in_q);
     cqueue_init(&pcon->out_q);
+    shbuf_queue_init(&pcon->out_bufs);
     queues_initialized = 1;
     if (0 != cqueue_reset(&pcon->in_q, IN_Q_SIZE))
       goto end;
@@ -230,6 +326,12 @@ accept_connections(int mother_socket)
     //if (log_cdev_error_state)
     //  send_enqueue(pcon, "[CDEV_ERROR]", 13); // Notify of driver error state
 
+    if (0 != add_fd_to_epoll(epoll_fd, s, EPOLLIN | EPOLLOUT | EPOLLET, pcon))
+      goto end;
+    /* Input may already be pending, and a new socket is writable */
+    pcon->readable = 1;
+    pcon->writable = 1;
+
     LOGSRV_LIST_PUSH_FRONT(pcon_list, pcon, next);
     /* Reset variables so they aren't freed if error occurs on next iteration: */
     s = 0;
@@ -251,6 +353,7 @@ end:
       if (queues_initialized) {
         cqueue_cleanup(&pcon->in_q);
         cqueue_cleanup(&pcon->out_q);
+        shbuf_queue_cleanup(&pcon->out_bufs);
       }
       free(pcon);
     }
@@ -263,10 +366,25 @@ con_close(con_data_t *pcon)
 {
   LOGSRV_LIST_REMOVE(pcon_list, pcon, con_data_t, next);
 
+  if (pcon->nof_dropped) {
+    WLOG_SDDD("Closing [%s]: %u record(s), %u byte(s) dropped, "
+        "output queue high-water mark %u byte(s)",
+        inet_ntoa(pcon->sockaddr.sin_addr), pcon->nof_dropped,
+        pcon->dropped_bytes, pcon->out_hwm);
+  }
+
+  remove_fd_from_epoll(epoll_fd, pcon->sock);
   close(pcon->sock);
 
   cqueue_cleanup(&pcon->in_q);
   cqueue_cleanup(&pcon->out_q);
+  shbuf_queue_cleanup(&pcon->out_bufs);
+  if (pcon->evt_rec)
+    shbuf_put(pcon->evt_rec);
+
+  /* Raw data being filtered belongs to the closed connection */
+  if (!parse_events)
+    cqueue_reset(&raw_filter_q, RAW_FILTER_Q_SIZE);
 
   free(pcon);
 }
@@ -279,7 +397,7 @@ process_user_commands(con_data_t *pcon)
 
   for (;;) {
     ILOG9_V("Calling lg_process_next_pkt");
-    ret = lg_process_next_pkt(&pcon->in_q);
+    ret = lg_process_next_pkt(&pcon->in_q, &pcon->filter);
     if (ret == -1) {
       ELOG_S("Unable to process a data packet from [%s]. Closing connection",
         inet_ntoa(pcon->sockaddr.sin_addr));
@@ -290,6 +408,10 @@ process_user_commands(con_data_t *pcon)
     ILOG9_D("Packet processed (%d)", ret);
   }
 
+  /* The client may have requested its own slow client policy */
+  pcon->overflow_policy = (pcon->filter.overflow_policy == LG_OVERFLOW_DEFAULT) ?
+      overflow_policy : (overflow_policy_t)pcon->filter.overflow_policy;
+
   // No packets recognized and no more space left in input queue
   if (cqueue_full(&pcon->in_q)) {
     ELOG_DS("Packet too long (%d byte(s) and still not recognized by "
@@ -314,9 +436,11 @@ process_input(con_data_t *pcon)
         inet_ntoa(pcon->sockaddr.sin_addr));
       return -1;
     } else if (ret == -1) {
-      if (errno == EINTR || // Interrupted by a system call
-          errno == EAGAIN || // Socket write would block
+      if (errno == EAGAIN || // Socket read would block
           errno == EWOULDBLOCK) {
+        pcon->readable = 0;
+        break;
+      } else if (errno == EINTR) { // Interrupted by a system call
         return 0;
       } else if (errno == ECONNRESET) {
         ILOG0_S("Connection reset [%s]",
@@ -328,8 +452,11 @@ process_input(con_data_t *pcon)
       return -1;
     }
 
-    if (cqueue_space_left(&pcon->in_q) > 0)
+    if (cqueue_space_left(&pcon->in_q) > 0) {
+      // Short read: the socket is drained
+      pcon->readable = 0;
       break;
+    }
 
     // Queue overflow: increase queue size and try to read more data
     sz = cqueue_max_size(&pcon->in_q);
@@ -356,23 +483,64 @@ process_input(con_data_t *pcon)
   return 0;
 }
 
+static int
+con_output_pending(con_data_t *pcon)
+{
+  return !shbuf_queue_empty(&pcon->out_bufs) || !cqueue_empty(&pcon->out_q);
+}
+
+static size_t
+con_output_size(con_data_t *pcon)
+{
+  return shbuf_queue_size(&pcon->out_bufs) + cqueue_size(&pcon->out_q);
+}
+
+static void
+con_update_hwm(con_data_t *pcon)
+{
+  size_t sz = con_output_size(pcon);
+
+  if (sz > pcon->out_hwm)
+    pcon->out_hwm = (uint32)sz;
+}
+
+static void
+close_failed_connections(void)
+{
+  con_data_t *pcon;
+  con_data_t *pcon_next;
+
+  for (pcon = pcon_list; pcon; pcon = pcon_next) {
+    pcon_next = pcon->next;
+
+    if (pcon->failed)
+      con_close(pcon);
+  }
+}
+
 static int
 process_output(con_data_t *pcon)
 {
   ssize_t ret;
 
-  ASSERT(!cqueue_empty(&pcon->out_q));
+  ASSERT(con_output_pending(pcon));
 
   for (;;) {
-    ret = cqueue_write(&pcon->out_q, pcon->sock);
+    /* Shared buffers carry the version info that must precede raw data */
+    if (!shbuf_queue_empty(&pcon->out_bufs))
+      ret = shbuf_queue_write(&pcon->out_bufs, pcon->sock);
+    else
+      ret = cqueue_write(&pcon->out_q, pcon->sock);
     if (ret == 0) {
       ILOG0_S("Connection closed by remote side [%s]",
         inet_ntoa(pcon->sockaddr.sin_addr));
       return -1;
     } else if (ret == -1) {
-      if (errno == EINTR || // Interrupted by a system call
-          errno == EAGAIN || // Socket write would block
+      if (errno == EAGAIN || // Socket write would block
           errno == EWOULDBLOCK) {
+        pcon->writable = 0;
+        return 0;
+      } else if (errno == EINTR) { // Interrupted by a system call
         return 0;
       } else if (errno == ECONNRESET) {
         ILOG0_S("Connection reset [%s]",
@@ -384,48 +552,227 @@ process_output(con_data_t *pcon)
       return -1;
     }
 
-    if (cqueue_empty(&pcon->out_q))
+    if (!con_output_pending(pcon))
       break;
   }
   return 0;
 }
 
+/* Appends a parsed event to the record: its text with the text protocol,
+ * the event as read from the driver otherwise */
+static int
+evt_rec_append(shbuf_t **prec, const mtlk_log_event_t *log_evt, const char *msg,
+               const unsigned char *pkt, uint32 pktlen)
+{
+  if (!*prec) {
+    *prec = shbuf_alloc(0);
+    if (!*prec)
+      return -1;
+  }
+
+  if (!text_protocol)
+    return shbuf_append(prec, pkt, pktlen);
+
+  return shbuf_printf(prec,
+      "! Log Event: TS=%lu, OID=%u, GID=%u, FID=%u, LID=%u, datalen=%u\r\n"
+      "    %s\r\n",
+      (unsigned long)log_evt->timestamp,
+      LOG_INFO_GET_OID(*log_evt), LOG_INFO_GET_GID(*log_evt),
+      LOG_INFO_GET_FID(*log_evt), LOG_INFO_GET_LID(*log_evt),
+      LOG_INFO_GET_DSIZE(*log_evt), msg);
+}
+
+static void
+con_flush_evts(con_data_t *pcon)
+{
+  if (!pcon->evt_rec)
+    return;
+
+  send_enqueue_buf(pcon, pcon->evt_rec);
+  shbuf_put(pcon->evt_rec);
+  pcon->evt_rec = NULL;
+}
+
+/* The connections taking every event share a single record queued to
+ * each of them by reference, so the data is never copied per connection.
+ * Filtered connections get records of their own. Records hold whole
+ * events, so the binary stream stays parseable when one is dropped. */
+int
+send_event(const mtlk_log_event_t *log_evt, const char *msg,
+           const unsigned char *pkt, uint32 pktlen)
+{
+  con_data_t *pcon;
+  int shared = 0;
+
+  for (pcon = pcon_list; pcon; pcon = pcon->next) {
+    if (pcon->failed)
+      continue;
+    if (lg_filter_pass_all(&pcon->filter)) {
+      shared = 1;
+      continue;
+    }
+    if (!lg_filter_match(&pcon->filter, log_evt))
+      continue;
+    if (0 != evt_rec_append(&pcon->evt_rec, log_evt, msg, pkt, pktlen))
+      return -1;
+    if (pcon->evt_rec->len >= EVT_REC_FLUSH_SIZE)
+      con_flush_evts(pcon);
+  }
+
+  if (shared) {
+    if (0 != evt_rec_append(&evt_rec, log_evt, msg, pkt, pktlen))
+      return -1;
+    if (evt_rec->len >= EVT_REC_FLUSH_SIZE)
+      send_event_flush();
+  }
+
+  return 0;
+}
+
 void
-send_to_all(char *data, size_t len)
+send_event_flush(void)
 {
   con_data_t *pcon;
+
   for (pcon = pcon_list; pcon; pcon = pcon->next) {
-    send_enqueue(pcon, (unsigned char*)data, len);
+    if (pcon->failed)
+      continue;
+    if (evt_rec && lg_filter_pass_all(&pcon->filter))
+      send_enqueue_buf(pcon, evt_rec);
+    con_flush_evts(pcon);
+  }
+
+  if (evt_rec) {
+    shbuf_put(evt_rec);
+    evt_rec = NULL;
+  }
+}
+
+/* In-band record telling the client where data is missing. Only the text
+ * protocol has one, the binary stream has no framing for it. */
+static shbuf_t *
+overflow_marker(con_data_t *pcon)
+{
+  shbuf_t *marker;
+
+  if (!text_protocol)
+    return NULL;
+
+  marker = shbuf_alloc(0);
+  if (!marker)
+    return NULL;
+
+  if (0 != shbuf_printf(&marker,
+        "! Log Overflow: %u record(s), %u byte(s) dropped (total %u)\r\n",
+        pcon->gap_dropped, pcon->gap_bytes, pcon->nof_dropped)) {
+    shbuf_put(marker);
+    return NULL;
+  }
+
+  return marker;
+}
+
+static void
+con_count_drop(con_data_t *pcon, uint32 records, size_t bytes)
+{
+  if (!pcon->gap_dropped) {
+    ELOG_SS("Output queue overflow [%s], policy %s",
+        inet_ntoa(pcon->sockaddr.sin_addr),
+        overflow_policy_names[pcon->overflow_policy]);
   }
+
+  pcon->nof_dropped   += records;
+  pcon->dropped_bytes += (uint32)bytes;
+  pcon->gap_dropped   += records;
+  pcon->gap_bytes     += (uint32)bytes;
 }
 
+// 0 - the buffer is queued, 1 - it was dropped
 static int
-send_enqueue(con_data_t *pcon, unsigned char *data, size_t len)
+send_enqueue_buf(con_data_t *pcon, shbuf_t *buf)
 {
-  int space_left = cqueue_space_left(&pcon->out_q);
+  shbuf_t *marker = NULL;
+  size_t need = buf->len;
+  size_t dropped;
+  int nof_dropped;
+  int res = 1;
+
+  /* The marker of the previous gap goes in front of the new data */
+  if (pcon->gap_dropped) {
+    marker = overflow_marker(pcon);
+    if (marker)
+      need += marker->len;
+  }
 
-  if (space_left < len) {
-    int need_space = len - space_left;
-    int q_size = cqueue_max_size(&pcon->out_q);
-    if (q_size + need_space > OUT_Q_MAX_SIZE) {
-      ELOG_S("Output queue overflow [%s]",
+  if (con_output_size(pcon) + need > OUT_Q_MAX_SIZE) {
+    switch (pcon->overflow_policy) {
+    case OVERFLOW_DISCONNECT:
+      ELOG_S("Output queue overflow [%s], disconnecting",
           inet_ntoa(pcon->sockaddr.sin_addr));
-      //cqueue_reset(&pcon->out_q, cqueue_max_size(&pcon->out_q));
-      //TODO: report overflow
-      return 1;
+      pcon->failed = 1;
+      goto end;
+    case OVERFLOW_DROP_OLDEST:
+      /* The marker is rebuilt with the new counts, it has to fit along
+       * with the data */
+      do {
+        nof_dropped = shbuf_queue_drop_oldest(&pcon->out_bufs,
+            con_output_size(pcon) + need - OUT_Q_MAX_SIZE, &dropped);
+        if (nof_dropped)
+          con_count_drop(pcon, nof_dropped, dropped);
+        if (marker)
+          shbuf_put(marker);
+        marker = pcon->gap_dropped ? overflow_marker(pcon) : NULL;
+        need = buf->len + (marker ? marker->len : 0);
+      } while (nof_dropped && con_output_size(pcon) + need > OUT_Q_MAX_SIZE);
+      if (con_output_size(pcon) + need <= OUT_Q_MAX_SIZE)
+        break;
+      /* Not enough queued data to drop: fall through */
+    case OVERFLOW_DROP_NEWEST:
+    default:
+      con_count_drop(pcon, 1, buf->len);
+      goto end;
     }
-    if (need_space < OUT_Q_RESIZE_STEP)
-      need_space = OUT_Q_RESIZE_STEP;
-    if (0 != cqueue_reserve(&pcon->out_q, q_size + need_space)) {
-      return 1;
+    /* Oldest data dropped: the gap is right in front of the queue */
+    if (marker) {
+      if (0 != shbuf_queue_push_next(&pcon->out_bufs, marker))
+        goto end;
+      shbuf_put(marker);
+      marker = NULL;
     }
   }
 
-  ASSERT(cqueue_space_left(&pcon->out_q) >= len);
+  if (marker && 0 != shbuf_queue_push_back(&pcon->out_bufs, marker))
+    goto end;
 
-  cqueue_push_back(&pcon->out_q, data, len);
+  if (0 != shbuf_queue_push_back(&pcon->out_bufs, buf))
+    goto end;
 
-  return 0;
+  pcon->gap_dropped = 0;
+  pcon->gap_bytes   = 0;
+  con_update_hwm(pcon);
+  res = 0;
+
+end:
+  if (marker)
+    shbuf_put(marker);
+  return res;
+}
+
+static int
+send_enqueue(con_data_t *pcon, unsigned char *data, size_t len)
+{
+  int res = 1;
+  shbuf_t *buf = shbuf_alloc(len);
+
+  if (!buf)
+    return res;
+
+  if (0 == shbuf_append(&buf, data, len))
+    res = send_enqueue_buf(pcon, buf);
+
+  shbuf_put(buf);
+
+  return res;
 }
 
 static int
@@ -445,6 +792,9 @@ process_drv_packets(cqueue_t *pq)
     ILOG9_D("Packet processed (%d)", ret);
   }
 
+  /* Records of all the events parsed above */
+  send_event_flush();
+
   // No packets recognized and no more space left in queue
   if (cqueue_full(pq)) {
     ELOG_D("Packet too long (%d byte(s) and still not recognized by "
@@ -455,103 +805,295 @@ process_drv_packets(cqueue_t *pq)
   return 0;
 }
 
+/* Follows the event boundaries in the raw data queued to out_q from
+ * position 'from' on */
 static void
-main_loop(int mother_socket)
+raw_track_events(con_data_t *pcon, uint32 from)
 {
-  int max_fd;
-  fd_set input_set;
-  fd_set output_set;
-  fd_set exc_set;
-  con_data_t *pcon;
-  con_data_t *pcon_next;
-  int ret;
+  uint32 pos = from;
+  uint32 tail = pcon->out_q.tail;
+  uint32 n;
+
+  while (pos != tail) {
+    if (pcon->raw_skip) {
+      n = MIN(pcon->raw_skip, tail - pos);
+      pcon->raw_skip -= n;
+    } else {
+      n = MIN(sizeof(mtlk_log_event_t) - pcon->raw_hdr_len, tail - pos);
+      cqueue_get(&pcon->out_q, pos - pcon->out_q.head, n,
+                 (unsigned char *) &pcon->raw_hdr + pcon->raw_hdr_len);
+      pcon->raw_hdr_len += n;
+      if (pcon->raw_hdr_len == sizeof(mtlk_log_event_t)) {
+        pcon->raw_skip = LOG_INFO_GET_DSIZE(pcon->raw_hdr);
+        pcon->raw_hdr_len = 0;
+      }
+    }
+    pos += n;
+  }
+}
 
-  while (!terminated) {
+static int
+raw_at_event_start(con_data_t *pcon)
+{
+  return !pcon->raw_skip && !pcon->raw_hdr_len;
+}
 
-    /*
-     * If no connections, sleep infinitely until a connection or
-     * a signal arrives
-     */
-    if (!pcon_list && !parse_events) {
-      ILOG0_V("No connections - going to sleep");
+/* Moves len bytes from raw_filter_q to out_q */
+static int
+raw_forward(con_data_t *pcon, uint32 len)
+{
+  unsigned char bounce[4096];
+  const unsigned char *data;
+  uint32 from = pcon->out_q.tail;
+  uint32 n;
+
+  if (cqueue_space_left(&pcon->out_q) < len) {
+    uint32 new_sz = MIN(cqueue_size(&pcon->out_q) + len, OUT_Q_MAX_SIZE);
+    if (0 != cqueue_reserve(&pcon->out_q, new_sz) ||
+        cqueue_space_left(&pcon->out_q) < len)
+      return -1;
+  }
 
-      close_datasource();
+  while (len) {
+    n = MIN(len, sizeof(bounce));
+    data = cqueue_peek(&raw_filter_q, 0, n, bounce);
+    cqueue_push_back(&pcon->out_q, (unsigned char *) data, n);
+    cqueue_pop_front(&raw_filter_q, n);
+    len -= n;
+  }
+  raw_track_events(pcon, from);
+  con_update_hwm(pcon);
 
-      FD_ZERO(&input_set);
-      FD_SET(mother_socket, &input_set);
-      if (select(mother_socket + 1, &input_set, NULL, NULL, NULL) < 0) {
-        if (errno == EINTR) {
-          ILOG0_V("Waking up to process signal");
-        } else {
-          ILOG1_S("select: %s", strerror(errno));
-        }
-      } else {
-        ILOG0_V("New connection - waking up");
-      }
+  return 0;
+}
 
-      if (terminated)
-        break;
+/* Passes the requested events from raw_filter_q to out_q */
+static void
+raw_filter_events(con_data_t *pcon)
+{
+  mtlk_log_event_t log_evt;
+  uint32 pktlen;
+
+  /* The event the filter has been switched on in the middle of */
+  while (!raw_at_event_start(pcon) && !cqueue_empty(&raw_filter_q)) {
+    uint32 len = pcon->raw_skip ? pcon->raw_skip :
+                 sizeof(mtlk_log_event_t) - pcon->raw_hdr_len;
+    if (0 != raw_forward(pcon, MIN(len, cqueue_size(&raw_filter_q)))) {
+      ELOG_S("Output queue overflow [%s], disconnecting",
+             inet_ntoa(pcon->sockaddr.sin_addr));
+      pcon->failed = 1;
+      return;
     }
+  }
 
-    /*
-     * Poll for new connections, new input and exceptions
-     */
-    FD_ZERO(&input_set);
-    FD_ZERO(&output_set);
-    FD_ZERO(&exc_set);
-
-    FD_SET(mother_socket, &input_set);
-    max_fd = mother_socket;
-    for (pcon = pcon_list; pcon; pcon = pcon->next) {
-      if (pcon->sock > max_fd)
-        max_fd = pcon->sock;
-
-      if (!cqueue_full(&pcon->in_q)) {
-        FD_SET(pcon->sock, &input_set);
-      }
+  while (cqueue_size(&raw_filter_q) >= sizeof(log_evt)) {
+    if (lg_filter_pass_all(&pcon->filter))
+      break;
+
+    cqueue_get(&raw_filter_q, 0, sizeof(log_evt), (unsigned char *) &log_evt);
+    pktlen = sizeof(log_evt) + LOG_INFO_GET_DSIZE(log_evt);
+    if (cqueue_size(&raw_filter_q) < pktlen)
+      break;
+
+    if (!lg_filter_match(&pcon->filter, &log_evt)) {
+      cqueue_pop_front(&raw_filter_q, pktlen);
+      continue;
+    }
 
-      if (!cqueue_empty(&pcon->out_q)) {
-        FD_SET(pcon->sock, &output_set);
+    /* Whole events are dropped, so the stream stays parseable */
+    if (0 != raw_forward(pcon, pktlen)) {
+      if (pcon->overflow_policy == OVERFLOW_DISCONNECT) {
+        ELOG_S("Output queue overflow [%s], disconnecting",
+               inet_ntoa(pcon->sockaddr.sin_addr));
+        pcon->failed = 1;
+        return;
       }
+      con_count_drop(pcon, 1, pktlen);
+      cqueue_pop_front(&raw_filter_q, pktlen);
+    }
+  }
 
-      FD_SET(pcon->sock, &exc_set);
+  /* No filter anymore: the rest goes to out_q directly from now on */
+  if (lg_filter_pass_all(&pcon->filter) && !cqueue_empty(&raw_filter_q)) {
+    if (0 != raw_forward(pcon, cqueue_size(&raw_filter_q))) {
+      ELOG_S("Output queue overflow [%s], disconnecting",
+             inet_ntoa(pcon->sockaddr.sin_addr));
+      pcon->failed = 1;
     }
+  }
+}
 
-    if (log_cdev) {
-      if (parse_events && (log_to_console || log_to_syslog || pcon_list)) {
-        if (!cqueue_full(&parse_event_q)) {
-          FD_SET(log_cdev->fd, &input_set);
-          if (log_cdev->fd > max_fd)
-            max_fd = log_cdev->fd;
-        }
-      } else {
-        if (pcon_list && !cqueue_full(&pcon_list->out_q)) {
-          FD_SET(log_cdev->fd, &input_set);
-          if (log_cdev->fd > max_fd)
-            max_fd = log_cdev->fd;
-        }
+/* Queue the driver data is read to, NULL if it can't be taken now */
+static cqueue_t *
+datasource_queue(void)
+{
+  if (!log_cdev)
+    return NULL;
+
+  if (parse_events) {
+    if (!(log_to_console || log_to_syslog || log_to_capture || pcon_list) ||
+        cqueue_full(&parse_event_q))
+      return NULL;
+    return &parse_event_q;
+  }
+
+  if (!pcon_list)
+    return NULL;
+
+  if (!lg_filter_pass_all(&pcon_list->filter) || !cqueue_empty(&raw_filter_q))
+    return cqueue_full(&raw_filter_q) ? NULL : &raw_filter_q;
+
+  if (read_enabled == FALSE) {
+    if (!cqueue_empty(&pcon_list->out_q))
+      return NULL;
+    read_enabled = TRUE;
+  }
+
+  return cqueue_full(&pcon_list->out_q) ? NULL : &pcon_list->out_q;
+}
+
+static void
+process_datasource(void)
+{
+  cqueue_t *pq;
+  con_data_t *pcon;
+  uint32 from;
+  int nof_reads = 0;
+  int ret;
+
+  while (log_cdev_readable && nof_reads < DATASOURCE_MAX_READS) {
+    pq = datasource_queue();
+    if (!pq)
+      break;
+
+    from = pq->tail;
+    ret = cdev_read_to_q(pq, log_cdev);
+    if (ret == -1 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+      log_cdev_readable = 0;
+      break;
+    }
+    /* Nothing left in a device that can't be polled, until next period */
+    if (ret == 0 && !log_cdev_polled) {
+      log_cdev_readable = 0;
+      break;
+    }
+    if (ret == -1 && errno == EINTR)
+      break;
+    ++nof_reads;
+
+    if (parse_events) {
+      if (ret <= 0) {
+        ELOG_S("While queuing log data for console: %s", strerror(errno));
+        log_cdev_error_state = 1;
+        close_datasource();
+        break;
+      }
+      if (0 != process_drv_packets(pq)) {
+        log_cdev_error_state = 1;
+        close_datasource();
       }
+      continue;
     }
 
-    if (read_enabled == FALSE)
-    {
-      if (log_cdev && pcon_list)
-      {
-        if (cqueue_empty(&pcon_list->out_q))
-        {
-          read_enabled = TRUE;
+    // Read directly to out_q unless filtered
+    pcon = pcon_list;
+    if (ret <= 0) {
+      ELOG_S("While queuing log data for [%s]",
+        inet_ntoa(pcon->sockaddr.sin_addr));
+      log_cdev_error_state = 1;
+      close_datasource();
+      continue;
+    }
+    if (pq == &raw_filter_q) {
+      raw_filter_events(pcon);
+      if (pcon->failed)
+        break;
+      continue;
+    }
+    raw_track_events(pcon, from);
+    if (cqueue_full(&pcon->out_q)) {
+      // Next time try with larger buffer
+      int cur_sz = cqueue_max_size(&pcon->out_q);
+      int new_sz = cur_sz + OUT_Q_RESIZE_STEP;
+      new_sz = MIN(new_sz, OUT_Q_MAX_SIZE);
+      con_update_hwm(pcon);
+      if (new_sz == cur_sz) {
+        if (pcon->overflow_policy == OVERFLOW_DISCONNECT) {
+          ELOG_S("Output queue overflow [%s], disconnecting",
+                 inet_ntoa(pcon->sockaddr.sin_addr));
+          pcon->failed = 1;
+          break;
         }
-        else
-        {
-          FD_ZERO(&input_set);
+        /* The raw stream can't be cut, so the driver data is dropped */
+        ELOG_DS("Internal buffer is FULL. Skip next %d bytes for [%s]",
+                cur_sz,
+                inet_ntoa(pcon->sockaddr.sin_addr));
+        read_enabled = FALSE;
+      }
+      if (read_enabled)
+      {
+        if (0 != cqueue_reserve(&pcon->out_q, new_sz)) {
+          ELOG_V("Out of memory");
         }
       }
     }
+  }
+}
+
+/* Something is known to be ready and can be processed without waiting */
+static int
+work_pending(void)
+{
+  con_data_t *pcon;
+
+  if (log_cdev_readable && datasource_queue())
+    return 1;
 
-    ILOG9_V("SELECT: calling");
-    ret = select(max_fd + 1, &input_set, &output_set, &exc_set, NULL);
+  for (pcon = pcon_list; pcon; pcon = pcon->next) {
+    if (pcon->readable && !cqueue_full(&pcon->in_q))
+      return 1;
+    if (pcon->writable && con_output_pending(pcon))
+      return 1;
+  }
+
+  return 0;
+}
+
+static void
+main_loop(int mother_socket)
+{
+  struct epoll_event events[EPOLL_MAX_EVENTS];
+  con_data_t *pcon;
+  con_data_t *pcon_next;
+  int accept_pending;
+  int timeout;
+  int ret;
+  int i;
+
+  while (!terminated) {
+
+    /*
+     * If no connections, only the mother socket is left in the epoll set
+     * and we sleep infinitely until a connection or a signal arrives
+     */
+    if (!pcon_list && !parse_events) {
+      ILOG0_V("No connections - going to sleep");
+      close_datasource();
+    }
+
+    /*
+     * Readiness is reported once per edge: don't block while
+     * descriptors known to be ready are waiting for queue space
+     */
+    timeout = work_pending() ? 0 : capture_timeout();
+    if (log_cdev && !log_cdev_polled &&
+        (timeout < 0 || timeout > DATASOURCE_POLL_MS))
+      timeout = DATASOURCE_POLL_MS;
+
+    ILOG9_D("EPOLL: calling (timeout %d)", timeout);
+    ret = epoll_wait(epoll_fd, events, ARRAY_SIZE(events), timeout);
     if (ret < 0) {
-      ILOG1_DS("select (%d): %s", errno, strerror(errno));
+      ILOG1_DS("epoll_wait (%d): %s", errno, strerror(errno));
       if (errno == EINTR) {
         /* Signal caught, this doesn't necessarily means termination */
         continue;
@@ -560,12 +1102,45 @@ main_loop(int mother_socket)
         continue;
       }
     }
-    ILOG9_D("SELECT: back from select (%d)", ret);
+    ILOG9_D("EPOLL: back from epoll_wait (%d)", ret);
+
+    /* A device that can't be polled is read every pass */
+    if (log_cdev && !log_cdev_polled)
+      log_cdev_readable = 1;
+
+    /*
+     * Record readiness. Nothing is closed here, so connections referred
+     * to by the events stay valid for the whole batch.
+     */
+    accept_pending = 0;
+    for (i = 0; i < ret; i++) {
+      void *ptr = events[i].data.ptr;
+      uint32 ev = events[i].events;
+
+      if (ptr == &epoll_tag_mother) {
+        accept_pending = 1;
+      } else if (ptr == &epoll_tag_cdev) {
+        log_cdev_readable = 1;
+      } else {
+        pcon = (con_data_t *) ptr;
+        if (ev & (EPOLLERR | EPOLLHUP))
+          pcon->failed = 1;
+        if (ev & EPOLLIN)
+          pcon->readable = 1;
+        if (ev & EPOLLOUT)
+          pcon->writable = 1;
+      }
+    }
+
+    /*
+     * Close sockets in error state
+     */
+    close_failed_connections();
 
     /*
      * Accept new connections
      */
-    if (FD_ISSET(mother_socket, &input_set)) {
+    if (accept_pending) {
       if (0 != accept_connections(mother_socket)) {
         ELOG_V("While accepting a new connection");
         terminated = 1;
@@ -576,66 +1151,17 @@ main_loop(int mother_socket)
     /*
      * Get new data from driver
      */
-    if (log_cdev && FD_ISSET(log_cdev->fd, &input_set)) {
-      if (parse_events) {
-        ASSERT(!cqueue_full(&parse_event_q));
-        ASSERT(log_cdev != NULL);
-        //int old_sz = cqueue_size(parse_event_q);
-        if (0 >= cdev_read_to_q(&parse_event_q, log_cdev)) {
-            ELOG_S("While queuing log data for console: %s", strerror(errno));
-            log_cdev_error_state = 1;
-            close_datasource();
-        }
-        // TODO: copy data to out_q
-        if (0 != process_drv_packets(&parse_event_q)) {
-          log_cdev_error_state = 1;
-          close_datasource();
-        }
-      } else {
-        // Read directly to out_q
-        if (pcon_list) {
-          pcon = pcon_list;
-          ASSERT(!cqueue_full(&pcon->out_q));
-          ASSERT(log_cdev != NULL);
-          if (0 >= cdev_read_to_q(&pcon->out_q, log_cdev)) {
-            ELOG_S("While queuing log data for [%s]",
-              inet_ntoa(pcon->sockaddr.sin_addr));
-            log_cdev_error_state = 1;
-            close_datasource();
-          } else if (cqueue_full(&pcon->out_q)) {
-            // Next time try with larger buffer
-            int cur_sz = cqueue_max_size(&pcon->out_q);
-            int new_sz = cur_sz + OUT_Q_RESIZE_STEP;
-            new_sz = MIN(new_sz, OUT_Q_MAX_SIZE);
-            if (new_sz == cur_sz) {
-              ELOG_DS("Internal buffer is FULL. Skip next %d bytes for [%s]",
-                      cur_sz,
-                      inet_ntoa(pcon->sockaddr.sin_addr));
-              read_enabled = FALSE;
-            }
-            if (read_enabled)
-            {
-              if (0 != cqueue_reserve(&pcon->out_q, new_sz)) {
-                ELOG_V("Out of memory");
-              }
-            }
-          }
-        }
-      }
-    }
+    process_datasource();
 
     /*
-     * Close sockets in exception state
+     * Write the captured events gathered for too long
      */
-    for (pcon = pcon_list; pcon; pcon = pcon_next) {
-      pcon_next = pcon->next;
+    capture_tick();
 
-      if (FD_ISSET(pcon->sock, &exc_set)) {
-        FD_CLR(pcon->sock, &input_set);
-        FD_CLR(pcon->sock, &output_set);
-        con_close(pcon);
-      }
-    }
+    /*
+     * Close slow consumers disconnected by the overflow policy
+     */
+    close_failed_connections();
 
     /*
      * Process input
@@ -643,7 +1169,7 @@ main_loop(int mother_socket)
     for (pcon = pcon_list; pcon; pcon = pcon_next) {
       pcon_next = pcon->next;
 
-      if (FD_ISSET(pcon->sock, &input_set)) {
+      if (pcon->readable && !cqueue_full(&pcon->in_q)) {
         if (0 != process_input(pcon))
           con_close(pcon);
       }
@@ -655,7 +1181,7 @@ main_loop(int mother_socket)
     for (pcon = pcon_list; pcon; pcon = pcon_next) {
       pcon_next = pcon->next;
 
-      if (FD_ISSET(pcon->sock, &output_set)) {
+      if (pcon->writable && con_output_pending(pcon)) {
         if (0 != process_output(pcon))
           con_close(pcon);
       }
@@ -687,6 +1213,24 @@ update_datasource(void)
                 ver_major, ver_minor, RTLOGGER_VER_MAJOR, RTLOGGER_VER_MINOR);
       }
     }
+
+    if (log_cdev) {
+      if (0 == add_fd_to_epoll(epoll_fd, log_cdev->fd, EPOLLIN | EPOLLET,
+                               &epoll_tag_cdev)) {
+        log_cdev_polled = 1;
+        log_cdev_readable = 1;
+      } else if (errno == EPERM) {
+        /* The driver has no poll(): read it until it has no more data,
+         * then again after a while */
+        WLOG_SD("%s can't be polled, reading it every %d ms",
+                log_cdev_name, DATASOURCE_POLL_MS);
+        log_cdev_polled = 0;
+        log_cdev_readable = 1;
+      } else {
+        log_cdev_error_state = 1;
+        close_datasource();
+      }
+    }
   }
 }
 
@@ -694,9 +1238,27 @@ static void
 close_datasource(void)
 {
   if (log_cdev) {
+    if (log_cdev_polled)
+      remove_fd_from_epoll(epoll_fd, log_cdev->fd);
     cdev_close(log_cdev);
     log_cdev = NULL;
   }
+  log_cdev_polled = 0;
+  log_cdev_readable = 0;
+}
+
+/* Compiled SCD files are mapped rather than parsed. They must be
+ * replaced by renaming a new file over, not rewritten in place. */
+static int
+scd_load_bin(void)
+{
+  struct scd_db *db = scd_db_open_bin(scd_filename);
+
+  if (!db)
+    return -1;
+
+  db_scd_publish(db);
+  return 0;
 }
 
 static int
@@ -712,6 +1274,10 @@ scd_load(void)
   int oid, gid, fid, lid;
   int eof = 0;
   char *p;
+  struct scd_db *db = NULL;
+
+  if (scdbin_is_binary(scd_filename))
+    return scd_load_bin();
 
   fl = fopen(scd_filename, "rb");
   if (!fl) {
@@ -724,9 +1290,16 @@ scd_load(void)
   buf = (char *) malloc(MAX_SCD_LINE_SIZE);
   if (!buf) {
     ELOG_V("Out of memory");
+    rslt = -1;
     goto cleanup;
   }
 
+  /* Loaded into a new snapshot, the current one stays in use meanwhile */
+  db = scd_db_create();
+  if (!db) {
+    rslt = -1;
+    goto cleanup;
+  }
 
   for (;;) {
     retval = get_line(scd_filename, buf, MAX_SCD_LINE_SIZE, fl, 1, &eof);
@@ -787,14 +1360,13 @@ scd_load(void)
     }
     lid = atoi(id_buf);
 
-    skip_spcrlf(&p);
-    if (0 != str_decode(p)) {
+    if (0 != logfmt_decode(p)) {
       ELOG_S("%s: syntax error", scd_filename);
       rslt = -1;
       goto cleanup;
     }
 
-    if (0 != db_register_scd_entry(oid, gid, fid, lid, p)) {
+    if (0 != scd_db_add(db, oid, gid, fid, lid, p)) {
       rslt = -1;
       goto cleanup;
     }
@@ -814,12 +1386,29 @@ cleanup:
     free(buf);
   }
 
+  if (db) {
+    if (rslt == 0)
+      db_scd_publish(db);
+    else
+      scd_db_free(db);
+  }
+
   return rslt;
 }
 
 static void
 on_sighup(int sig)
 {
+  char cmd = SCD_RELOAD_CMD_RELOAD;
+
+  if (scd_reload_pipe_fd[1] >= 0) {
+    ILOG0_V("Received SIGHUP: reloading SCD file");
+    if (write(scd_reload_pipe_fd[1], &cmd, 1) != 1) {
+      ELOG_V("Failed to signal the SCD reload thread");
+    }
+    return;
+  }
+
   ILOG0_V("Received SIGHUP: shutting down");
   terminated = 1;
 }
@@ -987,7 +1576,67 @@ static const struct mtlk_argv_param_info_ex param_scd_fname = {
     "scd-fname",
     MTLK_ARGV_PINFO_FLAG_HAS_STR_DATA
   },
-  "string configuration data file",
+  "string configuration data file (text or compiled by logcnv -c), reloaded on SIGHUP or when changed",
+  MTLK_ARGV_PTYPE_OPTIONAL
+};
+
+static const struct mtlk_argv_param_info_ex param_overflow_policy = {
+  {
+    "q",
+    "overflow-policy",
+    MTLK_ARGV_PINFO_FLAG_HAS_STR_DATA
+  },
+  "default slow client policy: drop-newest (default), drop-oldest or disconnect",
+  MTLK_ARGV_PTYPE_OPTIONAL
+};
+
+static const struct mtlk_argv_param_info_ex param_capture = {
+  {
+    "w",
+    "capture",
+    MTLK_ARGV_PINFO_FLAG_HAS_STR_DATA
+  },
+  "capture the events to segment files with this name prefix",
+  MTLK_ARGV_PTYPE_OPTIONAL
+};
+
+static const struct mtlk_argv_param_info_ex param_capture_size = {
+  {
+    NULL,
+    "capture-size",
+    MTLK_ARGV_PINFO_FLAG_HAS_INT_DATA
+  },
+  "capture segment size limit in KB (default 4096, 0 - unlimited)",
+  MTLK_ARGV_PTYPE_OPTIONAL
+};
+
+static const struct mtlk_argv_param_info_ex param_capture_time = {
+  {
+    NULL,
+    "capture-time",
+    MTLK_ARGV_PINFO_FLAG_HAS_INT_DATA
+  },
+  "capture segment duration limit in seconds (default unlimited)",
+  MTLK_ARGV_PTYPE_OPTIONAL
+};
+
+static const struct mtlk_argv_param_info_ex param_capture_segments = {
+  {
+    NULL,
+    "capture-segments",
+    MTLK_ARGV_PINFO_FLAG_HAS_INT_DATA
+  },
+  "number of capture segments kept (default 0 - all)",
+  MTLK_ARGV_PTYPE_OPTIONAL
+};
+
+static const struct mtlk_argv_param_info_ex param_capture_compress = {
+  {
+    NULL,
+    "capture-compress",
+    MTLK_ARGV_PINFO_FLAG_HAS_STR_DATA
+  },
+  "capture segment compression: none (default), lz4 or zstd",
   MTLK_ARGV_PTYPE_OPTIONAL
 };
 
@@ -1001,6 +1650,12 @@ _print_help (const char *app_name)
     &param_text,
     &param_port,
     &param_scd_fname,
+    &param_overflow_policy,
+    &param_capture,
+    &param_capture_size,
+    &param_capture_time,
+    &param_capture_segments,
+    &param_capture_compress,
     &param_dlevel,
     &param_stderr_err,
     &param_stderr_warn,
@@ -1055,7 +1710,7 @@ process_commandline(int argc, char *argv[])
     uint32 v = mtlk_argv_parser_param_get_uint_val(param, (uint32)-1);
     mtlk_argv_parser_param_release(param);
     if (v != (uint32)-1) {
-      debug = v;
+      mtlk_log_set_levels((int)v, debug_remote);
     }
     else {
       ELOG_V("Invalid debug-level");
@@ -1144,6 +1799,96 @@ process_commandline(int argc, char *argv[])
     }
   }
 
+  param = mtlk_argv_parser_param_get(&argv_parser, &param_overflow_policy.info);
+  if (param) {
+    const char *v = mtlk_argv_parser_param_get_str_val(param);
+    int i;
+
+    mtlk_argv_parser_param_release(param);
+    for (i = 0; v && i < ARRAY_SIZE(overflow_policy_names); i++) {
+      if (!strcmp(v, overflow_policy_names[i]))
+        break;
+    }
+    if (!v || i == ARRAY_SIZE(overflow_policy_names)) {
+      ELOG_V("Invalid overflow-policy");
+      res = MTLK_ERR_VALUE;
+      goto end;
+    }
+    overflow_policy = (overflow_policy_t)i;
+  }
+
+  param = mtlk_argv_parser_param_get(&argv_parser, &param_capture.info);
+  if (param) {
+    capture_cfg.path = mtlk_argv_parser_param_get_str_val(param);
+    mtlk_argv_parser_param_release(param);
+    if (!capture_cfg.path) {
+      ELOG_S("%s must be specified", param_capture.desc);
+      res = MTLK_ERR_VALUE;
+      goto end;
+    }
+    /* Captured events are parsed, binary clients get them as parsed */
+    parse_events = 1;
+  }
+
+  param = mtlk_argv_parser_param_get(&argv_parser, &param_capture_size.info);
+  if (param) {
+    uint32 v = mtlk_argv_parser_param_get_uint_val(param, (uint32)-1);
+    mtlk_argv_parser_param_release(param);
+    if (v > (uint32)-1 / 1024) {
+      ELOG_V("Invalid capture-size");
+      res = MTLK_ERR_VALUE;
+      goto end;
+    }
+    capture_cfg.segment_size = v * 1024;
+  }
+
+  param = mtlk_argv_parser_param_get(&argv_parser, &param_capture_time.info);
+  if (param) {
+    uint32 v = mtlk_argv_parser_param_get_uint_val(param, (uint32)-1);
+    mtlk_argv_parser_param_release(param);
+    if (v == (uint32)-1) {
+      ELOG_V("Invalid capture-time");
+      res = MTLK_ERR_VALUE;
+      goto end;
+    }
+    capture_cfg.segment_time = v;
+  }
+
+  param = mtlk_argv_parser_param_get(&argv_parser, &param_capture_segments.info);
+  if (param) {
+    uint32 v = mtlk_argv_parser_param_get_uint_val(param, (uint32)-1);
+    mtlk_argv_parser_param_release(param);
+    if (v == (uint32)-1) {
+      ELOG_V("Invalid capture-segments");
+      res = MTLK_ERR_VALUE;
+      goto end;
+    }
+    capture_cfg.nof_segments = v;
+  }
+
+  param = mtlk_argv_parser_param_get(&argv_parser, &param_capture_compress.info);
+  if (param) {
+    const char *v = mtlk_argv_parser_param_get_str_val(param);
+    int i;
+
+    mtlk_argv_parser_param_release(param);
+    for (i = 0; v && i < ARRAY_SIZE(capture_codec_names); i++) {
+      if (!strcmp(v, capture_codec_names[i]))
+        break;
+    }
+    if (!v || i == ARRAY_SIZE(capture_codec_names)) {
+      ELOG_V("Invalid capture-compress");
+      res = MTLK_ERR_VALUE;
+      goto end;
+    }
+    if (!capture_codec_supported((uint32)i)) {
+      ELOG_S("No %s support built in", v);
+      res = MTLK_ERR_NOT_SUPPORTED;
+      goto end;
+    }
+    capture_cfg.codec = (uint32)i;
+  }
+
   res = MTLK_ERR_OK;
 
 end:
@@ -1165,7 +1910,9 @@ static void
 _parse_log (void *param, void *packet)
 {
   mtlk_log_event_t *log_evt;
-  char *scd_text = NULL;
+  const struct scd_db *scd;
+  const char *scd_text;
+  uint32 scd_token;
   BOOL stderr_log = FALSE;
   int oid, gid, fid, lid, wlanif = 0;
 
@@ -1180,11 +1927,11 @@ _parse_log (void *param, void *packet)
   lid = LOG_INFO_GET_LID(*log_evt);
   wlanif = LOG_INFO_GET_WLAN_IF(*log_evt);
 
-  if (scd_data && (scd_filename))
-    scd_text = scd_get_text(oid, gid, fid, lid);
-
   if (scd_filename) {
-    if (scd_data) {
+    /* The text is valid until the snapshot is released */
+    scd = db_scd_acquire(&scd_token);
+    if (scd) {
+      scd_text = scd_db_get_text(scd, oid, gid, fid, lid);
       stderr_log = _mtlk_osdep_log_is_enabled_stderr(MTLK_OSLOG_INFO);
       if (!stderr_log) {
         _mtlk_osdep_log_enable_stderr(MTLK_OSLOG_INFO, TRUE);
@@ -1197,6 +1944,7 @@ _parse_log (void *param, void *packet)
         _mtlk_osdep_log_enable_stderr(MTLK_OSLOG_INFO, FALSE);
       }
     }
+    db_scd_release(scd_token);
   }
 }
 
@@ -1273,6 +2021,173 @@ _create_nlink_thread (void)
   return res;
 }
 
+pthread_t scd_reload_thread;
+
+/* Watches the directory of the SCD file, so the file is also noticed when
+ * it's replaced by renaming. Returns the inotify descriptor or -1. */
+static int
+_scd_watch_create (void)
+{
+  char dir[PATH_MAX];
+  const char *slash = strrchr(scd_filename, '/');
+  int fd;
+
+  if (!slash) {
+    wave_strcopy(dir, ".", sizeof(dir));
+  } else if (slash == scd_filename) {
+    wave_strcopy(dir, "/", sizeof(dir));
+  } else if ((size_t)(slash - scd_filename) < sizeof(dir)) {
+    wave_memcpy(dir, sizeof(dir), scd_filename, slash - scd_filename);
+    dir[slash - scd_filename] = '\0';
+  } else {
+    return -1;
+  }
+
+  fd = inotify_init();
+  if (fd < 0) {
+    WLOG_S("inotify is not available: %s", strerror(errno));
+    return -1;
+  }
+
+  if (inotify_add_watch(fd, dir, IN_CLOSE_WRITE | IN_MOVED_TO) < 0) {
+    WLOG_SS("%s: cannot watch: %s", dir, strerror(errno));
+    close(fd);
+    return -1;
+  }
+
+  return fd;
+}
+
+/* Returns nonzero if the SCD file has been rewritten or replaced */
+static int
+_scd_watch_check (int fd)
+{
+  char buf[4096] __attribute__((aligned(__alignof__(struct inotify_event))));
+  const char *slash = strrchr(scd_filename, '/');
+  const char *name = slash ? slash + 1 : scd_filename;
+  const struct inotify_event *ev;
+  ssize_t len;
+  char *p;
+  int res = 0;
+
+  len = read(fd, buf, sizeof(buf));
+  for (p = buf; len > 0 && p < buf + len; p += sizeof(*ev) + ev->len) {
+    ev = (const struct inotify_event *) p;
+    if (ev->len && !strcmp(ev->name, name))
+      res = 1;
+  }
+
+  return res;
+}
+
+/* Reloads the SCD file on request or when it changes. The new snapshot
+ * replaces the old one atomically, so events keep being processed while
+ * the file is being loaded. */
+static void *
+_scd_reload_thread_proc (void *param)
+{
+  struct pollfd fds[2];
+  int nof_fds = 1;
+  int watch_fd;
+  int stop = 0;
+
+  MTLK_UNREFERENCED_PARAM(param);
+
+  fds[0].fd = scd_reload_pipe_fd[0];
+  fds[0].events = POLLIN;
+
+  watch_fd = _scd_watch_create();
+  if (watch_fd >= 0) {
+    fds[1].fd = watch_fd;
+    fds[1].events = POLLIN;
+    nof_fds = 2;
+  }
+
+  while (!stop) {
+    int reload = 0;
+
+    if (poll(fds, nof_fds, -1) < 0) {
+      if (errno == EINTR)
+        continue;
+      ELOG_SD("poll failed: %s (%d)", strerror(errno), errno);
+      break;
+    }
+
+    if (fds[0].revents & POLLIN) {
+      char cmds[16];
+      ssize_t i, n = read(scd_reload_pipe_fd[0], cmds, sizeof(cmds));
+
+      for (i = 0; i < n; i++) {
+        if (cmds[i] == SCD_RELOAD_CMD_STOP)
+          stop = 1;
+        else
+          reload = 1;
+      }
+    }
+
+    if (nof_fds > 1 && (fds[1].revents & POLLIN) && _scd_watch_check(watch_fd)) {
+      ILOG0_S("%s: changed, reloading", scd_filename);
+      reload = 1;
+    }
+
+    if (reload && !stop && 0 != scd_load()) {
+      WLOG_S("%s: cannot be reloaded, the previous SCD is kept", scd_filename);
+    }
+  }
+
+  if (watch_fd >= 0)
+    close(watch_fd);
+
+  return NULL;
+}
+
+static int
+_create_scd_reload_thread (void)
+{
+  int res;
+
+  if (0 != pipe(scd_reload_pipe_fd)) {
+    ELOG_SD("Failed to create pipe: %s (%d)", strerror(errno), errno);
+    return -1;
+  }
+  /* Written by the signal handler, which must never block */
+  fcntl(scd_reload_pipe_fd[1], F_SETFL, O_NONBLOCK);
+
+  res = pthread_create(&scd_reload_thread, NULL, _scd_reload_thread_proc, NULL);
+  if (res != 0) {
+    ELOG_S("Failed create thread for SCD reloading: %s", strerror(res));
+    close(scd_reload_pipe_fd[0]);
+    close(scd_reload_pipe_fd[1]);
+    scd_reload_pipe_fd[0] = scd_reload_pipe_fd[1] = -1;
+    return -1;
+  }
+
+  return 0;
+}
+
+static void
+_scd_reload_thread_stop (void)
+{
+  char cmd = SCD_RELOAD_CMD_STOP;
+  int fd = scd_reload_pipe_fd[1];
+  int res;
+
+  /* SIGHUP means shutting down from now on */
+  scd_reload_pipe_fd[1] = -1;
+
+  if (write(fd, &cmd, 1) != 1) {
+    ELOG_V("Failed to signal the SCD reload thread to stop");
+  }
+  res = pthread_join(scd_reload_thread, NULL);
+  if (0 != res) {
+    ELOG_SD("Failed to terminate the SCD reload thread: %s (%d)", strerror(res), res);
+  }
+
+  close(scd_reload_pipe_fd[0]);
+  close(fd);
+  scd_reload_pipe_fd[0] = -1;
+}
+
 int
 main(int argc, char *argv[])
 {
@@ -1322,14 +2237,35 @@ main(int argc, char *argv[])
     goto end;
   }
 
+  if (0 != create_epoll(&epoll_fd) ||
+      0 != add_fd_to_epoll(epoll_fd, mother_socket, EPOLLIN | EPOLLET,
+                           &epoll_tag_mother)) {
+    rslt = 1;
+    goto end;
+  }
+
   setup_signals();
 
   if (parse_events) {
     ILOG0_V("Events will be parsed by logserver");
     cqueue_init(&parse_event_q);
     cqueue_reset(&parse_event_q, PARSE_EVENT_Q_SIZE);
-    if (log_to_console || log_to_syslog)
+    if (capture_cfg.path) {
+      if (0 != capture_open(&capture_cfg)) {
+        rslt = 1;
+        goto end;
+      }
+      ILOG0_S("Events will be captured to %s.*", capture_cfg.path);
+      log_to_capture = 1;
+    }
+    if (log_to_console || log_to_syslog || log_to_capture)
       update_datasource();
+  } else {
+    cqueue_init(&raw_filter_q);
+    if (0 != cqueue_reset(&raw_filter_q, RAW_FILTER_Q_SIZE)) {
+      rslt = 1;
+      goto end;
+    }
   }
 
   if (log_to_console) {
@@ -1364,11 +2300,21 @@ main(int argc, char *argv[])
         rslt = 1;
         goto end;
       }
+      if (0 != _create_scd_reload_thread()) {
+        WLOG_V("SCD file won't be reloaded");
+      }
     }
   }
 
+  run_db_utest();
+  run_proto_drv_utest();
+
   main_loop(mother_socket);
 
+  if (scd_reload_pipe_fd[1] >= 0) {
+    _scd_reload_thread_stop();
+  }
+
   if (scd_filename) {
     _notification_thread_stop();
   }
@@ -1380,8 +2326,20 @@ main(int argc, char *argv[])
 
   if (parse_events)
     cqueue_cleanup(&parse_event_q);
+  else
+    cqueue_cleanup(&raw_filter_q);
+
+  if (log_to_capture)
+    capture_close();
+
+  if (evt_rec)
+    shbuf_put(evt_rec);
+  shbuf_cleanup();
 
 end:
+  if (epoll_fd >= 0) {
+    close(epoll_fd);
+  }
   if (mother_socket >= 0) {
     close(mother_socket);
   }
@@ -23,12 +23,20 @@
 #ifndef __LOGSERVER_H__
 #define __LOGSERVER_H__
 
+#include "shbuf.h"
+#include "logdefs.h"
+
 extern int log_to_console;
 extern int log_to_syslog;
+extern int log_to_capture;
 extern int text_protocol;
 extern int syslog_pri;
 
-void send_to_all(char *data, size_t len);
+/* Queues a parsed event to the connections requesting it: its text msg
+ * with the text protocol, the pktlen bytes of pkt otherwise */
+int send_event(const mtlk_log_event_t *log_evt, const char *msg,
+               const unsigned char *pkt, uint32 pktlen);
+void send_event_flush(void);
 
 #endif // !__LOGSERVER_H__
 
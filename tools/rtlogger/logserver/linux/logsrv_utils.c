@@ -122,51 +122,3 @@ skip_spcrlf(char **pp)
   }
 }
 
-int
-str_decode(char *str)
-{
-  char *p = str;
-  char *to = str;
-  char c;
-
-  skip_spcrlf(&p);
-
-  while ((c = *p) != '\0') {
-    ++p;
-
-    if (c == '\\') {
-      switch (*p) {
-      case 'r':
-        *to++ = '\r';
-        break;
-      case 't':
-        *to++ = '\t';
-        break;
-      case 'n':
-        *to++ = '\n';
-        break;
-      case '\\':
-        *to++ = '\\';
-        break;
-      case '\'':
-        *to++ = '\'';
-        break;
-      case '\"':
-        *to++ = '\"';
-        break;
-      case '/':
-        *to++ = '/';
-        break;
-      default:
-        return -1;
-      }
-      ++p;
-    } else {
-      *to++ = c;
-    }
-  }
-
-  *to = '\0';
-  return 0;
-}
-
@@ -32,7 +32,6 @@ int get_line(const char *filename, char *buf, size_t buf_size, FILE *fl,
 int get_word(char **pp, char *buf, size_t buf_size);
 int is_spcrlf(char c);
 void skip_spcrlf(char **pp);
-int str_decode(char *str);
 
 #define MIN(x,y) ((x) < (y) ? (x) : (y))
 #define MAX(x,y) ((x) > (y) ? (x) : (y))
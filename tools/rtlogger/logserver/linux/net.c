@@ -22,6 +22,7 @@
 
 #include "mtlkinc.h"
 #include <sys/socket.h>
+#include <sys/epoll.h>
 #include <netinet/in.h>
 #include <arpa/inet.h>
 #include <unistd.h>
@@ -155,3 +156,45 @@ socket_set_nonblock(int s, int nonblock)
 }
 
 
+
+int
+create_epoll(int *pepoll_fd)
+{
+  int fd = epoll_create1(EPOLL_CLOEXEC);
+
+  if (fd < 0) {
+    ELOG_S("epoll_create1: %s", strerror(errno));
+    return -1;
+  }
+
+  *pepoll_fd = fd;
+  return 0;
+}
+
+int
+add_fd_to_epoll(int epoll_fd, int fd, uint32 events, void *ptr)
+{
+  struct epoll_event ev;
+
+  memset(&ev, 0, sizeof(ev));
+  ev.events = events;
+  ev.data.ptr = ptr;
+  if (epoll_ctl(epoll_fd, EPOLL_CTL_ADD, fd, &ev) < 0) {
+    int err = errno;
+
+    ELOG_DS("Adding descriptor %d to epoll: %s", fd, strerror(err));
+    errno = err; /* the caller may tell why */
+    return -1;
+  }
+  return 0;
+}
+
+int
+remove_fd_from_epoll(int epoll_fd, int fd)
+{
+  if (epoll_ctl(epoll_fd, EPOLL_CTL_DEL, fd, NULL) < 0) {
+    ILOG1_DS("Removing descriptor %d from epoll: %s", fd, strerror(errno));
+    return -1;
+  }
+  return 0;
+}
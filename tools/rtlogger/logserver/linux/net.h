@@ -38,5 +38,9 @@ int socket_set_opt(int s, int opt, const char *opt_name, int val);
 int socket_set_linger(int s, int onoff, int linger);
 int socket_set_nonblock(int s, int nonblock);
 
+int create_epoll(int *pepoll_fd);
+int add_fd_to_epoll(int epoll_fd, int fd, uint32 events, void *ptr);
+int remove_fd_from_epoll(int epoll_fd, int fd);
+
 #endif // !__NET_H__
 
@@ -38,13 +38,18 @@
 #include "logsrv_utils.h"
 #include "proto_drv.h"
 #include "db.h"
+#include "capture.h"
+#include "logfmt.h"
 #include "mtlkerr.h"
 
 #define LOG_LOCAL_GID   GID_PROTO_DRV
 #define LOG_LOCAL_FID   1
 
-char scd_text_not_found[] = "    SCD Text not found!";
-char scd_text_found[] = "    SCD Text = ";
+/* Largest driver packet: the event size field is 16-bit */
+#define LOG_MAX_PKT_SIZE    (sizeof(mtlk_log_event_t) + 0xFFFF)
+
+/* Initial size of the formatted message buffer */
+#define MSG_BUF_MIN_SIZE    512
 
 struct log_ver_info_req
 {
@@ -149,28 +154,97 @@ cdev_close(cdev_t *dev)
   return retval;
 }
 
+// >0 - data read
+//  0 - end of file
+// -1 - error (EAGAIN when the device has no more data)
 int
 cdev_read_to_q(cqueue_t *pqueue, cdev_t *dev)
 {
   ASSERT(cqueue_space_left(pqueue) > 0);
-  return cqueue_read(pqueue, dev->fd) > 0;
+  return cqueue_read(pqueue, dev->fd);
+}
+
+/* Formats the event message into msg_buf, growing it on demand.
+ * Returns NULL if the event data is corrupted or out of memory.
+ */
+static const char *
+drv_format_msg(const mtlk_log_event_t *log_evt, const unsigned char *data,
+               uint32 dsize)
+{
+  static char *msg_buf = NULL;
+  static size_t msg_buf_size = 0;
+  const struct scd_db *scd;
+  const logfmt_prog_t *prog;
+  const char *res = NULL;
+  uint32 scd_token;
+  logfmt_evt_t evt;
+  int len;
+
+  evt.oid      = LOG_INFO_GET_OID(*log_evt);
+  evt.gid      = LOG_INFO_GET_GID(*log_evt);
+  evt.fid      = LOG_INFO_GET_FID(*log_evt);
+  evt.lid      = LOG_INFO_GET_LID(*log_evt);
+  evt.data     = data;
+  evt.dsize    = dsize;
+  evt.reversed = FALSE;
+
+  /* The program is valid until the snapshot is released */
+  scd = db_scd_acquire(&scd_token);
+  prog = scd_db_get_prog(scd, evt.oid, evt.gid, evt.fid, evt.lid);
+
+  for (;;) {
+    char *new_buf;
+    size_t new_size;
+
+    len = logfmt_run(prog, &evt, msg_buf, msg_buf_size);
+    if (len < 0) {
+      ELOG_V("Data corrupted");
+      goto end;
+    }
+    if ((size_t)len < msg_buf_size) {
+      res = msg_buf;
+      goto end;
+    }
+
+    new_size = MAX((size_t)len + 1, MSG_BUF_MIN_SIZE);
+    new_buf = (char *) realloc(msg_buf, new_size);
+    if (!new_buf) {
+      ELOG_V("Out of memory");
+      goto end;
+    }
+    msg_buf = new_buf;
+    msg_buf_size = new_size;
+  }
+
+end:
+  db_scd_release(scd_token);
+  return res;
 }
 
 // -1 - error
 //  0 - success
 static int
-drv_process_pkt(cqueue_t *pqueue)
+drv_process_pkt(const unsigned char *pkt, uint32 pktlen)
 {
-  int printed;
   mtlk_log_event_t log_evt;
-  mtlk_log_event_data_t log_evt_data;
-  int pktlen;
-  int at = 0;
-  char buf[256];
-  char *scd_text = NULL;
+  const char *msg;
   int oid, gid, fid, lid, dsize;
 
-  cqueue_get(pqueue, at, sizeof(log_evt), (unsigned char *) &log_evt);
+  if (pktlen < sizeof(log_evt)) {
+    ELOG_V("Data corrupted");
+    return -1;
+  }
+  wave_memcpy(&log_evt, sizeof(log_evt), pkt, sizeof(log_evt));
+
+  if (log_to_capture)
+    capture_write(pkt, pktlen);
+
+  /* Binary clients get the events as read from the driver */
+  if (!text_protocol && 0 != send_event(&log_evt, NULL, pkt, pktlen))
+    return -1;
+
+  if (!(log_to_console || log_to_syslog || text_protocol))
+    return 0;
 
   dsize = LOG_INFO_GET_DSIZE(log_evt);
   oid   = LOG_INFO_GET_OID(log_evt);
@@ -178,255 +252,23 @@ drv_process_pkt(cqueue_t *pqueue)
   fid   = LOG_INFO_GET_FID(log_evt);
   lid   = LOG_INFO_GET_LID(log_evt);
 
-  if (scd_data && (log_to_console || log_to_syslog || text_protocol))
-    scd_text = scd_get_text(oid, gid, fid, lid);
+  msg = drv_format_msg(&log_evt, pkt + sizeof(log_evt), pktlen - sizeof(log_evt));
+  if (!msg)
+    return -1;
 
   if (log_to_console) {
     ILOG0_DDDDDD("! Log Event: TS=%lu, OID=%u, GID=%u, FID=%u, LID=%u, datalen=%u",
         log_evt.timestamp, oid, gid, fid, lid, dsize);
-    if (scd_data) {
-      if (!scd_text)
-        ILOG0_S("%s", scd_text_not_found);
-      else
-        ILOG0_SS("%s%s", scd_text_found, scd_text);
-    }
+    ILOG0_S("    %s", msg);
   }
   if (log_to_syslog) {
     syslog(syslog_pri, "! Log Event: TS=%lu, OID=%u, GID=%u, FID=%u, LID=%u, datalen=%u",
         (unsigned long)log_evt.timestamp, oid, gid, fid, lid, dsize);
-    if (scd_data) {
-      if (!scd_text)
-        syslog(syslog_pri, "%s", scd_text_not_found);
-      else
-        syslog(syslog_pri, "%s%s", scd_text_found, scd_text);
-    }
+    syslog(syslog_pri, "    %s", msg);
   }
   if (text_protocol) {
-    printed = snprintf(buf, sizeof(buf),
-        "! Log Event: TS=%lu, OID=%u, GID=%u, FID=%u, LID=%u, datalen=%u\r\n",
-        (unsigned long)log_evt.timestamp, oid, gid, fid, lid, dsize);
-    if (printed < 0 || printed >= sizeof(buf)) {
-      ELOG_V("Buffer too small");
-      return -1;
-    }
-    send_to_all(buf, printed);
-    if (scd_data) {
-      if (!scd_text) {
-        send_to_all(scd_text_not_found, ARRAY_SIZE(scd_text_not_found) - 1);
-      } else {
-        send_to_all(scd_text_found, ARRAY_SIZE(scd_text_found) - 1);
-        send_to_all(scd_text, strlen(scd_text));
-        send_to_all("\r\n", 2);
-      }
-    }
-  }
-  pktlen = sizeof(log_evt) + dsize;
-
-  at += sizeof(log_evt);
-  while (at < pktlen) {
-    if (pktlen - at < sizeof(log_evt_data)) {
-      ELOG_V("Data corrupted");
+    if (0 != send_event(&log_evt, msg, pkt, pktlen))
       return -1;
-    }
-    cqueue_get(pqueue, at, sizeof(log_evt_data),
-        (unsigned char *) &log_evt_data);
-    at += sizeof(log_evt_data);
-
-    /* TODO: The code meant to print log
-             messages to the console is
-             temporary. This code is to 
-             be removed as soon as logconv 
-             rewritten on C and linked with
-             log server. This will allow to 
-             have fully-functional debugging 
-             output from log server to the 
-             console and code below will be
-             unnecessary. */
-
-    switch (log_evt_data.datatype) {
-    case LOG_DT_LSTRING:
-      {
-        mtlk_log_lstring_t lstr;
-        unsigned char *pstrdata;
-        if (pktlen - at < sizeof(lstr)) {
-          ELOG_V("Data corrupted");
-          return -1;
-        }
-        cqueue_get(pqueue, at, sizeof(lstr),
-            (unsigned char *) &lstr);
-        at += sizeof(lstr);
-        if (pktlen - at < lstr.len) {
-          ELOG_V("Data corrupted");
-          return -1;
-        }
-        pstrdata = (unsigned char *) malloc(lstr.len + 1);
-        if (!pstrdata) {
-          ELOG_V("Out of memory");
-          return -1;
-        }
-        cqueue_get(pqueue, at, lstr.len, pstrdata);
-        at += lstr.len;
-        // TODO: replace \0 with ' ' in output
-        pstrdata[lstr.len] = '\0';
-        if (log_to_console) {
-          ILOG0_DS("    datatype = LOG_DT_LSTRING: len = %u, data = %s",
-              lstr.len, pstrdata);
-        }
-        if (log_to_syslog) {
-          syslog(syslog_pri,
-              "    datatype = LOG_DT_LSTRING: len = %u, data = %s",
-              lstr.len, pstrdata);
-        }
-        if (text_protocol) {
-          printed = snprintf(buf, sizeof(buf),
-              "    datatype = LOG_DT_LSTRING: len = %u, data = ",
-              lstr.len);
-          if (printed < 0 || printed >= sizeof(buf)) {
-            free(pstrdata);
-            ELOG_V("Buffer too small");
-            return -1;
-          }
-          send_to_all(buf, printed);
-          send_to_all((char*)pstrdata, lstr.len);
-          send_to_all("\r\n", 2);
-        }
-        free(pstrdata);
-      }
-      break;
-    case LOG_DT_INT8:
-      {
-        int8 val;
-        if (pktlen - at < sizeof(val)) {
-          ELOG_V("Data corrupted");
-          return -1;
-        }
-        cqueue_get(pqueue, at, sizeof(val), (unsigned char *) &val);
-        at += sizeof(val);
-        if (log_to_console) {
-          ILOG0_C("    datatype = LOG_DT_INT8: value = %c", val);
-        }
-        if (log_to_syslog) {
-          syslog(syslog_pri, "    datatype = LOG_DT_INT8: value = %c", val);
-        }
-        if (text_protocol) {
-          printed = snprintf(buf, sizeof(buf),
-              "    datatype = LOG_DT_INT8: value = %c\r\n", val);
-          if (printed < 0 || printed >= sizeof(buf)) {
-            ELOG_V("Buffer too small");
-            return -1;
-          }
-          send_to_all(buf, printed);
-        }
-      }
-      break;
-    case LOG_DT_INT32:
-      {
-        int32 val;
-        if (pktlen - at < sizeof(val)) {
-          ELOG_V("Data corrupted");
-          return -1;
-        }
-        cqueue_get(pqueue, at, sizeof(val), (unsigned char *) &val);
-        at += sizeof(val);
-        if (log_to_console) {
-          ILOG0_D("    datatype = LOG_DT_INT32: value = %ld", val);
-        }
-        if (log_to_syslog) {
-          syslog(syslog_pri, "    datatype = LOG_DT_INT32: value = %ld", (long int)val);
-        }
-        if (text_protocol) {
-          printed = snprintf(buf, sizeof(buf),
-              "    datatype = LOG_DT_INT32: value = %ld\r\n", (long int)val);
-          if (printed < 0 || printed >= sizeof(buf)) {
-            ELOG_V("Buffer too small");
-            return -1;
-          }
-          send_to_all(buf, printed);
-        }
-      }
-      break;
-    case LOG_DT_INT64:
-      {
-        int64 val;
-        if (pktlen - at < sizeof(val)) {
-          ELOG_V("Data corrupted");
-          return -1;
-        }
-        cqueue_get(pqueue, at, sizeof(val), (unsigned char *) &val);
-        at += sizeof(val);
-        if (log_to_console) {
-          ILOG0_H("    datatype = LOG_DT_INT64: value = %lld", val);
-        }
-        if (log_to_syslog) {
-          syslog(syslog_pri, "    datatype = LOG_DT_INT64: value = %lld", (long long) val);
-        }
-        if (text_protocol) {
-          printed = snprintf(buf, sizeof(buf),
-              "    datatype = LOG_DT_INT64: value = %lld\r\n", (long long) val);
-          if (printed < 0 || printed >= sizeof(buf)) {
-            ELOG_V("Buffer too small");
-            return -1;
-          }
-          send_to_all(buf, printed);
-        }
-      }
-      break;
-    case LOG_DT_MACADDR:
-      {
-        char val[MAC_ADDR_LENGTH];
-        if (pktlen - at < sizeof(val)) {
-          ELOG_V("Data corrupted");
-          return -1;
-        }
-        cqueue_get(pqueue, at, sizeof(val), (unsigned char *) &val);
-        at += sizeof(val);
-        if (log_to_console) {
-          ILOG0_Y("    datatype = LOG_DT_MACADDR: value = %Y", val);
-        }
-        if (log_to_syslog) {
-          syslog(syslog_pri, "    datatype = LOG_DT_MACADDR: value = " MAC_PRINTF_FMT, MAC_PRINTF_ARG(val));
-        }
-        if (text_protocol) {
-          printed = snprintf(buf, sizeof(buf),
-              "    datatype = LOG_DT_MACADDR: value = " MAC_PRINTF_FMT "\r\n", MAC_PRINTF_ARG(val));
-          if (printed < 0 || printed >= sizeof(buf)) {
-            ELOG_V("Buffer too small");
-            return -1;
-          }
-          send_to_all(buf, printed);
-        }
-      }
-      break;
-    case LOG_DT_IP6ADDR:
-      {
-        char val[IP6_ADDR_LENGTH];
-        if (pktlen - at < sizeof(val)) {
-          ELOG_V("Data corrupted");
-          return -1;
-        }
-        cqueue_get(pqueue, at, sizeof(val), (unsigned char *) &val);
-        at += sizeof(val);
-        if (log_to_console) {
-          ILOG0_K("    datatype = LOG_DT_IP6ADDR: value = %K", val);
-        }
-        if (log_to_syslog) {
-          syslog(syslog_pri, "    datatype = LOG_DT_IP6ADDR: value = " IP6_PRINTF_FMT, IP6_PRINTF_ARG(val));
-        }
-        if (text_protocol) {
-          printed = snprintf(buf, sizeof(buf),
-              "    datatype = LOG_DT_IP6ADDR: value = " IP6_PRINTF_FMT "\r\n", IP6_PRINTF_ARG(val));
-          if (printed < 0 || printed >= sizeof(buf)) {
-            ELOG_V("Buffer too small");
-            return -1;
-          }
-          send_to_all(buf, printed);
-        }
-      }
-      break;
-    default:
-      ELOG_D("Unknown log event data type (%u)", log_evt_data.datatype);
-      break;
-    }
   }
 
   return 0;
@@ -438,8 +280,11 @@ drv_process_pkt(cqueue_t *pqueue)
 int
 drv_process_next_pkt(cqueue_t *pqueue)
 {
+  /* Only used when a packet wraps in a queue that isn't mirrored */
+  static unsigned char bounce[LOG_MAX_PKT_SIZE];
   int sz = cqueue_size(pqueue);
   mtlk_log_event_t log_evt;
+  const unsigned char *pkt;
   uint32 pktlen;
   uint32 datalen;
 
@@ -456,8 +301,9 @@ drv_process_next_pkt(cqueue_t *pqueue)
     return 0;
 
   // At this point there's a complete packet in queue at offset 0.
-  // Process this packet.
-  if (0 != drv_process_pkt(pqueue)) {
+  // Process this packet in place.
+  pkt = cqueue_peek(pqueue, 0, pktlen, bounce);
+  if (0 != drv_process_pkt(pkt, pktlen)) {
     return -1;
   }
 
@@ -466,3 +312,170 @@ drv_process_next_pkt(cqueue_t *pqueue)
   return 1;
 }
 
+#ifdef RUN_PROTO_DRV_UTEST
+
+#define PROTO_DRV_UTEST_NOF_EVENTS  (64 * 1024)
+#define PROTO_DRV_UTEST_NOF_ROUNDS  16
+#define PROTO_DRV_UTEST_Q_SIZE      (32 * 1024)
+/* The largest event built below */
+#define PROTO_DRV_UTEST_MAX_PKT     128
+
+typedef enum
+{
+  PROTO_DRV_UTEST_BINARY,   /* framed and passed on as is */
+  PROTO_DRV_UTEST_TEXT,     /* formatted as well */
+  PROTO_DRV_UTEST_LAST
+} proto_drv_utest_mode_e;
+
+static const char *const proto_drv_utest_mode_names[PROTO_DRV_UTEST_LAST] = {
+  "binary",
+  "text",
+};
+
+static unsigned char *
+_proto_drv_utest_put (unsigned char *p, const void *data, uint32 len)
+{
+  wave_memcpy(p, len, data, len);
+  return p + len;
+}
+
+/* Driver stream of events with INT32, LSTRING, MACADDR and INT64
+ * parameters, as the driver writes it */
+static unsigned char *
+_proto_drv_utest_stream (uint32 *len)
+{
+  unsigned char *stream;
+  unsigned char *p;
+  uint32 i;
+
+  stream = (unsigned char *) malloc(PROTO_DRV_UTEST_NOF_EVENTS * PROTO_DRV_UTEST_MAX_PKT);
+  if (!stream)
+    return NULL;
+
+  p = stream;
+  for (i = 0; i < PROTO_DRV_UTEST_NOF_EVENTS; i++) {
+    unsigned char *hdr = p;
+    unsigned char mac[6] = { 0x00, 0x01, 0x02, 0x03, 0x04, (unsigned char)i };
+    char str[48];
+    mtlk_log_event_t log_evt;
+    uint32 dt;
+    uint32 str_len = 12 + i % 30;
+    int32 v32 = (int32)i;
+    int64 v64 = (int64)i << 20;
+
+    memset(str, 'a' + i % 26, sizeof(str));
+    p += sizeof(log_evt);
+    dt = LOG_DT_INT32;
+    p = _proto_drv_utest_put(p, &dt, sizeof(dt));
+    p = _proto_drv_utest_put(p, &v32, sizeof(v32));
+    dt = LOG_DT_LSTRING;
+    p = _proto_drv_utest_put(p, &dt, sizeof(dt));
+    p = _proto_drv_utest_put(p, &str_len, sizeof(str_len));
+    p = _proto_drv_utest_put(p, str, str_len);
+    dt = LOG_DT_MACADDR;
+    p = _proto_drv_utest_put(p, &dt, sizeof(dt));
+    p = _proto_drv_utest_put(p, mac, sizeof(mac));
+    dt = LOG_DT_INT64;
+    p = _proto_drv_utest_put(p, &dt, sizeof(dt));
+    p = _proto_drv_utest_put(p, &v64, sizeof(v64));
+
+    log_evt.info_w0   = LOG_MAKE_INFO_W0(0, i & 0x3FFF, 1, 3, 1);
+    log_evt.info_w1   = LOG_MAKE_INFO_W1(0, 0, 0, 0);
+    log_evt.timestamp = i;
+    log_evt.dsize     = (uint16)(p - hdr - sizeof(log_evt));
+    wave_memcpy(hdr, sizeof(log_evt), &log_evt, sizeof(log_evt));
+  }
+
+  *len = (uint32)(p - stream);
+  return stream;
+}
+
+/* Feeds the stream through a queue smaller than it, so that the events
+ * wrap around its end. Returns the number of events processed. */
+static uint32
+_proto_drv_utest_run (const unsigned char *stream, uint32 len)
+{
+  cqueue_t q;
+  uint32 pos = 0;
+  uint32 nof_events = 0;
+  int res = 0;
+
+  cqueue_init(&q);
+  if (0 != cqueue_reset(&q, PROTO_DRV_UTEST_Q_SIZE))
+    return 0;
+
+  while (pos < len) {
+    uint32 n = MIN((uint32)cqueue_space_left(&q), len - pos);
+
+    cqueue_push_back(&q, (unsigned char *) stream + pos, (int)n);
+    pos += n;
+    while ((res = drv_process_next_pkt(&q)) == 1)
+      nof_events++;
+    if (res < 0)
+      break;
+  }
+
+  cqueue_cleanup(&q);
+  return nof_events;
+}
+
+/* Driver events per second through drv_process_next_pkt(), parsed in
+ * place. Run before any client connects: nothing is sent. */
+BOOL
+run_proto_drv_utest(void)
+{
+  int saved_console = log_to_console;
+  int saved_syslog = log_to_syslog;
+  int saved_capture = log_to_capture;
+  int saved_text = text_protocol;
+  unsigned char *stream;
+  uint32 len = 0;
+  uint32 keps[PROTO_DRV_UTEST_LAST];
+  BOOL pased[PROTO_DRV_UTEST_LAST];
+  BOOL all_pased = TRUE;
+  proto_drv_utest_mode_e mode;
+
+  stream = _proto_drv_utest_stream(&len);
+  if (!stream) {
+    ELOG_V("Driver protocol unit tests: out of memory");
+    return FALSE;
+  }
+
+  /* Nothing is logged while the outputs are off */
+  log_to_console = 0;
+  log_to_syslog = 0;
+  log_to_capture = 0;
+  for (mode = PROTO_DRV_UTEST_BINARY; mode < PROTO_DRV_UTEST_LAST; mode++) {
+    mtlk_osal_timestamp_t start;
+    uint32 nof_events;
+    uint32 elapsed_ms;
+    uint32 round;
+
+    text_protocol = (mode == PROTO_DRV_UTEST_TEXT);
+    nof_events = 0;
+    start = mtlk_osal_timestamp();
+    for (round = 0; round < PROTO_DRV_UTEST_NOF_ROUNDS; round++)
+      nof_events += _proto_drv_utest_run(stream, len);
+    elapsed_ms = mtlk_osal_timestamp_to_ms(mtlk_osal_timestamp() - start);
+
+    pased[mode] = (nof_events == PROTO_DRV_UTEST_NOF_EVENTS * PROTO_DRV_UTEST_NOF_ROUNDS);
+    keps[mode] = nof_events / MAX(elapsed_ms, 1);
+  }
+  log_to_console = saved_console;
+  log_to_syslog = saved_syslog;
+  log_to_capture = saved_capture;
+  text_protocol = saved_text;
+
+  free(stream);
+
+  for (mode = PROTO_DRV_UTEST_BINARY; mode < PROTO_DRV_UTEST_LAST; mode++) {
+    ILOG0_SDS("Driver protocol: %s: %u Kevents/s %s", proto_drv_utest_mode_names[mode],
+              keps[mode], (TRUE == pased[mode]) ? "SUCCEED" : "FAILED");
+    if (!pased[mode])
+      all_pased = FALSE;
+  }
+
+  return all_pased;
+}
+
+#endif /* RUN_PROTO_DRV_UTEST */
@@ -51,5 +51,12 @@ cdev_get_ver_minor (cdev_t *dev)
 
 int drv_process_next_pkt(cqueue_t *pqueue);
 
+#ifdef RUN_PROTO_DRV_UTEST
+/* Driver events throughput, nothing must be connected yet */
+BOOL run_proto_drv_utest(void);
+#else
+#define run_proto_drv_utest()
+#endif
+
 #endif // !__PROTO_DRV_H__
 
@@ -26,6 +26,7 @@
 #include "compat.h"
 #include "logsrv_utils.h"
 #include "cqueue.h"
+#include "proto_lg.h"
 
 #define LOG_LOCAL_GID   GID_PROTO_LG
 #define LOG_LOCAL_FID   1
@@ -52,12 +53,89 @@ typedef struct _lg_datapkt_hdr {
   uint32 datalen;
 } __PACKED lg_datapkt_hdr;
 
+/* MSGID_REQ_CONFIG data: a tagged header followed by bitmaps of the
+ * requested event origins, GIDs (the same for all the origins), FIDs and
+ * levels (priorities). Bit N of a bitmap is bit (N % 8) of byte (N / 8).
+ *
+ * CONFIG payloads without the 'F' 'L' tag come from the legacy clients
+ * and are ignored, as before. maps_len is the size of the bitmaps that
+ * follow the header: the bitmaps the client didn't send request every
+ * event, the bytes beyond the ones known here are skipped.
+ *
+ * An optional byte after the bitmaps requests the slow client policy
+ * (LG_OVERFLOW_...), the server's default one is used without it.
+ */
+#define LG_CONFIG_VER 1
+
+typedef struct _lg_config_hdr {
+  uint8 id1; // 'F'
+  uint8 id2; // 'L'
+  uint8 version;
+  uint8 maps_len;
+} __PACKED lg_config_hdr;
+
+typedef struct _lg_config_req {
+  lg_config_hdr hdr;
+  uint8 oid_map[MAX_OID / 8];
+  uint8 gid_map[MAX_GID / 8];
+  uint8 fid_map[LG_FILTER_NOF_FIDS / 8];
+  uint8 level_map[LG_FILTER_NOF_LEVELS / 8];
+} __PACKED lg_config_req;
+
+#define LG_MAP_BIT(map, n)  (((map)[(n) / 8] >> ((n) % 8)) & 1)
+
+void
+lg_filter_init(lg_filter_t *filter)
+{
+  memset(filter, 0xFF, sizeof(*filter));
+  filter->started  = TRUE;
+  filter->pass_all = TRUE;
+  filter->overflow_policy = LG_OVERFLOW_DEFAULT;
+}
+
+static void
+lg_filter_config(lg_filter_t *filter, const lg_config_req *req)
+{
+  int oid, gid, n;
+
+  memset(filter->grp_map, 0, sizeof(filter->grp_map));
+  filter->pass_all = TRUE;
+
+  for (oid = 0; oid < MAX_OID; oid++) {
+    for (gid = 0; gid < MAX_GID; gid++) {
+      n = oid * MAX_GID + gid;
+      if (LG_MAP_BIT(req->oid_map, oid) && LG_MAP_BIT(req->gid_map, gid))
+        filter->grp_map[n / 32] |= 1U << (n % 32);
+      else
+        filter->pass_all = FALSE;
+    }
+  }
+
+  filter->fid_mask = 0;
+  for (n = 0; n < LG_FILTER_NOF_FIDS; n++) {
+    if (LG_MAP_BIT(req->fid_map, n))
+      filter->fid_mask |= 1U << n;
+    else
+      filter->pass_all = FALSE;
+  }
+
+  filter->level_mask = 0;
+  for (n = 0; n < LG_FILTER_NOF_LEVELS; n++) {
+    if (LG_MAP_BIT(req->level_map, n))
+      filter->level_mask |= 1U << n;
+    else
+      filter->pass_all = FALSE;
+  }
+}
+
 // -1 - error
 //  0 - success
 static int
-process_pkt(cqueue_t *pqueue)
+process_pkt(cqueue_t *pqueue, uint32 datalen, lg_filter_t *filter)
 {
+  lg_config_req req;
   uint8 msgid;
+  uint8 policy;
 
   ASSERT(SIZEOF_MEMB(lg_datapkt_hdr, msgid) == sizeof(msgid));
   cqueue_get(pqueue, offsetof(lg_datapkt_hdr, msgid), sizeof(msgid),
@@ -71,14 +149,51 @@ process_pkt(cqueue_t *pqueue)
 
   case MSGID_REQ_CONFIG:
     ILOG9_V("Received MSGID_REQ_CONFIG");
+    memset(&req, 0xFF, sizeof(req));
+    if (datalen < sizeof(req.hdr)) {
+      ILOG1_D("Legacy configuration (%u bytes) ignored", datalen);
+      break;
+    }
+    cqueue_get(pqueue, sizeof(lg_datapkt_hdr), sizeof(req.hdr), (unsigned char *) &req.hdr);
+    if (req.hdr.id1 != 'F' || req.hdr.id2 != 'L') {
+      ILOG1_D("Legacy configuration (%u bytes) ignored", datalen);
+      break;
+    }
+    if (req.hdr.version != LG_CONFIG_VER) {
+      WLOG_D("Configuration version %u not supported, ignored", req.hdr.version);
+      break;
+    }
+    if (req.hdr.maps_len > datalen - sizeof(req.hdr)) {
+      WLOG_DD("Truncated configuration (%u of %u bytes), ignored",
+          datalen - (uint32)sizeof(req.hdr), req.hdr.maps_len);
+      break;
+    }
+    cqueue_get(pqueue, sizeof(lg_datapkt_hdr) + sizeof(req.hdr),
+        MIN(req.hdr.maps_len, sizeof(req) - sizeof(req.hdr)),
+        (unsigned char *) &req + sizeof(req.hdr));
+    lg_filter_config(filter, &req);
+    ILOG1_S("Event filter configured: %s", filter->pass_all ? "all events" : "filtered");
+
+    policy = LG_OVERFLOW_DEFAULT;
+    if (datalen > sizeof(req.hdr) + req.hdr.maps_len) {
+      cqueue_get(pqueue, sizeof(lg_datapkt_hdr) + sizeof(req.hdr) + req.hdr.maps_len,
+          sizeof(policy), &policy);
+      if (policy > LG_OVERFLOW_DISCONNECT && policy != LG_OVERFLOW_DEFAULT) {
+        WLOG_D("Overflow policy %u not supported, ignored", policy);
+        policy = LG_OVERFLOW_DEFAULT;
+      }
+    }
+    filter->overflow_policy = policy;
     break;
 
   case MSGID_REQ_START_LOGGING:
     ILOG9_V("Received MSGID_REQ_START_LOGGIN");
+    filter->started = TRUE;
     break;
 
   case MSGID_REQ_STOP_LOGGING:
     ILOG9_V("Received MSGID_REQ_STOP_LOGGIN");
+    filter->started = FALSE;
     break;
 
   case MSGID_RESP_CONNECT:
@@ -113,7 +228,7 @@ process_pkt(cqueue_t *pqueue)
 // 0  - no complete packets in queue
 // 1  - packet processed succesfully
 int
-lg_process_next_pkt(cqueue_t *pqueue)
+lg_process_next_pkt(cqueue_t *pqueue, lg_filter_t *filter)
 {
   int sz = cqueue_size(pqueue);
   uint32 datalen;
@@ -139,7 +254,7 @@ lg_process_next_pkt(cqueue_t *pqueue)
   // Process this packet.
 
   ILOG9_V("Calling process_pkt");
-  if (0 != process_pkt(pqueue)) {
+  if (0 != process_pkt(pqueue, datalen, filter)) {
     return -1;
   }
 
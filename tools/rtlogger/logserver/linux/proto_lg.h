@@ -23,7 +23,54 @@
 #ifndef __PROTO_LG_H__
 #define __PROTO_LG_H__
 
-int lg_process_next_pkt(cqueue_t *pqueue);
+#include "cqueue.h"
+#include "logdefs.h"
+
+#define LG_FILTER_NOF_FIDS    32  /* LOG_INFO_W0_FID is 5 bits */
+#define LG_FILTER_NOF_LEVELS  8   /* LOG_INFO_W1_PRIOR is 3 bits */
+
+/* Slow client policies a client may request with MSGID_REQ_CONFIG */
+#define LG_OVERFLOW_DROP_NEWEST  0
+#define LG_OVERFLOW_DROP_OLDEST  1
+#define LG_OVERFLOW_DISCONNECT   2
+#define LG_OVERFLOW_DEFAULT      0xFF /* none requested, the server's one */
+
+/* Events a client subscribed to with MSGID_REQ_CONFIG and
+ * MSGID_REQ_START/STOP_LOGGING. The requested OID and GID bitmaps are
+ * expanded into a single OID x GID bitmap, so an event is matched with
+ * three bit tests.
+ */
+typedef struct _lg_filter_t
+{
+  BOOL   started;    /* logging hasn't been stopped by the client */
+  BOOL   pass_all;   /* every OID, GID, FID and level is requested */
+  uint32 grp_map[MAX_OID * MAX_GID / 32];
+  uint32 fid_mask;
+  uint32 level_mask;
+  uint8  overflow_policy; /* LG_OVERFLOW_... */
+} lg_filter_t;
+
+void lg_filter_init(lg_filter_t *filter);
+
+/* Every event is sent, no need to look at them */
+static __INLINE BOOL
+lg_filter_pass_all (const lg_filter_t *filter)
+{
+  return filter->started && filter->pass_all;
+}
+
+static __INLINE BOOL
+lg_filter_match (const lg_filter_t *filter, const mtlk_log_event_t *log_evt)
+{
+  uint32 grp = LOG_INFO_GET_OID(*log_evt) * MAX_GID + LOG_INFO_GET_GID(*log_evt);
+
+  return filter->started &&
+         (filter->grp_map[grp / 32] & (1U << (grp % 32))) &&
+         (filter->fid_mask & (1U << LOG_INFO_GET_FID(*log_evt))) &&
+         (filter->level_mask & (1U << MTLK_BFIELD_GET(log_evt->info_w1, LOG_INFO_W1_PRIOR)));
+}
+
+int lg_process_next_pkt(cqueue_t *pqueue, lg_filter_t *filter);
 
 #endif // !__PROTO_LG_H__
 
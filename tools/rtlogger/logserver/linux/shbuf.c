@@ -0,0 +1,344 @@
+/******************************************************************************
+
+         Copyright (c) 2020, MaxLinear, Inc.
+         Copyright 2016 - 2020 Intel Corporation
+         Copyright 2015 - 2016 Lantiq Beteiligungs-GmbH & Co. KG
+         Copyright 2009 - 2014 Lantiq Deutschland GmbH
+         Copyright 2007 - 2008 Infineon Technologies AG
+
+  For licensing information, see the file 'LICENSE' in the root folder of
+  this software module.
+
+*******************************************************************************/
+
+/*
+ * 
+ *
+ * Shared buffers
+ *
+ */
+
+#include "mtlkinc.h"
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <unistd.h>
+#include <sys/uio.h>
+
+#include "logsrv_utils.h"
+#include "shbuf.h"
+
+#define LOG_LOCAL_GID   GID_SHBUF
+#define LOG_LOCAL_FID   1
+
+/*****************************************************************************
+**
+** shbuf_alloc - allocates a buffer with reference count of 1.
+** shbuf_reserve - grows a buffer owned by the caller only (refcnt == 1).
+** shbuf_append - appends data to a buffer owned by the caller only.
+** shbuf_printf - appends formatted text to a buffer owned by the caller only.
+** shbuf_get - takes one more reference to a buffer.
+** shbuf_put - drops a reference, the buffer is freed when none are left.
+** shbuf_cleanup - frees the recycled buffers (at exit).
+**
+** shbuf_queue_init - initializes a newly created queue (constructor).
+** shbuf_queue_cleanup - drops all queued references (destructor).
+** shbuf_queue_push_back - queues a reference to a buffer.
+** shbuf_queue_push_next - queues a buffer right after the one being written.
+** shbuf_queue_drop_oldest - drops buffers that weren't started yet.
+** shbuf_queue_write - writes queued buffers to fd with a single writev().
+**
+** Buffers of the default size are recycled through a small free list,
+** so steady-state formatting does not hit malloc() for every event.
+******************************************************************************/
+
+#define SHBUF_DEFAULT_SIZE   4096
+#define SHBUF_POOL_MAX       64
+#define SHBUF_QUEUE_INIT_REFS 16
+#define SHBUF_QUEUE_IOV_MAX  64
+
+static shbuf_t *shbuf_pool[SHBUF_POOL_MAX];
+static int shbuf_pool_count = 0;
+
+shbuf_t *
+shbuf_alloc (size_t size)
+{
+  shbuf_t *buf;
+
+  if (size <= SHBUF_DEFAULT_SIZE && shbuf_pool_count > 0) {
+    buf = shbuf_pool[--shbuf_pool_count];
+  } else {
+    if (size < SHBUF_DEFAULT_SIZE)
+      size = SHBUF_DEFAULT_SIZE;
+    buf = (shbuf_t *) malloc(sizeof(shbuf_t) + size);
+    if (!buf) {
+      ELOG_V("Out of memory");
+      return NULL;
+    }
+    buf->size = size;
+  }
+
+  buf->refcnt = 1;
+  buf->len = 0;
+
+  return buf;
+}
+
+int
+shbuf_reserve (shbuf_t **pbuf, size_t size)
+{
+  shbuf_t *buf = *pbuf;
+  size_t new_size;
+
+  ASSERT(buf->refcnt == 1);
+
+  if (size <= buf->size)
+    return 0;
+
+  new_size = buf->size;
+  while (new_size < size)
+    new_size *= 2;
+
+  buf = (shbuf_t *) realloc(buf, sizeof(shbuf_t) + new_size);
+  if (!buf) {
+    ELOG_V("Out of memory");
+    return -1;
+  }
+  buf->size = new_size;
+  *pbuf = buf;
+
+  return 0;
+}
+
+int
+shbuf_append (shbuf_t **pbuf, const void *data, size_t len)
+{
+  if (0 != shbuf_reserve(pbuf, (*pbuf)->len + len))
+    return -1;
+
+  wave_memcpy((*pbuf)->data + (*pbuf)->len, (*pbuf)->size - (*pbuf)->len, data, len);
+  (*pbuf)->len += len;
+
+  return 0;
+}
+
+int
+shbuf_printf (shbuf_t **pbuf, const char *fmt, ...)
+{
+  va_list args;
+  int printed;
+
+  for (;;) {
+    size_t space_left = (*pbuf)->size - (*pbuf)->len;
+
+    va_start(args, fmt);
+    printed = vsnprintf((*pbuf)->data + (*pbuf)->len, space_left, fmt, args);
+    va_end(args);
+
+    if (printed < 0) {
+      ELOG_V("Formatting error");
+      return -1;
+    }
+    if ((size_t)printed < space_left)
+      break;
+
+    /* Not enough space for the text and its terminating zero */
+    if (0 != shbuf_reserve(pbuf, (*pbuf)->len + printed + 1))
+      return -1;
+  }
+  (*pbuf)->len += printed;
+
+  return 0;
+}
+
+void
+shbuf_put (shbuf_t *buf)
+{
+  ASSERT(buf->refcnt > 0);
+
+  if (--buf->refcnt)
+    return;
+
+  if (buf->size == SHBUF_DEFAULT_SIZE && shbuf_pool_count < SHBUF_POOL_MAX)
+    shbuf_pool[shbuf_pool_count++] = buf;
+  else
+    free(buf);
+}
+
+void
+shbuf_cleanup (void)
+{
+  while (shbuf_pool_count > 0)
+    free(shbuf_pool[--shbuf_pool_count]);
+}
+
+void
+shbuf_queue_init (shbuf_queue_t *pqueue)
+{
+  memset(pqueue, 0, sizeof(*pqueue));
+}
+
+static void
+shbuf_queue_pop_front (shbuf_queue_t *pqueue)
+{
+  shbuf_t *buf = pqueue->refs[pqueue->first];
+
+  ASSERT(pqueue->count > 0);
+
+  pqueue->bytes -= buf->len - pqueue->first_offset;
+  pqueue->first_offset = 0;
+  pqueue->first = (pqueue->first + 1) & (pqueue->max_refs - 1);
+  --pqueue->count;
+
+  shbuf_put(buf);
+}
+
+void
+shbuf_queue_cleanup (shbuf_queue_t *pqueue)
+{
+  while (pqueue->count)
+    shbuf_queue_pop_front(pqueue);
+
+  if (pqueue->refs) {
+    free(pqueue->refs);
+    pqueue->refs = NULL;
+  }
+  pqueue->max_refs = 0;
+}
+
+static int
+shbuf_queue_grow (shbuf_queue_t *pqueue)
+{
+  int new_max = pqueue->max_refs ? 2 * pqueue->max_refs : SHBUF_QUEUE_INIT_REFS;
+  shbuf_t **refs = (shbuf_t **) malloc(new_max * sizeof(shbuf_t *));
+  int i;
+
+  if (!refs) {
+    ELOG_V("Out of memory");
+    return -1;
+  }
+  for (i = 0; i < pqueue->count; i++)
+    refs[i] = pqueue->refs[(pqueue->first + i) & (pqueue->max_refs - 1)];
+  free(pqueue->refs);
+
+  pqueue->refs = refs;
+  pqueue->max_refs = new_max;
+  pqueue->first = 0;
+
+  return 0;
+}
+
+int
+shbuf_queue_push_back (shbuf_queue_t *pqueue, shbuf_t *buf)
+{
+  if (!buf->len)
+    return 0;
+
+  if (pqueue->count == pqueue->max_refs && 0 != shbuf_queue_grow(pqueue))
+    return -1;
+
+  pqueue->refs[(pqueue->first + pqueue->count) & (pqueue->max_refs - 1)] =
+    shbuf_get(buf);
+  ++pqueue->count;
+  pqueue->bytes += buf->len;
+
+  return 0;
+}
+
+int
+shbuf_queue_push_next (shbuf_queue_t *pqueue, shbuf_t *buf)
+{
+  int mask;
+
+  if (!buf->len)
+    return 0;
+
+  if (pqueue->count == pqueue->max_refs && 0 != shbuf_queue_grow(pqueue))
+    return -1;
+
+  mask = pqueue->max_refs - 1;
+  pqueue->first = (pqueue->first - 1) & mask;
+  if (pqueue->first_offset) {
+    // The partially written buffer stays in front
+    pqueue->refs[pqueue->first] = pqueue->refs[(pqueue->first + 1) & mask];
+    pqueue->refs[(pqueue->first + 1) & mask] = shbuf_get(buf);
+  } else {
+    pqueue->refs[pqueue->first] = shbuf_get(buf);
+  }
+  ++pqueue->count;
+  pqueue->bytes += buf->len;
+
+  return 0;
+}
+
+int
+shbuf_queue_drop_oldest (shbuf_queue_t *pqueue, size_t bytes, size_t *pdropped)
+{
+  int keep = pqueue->first_offset ? 1 : 0;
+  int mask = pqueue->max_refs - 1;
+  int nof_dropped = 0;
+  size_t dropped = 0;
+
+  while (dropped < bytes && pqueue->count > keep) {
+    int idx = (pqueue->first + keep) & mask;
+    shbuf_t *buf = pqueue->refs[idx];
+
+    if (keep)
+      pqueue->refs[idx] = pqueue->refs[pqueue->first];
+    pqueue->first = (pqueue->first + 1) & mask;
+    --pqueue->count;
+    pqueue->bytes -= buf->len;
+    dropped += buf->len;
+    ++nof_dropped;
+
+    shbuf_put(buf);
+  }
+
+  if (pdropped)
+    *pdropped = dropped;
+
+  return nof_dropped;
+}
+
+// Same return values as cqueue_write()
+int
+shbuf_queue_write (shbuf_queue_t *pqueue, int fd)
+{
+  struct iovec iov[SHBUF_QUEUE_IOV_MAX];
+  int nof_iov = MIN(pqueue->count, SHBUF_QUEUE_IOV_MAX);
+  ssize_t ret;
+  size_t written;
+  int i;
+
+  ASSERT(!shbuf_queue_empty(pqueue));
+
+  for (i = 0; i < nof_iov; i++) {
+    shbuf_t *buf = pqueue->refs[(pqueue->first + i) & (pqueue->max_refs - 1)];
+    size_t offset = i ? 0 : pqueue->first_offset;
+
+    iov[i].iov_base = buf->data + offset;
+    iov[i].iov_len  = buf->len - offset;
+  }
+
+  ret = writev(fd, iov, nof_iov);
+  ILOG9_DD("shbuf_queue_write: writev(%d) returned %d", nof_iov, (int)ret);
+  if (ret <= 0)
+    return (int)ret;
+
+  written = (size_t)ret;
+  while (written) {
+    shbuf_t *buf = pqueue->refs[pqueue->first];
+    size_t left = buf->len - pqueue->first_offset;
+
+    if (written < left) {
+      pqueue->first_offset += written;
+      pqueue->bytes -= written;
+      break;
+    }
+    written -= left;
+    shbuf_queue_pop_front(pqueue);
+  }
+
+  return 1;
+}
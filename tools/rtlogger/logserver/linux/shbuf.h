@@ -0,0 +1,83 @@
+/******************************************************************************
+
+         Copyright (c) 2020, MaxLinear, Inc.
+         Copyright 2016 - 2020 Intel Corporation
+         Copyright 2015 - 2016 Lantiq Beteiligungs-GmbH & Co. KG
+         Copyright 2009 - 2014 Lantiq Deutschland GmbH
+         Copyright 2007 - 2008 Infineon Technologies AG
+
+  For licensing information, see the file 'LICENSE' in the root folder of
+  this software module.
+
+*******************************************************************************/
+
+/*
+ * 
+ *
+ * Shared buffers
+ *
+ */
+
+#ifndef __SHBUF_H__
+#define __SHBUF_H__
+
+#include <stddef.h>
+
+/* Reference-counted data buffer. A single buffer is queued to several
+ * connections at once instead of being copied to each of them.
+ */
+typedef struct _shbuf_t
+{
+  int refcnt;
+  size_t size;
+  size_t len;
+  char data[0];
+} shbuf_t;
+
+/* Queue of shared buffer references waiting to be written to a socket */
+typedef struct _shbuf_queue_t
+{
+  shbuf_t **refs;
+  int max_refs;       /* always a power of 2 */
+  int first;
+  int count;
+  size_t first_offset; /* bytes of the first buffer already written */
+  size_t bytes;        /* total bytes waiting to be written */
+} shbuf_queue_t;
+
+shbuf_t *shbuf_alloc (size_t size);
+int shbuf_reserve (shbuf_t **pbuf, size_t size);
+int shbuf_append (shbuf_t **pbuf, const void *data, size_t len);
+int shbuf_printf (shbuf_t **pbuf, const char *fmt, ...)
+  __attribute__((format(printf, 2, 3)));
+void shbuf_put (shbuf_t *buf);
+void shbuf_cleanup (void);
+
+static __INLINE shbuf_t *
+shbuf_get (shbuf_t *buf)
+{
+  ++buf->refcnt;
+  return buf;
+}
+
+void shbuf_queue_init (shbuf_queue_t *pqueue);
+void shbuf_queue_cleanup (shbuf_queue_t *pqueue);
+int shbuf_queue_push_back (shbuf_queue_t *pqueue, shbuf_t *buf);
+int shbuf_queue_push_next (shbuf_queue_t *pqueue, shbuf_t *buf);
+int shbuf_queue_drop_oldest (shbuf_queue_t *pqueue, size_t bytes,
+                             size_t *pdropped);
+int shbuf_queue_write (shbuf_queue_t *pqueue, int fd);
+
+static __INLINE int
+shbuf_queue_empty (shbuf_queue_t *pqueue)
+{
+  return pqueue->count == 0;
+}
+
+static __INLINE size_t
+shbuf_queue_size (shbuf_queue_t *pqueue)
+{
+  return pqueue->bytes;
+}
+
+#endif // !__SHBUF_H__
@@ -16,40 +16,62 @@
 #include "mtlk_rtlog_app.h"
 #endif
 
+volatile uint32 mtlk_log_levels[MAX_GID] = {
+  [0 ... MAX_GID - 1] = MTLK_LOG_LEVELS_WORD(MTLK_LOG_DEF_DLEVEL, MTLK_LOG_DEF_DLEVEL_REMOTE)
+};
+
+void __MTLK_IFUNC
+mtlk_log_set_levels (int dlevel, int dlevel_remote)
+{
+  uint32 levels = MTLK_LOG_LEVELS_WORD(dlevel, dlevel_remote);
+  int gid;
+
+  IWLWAV_RTLOG_DLEVEL_VAR = dlevel;
+  IWLWAV_RTLOG_DLEVEL_VAR_REMOTE = dlevel_remote;
+
+  /* Each application uses the same debug level for all GIDs */
+  for (gid = 0; gid < MAX_GID; gid++) {
+    mtlk_log_levels[gid] = levels;
+  }
+}
+
 int mtlk_log_get_flags(int level, int oid, int gid)
 {
   int flags = 0;
+  uint32 levels;
 
   MTLK_UNREFERENCED_PARAM(oid); /* each application has constant unique OID */
-  MTLK_UNREFERENCED_PARAM(gid); /* each application uses the same debug level for all GIDs */
 
-  if (level <= IWLWAV_RTLOG_DLEVEL_VAR) {
+  if ((level < IWLWAV_RTLOG_SILENT_DLEVEL) || (level - IWLWAV_RTLOG_SILENT_DLEVEL >= 16)) {
+    return 0;
+  }
+
+  levels = mtlk_log_levels[(uint32)gid % MAX_GID];
+  if (levels & MTLK_LOG_LEVEL_BIT(level)) {
     flags |= LOG_TARGET_CONSOLE;
   }
-  if (level <= IWLWAV_RTLOG_DLEVEL_VAR_REMOTE) {
+  if (levels & (MTLK_LOG_LEVEL_BIT(level) << 16)) {
     flags |= LOG_TARGET_REMOTE;
   }
   return flags;
 }
 
 #ifdef CONFIG_WAVE_RTLOG_REMOTE
+/* The event is written right into the message to be sent: its header
+ * is only read, the data go out as they are */
 mtlk_log_buf_entry_t *mtlk_log_new_pkt_reserve(uint32 pkt_size, uint8 **ppdata)
 {
-  mtlk_log_buf_entry_t *res = (mtlk_log_buf_entry_t *)malloc(sizeof(mtlk_log_buf_entry_t));
+  mtlk_log_buf_entry_t *res;
 
-  if (NULL != res) {
-    memset((void *)res, 0, sizeof(*res));
+  if ((pkt_size <= sizeof(mtlk_log_event_t)) ||
+      (pkt_size - sizeof(mtlk_log_event_t) > (uint16)-1)) {
+    return NULL;
+  }
 
-    res->data = (uint8 *)malloc(pkt_size);
+  res = mtlk_rtlog_app_log_msg_reserve(sizeof(mtlk_log_event_t),
+                                       (uint16)(pkt_size - sizeof(mtlk_log_event_t)));
+  if (NULL != res) {
     *ppdata = res->data;
-
-    if (NULL == res->data) {
-      free((void *)res);
-      return NULL;
-    }
-    memset((void *)res->data, 0, pkt_size);
-
-    res->size = pkt_size;
   }
   return res;
 }
@@ -59,15 +81,12 @@ void mtlk_log_new_pkt_release(mtlk_log_buf_entry_t *buf)
   uint32 ids;
   mtlk_log_event_t *hdr = (mtlk_log_event_t *)buf->data;
 
+  /* Read before the header room gets overwritten */
   ids = LOG_INFO_MAKE_WORD(LOG_INFO_GET_LID(*hdr),
                            LOG_INFO_GET_OID(*hdr),
                            LOG_INFO_GET_GID(*hdr),
                            LOG_INFO_GET_FID(*hdr));
 
-  mtlk_rtlog_app_send_log_msg(ids, (uint32)timestamp(),
-                              (void *)(buf->data + sizeof(*hdr)),
-                              (uint16)(buf->size - sizeof(*hdr)));
-  free((void *)buf->data);
-  free((void *)buf);
+  mtlk_rtlog_app_log_msg_send(buf, sizeof(*hdr), ids, (uint32)timestamp());
 }
 #endif
@@ -74,6 +74,28 @@ extern int IWLWAV_RTLOG_DLEVEL_VAR;
 #define IWLWAV_RTLOG_DLEVEL_VAR_REMOTE debug_remote
 extern int IWLWAV_RTLOG_DLEVEL_VAR_REMOTE;
 
+#define MTLK_LOG_DEF_DLEVEL         0
+#define MTLK_LOG_DEF_DLEVEL_REMOTE  (-1)
+
+/* Levels enabled per GID, one word each: bit (level - SILENT_DLEVEL) of
+ * the low half for the console, of the high half for the remote target.
+ * A word is always stored at once, so it's read without locks and a
+ * disabled log point only costs a load and a branch. */
+#define MTLK_LOG_LEVEL_BIT(level)       (1U << ((level) - IWLWAV_RTLOG_SILENT_DLEVEL))
+#define MTLK_LOG_LEVELS_UPTO(level)     (((level) < IWLWAV_RTLOG_SILENT_DLEVEL) ? 0 :              \
+                                         ((level) - IWLWAV_RTLOG_SILENT_DLEVEL >= 15) ? 0xFFFFU :  \
+                                         ((MTLK_LOG_LEVEL_BIT(level) << 1) - 1))
+#define MTLK_LOG_LEVELS_WORD(dlevel, dlevel_remote) \
+  (MTLK_LOG_LEVELS_UPTO(dlevel) | (MTLK_LOG_LEVELS_UPTO(dlevel_remote) << 16))
+
+extern volatile uint32 mtlk_log_levels[];
+
+#define mtlk_log_enabled(level, oid, gid) \
+  __builtin_expect((mtlk_log_levels[(gid)] & (MTLK_LOG_LEVEL_BIT(level) * 0x10001U)) != 0, 0)
+
+/* Sets the console and remote levels of every GID */
+void __MTLK_IFUNC mtlk_log_set_levels(int dlevel, int dlevel_remote);
+
 #define mtlk_log_get_timestamp()    (uint32)mtlk_osal_timestamp()
 
 #define MTLK_IDEFS_ON
@@ -81,8 +103,9 @@ extern int IWLWAV_RTLOG_DLEVEL_VAR_REMOTE;
 
 struct _mtlk_log_buf_entry_t
 {
-  uint8  *data; /* pointer to data buffer */
-  uint32 size;  /* data size */
+  uint8  *data;   /* pointer to data buffer */
+  uint32 size;    /* data size */
+  BOOL   queued;  /* in the asynchronous delivery ring (rtlog app) */
 } __MTLK_IDATA;
 
 #define   MTLK_IDEFS_OFF
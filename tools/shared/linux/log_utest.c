@@ -0,0 +1,126 @@
+/******************************************************************************
+
+         Copyright (c) 2020, MaxLinear, Inc.
+         Copyright 2016 - 2020 Intel Corporation
+         Copyright 2015 - 2016 Lantiq Beteiligungs-GmbH & Co. KG
+         Copyright 2009 - 2014 Lantiq Deutschland GmbH
+         Copyright 2007 - 2008 Infineon Technologies AG
+
+  For licensing information, see the file 'LICENSE' in the root folder of
+  this software module.
+
+*******************************************************************************/
+
+/*
+ *  Unit test and benchmark of the log levels checked at the log point.
+ *  mtlk_log_enabled() must agree with mtlk_log_get_flags() for every
+ *  level pair set. Then the cost of a disabled log point is measured
+ *  against a call of the log function, what each log point used to do,
+ *  and against the bare loop.
+ */
+
+#ifdef RUN_LOG_UTEST
+
+#include "mtlkinc.h"
+#include "mtlk_osal.h"
+#include "log_utest.h"
+
+#define LOG_LOCAL_GID   GID_LOG
+#define LOG_LOCAL_FID   1
+
+#define LOG_UTEST_NOF_ITERS   (64 * 1024 * 1024)
+
+typedef enum
+{
+  LOG_UTEST_CHECKED,
+  LOG_UTEST_CALLED,
+  LOG_UTEST_EMPTY,
+  LOG_UTEST_LAST
+} log_utest_loop_e;
+
+static const char *const log_utest_loop_names[LOG_UTEST_LAST] = {
+  "disabled log point",
+  "log function call",
+  "empty loop",
+};
+
+static volatile uint32 log_utest_sink;
+
+static BOOL
+_log_utest_check_levels (void)
+{
+  int dlevel, dlevel_remote, level;
+
+  for (dlevel = IWLWAV_RTLOG_SILENT_DLEVEL - 1; dlevel <= IWLWAV_RTLOG_MAX_DLEVEL + 1; dlevel++) {
+    for (dlevel_remote = IWLWAV_RTLOG_SILENT_DLEVEL - 1; dlevel_remote <= IWLWAV_RTLOG_MAX_DLEVEL + 1; dlevel_remote++) {
+      mtlk_log_set_levels(dlevel, dlevel_remote);
+      for (level = IWLWAV_RTLOG_SILENT_DLEVEL; level <= IWLWAV_RTLOG_MAX_DLEVEL; level++) {
+        int flags = mtlk_log_get_flags(level, LOG_LOCAL_OID, LOG_LOCAL_GID);
+
+        if ((0 != flags) != (0 != mtlk_log_enabled(level, LOG_LOCAL_OID, LOG_LOCAL_GID)) ||
+            ((0 != (flags & LOG_TARGET_CONSOLE)) != (level <= dlevel)) ||
+            ((0 != (flags & LOG_TARGET_REMOTE)) != (level <= dlevel_remote))) {
+          return FALSE;
+        }
+      }
+    }
+  }
+
+  return TRUE;
+}
+
+static uint32
+_log_utest_loop (log_utest_loop_e loop)
+{
+  mtlk_osal_timestamp_t start;
+  uint32 i;
+
+  start = mtlk_osal_timestamp();
+  for (i = 0; i < LOG_UTEST_NOF_ITERS; i++) {
+    switch (loop) {
+    case LOG_UTEST_CHECKED:
+      ILOG0_D("LOG: disabled log point %u", i);
+      break;
+    case LOG_UTEST_CALLED:
+      __ILOG0_D_4(LOG_CONSOLE_TEXT_INFO, 0, LOG_LOCAL_OID, LOG_LOCAL_GID, LOG_LOCAL_FID, __LINE__,
+                  "LOG: disabled log point %u", (int32)i);
+      break;
+    default:
+      break;
+    }
+    log_utest_sink = i;
+  }
+
+  /* Picoseconds per iteration */
+  return (uint32)(((uint64)mtlk_osal_timestamp_to_ms(mtlk_osal_timestamp() - start) * 1000000000ULL) /
+                  LOG_UTEST_NOF_ITERS);
+}
+
+BOOL __MTLK_IFUNC
+run_log_utest (void)
+{
+  int dlevel = IWLWAV_RTLOG_DLEVEL_VAR;
+  int dlevel_remote = IWLWAV_RTLOG_DLEVEL_VAR_REMOTE;
+  uint32 ps[LOG_UTEST_LAST];
+  log_utest_loop_e loop;
+  BOOL pased;
+
+  /* Nothing is logged until the levels are restored */
+  pased = _log_utest_check_levels();
+
+  mtlk_log_set_levels(IWLWAV_RTLOG_RELEASE_DLEVEL, IWLWAV_RTLOG_RELEASE_DLEVEL);
+  for (loop = LOG_UTEST_CHECKED; loop < LOG_UTEST_LAST; loop++) {
+    ps[loop] = _log_utest_loop(loop);
+  }
+
+  mtlk_log_set_levels(dlevel, dlevel_remote);
+
+  ILOG0_S("LOG: Levels check %s", (TRUE == pased) ? "SUCCEED" : "FAILED");
+  for (loop = LOG_UTEST_CHECKED; loop < LOG_UTEST_LAST; loop++) {
+    ILOG0_SD("LOG: %s: %u ps per iteration", log_utest_loop_names[loop], ps[loop]);
+  }
+
+  return pased;
+}
+
+#endif /* RUN_LOG_UTEST */
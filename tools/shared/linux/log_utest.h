@@ -0,0 +1,31 @@
+/******************************************************************************
+
+         Copyright (c) 2020, MaxLinear, Inc.
+         Copyright 2016 - 2020 Intel Corporation
+         Copyright 2015 - 2016 Lantiq Beteiligungs-GmbH & Co. KG
+         Copyright 2009 - 2014 Lantiq Deutschland GmbH
+         Copyright 2007 - 2008 Infineon Technologies AG
+
+  For licensing information, see the file 'LICENSE' in the root folder of
+  this software module.
+
+*******************************************************************************/
+
+/*
+ *  Unit test and benchmark of the log levels checked at the log point
+ */
+#ifndef __LOG_UTEST_H__
+#define __LOG_UTEST_H__
+
+#ifdef RUN_LOG_UTEST
+
+BOOL __MTLK_IFUNC
+run_log_utest(void);
+
+#else /* RUN_LOG_UTEST */
+
+#define run_log_utest()
+
+#endif /* RUN_LOG_UTEST */
+
+#endif /* __LOG_UTEST_H__ */
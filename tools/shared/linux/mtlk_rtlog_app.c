@@ -19,6 +19,9 @@
 #include <sys/types.h>
 #include <sys/wait.h>
 #include <signal.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/uio.h>
 #include "nl.h"
 
 #define LOG_LOCAL_GID   GID_RTLOG_APP
@@ -81,55 +84,659 @@ __setup_signals (void)
   signal(SIGALRM, SIG_IGN);
 }
 
+/* Log messages are built in place in a netlink message preallocated per
+ * thread, so sending one takes neither allocations nor copies. A thread
+ * only falls back to a message allocated for the occasion when its own
+ * one is busy (a signal handler logs in the middle of a log call) or the
+ * message doesn't fit.
+ */
+#define RTLOG_APP_LOG_MSG_MAX_DATA  2048
+
+typedef struct _rtlog_app_log_msg_t
+{
+  mtlk_log_buf_entry_t entry;     /* header room followed by the data */
+  struct nl_msg       *msg;
+  rtlog_app_drv_msg_t *drv_msg;   /* in msg, the data follow it */
+  BOOL                 busy;
+  BOOL                 temporary; /* allocated for a single message */
+} rtlog_app_log_msg_t;
+
+static pthread_key_t  log_msg_key;
+static pthread_once_t log_msg_key_once = PTHREAD_ONCE_INIT;
+static BOOL           log_msg_key_created = FALSE;
+
+static rtlog_app_log_msg_t *
+_log_msg_alloc (uint16 max_data_len)
+{
+  rtlog_app_log_msg_t *lmsg = (rtlog_app_log_msg_t *)malloc(sizeof(*lmsg));
+
+  if (NULL == lmsg) {
+    return NULL;
+  }
+  memset(lmsg, 0, sizeof(*lmsg));
+
+  lmsg->msg = nlmsg_alloc_size(wave_nlink_brd_msg_size(sizeof(rtlog_app_drv_msg_t) + max_data_len));
+  if (NULL == lmsg->msg) {
+    free(lmsg);
+    return NULL;
+  }
+
+  return lmsg;
+}
+
+static void
+_log_msg_free (void *param)
+{
+  rtlog_app_log_msg_t *lmsg = (rtlog_app_log_msg_t *)param;
+
+  nlmsg_free(lmsg->msg);
+  free(lmsg);
+}
+
+/* Must not log: it's called on the log path */
+static void
+_log_msg_key_create (void)
+{
+  log_msg_key_created = (0 == pthread_key_create(&log_msg_key, _log_msg_free));
+}
+
+static rtlog_app_log_msg_t *
+_log_msg_get (uint16 data_len)
+{
+  rtlog_app_log_msg_t *lmsg = NULL;
+
+  if ((data_len <= RTLOG_APP_LOG_MSG_MAX_DATA) &&
+      (0 == pthread_once(&log_msg_key_once, _log_msg_key_create)) && log_msg_key_created) {
+    lmsg = (rtlog_app_log_msg_t *)pthread_getspecific(log_msg_key);
+    if (NULL == lmsg) {
+      lmsg = _log_msg_alloc(RTLOG_APP_LOG_MSG_MAX_DATA);
+      if ((NULL != lmsg) && (0 != pthread_setspecific(log_msg_key, lmsg))) {
+        _log_msg_free(lmsg);
+        lmsg = NULL;
+      }
+    }
+  }
+
+  if ((NULL == lmsg) || lmsg->busy) {
+    lmsg = _log_msg_alloc(data_len);
+    if (NULL == lmsg) {
+      return NULL;
+    }
+    lmsg->temporary = TRUE;
+  }
+
+  lmsg->busy = TRUE;
+  return lmsg;
+}
+
+static void
+_log_msg_put (rtlog_app_log_msg_t *lmsg)
+{
+  if (lmsg->temporary) {
+    _log_msg_free(lmsg);
+  }
+  else {
+    lmsg->busy = FALSE;
+  }
+}
+
+/* Asynchronous delivery: the log calls only queue their messages to a
+ * ring, the sender thread sends them in batches, many messages per
+ * datagram.
+ * The ring is a bounded MPSC queue. A producer claims a slot by advancing
+ * enqueue_pos, builds the whole netlink message in it in place and
+ * commits it by setting the slot's seq. The sender sends the committed
+ * slots it finds from dequeue_pos on, then releases them by advancing
+ * dequeue_pos. Positions are 31 bits wide: the top bit of enqueue_pos
+ * stops the ring, so nothing is claimed anymore.
+ * nof_writers counts the producers between the claim (stopped ring check
+ * included) and the commit. The ring is freed on stop only when there's
+ * none left: one stuck in a slot past RTLOG_APP_ASYNC_WAIT_MS (or killed
+ * there) leaves it allocated.
+ */
+#define RTLOG_APP_ASYNC_SLOT_SIZE   512               /* whole netlink message */
+#define RTLOG_APP_ASYNC_MAX_SLOTS   (1 << 16)
+#define RTLOG_APP_ASYNC_MAX_BATCH   64                /* messages per datagram */
+#define RTLOG_APP_ASYNC_BATCH_SIZE  (16 * 1024)       /* well below the socket send buffer */
+#define RTLOG_APP_ASYNC_POS_MASK    0x7FFFFFFF
+#define RTLOG_APP_ASYNC_STOPPED     0x80000000
+#define RTLOG_APP_ASYNC_WAIT_MS     200               /* for the messages being written */
+#define RTLOG_APP_ASYNC_REPORT_MS   1000              /* between the drop reports */
+
+typedef struct _rtlog_app_slot_t
+{
+  mtlk_log_buf_entry_t entry;     /* header room followed by the data */
+  rtlog_app_drv_msg_t *drv_msg;   /* in msg, the data follow it */
+  uint32               pos;
+  BOOL                 valid;     /* the message has to be sent */
+  volatile uint32      seq;       /* pos + 1 once committed */
+  uint64               msg[RTLOG_APP_ASYNC_SLOT_SIZE / sizeof(uint64)];
+} rtlog_app_slot_t;
+
+typedef struct _rtlog_app_async_t
+{
+  volatile uint32   enqueue_pos;
+  volatile uint32   dequeue_pos;
+  volatile uint32   nof_writers;  /* producers between claim and commit */
+  uint32            mask;
+  uint32            flush_ms;
+  rtlog_app_slot_t *slots;
+  pthread_t         sender_thread;
+  int               wake_pipe_fd[2];
+  volatile BOOL     stop;
+  pthread_mutex_t   lock;         /* for the flush waiters */
+  pthread_cond_t    flushed;
+  volatile uint32   nof_sent;
+  volatile uint32   nof_dropped;
+  volatile uint32   nof_failed;
+  volatile uint32   nof_batches;
+} rtlog_app_async_t;
+
+static rtlog_app_async_t rtlog_async = {
+  .enqueue_pos  = RTLOG_APP_ASYNC_STOPPED,
+  .wake_pipe_fd = { -1, -1 },
+  .lock         = PTHREAD_MUTEX_INITIALIZER,
+  .flushed      = PTHREAD_COND_INITIALIZER,
+};
+
+static __INLINE BOOL
+__async_pos_before (uint32 pos1, uint32 pos2)
+{
+  uint32 diff = (pos2 - pos1) & RTLOG_APP_ASYNC_POS_MASK;
+
+  return (diff != 0) && (diff <= (RTLOG_APP_ASYNC_POS_MASK >> 1));
+}
+
+/* Must not log: it's called on the log path */
+static void
+_async_wake (rtlog_app_async_t *async)
+{
+  /* Nothing to do if the pipe is full: the sender is awake already */
+  if (write(async->wake_pipe_fd[1], "x", 1) != 1) {
+    return;
+  }
+}
+
+/* MTLK_ERR_NOT_READY: the ring is stopped, MTLK_ERR_NO_RESOURCES: it's full */
+static int
+_async_slot_claim (rtlog_app_async_t *async, rtlog_app_slot_t **slot)
+{
+  uint32 pos;
+  uint32 used;
+
+  /* Counted before the stop check: the stop sees either the writer or
+   * the ring not claimable */
+  __sync_fetch_and_add(&async->nof_writers, 1);
+
+  do {
+    pos = async->enqueue_pos;
+    if (pos & RTLOG_APP_ASYNC_STOPPED) {
+      __sync_fetch_and_sub(&async->nof_writers, 1);
+      return MTLK_ERR_NOT_READY;
+    }
+    used = (pos - async->dequeue_pos) & RTLOG_APP_ASYNC_POS_MASK;
+    if (used > async->mask) {
+      __sync_fetch_and_add(&async->nof_dropped, 1);
+      __sync_fetch_and_sub(&async->nof_writers, 1);
+      return MTLK_ERR_NO_RESOURCES;
+    }
+  } while (!__sync_bool_compare_and_swap(&async->enqueue_pos, pos,
+                                         (pos + 1) & RTLOG_APP_ASYNC_POS_MASK));
+
+  /* Don't wait for the flush interval when the ring fills up */
+  if (used == (async->mask + 1) / 2) {
+    _async_wake(async);
+  }
+
+  *slot = &async->slots[pos & async->mask];
+  (*slot)->pos = pos;
+  return MTLK_ERR_OK;
+}
+
+/* The slot must not be touched after it: the ring may be freed */
+static void
+_async_slot_commit (rtlog_app_async_t *async, rtlog_app_slot_t *slot, BOOL valid)
+{
+  slot->valid = valid;
+  __sync_synchronize();
+  slot->seq = (slot->pos + 1) & RTLOG_APP_ASYNC_POS_MASK;
+  __sync_fetch_and_sub(&async->nof_writers, 1);
+}
+
+/* Tells the ring slots from the other messages by the entry flag only:
+ * the ring may have been stopped (and replaced) since the reservation */
+static rtlog_app_slot_t *
+_async_slot_of (mtlk_log_buf_entry_t *buf)
+{
+  if (buf->queued) {
+    return MTLK_CONTAINER_OF(buf, rtlog_app_slot_t, entry);
+  }
+  return NULL;
+}
+
+static mtlk_log_buf_entry_t *
+_async_reserve (rtlog_app_info_t *info, uint32 hdr_len, uint16 data_len, int *res)
+{
+  rtlog_app_async_t *async = &rtlog_async;
+  uint16 msg_len = (uint16)(sizeof(rtlog_app_drv_msg_t) + data_len);
+  rtlog_app_slot_t *slot;
+
+  if (wave_nlink_brd_msg_size(msg_len) > RTLOG_APP_ASYNC_SLOT_SIZE) {
+    *res = MTLK_ERR_NOT_READY;
+    return NULL;
+  }
+
+  *res = _async_slot_claim(async, &slot);
+  if (MTLK_ERR_OK != *res) {
+    return NULL;
+  }
+
+  slot->drv_msg = (rtlog_app_drv_msg_t *)
+    wave_nlink_brd_msg_build(&info->nl_socket, slot->msg, sizeof(slot->msg),
+                             msg_len, NL_DRV_CMD_RTLOG_NOTIFY);
+  slot->entry.data = (uint8 *)(slot->drv_msg + 1) - hdr_len;
+  slot->entry.size = hdr_len + data_len;
+  slot->entry.queued = TRUE;
+
+  return &slot->entry;
+}
+
+/* Sends the committed messages, returns once the first one not committed
+ * yet is reached */
+static void
+_async_send_pending (rtlog_app_async_t *async)
+{
+  struct iovec iov[RTLOG_APP_ASYNC_MAX_BATCH];
+  uint32 pos = async->dequeue_pos;
+
+  for (;;) {
+    rtlog_app_info_t *info = rtlog_info;
+    uint32 end = pos;
+    int nof_msgs = 0;
+    size_t size = 0;
+
+    while (nof_msgs < RTLOG_APP_ASYNC_MAX_BATCH) {
+      rtlog_app_slot_t *slot = &async->slots[end & async->mask];
+      size_t len;
+
+      if (slot->seq != ((end + 1) & RTLOG_APP_ASYNC_POS_MASK)) {
+        break;
+      }
+      __sync_synchronize();
+
+      if (slot->valid) {
+        len = NLMSG_ALIGN(((struct nlmsghdr *)slot->msg)->nlmsg_len);
+        if (size + len > RTLOG_APP_ASYNC_BATCH_SIZE) {
+          break;
+        }
+        iov[nof_msgs].iov_base = slot->msg;
+        size += len;
+        nof_msgs++;
+      }
+      else {
+        async->nof_failed++;
+      }
+      end = (end + 1) & RTLOG_APP_ASYNC_POS_MASK;
+    }
+
+    if (end == pos) {
+      break;
+    }
+
+    if (nof_msgs) {
+      if ((NULL != info) && (0 == wave_nlink_brd_msgs_send(&info->nl_socket, iov, nof_msgs))) {
+        async->nof_sent += nof_msgs;
+        async->nof_batches++;
+      }
+      else {
+        async->nof_failed += nof_msgs;
+      }
+    }
+
+    /* Release the slots */
+    pos = end;
+    __sync_synchronize();
+    async->dequeue_pos = pos;
+  }
+}
+
+/* Not committed within RTLOG_APP_ASYNC_WAIT_MS of the stop, the messages
+ * left are given up: their producers may have died while writing them */
+static BOOL
+_async_stop_done (rtlog_app_async_t *async, mtlk_osal_timestamp_t deadline)
+{
+  uint32 end = async->enqueue_pos & RTLOG_APP_ASYNC_POS_MASK;
+  uint32 nof_left = (end - async->dequeue_pos) & RTLOG_APP_ASYNC_POS_MASK;
+
+  if (0 == nof_left) {
+    return TRUE;
+  }
+  if (!mtlk_osal_time_after(mtlk_osal_timestamp(), deadline)) {
+    return FALSE;
+  }
+
+  async->nof_failed += nof_left;
+  return TRUE;
+}
+
+static void *
+_async_sender_thread_proc (void *param)
+{
+  rtlog_app_async_t *async = (rtlog_app_async_t *)param;
+  mtlk_osal_timestamp_t deadline = 0;
+  mtlk_osal_timestamp_t report_time = mtlk_osal_timestamp();
+  uint32 nof_reported = 0;
+  BOOL stopping = FALSE;
+  struct pollfd pfd;
+  char buf[64];
+
+  pfd.fd = async->wake_pipe_fd[0];
+  pfd.events = POLLIN;
+
+  for (;;) {
+    BOOL stop = async->stop;
+
+    /* On stop, only the messages being written are waited for */
+    pfd.revents = 0;
+    if (poll(&pfd, 1, stop ? 1 : (int)async->flush_ms) > 0) {
+      while (read(pfd.fd, buf, sizeof(buf)) > 0);
+    }
+
+    _async_send_pending(async);
+
+    pthread_mutex_lock(&async->lock);
+    pthread_cond_broadcast(&async->flushed);
+    pthread_mutex_unlock(&async->lock);
+
+    if (stop) {
+      if (!stopping) {
+        deadline = mtlk_osal_timestamp() + mtlk_osal_ms_to_timestamp(RTLOG_APP_ASYNC_WAIT_MS);
+        stopping = TRUE;
+      }
+      if (_async_stop_done(async, deadline)) {
+        break;
+      }
+    }
+    else if (async->nof_dropped != nof_reported) {
+      mtlk_osal_timestamp_t now = mtlk_osal_timestamp();
+
+      if (mtlk_osal_time_after(now, report_time + mtlk_osal_ms_to_timestamp(RTLOG_APP_ASYNC_REPORT_MS))) {
+        uint32 nof_dropped = async->nof_dropped;
+
+        WLOG_D("%u log messages dropped: asynchronous delivery ring is full",
+               nof_dropped - nof_reported);
+        nof_reported = nof_dropped;
+        report_time = now;
+      }
+    }
+  }
+
+  return NULL;
+}
+
 int __MTLK_IFUNC
-mtlk_rtlog_app_send_log_msg (/*rtlog_app_info_t *info,*/
-        const uint32 ids, /* LID, OID, GID, FID */
-        const uint32 timestamp,
-        const void *data, const uint16 data_len)
+mtlk_rtlog_app_async_start (uint32 nof_slots, uint32 flush_ms)
+{
+  rtlog_app_async_t *async = &rtlog_async;
+  int res;
+
+  if ((0 == nof_slots) || (nof_slots & (nof_slots - 1)) ||
+      (nof_slots > RTLOG_APP_ASYNC_MAX_SLOTS) || (0 == flush_ms)) {
+    ELOG_DD("Wrong asynchronous delivery parameters: slots=%u, flush=%u ms", nof_slots, flush_ms);
+    return MTLK_ERR_PARAMS;
+  }
+  if (!(async->enqueue_pos & RTLOG_APP_ASYNC_STOPPED)) {
+    return MTLK_ERR_ALREADY_EXISTS;
+  }
+
+  async->slots = (rtlog_app_slot_t *)malloc(nof_slots * sizeof(*async->slots));
+  if (NULL == async->slots) {
+    ELOG_D("Can't allocate %u asynchronous delivery slots", nof_slots);
+    return MTLK_ERR_NO_MEM;
+  }
+  memset(async->slots, 0, nof_slots * sizeof(*async->slots));
+
+  if (pipe(async->wake_pipe_fd)) {
+    ELOG_SD("Failed to create pipe: %s (%d)", strerror(errno), errno);
+    res = MTLK_ERR_SYSTEM;
+    goto err_free;
+  }
+  fcntl(async->wake_pipe_fd[0], F_SETFL, O_NONBLOCK);
+  fcntl(async->wake_pipe_fd[1], F_SETFL, O_NONBLOCK);
+
+  async->mask = nof_slots - 1;
+  async->flush_ms = flush_ms;
+  async->dequeue_pos = 0;
+  async->stop = FALSE;
+  async->nof_sent = 0;
+  async->nof_dropped = 0;
+  async->nof_failed = 0;
+  async->nof_batches = 0;
+
+  res = pthread_create(&async->sender_thread, NULL, _async_sender_thread_proc, async);
+  if (res != 0) {
+    ELOG_SD("Failed to create Sender thread: %s (%d)", strerror(res), res);
+    res = MTLK_ERR_SYSTEM;
+    goto err_close;
+  }
+
+  /* Open the ring */
+  __sync_synchronize();
+  async->enqueue_pos = 0;
+
+  ILOG1_DD("Asynchronous delivery started: %u slots, flush every %u ms", nof_slots, flush_ms);
+  return MTLK_ERR_OK;
+
+err_close:
+  close(async->wake_pipe_fd[0]);
+  close(async->wake_pipe_fd[1]);
+err_free:
+  free(async->slots);
+  async->slots = NULL;
+  return res;
+}
+
+int __MTLK_IFUNC
+mtlk_rtlog_app_async_flush (void)
+{
+  rtlog_app_async_t *async = &rtlog_async;
+  uint32 pos;
+  struct timespec wait_tp;
+  int res = 0;
+
+  /* Counted as a writer not to wake up through a closed pipe */
+  __sync_fetch_and_add(&async->nof_writers, 1);
+  pos = async->enqueue_pos;
+  if (pos & RTLOG_APP_ASYNC_STOPPED) {
+    __sync_fetch_and_sub(&async->nof_writers, 1);
+    return MTLK_ERR_OK;
+  }
+
+  _async_wake(async);
+  __sync_fetch_and_sub(&async->nof_writers, 1);
+
+  /* The flushed condition uses the default (realtime) clock */
+  clock_gettime(CLOCK_REALTIME, &wait_tp);
+  wait_tp.tv_nsec += RTLOG_APP_ASYNC_WAIT_MS * NS_PER_MS;
+  if (wait_tp.tv_nsec >= NS_PER_S) {
+    wait_tp.tv_sec  += 1;
+    wait_tp.tv_nsec -= NS_PER_S;
+  }
+
+  pthread_mutex_lock(&async->lock);
+  while ((0 == res) && __async_pos_before(async->dequeue_pos, pos)) {
+    res = pthread_cond_timedwait(&async->flushed, &async->lock, &wait_tp);
+  }
+  pthread_mutex_unlock(&async->lock);
+
+  return (0 == res) ? MTLK_ERR_OK : MTLK_ERR_TIMEOUT;
+}
+
+void __MTLK_IFUNC
+mtlk_rtlog_app_async_stop (void)
+{
+  rtlog_app_async_t *async = &rtlog_async;
+  mtlk_osal_timestamp_t deadline;
+  uint32 pos;
+  int res;
+
+  /* Nothing is queued anymore, the messages queued are sent */
+  do {
+    pos = async->enqueue_pos;
+    if (pos & RTLOG_APP_ASYNC_STOPPED) {
+      return;
+    }
+  } while (!__sync_bool_compare_and_swap(&async->enqueue_pos, pos, pos | RTLOG_APP_ASYNC_STOPPED));
+
+  deadline = mtlk_osal_timestamp() + mtlk_osal_ms_to_timestamp(RTLOG_APP_ASYNC_WAIT_MS);
+  async->stop = TRUE;
+  _async_wake(async);
+
+  res = pthread_join(async->sender_thread, NULL);
+  if (0 != res) {
+    ELOG_SD("Failed to terminate Sender thread: %s (%d)", strerror(res), res);
+  }
+
+  /* A producer still writing to its slot (or waking the sender up) would
+   * write to the freed memory (or to a reused descriptor). The ones just
+   * finding the ring stopped leave it at once. */
+  while ((0 != async->nof_writers) &&
+         !mtlk_osal_time_after(mtlk_osal_timestamp(), deadline)) {
+    mtlk_osal_msleep(1);
+  }
+  __sync_synchronize();
+  if (0 == async->nof_writers) {
+    close(async->wake_pipe_fd[0]);
+    close(async->wake_pipe_fd[1]);
+    free(async->slots);
+  }
+  else {
+    WLOG_D("%u log messages still being written: asynchronous delivery ring left allocated",
+           async->nof_writers);
+  }
+  async->wake_pipe_fd[0] = async->wake_pipe_fd[1] = -1;
+  async->slots = NULL;
+
+  ILOG1_DDDD("Asynchronous delivery stopped: %u sent in %u batches, %u dropped, %u failed",
+             async->nof_sent, async->nof_batches, async->nof_dropped, async->nof_failed);
+}
+
+void __MTLK_IFUNC
+mtlk_rtlog_app_async_get_stats (mtlk_rtlog_app_async_stats_t *stats)
+{
+  rtlog_app_async_t *async = &rtlog_async;
+
+  stats->sent    = async->nof_sent;
+  stats->batches = async->nof_batches;
+  stats->dropped = async->nof_dropped;
+  stats->failed  = async->nof_failed;
+}
+
+mtlk_log_buf_entry_t * __MTLK_IFUNC
+mtlk_rtlog_app_log_msg_reserve (uint32 hdr_len, uint16 data_len)
 {
+  mtlk_log_buf_entry_t *buf;
+  rtlog_app_log_msg_t *lmsg;
   int res;
-  void *msg;
-  size_t msglen;
-  rtlog_app_drv_msghdr_t *msgbody_hdr;
-  rtlog_app_drv_msgpay_t *msgbody_appname;
-  void *msgbody_logdata;
   rtlog_app_info_t *info = rtlog_info;
 
-  if ((0 == data_len) || (NULL == info)) {
-    return 0;
+  /* The header room overlaps the message header */
+  if ((0 == data_len) || (NULL == info) || (hdr_len > sizeof(rtlog_app_drv_msg_t))) {
+    return NULL;
   }
 
-  msglen = (size_t)data_len + sizeof(rtlog_app_drv_msg_t);
-  msg = malloc(msglen);
-  if (NULL == msg) {
-    return -1;
+  /* Queued if possible, sent right away if not. Dropped if the ring is full. */
+  buf = _async_reserve(info, hdr_len, data_len, &res);
+  if ((NULL != buf) || (MTLK_ERR_NO_RESOURCES == res)) {
+    return buf;
+  }
+
+  lmsg = _log_msg_get(data_len);
+  if (NULL == lmsg) {
+    return NULL;
   }
 
-  msgbody_hdr = (rtlog_app_drv_msghdr_t *)msg;
-  msgbody_appname = (rtlog_app_drv_msgpay_t *)(msgbody_hdr + 1);
-  msgbody_logdata = (void *)(msgbody_appname + 1);
+  lmsg->drv_msg = (rtlog_app_drv_msg_t *)
+    wave_nlink_brd_msg_reserve(&info->nl_socket, lmsg->msg,
+                               (uint16)(sizeof(rtlog_app_drv_msg_t) + data_len),
+                               NL_DRV_CMD_RTLOG_NOTIFY);
+  if (NULL == lmsg->drv_msg) {
+    _log_msg_put(lmsg);
+    return NULL;
+  }
+
+  lmsg->entry.data = (uint8 *)(lmsg->drv_msg + 1) - hdr_len;
+  lmsg->entry.size = hdr_len + data_len;
+
+  return &lmsg->entry;
+}
 
-  /* Prepare message header */
+static void
+_log_msg_fill (rtlog_app_info_t *info, rtlog_app_drv_msg_t *drv_msg, uint16 data_len,
+               const uint32 ids, const uint32 timestamp)
+{
+  rtlog_app_drv_msghdr_t *msgbody_hdr = &drv_msg->hdr;
+
+  /* Prepare message header, the header room isn't needed anymore */
   msgbody_hdr->cmd_id = (uint16)IWLWAV_RTLOG_APP_DRV_CMDID_LOG;
-  msgbody_hdr->length = data_len + sizeof(*msgbody_appname);
+  msgbody_hdr->length = (uint16)(data_len + sizeof(rtlog_app_drv_msgpay_t));
   msgbody_hdr->pid = (uint32)info->app_pid;
   msgbody_hdr->log_info = ids;
   msgbody_hdr->wlan_if = info->wlan_if;
   msgbody_hdr->log_time = timestamp;
+  memset(&drv_msg->data, 0, sizeof(drv_msg->data));
+  wave_strcopy(drv_msg->data.name, info->app_name, sizeof(drv_msg->data.name));
+}
 
-  /* Prepare message's payload */
-  wave_strcopy(msgbody_appname->name, info->app_name, sizeof(msgbody_appname->name));
-  wave_memcpy(msgbody_logdata, (size_t)data_len, data, (size_t)data_len);
+int __MTLK_IFUNC
+mtlk_rtlog_app_log_msg_send (mtlk_log_buf_entry_t *buf, uint32 hdr_len,
+                             const uint32 ids, const uint32 timestamp)
+{
+  int res = 0;
+  rtlog_app_slot_t *slot = _async_slot_of(buf);
+  rtlog_app_log_msg_t *lmsg;
+  rtlog_app_info_t *info = rtlog_info;
 
-  /* Send message */
-  res = wave_nlink_send_brd_msg(&info->nl_socket,
-                                msg,
-                                msglen,
-                                NL_DRV_CMD_RTLOG_NOTIFY);
-  free(msg);
+  if (NULL != slot) {
+    /* Queued: the sender sends it */
+    if (NULL != info) {
+      _log_msg_fill(info, slot->drv_msg, (uint16)(buf->size - hdr_len), ids, timestamp);
+    }
+    _async_slot_commit(&rtlog_async, slot, NULL != info);
+    return res;
+  }
+
+  lmsg = MTLK_CONTAINER_OF(buf, rtlog_app_log_msg_t, entry);
+  if (NULL != info) {
+    _log_msg_fill(info, lmsg->drv_msg, (uint16)(buf->size - hdr_len), ids, timestamp);
+    res = wave_nlink_brd_msg_send(&info->nl_socket, lmsg->msg);
+  }
+
+  _log_msg_put(lmsg);
   return res;
 }
 
+int __MTLK_IFUNC
+mtlk_rtlog_app_send_log_msg (/*rtlog_app_info_t *info,*/
+        const uint32 ids, /* LID, OID, GID, FID */
+        const uint32 timestamp,
+        const void *data, const uint16 data_len)
+{
+  mtlk_log_buf_entry_t *buf;
+
+  if ((0 == data_len) || (NULL == rtlog_info)) {
+    return 0;
+  }
+
+  buf = mtlk_rtlog_app_log_msg_reserve(0, data_len);
+  if (NULL == buf) {
+    return -1;
+  }
+
+  wave_memcpy(buf->data, (size_t)data_len, data, (size_t)data_len);
+  return mtlk_rtlog_app_log_msg_send(buf, 0, ids, timestamp);
+}
+
 static int
 _send_notification_msg (rtlog_app_info_t *info, const uint8 cmd)
 {
@@ -230,10 +837,8 @@ _parse_notification_msg (void *param, void *packet)
   }
 
   if (is_cfg_changed) {
-    /* FIXME: check if lock is required */
-    IWLWAV_RTLOG_DLEVEL_VAR = (int)data->cdbg_lvl;
-    IWLWAV_RTLOG_DLEVEL_VAR_REMOTE = (int)data->rdbg_lvl;
-    /* FIXME: check if unlock is required */
+    /* Published at once for each GID, the log points read it lock-free */
+    mtlk_log_set_levels((int)data->cdbg_lvl, (int)data->rdbg_lvl);
 
     ILOG2_DD("Notification message from mtlkroot processed. "
              "Debug levels set to: [cdebug=%d, rdebug=%d].",
@@ -379,6 +984,9 @@ mtlk_rtlog_app_init (rtlog_app_info_t *info, const char *name)
 void __MTLK_IFUNC
 mtlk_rtlog_app_cleanup (rtlog_app_info_t *info)
 {
+  /* The messages queued are sent before the cleanup notification */
+  mtlk_rtlog_app_async_stop();
+
   if (NULL != rtlog_info) {
     __notification_thread_stop(info);
   }
@@ -394,4 +1002,22 @@ mtlk_rtlog_app_get_terminated_status (void)
 
   return flag;
 }
+
+#ifdef RUN_RTLOG_APP_UTEST
+int __MTLK_IFUNC
+mtlk_rtlog_app_utest_attach (rtlog_app_info_t *info, rtlog_app_info_t **prev_info)
+{
+  /* The queued messages are sent through rtlog_info by the sender */
+  if (!(rtlog_async.enqueue_pos & RTLOG_APP_ASYNC_STOPPED)) {
+    return MTLK_ERR_BUSY;
+  }
+
+  if (NULL != prev_info) {
+    *prev_info = rtlog_info;
+  }
+  rtlog_info = info;
+
+  return MTLK_ERR_OK;
+}
+#endif /* RUN_RTLOG_APP_UTEST */
 #endif /* CONFIG_WAVE_RTLOG_REMOTE */
@@ -38,7 +38,48 @@ int __MTLK_IFUNC mtlk_rtlog_app_send_log_msg(/*rtlog_app_info_t *info,*/
                                              const uint32 ids, /* LID, OID, GID, FID */
                                              const uint32 timestamp,
                                              const void *data, const uint16 data_len);
+/* Log message built in place: buf->data points to hdr_len bytes of room
+ * for a header that isn't sent, followed by data_len bytes of data. The
+ * header room is overwritten by mtlk_rtlog_app_log_msg_send(). Returns
+ * NULL if the message can't be sent. */
+mtlk_log_buf_entry_t * __MTLK_IFUNC mtlk_rtlog_app_log_msg_reserve(uint32 hdr_len, uint16 data_len);
+int __MTLK_IFUNC mtlk_rtlog_app_log_msg_send(mtlk_log_buf_entry_t *buf, uint32 hdr_len,
+                                             const uint32 ids, /* LID, OID, GID, FID */
+                                             const uint32 timestamp);
+
+/* Asynchronous delivery, off unless started: once started, the log
+ * messages are queued to a ring of nof_slots (a power of 2) messages and
+ * sent in batches by a sender thread every flush_ms milliseconds, sooner
+ * if the ring gets half full. Messages are dropped, counted and reported
+ * while the ring is full, the ones too big for a slot are sent right away.
+ * Stopped, with the messages queued sent, by mtlk_rtlog_app_async_stop()
+ * or mtlk_rtlog_app_cleanup(). Messages still being written 200 ms after
+ * the stop are given up and counted as failed. */
+#define MTLK_RTLOG_APP_ASYNC_DEF_SLOTS      256
+#define MTLK_RTLOG_APP_ASYNC_DEF_FLUSH_MS   20
+
+typedef struct _mtlk_rtlog_app_async_stats_t
+{
+  uint32 sent;      /* messages sent */
+  uint32 batches;   /* datagrams sent */
+  uint32 dropped;   /* messages not queued: the ring was full */
+  uint32 failed;    /* messages queued but not sent */
+} mtlk_rtlog_app_async_stats_t;
+
+int __MTLK_IFUNC mtlk_rtlog_app_async_start(uint32 nof_slots, uint32 flush_ms);
+/* Returns once the messages queued before the call are sent,
+ * MTLK_ERR_TIMEOUT if they aren't within 200 ms */
+int __MTLK_IFUNC mtlk_rtlog_app_async_flush(void);
+void __MTLK_IFUNC mtlk_rtlog_app_async_stop(void);
+void __MTLK_IFUNC mtlk_rtlog_app_async_get_stats(mtlk_rtlog_app_async_stats_t *stats);
+
 int __MTLK_IFUNC mtlk_rtlog_app_get_terminated_status(void);
 int __MTLK_IFUNC mtlk_assign_logger_hw_iface(rtlog_app_info_t *info, const char *ifname);
 
+#ifdef RUN_RTLOG_APP_UTEST
+/* The log messages go through info, the previous one is returned in
+ * prev_info. MTLK_ERR_BUSY while the asynchronous delivery is started. */
+int __MTLK_IFUNC mtlk_rtlog_app_utest_attach(rtlog_app_info_t *info, rtlog_app_info_t **prev_info);
+#endif
+
 #endif /* __MTLK_RTLOG_APP_H__ */
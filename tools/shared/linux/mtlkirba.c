@@ -33,6 +33,10 @@
 
 #define MTLK_NODES_INI             "/proc/net/mtlk/" MTLK_IRB_INI_NAME
 
+/* Call buffer kept by every IRBA object. Bigger calls, and the ones made
+ * while it is in use (concurrent or nested), are allocated. */
+#define IRBA_CALL_BUF_SIZE         (4 * 1024)
+
 #include "mtlkhash.h"
 
 MTLK_MHASH_DECLARE_ENTRY_T(irba, uint32);
@@ -342,6 +346,8 @@ struct mtlk_irba_private
   mtlk_irba_rm_handler_f   rm_handler;
   mtlk_handle_t            rm_handler_ctx;
   mtlk_irba_handle_t      *private_handlers[ARRAY_SIZE(mtlk_irba_private_handlers)];
+  mtlk_atomic_t            call_buf_busy;
+  struct mtlk_irb_call_hdr *call_buf; /* IRBA_CALL_BUF_SIZE, owned while call_buf_busy */
   MTLK_DECLARE_INIT_STATUS;
   MTLK_DECLARE_INIT_LOOP(IRBA_INTERNAL_HANDLERS);
 };
@@ -353,6 +359,7 @@ MTLK_INIT_STEPS_LIST_BEGIN(irba)
   MTLK_INIT_STEPS_LIST_ENTRY(irba, IRBA_MKNOD)
   MTLK_INIT_STEPS_LIST_ENTRY(irba, IRBA_OPEN)
   MTLK_INIT_STEPS_LIST_ENTRY(irba, IRBA_HASH)
+  MTLK_INIT_STEPS_LIST_ENTRY(irba, IRBA_CALL_BUF)
   MTLK_INIT_STEPS_LIST_ENTRY(irba, IRBA_ADD_TO_DB)
   MTLK_INIT_STEPS_LIST_ENTRY(irba, IRBA_INTERNAL_HANDLERS)
 MTLK_INIT_INNER_STEPS_BEGIN(irba)
@@ -554,6 +561,12 @@ mtlk_irba_init (mtlk_irba_t           *irba,
                       MTLK_ERR_SYSTEM);
     MTLK_INIT_STEP(irba, IRBA_HASH, MTLK_OBJ_PTR(irba),
                    _mtlk_irb_hash_init, (&irba->hash));
+    mtlk_osal_atomic_set(&irba->call_buf_busy, 0);
+    MTLK_INIT_STEP_EX(irba, IRBA_CALL_BUF, MTLK_OBJ_PTR(irba),
+                      malloc, (IRBA_CALL_BUF_SIZE),
+                      irba->call_buf,
+                      irba->call_buf != NULL,
+                      MTLK_ERR_NO_MEM);
     MTLK_INIT_STEP_VOID(irba, IRBA_ADD_TO_DB, MTLK_OBJ_PTR(irba),
                         _mtlk_irba_app_add_to_db, (irba->minor, &irba->hentry));
 
@@ -594,6 +607,8 @@ mtlk_irba_cleanup (mtlk_irba_t *irba)
 
     MTLK_CLEANUP_STEP(irba, IRBA_ADD_TO_DB, MTLK_OBJ_PTR(irba),
                       _mtlk_irba_app_del_from_db, (&irba->hentry));
+    MTLK_CLEANUP_STEP(irba, IRBA_CALL_BUF, MTLK_OBJ_PTR(irba),
+                      free, (irba->call_buf));
     MTLK_CLEANUP_STEP(irba, IRBA_HASH, MTLK_OBJ_PTR(irba),
                       _mtlk_irb_hash_cleanup, (&irba->hash));
     MTLK_CLEANUP_STEP(irba, IRBA_OPEN, MTLK_OBJ_PTR(irba),
@@ -644,6 +659,33 @@ mtlk_irba_unregister (mtlk_irba_t        *irba,
   _mtlk_irb_hash_unregister(&irba->hash, HANDLE_T(irbah));
 }
 
+#ifdef RUN_IRBA_UTEST
+/* IRBA objects of the unit test have no driver behind */
+#define IRBA_UTEST_FD  (-2)
+
+static int _irba_utest_ioctl(struct mtlk_irb_call_hdr *hdr);
+#endif
+
+static mtlk_error_t
+_mtlk_irba_ioctl (mtlk_irba_t *irba, struct mtlk_irb_call_hdr *hdr)
+{
+  int res;
+
+#ifdef RUN_IRBA_UTEST
+  if (irba->fd == IRBA_UTEST_FD)
+    res = _irba_utest_ioctl(hdr);
+  else
+#endif
+  res = ioctl(irba->fd, MTLK_CDEV_IRB_IOCTL, hdr);
+
+  if (res != 0) {
+    ELOG_D("IRB IOCTL failed (%d)", res);
+    return MTLK_ERR_UNKNOWN;
+  }
+
+  return MTLK_ERR_OK;
+}
+
 mtlk_error_t __MTLK_IFUNC
 mtlk_irba_call_drv (mtlk_irba_t       *irba,
                     const mtlk_guid_t *evt,
@@ -651,6 +693,7 @@ mtlk_irba_call_drv (mtlk_irba_t       *irba,
                     uint32             size)
 {
   struct mtlk_irb_call_hdr *hdr;
+  BOOL                      own_buf;
   mtlk_error_t              res = MTLK_ERR_UNKNOWN;
 
   MTLK_ASSERT(irba != NULL);
@@ -659,34 +702,224 @@ mtlk_irba_call_drv (mtlk_irba_t       *irba,
   if(!irba || !evt || (!buffer && size))
     return MTLK_ERR_PARAMS;
 
-  hdr = (struct mtlk_irb_call_hdr *)malloc(sizeof(*hdr) + size);
-  if (!hdr) {
-    ELOG_D("Can't allocate IRB call driver struct of %u bytes", sizeof(*hdr) + size);
-    res = MTLK_ERR_NO_MEM;
-    goto end;
+  /* Never waits for the call buffer: a nested call would deadlock */
+  own_buf = (size <= IRBA_CALL_BUF_SIZE - sizeof(*hdr)) &&
+            (0 == mtlk_osal_atomic_xchg(&irba->call_buf_busy, 1));
+  if (own_buf) {
+    hdr = irba->call_buf;
+  }
+  else {
+    hdr = (struct mtlk_irb_call_hdr *)malloc(sizeof(*hdr) + size);
+    if (!hdr) {
+      ELOG_D("Can't allocate IRB call driver struct of %u bytes", sizeof(*hdr) + size);
+      return MTLK_ERR_NO_MEM;
+    }
   }
 
   hdr->evt       = *evt;
   hdr->data_size = size;
   wave_memcpy(hdr + 1, size, buffer, size);
 
-  res = ioctl(irba->fd, MTLK_CDEV_IRB_IOCTL, hdr);
-  if (res != 0) {
-    ELOG_D("IRB IOCTL failed (%d)", res);
-    res = MTLK_ERR_UNKNOWN;
-    goto end;
+  res = _mtlk_irba_ioctl(irba, hdr);
+  if (res == MTLK_ERR_OK) {
+    wave_memcpy(buffer, size, hdr + 1, size);
+  }
 
+  if (own_buf) {
+    mtlk_osal_atomic_set(&irba->call_buf_busy, 0);
+  }
+  else {
+    free(hdr);
   }
 
-  wave_memcpy(buffer, size, hdr + 1, size);
+  return res;
+}
 
-  res = MTLK_ERR_OK;
+mtlk_error_t __MTLK_IFUNC
+mtlk_irba_call_drv_inplace (mtlk_irba_t       *irba,
+                            const mtlk_guid_t *evt,
+                            void              *buffer,
+                            uint32             size)
+{
+  struct mtlk_irb_call_hdr *hdr;
+  struct mtlk_irb_call_hdr  headroom;
+  mtlk_error_t              res;
 
-end:
-  if (hdr) {
-    free(hdr);
-  }
+  MTLK_ASSERT(irba != NULL);
+  MTLK_ASSERT(evt != NULL);
+  MTLK_ASSERT(buffer != NULL);
+  if(!irba || !evt || !buffer)
+    return MTLK_ERR_PARAMS;
+
+  /* The header is packed, so the buffer needs no alignment */
+  hdr      = (struct mtlk_irb_call_hdr *)buffer - 1;
+  headroom = *hdr;
+
+  hdr->evt       = *evt;
+  hdr->data_size = size;
+
+  res = _mtlk_irba_ioctl(irba, hdr);
+
+  *hdr = headroom;
 
   return res;
 }
 
+#ifdef RUN_IRBA_UTEST
+
+#include <pthread.h>
+
+#define IRBA_UTEST_MAX_THREADS  4
+#define IRBA_UTEST_NOF_CALLS    (1024 * 1024)   /* per thread */
+#define IRBA_UTEST_DATA_SIZE    64
+
+static const mtlk_guid_t _irba_utest_guid =
+  MTLK_DECLARE_GUID(0x5b1e0a2c, 0x7d41, 0x4c8e, 0x9a, 0x13, 0x2f, 0x6b, 0xd0, 0x48, 0xe5, 0x71);
+
+typedef enum
+{
+  IRBA_UTEST_CALL_BUF,    /* mtlk_irba_call_drv with the call buffer */
+  IRBA_UTEST_CALL_ALLOC,  /* mtlk_irba_call_drv of data too big for it */
+  IRBA_UTEST_CALL_INPLACE,
+  IRBA_UTEST_LAST
+} irba_utest_mode_e;
+
+static const char *const irba_utest_mode_names[IRBA_UTEST_LAST] = {
+  "call buffer",
+  "allocated",
+  "in place",
+};
+
+typedef struct
+{
+  mtlk_irba_t       *irba;
+  irba_utest_mode_e  mode;
+} irba_utest_thread_t;
+
+/* The driver side: checks the event and counts the call in the data,
+ * so the data is seen to be passed both ways */
+static int
+_irba_utest_ioctl (struct mtlk_irb_call_hdr *hdr)
+{
+  uint32 cnt;
+
+  if (memcmp(&hdr->evt, &_irba_utest_guid, sizeof(hdr->evt)) ||
+      hdr->data_size < sizeof(cnt))
+    return -1;
+
+  wave_memcpy(&cnt, sizeof(cnt), hdr + 1, sizeof(cnt));
+  ++cnt;
+  wave_memcpy(hdr + 1, sizeof(cnt), &cnt, sizeof(cnt));
+
+  return 0;
+}
+
+static void *
+_irba_utest_thread_proc (void *param)
+{
+  irba_utest_thread_t *thread = (irba_utest_thread_t *)param;
+  uint32               size = (thread->mode == IRBA_UTEST_CALL_ALLOC) ?
+                              IRBA_CALL_BUF_SIZE : IRBA_UTEST_DATA_SIZE;
+  char                *buf;
+  uint32               cnt = 0;
+  uint32               i;
+  mtlk_error_t         res;
+
+  buf = (char *)malloc(MTLK_IRBA_CALL_HEADROOM + size);
+  if (!buf)
+    return (void *)1;
+  memset(buf, 0, MTLK_IRBA_CALL_HEADROOM + size);
+
+  for (i = 0; i < IRBA_UTEST_NOF_CALLS; i++) {
+    if (thread->mode == IRBA_UTEST_CALL_INPLACE)
+      res = mtlk_irba_call_drv_inplace(thread->irba, &_irba_utest_guid,
+                                       buf + MTLK_IRBA_CALL_HEADROOM, size);
+    else
+      res = mtlk_irba_call_drv(thread->irba, &_irba_utest_guid,
+                               buf + MTLK_IRBA_CALL_HEADROOM, size);
+    if (res != MTLK_ERR_OK)
+      break;
+  }
+
+  wave_memcpy(&cnt, sizeof(cnt), buf + MTLK_IRBA_CALL_HEADROOM, sizeof(cnt));
+  free(buf);
+
+  return (cnt == IRBA_UTEST_NOF_CALLS) ? NULL : (void *)1;
+}
+
+static BOOL
+_irba_utest_run (mtlk_irba_t *irba, irba_utest_mode_e mode, uint32 nof_threads,
+                 uint32 *kcalls)
+{
+  irba_utest_thread_t    threads[IRBA_UTEST_MAX_THREADS];
+  pthread_t              ids[IRBA_UTEST_MAX_THREADS];
+  mtlk_osal_timestamp_t  start;
+  uint32                 nof_started;
+  uint32                 elapsed_ms;
+  BOOL                   pased = TRUE;
+
+  start = mtlk_osal_timestamp();
+  for (nof_started = 0; nof_started < nof_threads; nof_started++) {
+    threads[nof_started].irba = irba;
+    threads[nof_started].mode = mode;
+    if (0 != pthread_create(&ids[nof_started], NULL, _irba_utest_thread_proc, &threads[nof_started])) {
+      ELOG_D("Can't create test thread %u", nof_started);
+      pased = FALSE;
+      break;
+    }
+  }
+  while (nof_started) {
+    void *thread_res = NULL;
+
+    pthread_join(ids[--nof_started], &thread_res);
+    if (NULL != thread_res) {
+      pased = FALSE;
+    }
+  }
+  elapsed_ms = mtlk_osal_timestamp_to_ms(mtlk_osal_timestamp() - start);
+
+  *kcalls = (uint32)(((uint64)nof_threads * IRBA_UTEST_NOF_CALLS) / (elapsed_ms ? elapsed_ms : 1));
+  return pased;
+}
+
+/* Driver calls per second through an IRBA object whose ioctl is answered
+ * by _irba_utest_ioctl(): the cost of the user space side of a call */
+BOOL __MTLK_IFUNC
+run_irba_utest (void)
+{
+  static const uint32 nof_threads[] = { 1, IRBA_UTEST_MAX_THREADS };
+  mtlk_irba_t irba;
+  irba_utest_mode_e mode;
+  BOOL all_pased = TRUE;
+  uint32 i;
+
+  memset(&irba, 0, sizeof(irba));
+  irba.fd = IRBA_UTEST_FD;
+  irba.call_buf = (struct mtlk_irb_call_hdr *)malloc(IRBA_CALL_BUF_SIZE);
+  if (!irba.call_buf) {
+    ELOG_V("IRBA unit tests: out of memory");
+    return FALSE;
+  }
+  mtlk_osal_atomic_set(&irba.call_buf_busy, 0);
+
+  for (mode = IRBA_UTEST_CALL_BUF; mode < IRBA_UTEST_LAST; mode++) {
+    for (i = 0; i < ARRAY_SIZE(nof_threads); i++) {
+      uint32 kcalls = 0;
+      BOOL   pased = _irba_utest_run(&irba, mode, nof_threads[i], &kcalls);
+
+      ILOG0_SDDS("IRBA: %s, %u threads: %u Kcalls/s %s", irba_utest_mode_names[mode],
+                 nof_threads[i], kcalls, (TRUE == pased) ? "SUCCEED" : "FAILED");
+      if (!pased) {
+        all_pased = FALSE;
+      }
+    }
+  }
+
+  free(irba.call_buf);
+
+  ILOG0_S("IRBA unit tests %s", (TRUE == all_pased) ? "SUCCEED" : "FAILED");
+
+  return all_pased;
+}
+
+#endif /* RUN_IRBA_UTEST */
@@ -19,11 +19,13 @@
 #include <sys/select.h>
 #include <sys/types.h>
 #include <sys/socket.h>
+#include <sys/uio.h>
 #include <string.h>
 #include <linux/if.h>
 
 #include "mtlkinc.h"
 #include "mtlknlink.h"
+#include "rtlog_app_utest.h"
 
 #define LOG_LOCAL_GID   GID_MTLKNLINK
 #define LOG_LOCAL_FID   1
@@ -96,33 +98,127 @@ nlink_parse_msg(mtlk_nlink_socket_t* nlink_socket, struct mtlk_nl_msghdr *phdr)
   return 0;
 }
 
-int wave_nlink_send_brd_msg (mtlk_nlink_socket_t *nlink_socket, const void *data, uint16 data_len, uint8 cmd)
+size_t wave_nlink_brd_msg_size (uint16 data_len)
+{
+  return nlmsg_total_size(GENL_HDRLEN +
+                          nla_total_size(sizeof(struct mtlk_nl_msghdr) + data_len));
+}
+
+void *wave_nlink_brd_msg_reserve (mtlk_nlink_socket_t *nlink_socket, struct nl_msg *msg,
+                                  uint16 data_len, uint8 cmd)
 {
-  struct nl_msg *msg;
   struct nlattr *attr;
   struct mtlk_nl_msghdr *phdr;
-  int res = -1;
 
-  msg = nlmsg_alloc();
-  if (NULL == msg)
-    return res;
+  /* Start over, the message may have been sent already */
+  nlmsg_hdr(msg)->nlmsg_len = NLMSG_HDRLEN;
 
   if (NULL == genlmsg_put(msg, NL_AUTO_PID, NL_AUTO_SEQ, nlink_socket->family, 0, 0,
           MTLK_GENL_CMD_EVENT, MTLK_GENL_FAMILY_VERSION))
-    goto end;
+    return NULL;
 
   attr = nla_reserve(msg, MTLK_GENL_ATTR_EVENT, data_len + sizeof(*phdr));
   if (NULL == attr)
-    goto end;
+    return NULL;
+
+  phdr = (struct mtlk_nl_msghdr*)nla_data(attr);
+  wave_memcpy(phdr->fingerprint, sizeof(phdr->fingerprint), FINGERPRINT_TEXT, FINGERPRINT_SIZE);
+  phdr->proto_ver = MTLK_NL_PROTOCOL_VERSION;
+  phdr->cmd_id = cmd;
+  phdr->data_len = data_len;
+
+  return phdr + 1;
+}
+
+int wave_nlink_brd_msg_send (mtlk_nlink_socket_t *nlink_socket, struct nl_msg *msg)
+{
+#ifdef RUN_RTLOG_APP_UTEST
+  if (NULL == nlink_socket->sock)
+    return rtlog_app_utest_send(msg);
+#endif
+  return nl_send_auto(nlink_socket->sock, msg);
+}
+
+void *wave_nlink_brd_msg_build (mtlk_nlink_socket_t *nlink_socket, void *buf, size_t buf_size,
+                                uint16 data_len, uint8 cmd)
+{
+  struct nlmsghdr *nlh = (struct nlmsghdr *)buf;
+  struct genlmsghdr *ghdr;
+  struct nlattr *attr;
+  struct mtlk_nl_msghdr *phdr;
+  size_t attr_len = sizeof(*phdr) + data_len;
+
+  if (wave_nlink_brd_msg_size(data_len) > buf_size)
+    return NULL;
+
+  /* Same message as genlmsg_put() and nla_reserve() build, but no ACK is
+   * requested: nobody would wait for it */
+  nlh->nlmsg_len = NLMSG_HDRLEN + GENL_HDRLEN + nla_total_size(attr_len);
+  nlh->nlmsg_type = nlink_socket->family;
+  nlh->nlmsg_flags = NLM_F_REQUEST;
+  nlh->nlmsg_seq = 0;
+  nlh->nlmsg_pid = nl_socket_get_local_port(nlink_socket->sock);
+
+  ghdr = (struct genlmsghdr *)((uint8 *)buf + NLMSG_HDRLEN);
+  ghdr->cmd = MTLK_GENL_CMD_EVENT;
+  ghdr->version = MTLK_GENL_FAMILY_VERSION;
+  ghdr->reserved = 0;
+
+  attr = (struct nlattr *)((uint8 *)ghdr + GENL_HDRLEN);
+  attr->nla_type = MTLK_GENL_ATTR_EVENT;
+  attr->nla_len = nla_attr_size(attr_len);
+  memset((uint8 *)attr + nla_attr_size(attr_len), 0, nla_padlen(attr_len));
 
   phdr = (struct mtlk_nl_msghdr*)nla_data(attr);
   wave_memcpy(phdr->fingerprint, sizeof(phdr->fingerprint), FINGERPRINT_TEXT, FINGERPRINT_SIZE);
   phdr->proto_ver = MTLK_NL_PROTOCOL_VERSION;
   phdr->cmd_id = cmd;
   phdr->data_len = data_len;
-  wave_memcpy((char *)(phdr + 1), data_len, data, data_len);
 
-  res = nl_send_auto(nlink_socket->sock, msg);
+  return phdr + 1;
+}
+
+int wave_nlink_brd_msgs_send (mtlk_nlink_socket_t *nlink_socket, struct iovec *iov, int nof_msgs)
+{
+  struct sockaddr_nl peer;
+  struct msghdr hdr;
+  int i;
+
+  for (i = 0; i < nof_msgs; i++)
+    iov[i].iov_len = NLMSG_ALIGN(((struct nlmsghdr *)iov[i].iov_base)->nlmsg_len);
+
+  /* The kernel processes the messages of a datagram one by one */
+  memset(&peer, 0, sizeof(peer));
+  peer.nl_family = AF_NETLINK;
+
+  memset(&hdr, 0, sizeof(hdr));
+  hdr.msg_name = &peer;
+  hdr.msg_namelen = sizeof(peer);
+  hdr.msg_iov = iov;
+  hdr.msg_iovlen = nof_msgs;
+
+  if (sendmsg(nl_socket_get_fd(nlink_socket->sock), &hdr, 0) < 0)
+    return -errno;
+
+  return 0;
+}
+
+int wave_nlink_send_brd_msg (mtlk_nlink_socket_t *nlink_socket, const void *data, uint16 data_len, uint8 cmd)
+{
+  struct nl_msg *msg;
+  void *pdata;
+  int res = -1;
+
+  msg = nlmsg_alloc();
+  if (NULL == msg)
+    return res;
+
+  pdata = wave_nlink_brd_msg_reserve(nlink_socket, msg, data_len, cmd);
+  if (NULL == pdata)
+    goto end;
+
+  wave_memcpy(pdata, data_len, data, data_len);
+  res = wave_nlink_brd_msg_send(nlink_socket, msg);
 
 end:
   nlmsg_free(msg);
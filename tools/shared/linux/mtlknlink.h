@@ -45,6 +45,26 @@ mtlk_nlink_create(mtlk_nlink_socket_t* nlink_socket, const char* group_name,
 
 int wave_nlink_send_brd_msg(mtlk_nlink_socket_t *nlink_socket, const void *data, uint16 data_len, uint8 cmd);
 
+/* Broadcast message built in place, avoids copying the data:
+ * wave_nlink_brd_msg_reserve() returns the room for data_len bytes in msg,
+ * wave_nlink_brd_msg_send() sends msg once the data are written. The same
+ * msg, allocated with nlmsg_alloc_size(wave_nlink_brd_msg_size(max_len)),
+ * can be reserved and sent over and over again. */
+size_t wave_nlink_brd_msg_size(uint16 data_len);
+void *wave_nlink_brd_msg_reserve(mtlk_nlink_socket_t *nlink_socket, struct nl_msg *msg,
+                                 uint16 data_len, uint8 cmd);
+int wave_nlink_brd_msg_send(mtlk_nlink_socket_t *nlink_socket, struct nl_msg *msg);
+
+/* Broadcast message built in a buffer of buf_size bytes, to be sent later
+ * along with others by wave_nlink_brd_msgs_send(): returns the room for
+ * data_len bytes, NULL if the message doesn't fit. No ACK is requested. */
+void *wave_nlink_brd_msg_build(mtlk_nlink_socket_t *nlink_socket, void *buf, size_t buf_size,
+                               uint16 data_len, uint8 cmd);
+/* Sends nof_msgs built messages, iov[i].iov_base each, in a single
+ * datagram. iov[i].iov_len is set by the function. Returns 0 or -errno. */
+struct iovec;
+int wave_nlink_brd_msgs_send(mtlk_nlink_socket_t *nlink_socket, struct iovec *iov, int nof_msgs);
+
 int __MTLK_IFUNC
 mtlk_nlink_receive_loop(mtlk_nlink_socket_t* nlink_socket, int stop_fd);
 
@@ -21,6 +21,7 @@
 MTLK_DECLARE_OBJPOOL(g_objpool);
 
 struct mtlk_osal_obj mtlk_osal_global;
+__thread uint32      mtlk_osal_thread_slot;
 
 int  __MTLK_IFUNC
 _mtlk_linux_app_osal_init (void)
@@ -32,6 +33,14 @@ _mtlk_linux_app_osal_init (void)
     ELOG_D("OBJPOOL init error#%d", res);
     goto objpool_init_failed;
   }
+
+#ifdef CPTCFG_IWLWAV_ENABLE_OBJPOOL
+  res = mem_leak_init();
+  if (res != MTLK_ERR_OK) {
+    ELOG_D("Memory leak control init error#%d", res);
+    goto mem_leak_init_failed;
+  }
+#endif
   
 #ifndef HAVE_BUILTIN_ATOMIC
   res = mtlk_osal_mutex_init(&mtlk_osal_global.atomic_lock);
@@ -45,8 +54,12 @@ _mtlk_linux_app_osal_init (void)
 
 #ifndef HAVE_BUILTIN_ATOMIC
 mutex_init_failed:
-  mtlk_objpool_cleanup(&g_objpool);
 #endif
+#ifdef CPTCFG_IWLWAV_ENABLE_OBJPOOL
+  mem_leak_cleanup();
+mem_leak_init_failed:
+#endif
+  mtlk_objpool_cleanup(&g_objpool);
 objpool_init_failed:
 
   return res;
@@ -57,6 +70,9 @@ _mtlk_linux_app_osal_cleanup (void)
 {
 #ifndef HAVE_BUILTIN_ATOMIC
   mtlk_osal_mutex_cleanup(&mtlk_osal_global.atomic_lock);
+#endif
+#ifdef CPTCFG_IWLWAV_ENABLE_OBJPOOL
+  mem_leak_cleanup();
 #endif
   mtlk_objpool_cleanup(&g_objpool);
 }
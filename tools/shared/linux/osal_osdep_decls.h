@@ -70,6 +70,9 @@ typedef struct
   volatile uint32 counter;
 } mtlk_atomic_t;
 
+/* mtlk_osal_get_context_slot() numbers the threads */
+#define MTLK_OSAL_HAVE_CONTEXT_SLOT
+
 typedef struct
 { 
   MTLK_DECLARE_OBJPOOL_CTX(objpool_ctx);
@@ -46,9 +46,11 @@ struct mtlk_osal_obj
 #ifndef HAVE_BUILTIN_ATOMIC
   mtlk_osal_mutex_t atomic_lock;
 #endif
+  mtlk_atomic_t     nof_threads;  /* numbered by mtlk_osal_get_context_slot() */
 };
 
 extern struct mtlk_osal_obj mtlk_osal_global;
+extern __thread uint32      mtlk_osal_thread_slot; /* 0 - not numbered yet */
 
 #define __MTLK_OSAL_GRANULARITY_MS 20 
 
@@ -56,6 +58,7 @@ extern struct mtlk_osal_obj mtlk_osal_global;
 #define US_PER_MS 1000
 #define NS_PER_US 1000
 #define NS_PER_MS (US_PER_MS * NS_PER_US)
+#define NS_PER_S  (MS_PER_S * NS_PER_MS)
 
 #ifdef CPTCFG_IWLWAV_DEBUG
 #define __MTLK_CALL_ASSERT_RESULT(call, text)           \
@@ -164,13 +167,24 @@ static __INLINE int
 mtlk_osal_event_init (mtlk_osal_event_t* event)
 {
   int res = 0;
+  pthread_condattr_t attr;
 
   res = pthread_mutex_init(&event->mutex, NULL);
   if (res != 0) {
     goto end;
   }
 
-  res = pthread_cond_init(&event->cond, 0);
+  /* Timeouts must not depend on the wall clock being set */
+  res = pthread_condattr_init(&attr);
+  if (res != 0) {
+    goto end;
+  }
+
+  res = pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+  if (res == 0) {
+    res = pthread_cond_init(&event->cond, &attr);
+  }
+  pthread_condattr_destroy(&attr);
   if (res != 0) {
     goto end;
   }
@@ -187,19 +201,26 @@ mtlk_osal_event_wait (mtlk_osal_event_t* event, uint32 msec)
   int res = 0;
   struct timespec wait_tp;
 
-  clock_gettime(CLOCK_REALTIME, &wait_tp);
+  clock_gettime(CLOCK_MONOTONIC, &wait_tp);
 
   wait_tp.tv_sec  += msec / MS_PER_S;
   wait_tp.tv_nsec += (msec % MS_PER_S) * NS_PER_MS;
-  
+  if (wait_tp.tv_nsec >= NS_PER_S) {
+    wait_tp.tv_sec  += 1;
+    wait_tp.tv_nsec -= NS_PER_S;
+  }
+
   __MTLK_CALL_ASSERT_RESULT(
                             pthread_mutex_lock(&event->mutex),
                            "Mutex (ev) lock");
 
   while (!event->wait_flag) {
-    res = pthread_cond_timedwait(&event->cond, 
-                                 &event->mutex,
-                                 &wait_tp);
+    if (msec == MTLK_OSAL_EVENT_INFINITE)
+      res = pthread_cond_wait(&event->cond, &event->mutex);
+    else
+      res = pthread_cond_timedwait(&event->cond, 
+                                   &event->mutex,
+                                   &wait_tp);
     if (res != 0)
       break;
   }
@@ -305,7 +326,7 @@ mtlk_osal_timestamp (void)
 {
   struct timespec ts;
 
-  clock_gettime(CLOCK_REALTIME, &ts);
+  clock_gettime(CLOCK_MONOTONIC, &ts);
 
   return ((uint64)ts.tv_sec) * MS_PER_S + ts.tv_nsec / NS_PER_MS;
 }
@@ -399,7 +420,21 @@ mtlk_osal_eth_is_directed (const uint8* addr)
   return !mtlk_osal_eth_is_group_addr(addr);
 }
 
-/* atomic counters */
+/* atomic counters
+ * All the operations are sequentially consistent. Unlike the former
+ * __sync builtins, they don't order the plain memory accesses around
+ * them beyond the acquire/release semantics.
+ */
+
+#ifndef HAVE_BUILTIN_ATOMIC
+#define __MTLK_OSAL_ATOMIC_RMW(val, expr, res)                    \
+  do {                                                            \
+    mtlk_osal_mutex_acquire(&mtlk_osal_global.atomic_lock);       \
+    (res) = (val)->counter;                                       \
+    (val)->counter = (expr);                                      \
+    mtlk_osal_mutex_release(&mtlk_osal_global.atomic_lock);       \
+  } while (0)
+#endif
 
 static __INLINE uint32
 mtlk_osal_atomic_add (mtlk_atomic_t* val, uint32 i)
@@ -407,14 +442,11 @@ mtlk_osal_atomic_add (mtlk_atomic_t* val, uint32 i)
 #ifndef HAVE_BUILTIN_ATOMIC
   uint32 res;
 
-  mtlk_osal_mutex_acquire(&mtlk_osal_global.atomic_lock);
-  val->counter += i;
-  res           = val->counter;
-  mtlk_osal_mutex_release(&mtlk_osal_global.atomic_lock);
+  __MTLK_OSAL_ATOMIC_RMW(val, res + i, res);
 
-  return res;
+  return res + i;
 #else
-  return __sync_add_and_fetch(&val->counter, i);
+  return __atomic_add_fetch(&val->counter, i, __ATOMIC_SEQ_CST);
 #endif
 }
 
@@ -424,14 +456,11 @@ mtlk_osal_atomic_sub (mtlk_atomic_t* val, uint32 i)
 #ifndef HAVE_BUILTIN_ATOMIC
   uint32 res;
 
-  mtlk_osal_mutex_acquire(&mtlk_osal_global.atomic_lock);
-  val->counter -= i;
-  res           = val->counter;
-  mtlk_osal_mutex_release(&mtlk_osal_global.atomic_lock);
+  __MTLK_OSAL_ATOMIC_RMW(val, res - i, res);
 
-  return res;
+  return res - i;
 #else
-  return __sync_sub_and_fetch(&val->counter, i);
+  return __atomic_sub_fetch(&val->counter, i, __ATOMIC_SEQ_CST);
 #endif
 }
 
@@ -450,13 +479,21 @@ mtlk_osal_atomic_dec (mtlk_atomic_t* val)
 static __INLINE void
 mtlk_osal_atomic_set (mtlk_atomic_t* target, uint32 value)
 {
+#ifndef HAVE_BUILTIN_ATOMIC
   mtlk_osal_atomic_xchg(target, value);
+#else
+  __atomic_store_n(&target->counter, value, __ATOMIC_SEQ_CST);
+#endif
 }
 
 static __INLINE uint32
 mtlk_osal_atomic_get (const mtlk_atomic_t* val)
 {
+#ifndef HAVE_BUILTIN_ATOMIC
   return val->counter;
+#else
+  return __atomic_load_n(&val->counter, __ATOMIC_SEQ_CST);
+#endif
 }
 
 static __INLINE uint32
@@ -465,17 +502,62 @@ mtlk_osal_atomic_xchg (mtlk_atomic_t* target, uint32 value)
 #ifndef HAVE_BUILTIN_ATOMIC
   uint32 res;
 
-  mtlk_osal_mutex_acquire(&mtlk_osal_global.atomic_lock);
-  res             = target->counter;
-  target->counter = value;
-  mtlk_osal_mutex_release(&mtlk_osal_global.atomic_lock);
+  __MTLK_OSAL_ATOMIC_RMW(target, value, res);
+
+  return res;
+#else
+  return __atomic_exchange_n(&target->counter, value, __ATOMIC_SEQ_CST);
+#endif
+}
+
+static __INLINE uint32
+mtlk_osal_atomic_cmpxchg (mtlk_atomic_t* target, uint32 old, uint32 value)
+{
+#ifndef HAVE_BUILTIN_ATOMIC
+  uint32 res;
+
+  __MTLK_OSAL_ATOMIC_RMW(target, (res == old) ? value : res, res);
 
   return res;
 #else
-  return __sync_lock_test_and_set(&target->counter, value);
+  __atomic_compare_exchange_n(&target->counter, &old, value, FALSE,
+                              __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST);
+  return old;
 #endif
 }
 
+static __INLINE uint32
+mtlk_osal_atomic_fetch_or (mtlk_atomic_t* target, uint32 mask)
+{
+#ifndef HAVE_BUILTIN_ATOMIC
+  uint32 res;
+
+  __MTLK_OSAL_ATOMIC_RMW(target, res | mask, res);
+
+  return res;
+#else
+  return __atomic_fetch_or(&target->counter, mask, __ATOMIC_SEQ_CST);
+#endif
+}
+
+static __INLINE uint32
+mtlk_osal_atomic_fetch_and (mtlk_atomic_t* target, uint32 mask)
+{
+#ifndef HAVE_BUILTIN_ATOMIC
+  uint32 res;
+
+  __MTLK_OSAL_ATOMIC_RMW(target, res & mask, res);
+
+  return res;
+#else
+  return __atomic_fetch_and(&target->counter, mask, __ATOMIC_SEQ_CST);
+#endif
+}
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
 int  _mtlk_osal_thread_init(mtlk_osal_thread_t *thread);
 int  _mtlk_osal_thread_run(mtlk_osal_thread_t     *thread,
                            mtlk_osal_thread_proc_f proc,
@@ -484,6 +566,10 @@ int  _mtlk_osal_thread_wait(mtlk_osal_thread_t *thread,
                             int32              *thread_res);
 void _mtlk_osal_thread_cleanup(mtlk_osal_thread_t *thread);
 
+#ifdef __cplusplus
+}
+#endif
+
 static __INLINE int
 mtlk_osal_thread_init (mtlk_osal_thread_t *thread)
 {
@@ -511,5 +597,15 @@ mtlk_osal_thread_cleanup (mtlk_osal_thread_t *thread)
  _mtlk_osal_thread_cleanup(thread);
 }
 
+static __INLINE uint32
+mtlk_osal_get_context_slot (void)
+{
+  if (0 == mtlk_osal_thread_slot) {
+    mtlk_osal_thread_slot = mtlk_osal_atomic_inc(&mtlk_osal_global.nof_threads);
+  }
+
+  return mtlk_osal_thread_slot - 1;
+}
+
 #undef LOG_LOCAL_GID
 #undef LOG_LOCAL_FID
@@ -0,0 +1,200 @@
+/******************************************************************************
+
+         Copyright (c) 2020, MaxLinear, Inc.
+         Copyright 2016 - 2020 Intel Corporation
+         Copyright 2015 - 2016 Lantiq Beteiligungs-GmbH & Co. KG
+         Copyright 2009 - 2014 Lantiq Deutschland GmbH
+         Copyright 2007 - 2008 Infineon Technologies AG
+
+  For licensing information, see the file 'LICENSE' in the root folder of
+  this software module.
+
+*******************************************************************************/
+
+/*
+ *  Unit test and contention benchmark of the OSAL atomics.
+ *  N threads hammer a single atomic, the result is checked and the total
+ *  throughput printed. A mutex protected counter, as used where the
+ *  atomic builtins aren't available, is measured for comparison.
+ *  The numbers only tell about contention with more than one CPU online.
+ */
+
+#ifdef RUN_OSAL_ATOMIC_UTEST
+
+#include "mtlkinc.h"
+#include "mtlk_osal.h"
+#include "osal_utest.h"
+
+#include <pthread.h>
+
+#define LOG_LOCAL_GID   GID_OSAL
+#define LOG_LOCAL_FID   2
+
+#define OSAL_UTEST_MAX_THREADS    8
+#define OSAL_UTEST_NOF_OPS        (4 * 1024 * 1024)   /* per thread */
+
+typedef enum
+{
+  OSAL_UTEST_INC,
+  OSAL_UTEST_CMPXCHG,
+  OSAL_UTEST_FETCH_OR,
+  OSAL_UTEST_MUTEX,
+  OSAL_UTEST_LAST
+} osal_utest_op_e;
+
+static const char *const osal_utest_op_names[OSAL_UTEST_LAST] = {
+  "inc",
+  "cmpxchg loop",
+  "fetch_or/and",
+  "mutex",
+};
+
+typedef struct
+{
+  osal_utest_op_e    op;
+  mtlk_atomic_t      counter;
+  pthread_mutex_t    lock;
+  uint32             locked_counter;
+} osal_utest_ctx_t;
+
+typedef struct
+{
+  osal_utest_ctx_t  *ctx;
+  uint32             idx;
+} osal_utest_thread_t;
+
+static void *
+_osal_utest_thread_proc (void *param)
+{
+  osal_utest_thread_t *thread = (osal_utest_thread_t *)param;
+  osal_utest_ctx_t    *ctx = thread->ctx;
+  uint32               bit = 1U << thread->idx;
+  uint32               i;
+
+  for (i = 0; i < OSAL_UTEST_NOF_OPS; i++) {
+    switch (ctx->op) {
+    case OSAL_UTEST_INC:
+      mtlk_osal_atomic_inc(&ctx->counter);
+      break;
+    case OSAL_UTEST_CMPXCHG:
+    {
+      uint32 old;
+
+      do {
+        old = mtlk_osal_atomic_get(&ctx->counter);
+      } while (mtlk_osal_atomic_cmpxchg(&ctx->counter, old, old + 1) != old);
+      break;
+    }
+    case OSAL_UTEST_FETCH_OR:
+      /* Own bit set, then cleared again: it must be clear every time */
+      if (mtlk_osal_atomic_fetch_or(&ctx->counter, bit) & bit) {
+        return (void *)1;
+      }
+      mtlk_osal_atomic_fetch_and(&ctx->counter, ~bit);
+      break;
+    case OSAL_UTEST_MUTEX:
+      pthread_mutex_lock(&ctx->lock);
+      ctx->locked_counter++;
+      pthread_mutex_unlock(&ctx->lock);
+      break;
+    default:
+      return (void *)1;
+    }
+  }
+
+  return NULL;
+}
+
+static BOOL
+_osal_utest_run (osal_utest_ctx_t *ctx, uint32 nof_threads, uint32 *kops)
+{
+  osal_utest_thread_t    threads[OSAL_UTEST_MAX_THREADS];
+  pthread_t              ids[OSAL_UTEST_MAX_THREADS];
+  mtlk_osal_timestamp_t  start;
+  uint32                 nof_started;
+  uint32                 expected;
+  uint32                 result;
+  uint32                 elapsed_ms;
+  BOOL                   pased = TRUE;
+
+  mtlk_osal_atomic_set(&ctx->counter, 0);
+  ctx->locked_counter = 0;
+
+  start = mtlk_osal_timestamp();
+  for (nof_started = 0; nof_started < nof_threads; nof_started++) {
+    threads[nof_started].ctx = ctx;
+    threads[nof_started].idx = nof_started;
+    if (0 != pthread_create(&ids[nof_started], NULL, _osal_utest_thread_proc, &threads[nof_started])) {
+      ELOG_D("OSAL: Can't create test thread %u", nof_started);
+      pased = FALSE;
+      break;
+    }
+  }
+  while (nof_started) {
+    void *thread_res = NULL;
+
+    pthread_join(ids[--nof_started], &thread_res);
+    if (NULL != thread_res) {
+      pased = FALSE;
+    }
+  }
+  elapsed_ms = mtlk_osal_timestamp_to_ms(mtlk_osal_timestamp() - start);
+
+  switch (ctx->op) {
+  case OSAL_UTEST_FETCH_OR:
+    expected = 0;
+    result   = mtlk_osal_atomic_get(&ctx->counter);
+    break;
+  case OSAL_UTEST_MUTEX:
+    expected = nof_threads * OSAL_UTEST_NOF_OPS;
+    result   = ctx->locked_counter;
+    break;
+  default:
+    expected = nof_threads * OSAL_UTEST_NOF_OPS;
+    result   = mtlk_osal_atomic_get(&ctx->counter);
+    break;
+  }
+  if (result != expected) {
+    ELOG_SDDD("OSAL: %s with %u threads ends with %u, expected %u",
+              osal_utest_op_names[ctx->op], nof_threads, result, expected);
+    pased = FALSE;
+  }
+
+  *kops = (uint32)(((uint64)nof_threads * OSAL_UTEST_NOF_OPS) / MAX(elapsed_ms, 1));
+  return pased;
+}
+
+BOOL __MTLK_IFUNC
+run_osal_atomic_utest (void)
+{
+  static const uint32 nof_threads[] = { 1, 2, 4, OSAL_UTEST_MAX_THREADS };
+  osal_utest_ctx_t ctx;
+  BOOL all_pased = TRUE;
+  uint32 i;
+
+  memset(&ctx, 0, sizeof(ctx));
+  pthread_mutex_init(&ctx.lock, NULL);
+
+  ILOG0_D("OSAL: Atomics unit tests, %d CPUs online", (int)sysconf(_SC_NPROCESSORS_ONLN));
+
+  for (ctx.op = OSAL_UTEST_INC; ctx.op < OSAL_UTEST_LAST; ctx.op++) {
+    for (i = 0; i < ARRAY_SIZE(nof_threads); i++) {
+      uint32 kops = 0;
+      BOOL   pased = _osal_utest_run(&ctx, nof_threads[i], &kops);
+
+      ILOG0_SDDS("OSAL: %s, %u threads: %u Kops/s %s", osal_utest_op_names[ctx.op],
+                 nof_threads[i], kops, (TRUE == pased) ? "SUCCEED" : "FAILED");
+      if (!pased) {
+        all_pased = FALSE;
+      }
+    }
+  }
+
+  pthread_mutex_destroy(&ctx.lock);
+
+  ILOG0_S("OSAL: Atomics unit tests %s", (TRUE == all_pased) ? "SUCCEED" : "FAILED");
+
+  return all_pased;
+}
+
+#endif /* RUN_OSAL_ATOMIC_UTEST */
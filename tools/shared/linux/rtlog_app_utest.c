@@ -0,0 +1,196 @@
+/******************************************************************************
+
+         Copyright (c) 2020, MaxLinear, Inc.
+         Copyright 2016 - 2020 Intel Corporation
+         Copyright 2015 - 2016 Lantiq Beteiligungs-GmbH & Co. KG
+         Copyright 2009 - 2014 Lantiq Deutschland GmbH
+         Copyright 2007 - 2008 Infineon Technologies AG
+
+  For licensing information, see the file 'LICENSE' in the root folder of
+  this software module.
+
+*******************************************************************************/
+
+/*
+ *  Unit test and benchmark of the remote log messages of the applications.
+ *  N threads send log events through an rtlog_app_info_t whose netlink
+ *  socket isn't created: the messages end up in rtlog_app_utest_send(),
+ *  which checks and counts them. What is measured is the user space cost
+ *  of a message, built in place as the log macros do or copied by
+ *  mtlk_rtlog_app_send_log_msg().
+ *  Only the direct delivery is tested: the test is skipped while the
+ *  messages are queued by mtlk_rtlog_app_async_start().
+ */
+
+#include "mtlkinc.h"
+#include "rtlog_app_utest.h"
+
+#ifdef RUN_RTLOG_APP_UTEST
+
+#include "mtlk_osal.h"
+#include "mtlk_rtlog_app.h"
+
+#include <pthread.h>
+
+#define LOG_LOCAL_GID   GID_RTLOG_APP
+#define LOG_LOCAL_FID   2
+
+#define RTLOG_APP_UTEST_MAX_THREADS   4
+#define RTLOG_APP_UTEST_NOF_MSGS      (1024 * 1024)   /* per thread */
+#define RTLOG_APP_UTEST_DATA_SIZE     64
+#define RTLOG_APP_UTEST_MAGIC         0x52544C47      /* "RTLG" */
+
+typedef enum
+{
+  RTLOG_APP_UTEST_INPLACE,
+  RTLOG_APP_UTEST_COPIED,
+  RTLOG_APP_UTEST_LAST
+} rtlog_app_utest_mode_e;
+
+static const char *const rtlog_app_utest_mode_names[RTLOG_APP_UTEST_LAST] = {
+  "in place",
+  "copied",
+};
+
+static mtlk_atomic_t rtlog_app_utest_nof_sent;
+static mtlk_atomic_t rtlog_app_utest_nof_bad;
+
+int __MTLK_IFUNC
+rtlog_app_utest_send (struct nl_msg *msg)
+{
+  struct nlmsghdr *nlh = nlmsg_hdr(msg);
+  struct nlattr *attr = (struct nlattr *)((uint8 *)nlmsg_data(nlh) + GENL_HDRLEN);
+  uint8 *data_end = (uint8 *)nla_data(attr) + nla_len(attr);
+  uint32 magic;
+
+  /* The event data are at the end of the message */
+  wave_memcpy(&magic, sizeof(magic), data_end - RTLOG_APP_UTEST_DATA_SIZE, sizeof(magic));
+  if (magic != RTLOG_APP_UTEST_MAGIC) {
+    mtlk_osal_atomic_inc(&rtlog_app_utest_nof_bad);
+    return -1;
+  }
+
+  mtlk_osal_atomic_inc(&rtlog_app_utest_nof_sent);
+  return (int)nlh->nlmsg_len;
+}
+
+static void *
+_rtlog_app_utest_thread_proc (void *param)
+{
+  rtlog_app_utest_mode_e mode = (rtlog_app_utest_mode_e)(uintptr_t)param;
+  uint8                  data[RTLOG_APP_UTEST_DATA_SIZE];
+  uint32                 magic = RTLOG_APP_UTEST_MAGIC;
+  uint32                 ids = LOG_INFO_MAKE_WORD(0, LOG_LOCAL_OID, LOG_LOCAL_GID, LOG_LOCAL_FID);
+  uint32                 i;
+  int                    res;
+
+  memset(data, 0, sizeof(data));
+  wave_memcpy(data, sizeof(data), &magic, sizeof(magic));
+
+  for (i = 0; i < RTLOG_APP_UTEST_NOF_MSGS; i++) {
+    if (mode == RTLOG_APP_UTEST_INPLACE) {
+      /* As mtlk_log_new_pkt_reserve() and mtlk_log_new_pkt_release() do */
+      mtlk_log_buf_entry_t *buf = mtlk_rtlog_app_log_msg_reserve(sizeof(mtlk_log_event_t),
+                                                                 sizeof(data));
+
+      if (NULL == buf) {
+        return (void *)1;
+      }
+      wave_memcpy(buf->data + sizeof(mtlk_log_event_t), sizeof(data), data, sizeof(data));
+      res = mtlk_rtlog_app_log_msg_send(buf, sizeof(mtlk_log_event_t), ids, i);
+    }
+    else {
+      res = mtlk_rtlog_app_send_log_msg(ids, i, data, sizeof(data));
+    }
+    if (res < 0) {
+      return (void *)1;
+    }
+  }
+
+  return NULL;
+}
+
+static BOOL
+_rtlog_app_utest_run (rtlog_app_utest_mode_e mode, uint32 nof_threads, uint32 *kmsgs)
+{
+  pthread_t              ids[RTLOG_APP_UTEST_MAX_THREADS];
+  mtlk_osal_timestamp_t  start;
+  uint32                 nof_started;
+  uint32                 expected = nof_threads * RTLOG_APP_UTEST_NOF_MSGS;
+  uint32                 elapsed_ms;
+  BOOL                   pased = TRUE;
+
+  mtlk_osal_atomic_set(&rtlog_app_utest_nof_sent, 0);
+  mtlk_osal_atomic_set(&rtlog_app_utest_nof_bad, 0);
+
+  start = mtlk_osal_timestamp();
+  for (nof_started = 0; nof_started < nof_threads; nof_started++) {
+    if (0 != pthread_create(&ids[nof_started], NULL, _rtlog_app_utest_thread_proc,
+                            (void *)(uintptr_t)mode)) {
+      ELOG_D("RTLOG: Can't create test thread %u", nof_started);
+      pased = FALSE;
+      break;
+    }
+  }
+  while (nof_started) {
+    void *thread_res = NULL;
+
+    pthread_join(ids[--nof_started], &thread_res);
+    if (NULL != thread_res) {
+      pased = FALSE;
+    }
+  }
+  elapsed_ms = mtlk_osal_timestamp_to_ms(mtlk_osal_timestamp() - start);
+
+  if ((mtlk_osal_atomic_get(&rtlog_app_utest_nof_sent) != expected) ||
+      (mtlk_osal_atomic_get(&rtlog_app_utest_nof_bad) != 0)) {
+    ELOG_SDDD("RTLOG: %s with %u threads sent %u good messages, expected %u",
+              rtlog_app_utest_mode_names[mode], nof_threads,
+              mtlk_osal_atomic_get(&rtlog_app_utest_nof_sent), expected);
+    pased = FALSE;
+  }
+
+  *kmsgs = (uint32)(((uint64)expected) / MAX(elapsed_ms, 1));
+  return pased;
+}
+
+BOOL __MTLK_IFUNC
+run_rtlog_app_utest (void)
+{
+  static const uint32 nof_threads[] = { 1, RTLOG_APP_UTEST_MAX_THREADS };
+  rtlog_app_info_t info;
+  rtlog_app_info_t *app_info = NULL;
+  rtlog_app_utest_mode_e mode;
+  BOOL all_pased = TRUE;
+  uint32 i;
+
+  memset(&info, 0, sizeof(info));
+  wave_strcopy(info.app_name, "rtlog_utest", sizeof(info.app_name));
+  info.app_pid = getpid();
+
+  if (MTLK_ERR_OK != mtlk_rtlog_app_utest_attach(&info, &app_info)) {
+    WLOG_V("RTLOG: Asynchronous delivery is on, unit tests skipped");
+    return TRUE;
+  }
+
+  for (mode = RTLOG_APP_UTEST_INPLACE; mode < RTLOG_APP_UTEST_LAST; mode++) {
+    for (i = 0; i < ARRAY_SIZE(nof_threads); i++) {
+      uint32 kmsgs = 0;
+      BOOL   pased = _rtlog_app_utest_run(mode, nof_threads[i], &kmsgs);
+
+      ILOG0_SDDS("RTLOG: %s, %u threads: %u Kmsgs/s %s", rtlog_app_utest_mode_names[mode],
+                 nof_threads[i], kmsgs, (TRUE == pased) ? "SUCCEED" : "FAILED");
+      if (!pased) {
+        all_pased = FALSE;
+      }
+    }
+  }
+
+  mtlk_rtlog_app_utest_attach(app_info, NULL);
+
+  ILOG0_S("RTLOG: Remote log unit tests %s", (TRUE == all_pased) ? "SUCCEED" : "FAILED");
+
+  return all_pased;
+}
+
+#endif /* RUN_RTLOG_APP_UTEST */
@@ -0,0 +1,42 @@
+/******************************************************************************
+
+         Copyright (c) 2020, MaxLinear, Inc.
+         Copyright 2016 - 2020 Intel Corporation
+         Copyright 2015 - 2016 Lantiq Beteiligungs-GmbH & Co. KG
+         Copyright 2009 - 2014 Lantiq Deutschland GmbH
+         Copyright 2007 - 2008 Infineon Technologies AG
+
+  For licensing information, see the file 'LICENSE' in the root folder of
+  this software module.
+
+*******************************************************************************/
+
+/*
+ *  Unit test and benchmark of the remote log messages of the applications
+ */
+#ifndef __RTLOG_APP_UTEST_H__
+#define __RTLOG_APP_UTEST_H__
+
+/* The applications send remote log messages in debug builds only */
+#ifndef CONFIG_WAVE_RTLOG_REMOTE
+#undef RUN_RTLOG_APP_UTEST
+#endif
+
+#ifdef RUN_RTLOG_APP_UTEST
+
+struct nl_msg;
+
+BOOL __MTLK_IFUNC
+run_rtlog_app_utest(void);
+
+/* Takes the messages sent through a netlink socket not created */
+int __MTLK_IFUNC
+rtlog_app_utest_send(struct nl_msg *msg);
+
+#else /* RUN_RTLOG_APP_UTEST */
+
+#define run_rtlog_app_utest()
+
+#endif /* RUN_RTLOG_APP_UTEST */
+
+#endif /* __RTLOG_APP_UTEST_H__ */
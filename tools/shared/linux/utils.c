@@ -20,8 +20,8 @@
 #define LOG_LOCAL_GID   GID_UTILS
 #define LOG_LOCAL_FID   0
 
-int debug = 0;
-int debug_remote = -1;
+int debug = MTLK_LOG_DEF_DLEVEL;
+int debug_remote = MTLK_LOG_DEF_DLEVEL_REMOTE;
 static char module_name[IFNAMSIZ]; 
 
 #define MAX_PRINT_BUFF_SIZE 512
@@ -0,0 +1,724 @@
+/******************************************************************************
+
+         Copyright (c) 2020, MaxLinear, Inc.
+         Copyright 2016 - 2020 Intel Corporation
+         Copyright 2015 - 2016 Lantiq Beteiligungs-GmbH & Co. KG
+         Copyright 2009 - 2014 Lantiq Deutschland GmbH
+         Copyright 2007 - 2008 Infineon Technologies AG
+
+  For licensing information, see the file 'LICENSE' in the root folder of
+  this software module.
+
+*******************************************************************************/
+
+#include "mtlkinc.h"
+#include <stdarg.h>
+#include <stddef.h>
+#include <byteswap.h>
+
+#include "logdefs.h"
+#include "formats.h"
+#include "logfmt.h"
+
+#define LOG_LOCAL_GID   GID_LOGFMT
+#define LOG_LOCAL_FID   1
+
+
+/*****************************************************************************
+**
+** A format string is compiled once into a program: the literal text before
+** the first conversion followed by a list of conversions, each one with the
+** literal text that follows it. Literal text is stored unescaped ("%%" is
+** already "%"), so formatting an event is a walk over the parameters that
+** copies literal spans and converts one parameter per conversion.
+**
+** Length modifiers of the format are ignored: the argument size is always
+** taken from the parameter data type, and a conversion that doesn't suit the
+** parameter type is replaced by the default one for this type, so a stale
+** or wrong .scd file can't make the formatter read arguments that were never
+** passed. Parameters left over when the conversions are exhausted (or when
+** there is no format at all) are appended as " 'value'", conversions left
+** over when the parameters are exhausted are printed as is.
+**
+******************************************************************************/
+
+/* '%', flags, width and precision; 4 more bytes for "ll", type and zero */
+#define LOGFMT_SPEC_SIZE      32
+#define LOGFMT_SPEC_MAX_LEN   (LOGFMT_SPEC_SIZE - 4)
+/* room left for ".<precision>" */
+#define LOGFMT_WIDTH_MAX_LEN  (LOGFMT_SPEC_MAX_LEN - 6)
+#define LOGFMT_MAX_PRECISION  0xFFFF
+
+typedef struct _logfmt_out_t
+{
+  char  *buf;
+  size_t size;
+  size_t len;  /* full length, may exceed size */
+} logfmt_out_t;
+
+/* Stored in files as is: fields of explicit sizes and offsets, the
+ * multi-byte ones in little endian order there (see logfmt_prog_bswap) */
+typedef struct _logfmt_conv_t
+{
+  char   spec[LOGFMT_SPEC_SIZE]; /* '%', flags, width and precision */
+  uint8  spec_len;
+  uint8  width_len;              /* spec length without precision */
+  uint8  plain;                  /* no flags, width or precision */
+  char   type;                   /* '\0' for a '%' ending the format */
+  int32  precision;              /* -1 if not specified */
+  uint32 raw_off;                /* offset of the conversion in the format */
+  uint32 lit_off;                /* literal text following the conversion */
+  uint32 lit_len;
+} logfmt_conv_t;
+
+/* Position independent: the texts follow the conversions and are referred
+ * to by offsets from the beginning of the program */
+struct _logfmt_prog_t
+{
+  uint32        size;      /* of the whole program */
+  uint32        fmt_off;   /* original format string */
+  uint32        text_off;  /* unescaped literal text */
+  uint32        lead_len;  /* literal text before the first conversion */
+  uint32        nof_convs;
+  logfmt_conv_t convs[1];
+};
+
+MTLK_STATIC_ASSERT(offsetof(logfmt_conv_t, spec_len)  == 32, conv_spec_len);
+MTLK_STATIC_ASSERT(offsetof(logfmt_conv_t, type)      == 35, conv_type);
+MTLK_STATIC_ASSERT(offsetof(logfmt_conv_t, precision) == 36, conv_precision);
+MTLK_STATIC_ASSERT(offsetof(logfmt_conv_t, lit_len)   == 48, conv_lit_len);
+MTLK_STATIC_ASSERT(sizeof(logfmt_conv_t)              == 52, conv_size);
+MTLK_STATIC_ASSERT(offsetof(logfmt_prog_t, nof_convs) == 16, prog_nof_convs);
+MTLK_STATIC_ASSERT(offsetof(logfmt_prog_t, convs)     == 20, prog_convs);
+
+static __INLINE const char *
+logfmt_prog_fmt (const logfmt_prog_t *prog)
+{
+  return (const char *)prog + prog->fmt_off;
+}
+
+static __INLINE const char *
+logfmt_prog_text (const logfmt_prog_t *prog)
+{
+  return (const char *)prog + prog->text_off;
+}
+
+/* Used for parameters that have no conversion left */
+static const logfmt_conv_t logfmt_no_conv;
+
+static __INLINE void
+logfmt_put (logfmt_out_t *out, const char *str, size_t len)
+{
+  if (out->len + 1 < out->size) {
+    size_t n = MIN(len, out->size - out->len - 1);
+
+    wave_memcpy(out->buf + out->len, out->size - out->len, str, n);
+    out->buf[out->len + n] = '\0';
+  }
+  out->len += len;
+}
+
+static void
+logfmt_printf (logfmt_out_t *out, const char *fmt, ...)
+{
+  size_t room = (out->len < out->size) ? out->size - out->len : 0;
+  va_list ap;
+  int n;
+
+  va_start(ap, fmt);
+  n = vsnprintf(room ? out->buf + out->len : NULL, room, fmt, ap);
+  va_end(ap);
+
+  if (n > 0)
+    out->len += n;
+}
+
+/* Plain %d, %u, %x and %X without printf */
+static void
+logfmt_put_num (logfmt_out_t *out, uint64 val, BOOL neg, char type)
+{
+  static const char lc_digits[] = "0123456789abcdef";
+  static const char uc_digits[] = "0123456789ABCDEF";
+  const char *digits = (type == 'X') ? uc_digits : lc_digits;
+  uint32 base = (type == 'x' || type == 'X') ? 16 : 10;
+  char tmp[24];
+  char *p = tmp + sizeof(tmp);
+
+  do {
+    *--p = digits[val % base];
+    val /= base;
+  } while (val);
+  if (neg)
+    *--p = '-';
+
+  logfmt_put(out, p, tmp + sizeof(tmp) - p);
+}
+
+static __INLINE void
+logfmt_put_signed (logfmt_out_t *out, int64 val, char type)
+{
+  if (val < 0)
+    logfmt_put_num(out, (uint64)0 - (uint64)val, TRUE, type);
+  else
+    logfmt_put_num(out, (uint64)val, FALSE, type);
+}
+
+/* Copies the literal text up to the next conversion to text ("%%" is
+ * unescaped), text may be NULL to just measure it.
+ * Returns a pointer to the conversion or NULL if the format is over.
+ */
+static const char *
+logfmt_compile_literal (const char *p, char *text, uint32 *text_len)
+{
+  for (;; p++) {
+    if (*p == '\0')
+      return NULL;
+    if (*p == '%') {
+      if (p[1] != '%')
+        return p;
+      p++;
+    }
+    if (text)
+      text[*text_len] = *p;
+    ++*text_len;
+  }
+}
+
+static void
+logfmt_spec_add (logfmt_conv_t *conv, char c)
+{
+  if (conv->spec_len < LOGFMT_WIDTH_MAX_LEN)
+    conv->spec[conv->spec_len++] = c;
+}
+
+static const char *
+logfmt_compile_conv (const char *p, logfmt_conv_t *conv)
+{
+  conv->spec_len  = 0;
+  conv->precision = -1;
+
+  logfmt_spec_add(conv, *p++); /* '%' */
+  while (*p && strchr("-+ #0", *p))
+    logfmt_spec_add(conv, *p++);
+  while (*p >= '0' && *p <= '9')
+    logfmt_spec_add(conv, *p++);
+  conv->width_len = conv->spec_len;
+
+  /* Width and precision can't be passed as arguments: skip them */
+  if (*p == '*')
+    p++;
+  if (*p == '.') {
+    p++;
+    conv->precision = 0;
+    if (*p == '*')
+      p++;
+    while (*p >= '0' && *p <= '9') {
+      conv->precision = MIN(conv->precision * 10 + (*p - '0'), LOGFMT_MAX_PRECISION);
+      p++;
+    }
+    conv->spec_len += snprintf(conv->spec + conv->spec_len,
+                               LOGFMT_SPEC_SIZE - conv->spec_len,
+                               ".%d", conv->precision);
+  }
+  while (*p && strchr("hlLqjzt", *p))
+    p++;
+
+  conv->plain = (conv->spec_len == 1);
+  conv->type  = *p;
+  if (*p)
+    p++;
+
+  return p;
+}
+
+logfmt_prog_t * __MTLK_IFUNC
+logfmt_compile (const char *fmt)
+{
+  logfmt_prog_t *prog;
+  logfmt_conv_t  conv;
+  const char    *p;
+  size_t         fmt_len = strlen(fmt);
+  uint32         nof_convs = 0;
+  uint32         text_len = 0;
+  uint32         size;
+  char          *text;
+
+  /* Measure */
+  p = logfmt_compile_literal(fmt, NULL, &text_len);
+  while (p) {
+    p = logfmt_compile_conv(p, &conv);
+    p = logfmt_compile_literal(p, NULL, &text_len);
+    nof_convs++;
+  }
+
+  size = (uint32)(offsetof(logfmt_prog_t, convs) +
+                  MAX(nof_convs, 1) * sizeof(logfmt_conv_t) +
+                  text_len + fmt_len + 1);
+  prog = (logfmt_prog_t *) malloc(size);
+  if (!prog)
+    return NULL;
+  memset(prog, 0, size);
+
+  text = (char *)&prog->convs[MAX(nof_convs, 1)];
+  wave_memcpy(text + text_len, fmt_len + 1, fmt, fmt_len + 1);
+  prog->size      = size;
+  prog->fmt_off   = (uint32)(text + text_len - (char *)prog);
+  prog->text_off  = (uint32)(text - (char *)prog);
+  prog->nof_convs = nof_convs;
+
+  /* Fill */
+  text_len = 0;
+  nof_convs = 0;
+  p = logfmt_compile_literal(fmt, text, &text_len);
+  prog->lead_len = text_len;
+  while (p) {
+    logfmt_conv_t *c = &prog->convs[nof_convs++];
+
+    c->raw_off = (uint32)(p - fmt);
+    p = logfmt_compile_conv(p, c);
+    c->lit_off = text_len;
+    p = logfmt_compile_literal(p, text, &text_len);
+    c->lit_len = text_len - c->lit_off;
+  }
+
+  return prog;
+}
+
+void __MTLK_IFUNC
+logfmt_free (logfmt_prog_t *prog)
+{
+  free(prog);
+}
+
+int __MTLK_IFUNC
+logfmt_decode (char *fmt)
+{
+  char  *p  = fmt;
+  char  *to = fmt;
+  size_t len;
+  char   c;
+
+  while (*p == ' ' || *p == '\t' || *p == '\r' || *p == '\n')
+    ++p;
+  len = strlen(p);
+  while (len && (p[len - 1] == '\r' || p[len - 1] == '\n'))
+    p[--len] = '\0';
+
+  while ((c = *p++) != '\0') {
+    if (c == '"' && *p == '"') {
+      /* Adjacent string literals */
+      ++p;
+      continue;
+    }
+    if (c != '\\') {
+      *to++ = c;
+      continue;
+    }
+
+    switch (*p++) {
+    case 'r':
+      *to++ = '\r';
+      break;
+    case 't':
+      *to++ = '\t';
+      break;
+    case 'n':
+      *to++ = '\n';
+      break;
+    case '\\':
+      *to++ = '\\';
+      break;
+    case '\'':
+      *to++ = '\'';
+      break;
+    case '"':
+      *to++ = '"';
+      break;
+    case '/':
+      *to++ = '/';
+      break;
+    default:
+      return -1;
+    }
+  }
+
+  *to = '\0';
+  return 0;
+}
+
+const char * __MTLK_IFUNC
+logfmt_get_format (const logfmt_prog_t *prog)
+{
+  return logfmt_prog_fmt(prog);
+}
+
+uint32 __MTLK_IFUNC
+logfmt_prog_size (const logfmt_prog_t *prog)
+{
+  return prog->size;
+}
+
+const logfmt_prog_t * __MTLK_IFUNC
+logfmt_prog_check (const void *image, size_t size)
+{
+  const logfmt_prog_t *prog = (const logfmt_prog_t *)image;
+  size_t convs_end;
+  uint32 text_len;
+  uint32 fmt_len;
+  uint32 i;
+
+  if ((uintptr_t)image % LOGFMT_PROG_ALIGN != 0 ||
+      size < offsetof(logfmt_prog_t, convs) + sizeof(logfmt_conv_t) ||
+      prog->size != size || prog->nof_convs > size / sizeof(logfmt_conv_t))
+    return NULL;
+
+  /* Conversions, literal text, then the zero terminated format */
+  convs_end = offsetof(logfmt_prog_t, convs) +
+              MAX(prog->nof_convs, 1) * sizeof(logfmt_conv_t);
+  if (prog->text_off != convs_end || prog->fmt_off < prog->text_off ||
+      prog->fmt_off >= size || ((const char *)image)[size - 1] != '\0')
+    return NULL;
+
+  text_len = prog->fmt_off - prog->text_off;
+  fmt_len  = (uint32)strlen(logfmt_prog_fmt(prog));
+  if (prog->fmt_off + fmt_len + 1 != size || prog->lead_len > text_len)
+    return NULL;
+
+  for (i = 0; i < prog->nof_convs; i++) {
+    const logfmt_conv_t *c = &prog->convs[i];
+
+    if (c->spec_len < 1 || c->spec_len > LOGFMT_SPEC_MAX_LEN ||
+        c->width_len > c->spec_len || c->spec[0] != '%' ||
+        c->precision < -1 || c->precision > LOGFMT_MAX_PRECISION ||
+        c->raw_off >= fmt_len || c->lit_off > text_len ||
+        c->lit_len > text_len - c->lit_off)
+      return NULL;
+    /* The specification goes to printf as is */
+    if (strspn(c->spec + 1, "-+ #0123456789.") != (size_t)c->spec_len - 1)
+      return NULL;
+  }
+
+  return prog;
+}
+
+void __MTLK_IFUNC
+logfmt_prog_bswap (void *image, size_t size, BOOL to_host)
+{
+  logfmt_prog_t *prog = (logfmt_prog_t *)image;
+  uint32 nof_convs;
+  uint32 i;
+
+  if (size < offsetof(logfmt_prog_t, convs))
+    return;
+
+  nof_convs       = prog->nof_convs;
+  prog->size      = bswap_32(prog->size);
+  prog->fmt_off   = bswap_32(prog->fmt_off);
+  prog->text_off  = bswap_32(prog->text_off);
+  prog->lead_len  = bswap_32(prog->lead_len);
+  prog->nof_convs = bswap_32(prog->nof_convs);
+  if (to_host)
+    nof_convs = prog->nof_convs;
+
+  /* Not checked yet: only the conversions within the image */
+  nof_convs = MIN(nof_convs, (size - offsetof(logfmt_prog_t, convs)) / sizeof(logfmt_conv_t));
+  for (i = 0; i < nof_convs; i++) {
+    logfmt_conv_t *c = &prog->convs[i];
+
+    c->precision = (int32)bswap_32((uint32)c->precision);
+    c->raw_off   = bswap_32(c->raw_off);
+    c->lit_off   = bswap_32(c->lit_off);
+    c->lit_len   = bswap_32(c->lit_len);
+  }
+}
+
+/* Builds the printf specification for the conversion using spec_len bytes
+ * of its flags, width and precision with the given length modifier and type.
+ */
+static const char *
+logfmt_make_spec (const logfmt_conv_t *conv, uint32 spec_len,
+                  const char *len_mod, char type, char *spec)
+{
+  uint32 len = spec_len;
+
+  wave_memcpy(spec, LOGFMT_SPEC_SIZE, conv->spec, spec_len);
+  while (*len_mod)
+    spec[len++] = *len_mod++;
+  spec[len++] = type;
+  spec[len]   = '\0';
+
+  return spec;
+}
+
+static void
+logfmt_put_int32 (logfmt_out_t *out, const logfmt_conv_t *conv, int32 val)
+{
+  char spec[LOGFMT_SPEC_SIZE];
+  char type = conv->type;
+
+  switch (type) {
+  case '\0':
+    logfmt_put(out, " '", 2);
+    logfmt_put_signed(out, val, 'd');
+    logfmt_put(out, "'", 1);
+    return;
+  case 'p':
+    /* 32-bit pointer of the target */
+    logfmt_printf(out, "%08x", (uint32)val);
+    return;
+  case MTLK_LOG_FMT_IP4:
+    logfmt_printf(out, IP4_PRINTF_FMT, IP4_PRINTF_ARG(&val));
+    return;
+  case 'd': case 'i':
+    if (conv->plain) {
+      logfmt_put_signed(out, val, 'd');
+      return;
+    }
+    break;
+  case 'u': case 'x': case 'X':
+    if (conv->plain) {
+      logfmt_put_num(out, (uint32)val, FALSE, type);
+      return;
+    }
+    break;
+  case 'o': case 'c':
+    break;
+  default:
+    type = 'd';
+    break;
+  }
+
+  logfmt_printf(out, logfmt_make_spec(conv, conv->spec_len, "", type, spec), val);
+}
+
+static void
+logfmt_put_int64 (logfmt_out_t *out, const logfmt_conv_t *conv, int64 val)
+{
+  char spec[LOGFMT_SPEC_SIZE];
+  char type = conv->type;
+
+  switch (type) {
+  case '\0':
+    logfmt_put(out, " '", 2);
+    logfmt_put_signed(out, val, 'd');
+    logfmt_put(out, "'", 1);
+    return;
+  case 'p':
+    /* 64-bit pointer of the target */
+    logfmt_printf(out, "%08x%08x", (uint32)(val >> 32), (uint32)val);
+    return;
+  case 'c':
+    logfmt_printf(out, logfmt_make_spec(conv, conv->spec_len, "", type, spec), (int)val);
+    return;
+  case 'd': case 'i':
+    if (conv->plain) {
+      logfmt_put_signed(out, val, 'd');
+      return;
+    }
+    break;
+  case 'u': case 'x': case 'X':
+    if (conv->plain) {
+      logfmt_put_num(out, (uint64)val, FALSE, type);
+      return;
+    }
+    break;
+  case 'o':
+    break;
+  default:
+    type = 'd';
+    break;
+  }
+
+  logfmt_printf(out, logfmt_make_spec(conv, conv->spec_len, "ll", type, spec),
+                (long long)val);
+}
+
+static void
+logfmt_put_int8 (logfmt_out_t *out, const logfmt_conv_t *conv, int8 val)
+{
+  char spec[LOGFMT_SPEC_SIZE];
+  char type = conv->type;
+
+  switch (type) {
+  case '\0':
+    logfmt_put(out, " '", 2);
+    logfmt_put(out, (const char *)&val, 1);
+    logfmt_put(out, "'", 1);
+    return;
+  case 'd': case 'i': case 'u': case 'x': case 'X': case 'o':
+    break;
+  case 'c':
+  default:
+    if (conv->plain) {
+      logfmt_put(out, (const char *)&val, 1);
+      return;
+    }
+    type = 'c';
+    break;
+  }
+
+  logfmt_printf(out, logfmt_make_spec(conv, conv->spec_len, "", type, spec), (int)val);
+}
+
+static void
+logfmt_put_string (logfmt_out_t *out, const logfmt_conv_t *conv,
+                   const char *str, uint32 len)
+{
+  char spec[LOGFMT_SPEC_SIZE];
+  /* The length usually includes the terminating zero */
+  int n = (int)strnlen(str, len);
+
+  if (conv->type == '\0') {
+    logfmt_put(out, " '", 2);
+    logfmt_put(out, str, n);
+    logfmt_put(out, "'", 1);
+    return;
+  }
+
+  if (conv->plain) {
+    logfmt_put(out, str, n);
+    return;
+  }
+
+  if (conv->precision >= 0)
+    n = MIN(n, conv->precision);
+
+  logfmt_printf(out, logfmt_make_spec(conv, conv->width_len, ".*", 's', spec), n, str);
+}
+
+static void
+logfmt_put_addr (logfmt_out_t *out, const logfmt_conv_t *conv,
+                 uint32 datatype, const unsigned char *addr)
+{
+  if (conv->type == '\0')
+    logfmt_put(out, " '", 2);
+
+  if (datatype == LOG_DT_MACADDR)
+    logfmt_printf(out, MAC_PRINTF_FMT, MAC_PRINTF_ARG(addr));
+  else
+    logfmt_printf(out, IP6_PRINTF_FMT, IP6_PRINTF_ARG(addr));
+
+  if (conv->type == '\0')
+    logfmt_put(out, "'", 1);
+}
+
+/* Copies a fixed size value out of the event data (it may be unaligned) */
+static __INLINE const unsigned char *
+logfmt_get (const unsigned char *p, const unsigned char *end, void *val, size_t len)
+{
+  if ((size_t)(end - p) < len)
+    return NULL;
+
+  wave_memcpy(val, len, p, len);
+  return p + len;
+}
+
+int __MTLK_IFUNC
+logfmt_run (const logfmt_prog_t *prog, const logfmt_evt_t *evt, char *buf, size_t size)
+{
+  const unsigned char *p   = (const unsigned char *)evt->data;
+  const unsigned char *end = p + evt->dsize;
+  const logfmt_conv_t *conv;
+  logfmt_out_t out;
+  uint32 idx = 0;
+
+  out.buf  = buf;
+  out.size = size;
+  out.len  = 0;
+  if (size)
+    buf[0] = '\0';
+
+  if (prog && logfmt_prog_fmt(prog)[0]) {
+    logfmt_put(&out, logfmt_prog_text(prog), prog->lead_len);
+  }
+  else {
+    logfmt_printf(&out, "{%u:%u:%u:%u} :",
+                  evt->oid, evt->gid, evt->fid, evt->lid);
+    prog = NULL;
+  }
+
+  while (p < end) {
+    uint32 datatype;
+
+    p = logfmt_get(p, end, &datatype, sizeof(datatype));
+    if (!p)
+      return -1;
+    if (evt->reversed)
+      datatype = bswap_32(datatype);
+
+    conv = (prog && idx < prog->nof_convs) ? &prog->convs[idx] : &logfmt_no_conv;
+
+    switch (datatype) {
+    case LOG_DT_INT8:
+      {
+        int8 val;
+        p = logfmt_get(p, end, &val, sizeof(val));
+        if (!p)
+          return -1;
+        logfmt_put_int8(&out, conv, val);
+      }
+      break;
+    case LOG_DT_INT32:
+      {
+        int32 val;
+        p = logfmt_get(p, end, &val, sizeof(val));
+        if (!p)
+          return -1;
+        if (evt->reversed)
+          val = (int32)bswap_32((uint32)val);
+        logfmt_put_int32(&out, conv, val);
+      }
+      break;
+    case LOG_DT_INT64:
+      {
+        int64 val;
+        p = logfmt_get(p, end, &val, sizeof(val));
+        if (!p)
+          return -1;
+        if (evt->reversed)
+          val = (int64)bswap_64((uint64)val);
+        logfmt_put_int64(&out, conv, val);
+      }
+      break;
+    case LOG_DT_MACADDR:
+    case LOG_DT_IP6ADDR:
+      {
+        size_t len = (datatype == LOG_DT_MACADDR) ? MAC_ADDR_LENGTH : IP6_ADDR_LENGTH;
+        if ((size_t)(end - p) < len)
+          return -1;
+        logfmt_put_addr(&out, conv, datatype, p);
+        p += len;
+      }
+      break;
+    case LOG_DT_LSTRING:
+      {
+        mtlk_log_lstring_t lstr;
+        p = logfmt_get(p, end, &lstr, sizeof(lstr));
+        if (!p)
+          return -1;
+        if (evt->reversed)
+          lstr.len = bswap_32(lstr.len);
+        if ((uint32)(end - p) < lstr.len)
+          return -1;
+        logfmt_put_string(&out, conv, (const char *)p, lstr.len);
+        p += lstr.len;
+      }
+      break;
+    default:
+      return -1;
+    }
+
+    if (conv != &logfmt_no_conv) {
+      logfmt_put(&out, logfmt_prog_text(prog) + conv->lit_off, conv->lit_len);
+      idx++;
+    }
+  }
+
+  /* Conversions without parameters are printed as is */
+  if (prog && idx < prog->nof_convs) {
+    const char *rest = logfmt_prog_fmt(prog) + prog->convs[idx].raw_off;
+    logfmt_put(&out, rest, strlen(rest));
+  }
+
+  return (int)out.len;
+}
@@ -0,0 +1,100 @@
+/******************************************************************************
+
+         Copyright (c) 2020, MaxLinear, Inc.
+         Copyright 2016 - 2020 Intel Corporation
+         Copyright 2015 - 2016 Lantiq Beteiligungs-GmbH & Co. KG
+         Copyright 2009 - 2014 Lantiq Deutschland GmbH
+         Copyright 2007 - 2008 Infineon Technologies AG
+
+  For licensing information, see the file 'LICENSE' in the root folder of
+  this software module.
+
+*******************************************************************************/
+
+/*
+ * Log event formatter
+ *
+ * Turns the binary parameters of a log event into text according to the
+ * printf-like format string extracted to the .scd file by logprep.
+ * Shared by logserver (in-process decoding) and logcnv.
+ */
+
+#ifndef __LOGFMT_H__
+#define __LOGFMT_H__
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct _logfmt_evt_t
+{
+  uint8       oid;
+  uint8       gid;
+  uint16      fid;
+  uint16      lid;
+  const void *data;     /* parameters following the mtlk_log_event_t header */
+  uint32      dsize;
+  BOOL        reversed; /* parameters are in the opposite byte order */
+} logfmt_evt_t;
+
+/* Decodes in place the format string of an .scd file record, as written
+ * by logprep: the contents of the C string literals. Leading blanks and
+ * trailing line ends are dropped, "" between literals is removed and the
+ * escape sequences are replaced. Every reader of .scd files decodes them
+ * this way, compiled .scd files hold the decoded strings.
+ * Returns -1 on an unsupported escape sequence.
+ */
+int __MTLK_IFUNC
+logfmt_decode(char *fmt);
+
+/* Format string compiled for repeated use */
+typedef struct _logfmt_prog_t logfmt_prog_t;
+
+/* Compiles the format string, returns NULL if out of memory */
+logfmt_prog_t * __MTLK_IFUNC
+logfmt_compile(const char *fmt);
+
+void __MTLK_IFUNC
+logfmt_free(logfmt_prog_t *prog);
+
+/* Returns the source format string of the program */
+const char * __MTLK_IFUNC
+logfmt_get_format(const logfmt_prog_t *prog);
+
+/* Compiled programs are position independent: a program copied as is
+ * (e.g. to a file that is mapped back) can be used in place, as long as
+ * it's aligned to LOGFMT_PROG_ALIGN and LOGFMT_PROG_VERSION matches.
+ * The layout doesn't depend on the compiler, only the byte order does.
+ */
+#define LOGFMT_PROG_VERSION  2
+#define LOGFMT_PROG_ALIGN    8
+
+uint32 __MTLK_IFUNC
+logfmt_prog_size(const logfmt_prog_t *prog);
+
+/* Returns the program copied to image of size bytes, NULL if the image
+ * isn't a valid program (e.g. a corrupted file) */
+const logfmt_prog_t * __MTLK_IFUNC
+logfmt_prog_check(const void *image, size_t size);
+
+/* Converts the program image of size bytes between the host and the
+ * other byte order, to the host one if to_host. Safe on images that
+ * aren't checked yet. */
+void __MTLK_IFUNC
+logfmt_prog_bswap(void *image, size_t size, BOOL to_host);
+
+/* Formats the event parameters according to the program (NULL if the
+ * event has no format string) into buf of size bytes.
+ * Follows snprintf conventions: the result is always terminated and the
+ * returned value is the full message length, so a value >= size means
+ * that the message was truncated.
+ * Returns -1 if the event data is corrupted.
+ */
+int __MTLK_IFUNC
+logfmt_run(const logfmt_prog_t *prog, const logfmt_evt_t *evt, char *buf, size_t size);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __LOGFMT_H__ */
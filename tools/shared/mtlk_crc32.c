@@ -0,0 +1,248 @@
+/******************************************************************************
+
+         Copyright (c) 2020, MaxLinear, Inc.
+         Copyright 2016 - 2020 Intel Corporation
+         Copyright 2015 - 2016 Lantiq Beteiligungs-GmbH & Co. KG
+         Copyright 2009 - 2014 Lantiq Deutschland GmbH
+         Copyright 2007 - 2008 Infineon Technologies AG
+
+  For licensing information, see the file 'LICENSE' in the root folder of
+  this software module.
+
+*******************************************************************************/
+
+#include "mtlkinc.h"
+#include "mtlk_crc32.h"
+
+#include <pthread.h>
+
+#if (defined(__x86_64__) || defined(__i386__)) && defined(__GNUC__) && (__GNUC__ >= 5)
+#define CRC32_HAVE_PCLMUL
+#include <cpuid.h>
+#include <wmmintrin.h>
+#include <smmintrin.h>
+#elif defined(__aarch64__) && defined(__GNUC__) && (__GNUC__ >= 6)
+#define CRC32_HAVE_ARMV8
+#include <sys/auxv.h>
+#ifndef HWCAP_CRC32
+#define HWCAP_CRC32 (1 << 7)
+#endif
+#endif
+
+#define CRC32_POLY      0xEDB88320
+
+typedef uint32 (*crc32_impl_f)(uint32 crc, const uint8 *p, uint32 len);
+
+static uint32          crc32_table[8][256];
+static crc32_impl_f    crc32_impl;
+static const char     *crc32_impl_name;
+static pthread_once_t  crc32_once = PTHREAD_ONCE_INIT;
+
+/* Little endian load on any CPU, a single one where allowed */
+#define CRC32_LOAD_LE32(p) \
+  ((uint32)(p)[0] | ((uint32)(p)[1] << 8) | ((uint32)(p)[2] << 16) | ((uint32)(p)[3] << 24))
+
+static uint32
+_mtlk_crc32_slice8 (uint32 crc, const uint8 *p, uint32 len)
+{
+  while (len >= 8) {
+    uint32 lo = crc ^ CRC32_LOAD_LE32(p);
+    uint32 hi = CRC32_LOAD_LE32(p + 4);
+
+    crc = crc32_table[7][lo & 0xFF]         ^ crc32_table[6][(lo >> 8) & 0xFF] ^
+          crc32_table[5][(lo >> 16) & 0xFF] ^ crc32_table[4][lo >> 24] ^
+          crc32_table[3][hi & 0xFF]         ^ crc32_table[2][(hi >> 8) & 0xFF] ^
+          crc32_table[1][(hi >> 16) & 0xFF] ^ crc32_table[0][hi >> 24];
+    p   += 8;
+    len -= 8;
+  }
+
+  while (len--) {
+    crc = crc32_table[0][(crc ^ *p++) & 0xFF] ^ (crc >> 8);
+  }
+
+  return crc;
+}
+
+#ifdef CRC32_HAVE_PCLMUL
+/* Folding by 4 x 128 bits and Barrett reduction, see Intel's "Fast CRC
+ * Computation for Generic Polynomials Using PCLMULQDQ Instruction".
+ * Requires len >= 64 and a multiple of 16. */
+__attribute__((target("pclmul,sse4.1")))
+static uint32
+_mtlk_crc32_pclmul_fold (uint32 crc, const uint8 *p, uint32 len)
+{
+  const __m128i k1k2 = _mm_set_epi64x(0x01C6E41596LL, 0x0154442BD4LL);
+  const __m128i k3k4 = _mm_set_epi64x(0x00CCAA009ELL, 0x01751997D0LL);
+  const __m128i k5k0 = _mm_set_epi64x(0,              0x0163CD6124LL);
+  const __m128i poly = _mm_set_epi64x(0x01F7011641LL, 0x01DB710641LL);
+  const __m128i mask = _mm_setr_epi32(~0, 0, ~0, 0);
+  __m128i x0, x1, x2, x3, x4, x5, x6, x7, x8;
+
+  x1 = _mm_loadu_si128((const __m128i *)(p + 0x00));
+  x2 = _mm_loadu_si128((const __m128i *)(p + 0x10));
+  x3 = _mm_loadu_si128((const __m128i *)(p + 0x20));
+  x4 = _mm_loadu_si128((const __m128i *)(p + 0x30));
+  x1 = _mm_xor_si128(x1, _mm_cvtsi32_si128((int)crc));
+  p   += 64;
+  len -= 64;
+
+  for (; len >= 64; p += 64, len -= 64) {
+    x5 = _mm_clmulepi64_si128(x1, k1k2, 0x00);
+    x6 = _mm_clmulepi64_si128(x2, k1k2, 0x00);
+    x7 = _mm_clmulepi64_si128(x3, k1k2, 0x00);
+    x8 = _mm_clmulepi64_si128(x4, k1k2, 0x00);
+    x1 = _mm_clmulepi64_si128(x1, k1k2, 0x11);
+    x2 = _mm_clmulepi64_si128(x2, k1k2, 0x11);
+    x3 = _mm_clmulepi64_si128(x3, k1k2, 0x11);
+    x4 = _mm_clmulepi64_si128(x4, k1k2, 0x11);
+    x1 = _mm_xor_si128(_mm_xor_si128(x1, x5), _mm_loadu_si128((const __m128i *)(p + 0x00)));
+    x2 = _mm_xor_si128(_mm_xor_si128(x2, x6), _mm_loadu_si128((const __m128i *)(p + 0x10)));
+    x3 = _mm_xor_si128(_mm_xor_si128(x3, x7), _mm_loadu_si128((const __m128i *)(p + 0x20)));
+    x4 = _mm_xor_si128(_mm_xor_si128(x4, x8), _mm_loadu_si128((const __m128i *)(p + 0x30)));
+  }
+
+  /* 4 x 128 -> 128 bits, then the remaining 128 bits blocks */
+  x5 = _mm_clmulepi64_si128(x1, k3k4, 0x00);
+  x1 = _mm_clmulepi64_si128(x1, k3k4, 0x11);
+  x1 = _mm_xor_si128(_mm_xor_si128(x1, x2), x5);
+  x5 = _mm_clmulepi64_si128(x1, k3k4, 0x00);
+  x1 = _mm_clmulepi64_si128(x1, k3k4, 0x11);
+  x1 = _mm_xor_si128(_mm_xor_si128(x1, x3), x5);
+  x5 = _mm_clmulepi64_si128(x1, k3k4, 0x00);
+  x1 = _mm_clmulepi64_si128(x1, k3k4, 0x11);
+  x1 = _mm_xor_si128(_mm_xor_si128(x1, x4), x5);
+
+  for (; len >= 16; p += 16, len -= 16) {
+    x5 = _mm_clmulepi64_si128(x1, k3k4, 0x00);
+    x1 = _mm_clmulepi64_si128(x1, k3k4, 0x11);
+    x1 = _mm_xor_si128(_mm_xor_si128(x1, _mm_loadu_si128((const __m128i *)p)), x5);
+  }
+
+  /* 128 -> 64 bits */
+  x2 = _mm_clmulepi64_si128(x1, k3k4, 0x10);
+  x1 = _mm_xor_si128(_mm_srli_si128(x1, 8), x2);
+  x2 = _mm_srli_si128(x1, 4);
+  x1 = _mm_clmulepi64_si128(_mm_and_si128(x1, mask), k5k0, 0x00);
+  x1 = _mm_xor_si128(x1, x2);
+
+  /* Barrett reduction to 32 bits */
+  x0 = _mm_clmulepi64_si128(_mm_and_si128(x1, mask), poly, 0x10);
+  x0 = _mm_clmulepi64_si128(_mm_and_si128(x0, mask), poly, 0x00);
+  x1 = _mm_xor_si128(x1, x0);
+
+  return (uint32)_mm_extract_epi32(x1, 1);
+}
+
+static uint32
+_mtlk_crc32_pclmul (uint32 crc, const uint8 *p, uint32 len)
+{
+  if (len >= 64) {
+    uint32 fold_len = len & ~15U;
+
+    crc  = _mtlk_crc32_pclmul_fold(crc, p, fold_len);
+    p   += fold_len;
+    len -= fold_len;
+  }
+
+  return _mtlk_crc32_slice8(crc, p, len);
+}
+
+static BOOL
+_mtlk_crc32_pclmul_supported (void)
+{
+  unsigned int eax, ebx, ecx, edx;
+
+  if (!__get_cpuid(1, &eax, &ebx, &ecx, &edx))
+    return FALSE;
+
+  return (ecx & bit_PCLMUL) && (ecx & bit_SSE4_1);
+}
+#endif /* CRC32_HAVE_PCLMUL */
+
+#ifdef CRC32_HAVE_ARMV8
+#pragma GCC push_options
+#pragma GCC target("+crc")
+#include <arm_acle.h>
+
+static uint32
+_mtlk_crc32_armv8 (uint32 crc, const uint8 *p, uint32 len)
+{
+  while (len && ((uintptr_t)p & 7)) {
+    crc = __crc32b(crc, *p++);
+    len--;
+  }
+
+  for (; len >= 8; p += 8, len -= 8) {
+    crc = __crc32d(crc, *(const uint64 *)p);
+  }
+
+  while (len--) {
+    crc = __crc32b(crc, *p++);
+  }
+
+  return crc;
+}
+#pragma GCC pop_options
+#endif /* CRC32_HAVE_ARMV8 */
+
+static void
+_mtlk_crc32_init (void)
+{
+  uint32 i, k;
+
+  for (i = 0; i < 256; i++) {
+    uint32 c = i;
+
+    for (k = 0; k < 8; k++) {
+      c = (c >> 1) ^ ((c & 1) ? CRC32_POLY : 0);
+    }
+    crc32_table[0][i] = c;
+  }
+
+  for (i = 0; i < 256; i++) {
+    for (k = 1; k < 8; k++) {
+      crc32_table[k][i] = (crc32_table[k - 1][i] >> 8) ^
+                          crc32_table[0][crc32_table[k - 1][i] & 0xFF];
+    }
+  }
+
+  crc32_impl      = _mtlk_crc32_slice8;
+  crc32_impl_name = "slicing-by-8";
+
+#if defined(CRC32_HAVE_PCLMUL)
+  if (_mtlk_crc32_pclmul_supported()) {
+    crc32_impl      = _mtlk_crc32_pclmul;
+    crc32_impl_name = "pclmulqdq";
+  }
+#elif defined(CRC32_HAVE_ARMV8)
+  if (getauxval(AT_HWCAP) & HWCAP_CRC32) {
+    crc32_impl      = _mtlk_crc32_armv8;
+    crc32_impl_name = "armv8-crc32";
+  }
+#endif
+}
+
+uint32 __MTLK_IFUNC
+mtlk_crc32_update (uint32 crc, const void *data, uint32 len)
+{
+  pthread_once(&crc32_once, _mtlk_crc32_init);
+
+  return crc32_impl(crc, (const uint8 *)data, len);
+}
+
+uint32 __MTLK_IFUNC
+mtlk_crc32_update_sw (uint32 crc, const void *data, uint32 len)
+{
+  pthread_once(&crc32_once, _mtlk_crc32_init);
+
+  return _mtlk_crc32_slice8(crc, (const uint8 *)data, len);
+}
+
+const char * __MTLK_IFUNC
+mtlk_crc32_get_impl_name (void)
+{
+  pthread_once(&crc32_once, _mtlk_crc32_init);
+
+  return crc32_impl_name;
+}
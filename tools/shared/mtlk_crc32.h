@@ -0,0 +1,54 @@
+/******************************************************************************
+
+         Copyright (c) 2020, MaxLinear, Inc.
+         Copyright 2016 - 2020 Intel Corporation
+         Copyright 2015 - 2016 Lantiq Beteiligungs-GmbH & Co. KG
+         Copyright 2009 - 2014 Lantiq Deutschland GmbH
+         Copyright 2007 - 2008 Infineon Technologies AG
+
+  For licensing information, see the file 'LICENSE' in the root folder of
+  this software module.
+
+*******************************************************************************/
+
+/*
+ * CRC-32 as used by Ethernet, zlib, EEPROM CIS etc.:
+ * reflected, polynomial 0xEDB88320.
+ *
+ * Slicing-by-8 tables on any CPU. The carry-less multiplication
+ * (x86 PCLMULQDQ) or the CRC32 instructions (ARMv8) are used instead
+ * when the CPU the application runs on has them.
+ */
+
+#ifndef __MTLK_CRC32_H__
+#define __MTLK_CRC32_H__
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Updates the CRC register with len bytes of data. There is no initial
+ * and final inversion here, i.e. the CRC-32 of data is
+ * mtlk_crc32_update(~0U, data, len) ^ ~0U, see mtlk_crc32() */
+uint32 __MTLK_IFUNC
+mtlk_crc32_update(uint32 crc, const void *data, uint32 len);
+
+/* The same with the tables only, regardless of the CPU */
+uint32 __MTLK_IFUNC
+mtlk_crc32_update_sw(uint32 crc, const void *data, uint32 len);
+
+/* Name of the implementation mtlk_crc32_update() uses */
+const char * __MTLK_IFUNC
+mtlk_crc32_get_impl_name(void);
+
+static __INLINE uint32
+mtlk_crc32 (const void *data, uint32 len)
+{
+  return mtlk_crc32_update(~0U, data, len) ^ ~0U;
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __MTLK_CRC32_H__ */
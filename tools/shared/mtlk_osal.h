@@ -176,7 +176,8 @@ static __INLINE void          mtlk_osal_lock_cleanup(mtlk_osal_spinlock_t* spinl
   \brief   Waits for event object to be set with timeout. 
 
   \param   event Event object
-  \param   msec  Maximal time to wait (in milliseconds)
+  \param   msec  Maximal time to wait (in milliseconds),
+                 MTLK_OSAL_EVENT_INFINITE to wait with no timeout
 
   \return  MTLK_ERR... values, MTLK_ERR_OK if succeeded, MTLK_ERR_TIMEOUT if timed out
  */
@@ -234,7 +235,8 @@ static __INLINE int  mtlk_osal_pause(void);
   \fn      mtlk_osal_timestamp_t __MTLK_IFUNC mtlk_osal_timestamp()
   \brief   Produces timestamp. 
 
-  \return  Timestamp for the current time
+  \return  Timestamp for the current time, monotonic (not affected by
+           the system time changes)
  */
 
 /*! 
@@ -352,6 +354,39 @@ static __INLINE void mtlk_osal_copy_ip4_addresses(void* dst, const void* src);
 \param   target    Pointer to a variable to be set
 \param   value     Specifies the value to which the variable will be set
 
+\return  the value of the variable at target when the call occurred
+*/
+
+/*! 
+\fn      uint32 __MTLK_IFUNC mtlk_osal_atomic_cmpxchg(mtlk_atomic_t* target, uint32 old, uint32 value)
+\brief   Sets value of caller-supplied variable to a given value if it equals
+         to old as an atomic operation.
+
+\param   target    Pointer to a variable to be set
+\param   old       Specifies the value expected in the variable
+\param   value     Specifies the value to which the variable will be set
+
+\return  the value of the variable at target when the call occurred,
+         the variable is set if it is equal to old
+*/
+
+/*! 
+\fn      uint32 __MTLK_IFUNC mtlk_osal_atomic_fetch_or(mtlk_atomic_t* target, uint32 mask)
+\brief   Sets the bits of mask in caller-supplied variable as an atomic operation.
+
+\param   target    Pointer to a variable to be modified
+\param   mask      Bits to be set
+
+\return  the value of the variable at target when the call occurred
+*/
+
+/*! 
+\fn      uint32 __MTLK_IFUNC mtlk_osal_atomic_fetch_and(mtlk_atomic_t* target, uint32 mask)
+\brief   Clears the bits not in mask in caller-supplied variable as an atomic operation.
+
+\param   target    Pointer to a variable to be modified
+\param   mask      Bits to be kept
+
 \return  the value of the variable at target when the call occurred
 */
 static __INLINE uint32 mtlk_osal_atomic_add(mtlk_atomic_t* val, uint32 i);
@@ -361,6 +396,9 @@ static __INLINE uint32 mtlk_osal_atomic_dec(mtlk_atomic_t* val);
 static __INLINE void   mtlk_osal_atomic_set(mtlk_atomic_t* target, uint32 value);
 static __INLINE uint32 mtlk_osal_atomic_get(const mtlk_atomic_t* val);
 static __INLINE uint32 mtlk_osal_atomic_xchg(mtlk_atomic_t* target, uint32 value);
+static __INLINE uint32 mtlk_osal_atomic_cmpxchg(mtlk_atomic_t* target, uint32 old, uint32 value);
+static __INLINE uint32 mtlk_osal_atomic_fetch_or(mtlk_atomic_t* target, uint32 mask);
+static __INLINE uint32 mtlk_osal_atomic_fetch_and(mtlk_atomic_t* target, uint32 mask);
 /**********************************************************************/
 
 /**********************************************************************
@@ -411,6 +449,19 @@ static __INLINE int    mtlk_osal_thread_run(mtlk_osal_thread_t     *thread,
 static __INLINE int    mtlk_osal_thread_wait(mtlk_osal_thread_t *thread,
                                              int32              *thread_res);
 static __INLINE void   mtlk_osal_thread_cleanup(mtlk_osal_thread_t *thread);
+
+/*! 
+  \fn      uint32 __MTLK_IFUNC mtlk_osal_get_context_slot(void)
+  \brief   Returns a small number of the calling context: the thread (numbered
+           on its first call) in user space, the CPU in the kernel.
+
+  \return  the slot number. It may change between calls, so it may only select
+           one of equivalent resources (e.g. to spread lock contention).
+
+  The OSALs providing it define MTLK_OSAL_HAVE_CONTEXT_SLOT in their
+  osal_osdep_decls.h, the shared code falls back to a single slot otherwise.
+ */
+static __INLINE uint32 mtlk_osal_get_context_slot(void);
 /**********************************************************************/
 
 /**********************************************************************
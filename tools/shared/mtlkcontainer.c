@@ -14,30 +14,266 @@
 #include "mtlkinc.h"
 #include "mtlkcontainer.h"
 
+#include <limits.h>
+#include <poll.h>
+#include <fcntl.h>
+#include <unistd.h>
+
 #define LOG_LOCAL_GID   GID_MTLKCONTAINER
 #define LOG_LOCAL_FID   1
 
 #define MTLK_CNT_INITED       0x00000001
-#define MTLK_CNT_MUST_ITERATE 0x80000000
 
 #define MTLK_CMP_STARTED      0x00000001
 
-#define MTLK_DEF_ITERATOR_STEP 20 /* ms */
+/* Hierarchical timer wheel of the component deadlines (ms).
+ * A slot of level L spans MTLK_WHEEL_SLOTS^L ms. A deadline is kept at the
+ * lowest level whose window (the slots ahead of the current one) holds it
+ * and moves to the lower levels as its slot is reached, so arming and
+ * expiring are O(1) whatever the number of components. Deadlines beyond
+ * a turn of the top level (~4.6 hours) are re-armed on the way.
+ */
+#define MTLK_WHEEL_BITS       6
+#define MTLK_WHEEL_SLOTS      (1 << MTLK_WHEEL_BITS)
+#define MTLK_WHEEL_MASK       (MTLK_WHEEL_SLOTS - 1)
+#define MTLK_WHEEL_LEVELS     4
+
+typedef struct
+{
+  uint64       now;
+  uint64       occupied[MTLK_WHEEL_LEVELS]; /* non-empty slots bitmaps */
+  mtlk_dlist_t slots[MTLK_WHEEL_LEVELS][MTLK_WHEEL_SLOTS];
+  mtlk_dlist_t expired;
+} mtlk_wheel_t;
 
 struct mtlk_component
 {
   mtlk_dlist_entry_t   lentry;
+  mtlk_dlist_entry_t   tentry;   /* wheel entry */
+  mtlk_dlist_t        *tlist;    /* wheel slot or expired list, NULL if not armed */
+  uint64               deadline;
+  int                  fd;
   mtlk_handle_t        ctx;
   mtlk_component_api_t api;
   char                 name[MTLK_COMPONENT_NAME_LEN + 1];
   uint32               state;
 };
 
+/* Bits [first, first + nof) of a 64 bit map, wrapping around */
+static __INLINE uint64
+_mtlk_wheel_slot_bits (uint32 first, uint64 nof)
+{
+  uint64 bits = (nof >= MTLK_WHEEL_SLOTS) ? (uint64)-1 : ((1ULL << nof) - 1);
+
+  first &= MTLK_WHEEL_MASK;
+  return (bits << first) | (bits >> ((MTLK_WHEEL_SLOTS - first) & MTLK_WHEEL_MASK));
+}
+
+static void
+_mtlk_wheel_init (mtlk_wheel_t *wheel, uint64 now)
+{
+  int level, slot;
+
+  memset(wheel, 0, sizeof(*wheel));
+  wheel->now = now;
+  for (level = 0; level < MTLK_WHEEL_LEVELS; level++) {
+    for (slot = 0; slot < MTLK_WHEEL_SLOTS; slot++) {
+      mtlk_dlist_init(&wheel->slots[level][slot]);
+    }
+  }
+  mtlk_dlist_init(&wheel->expired);
+}
+
+static void
+_mtlk_wheel_cleanup (mtlk_wheel_t *wheel)
+{
+  int level, slot;
+
+  for (level = 0; level < MTLK_WHEEL_LEVELS; level++) {
+    for (slot = 0; slot < MTLK_WHEEL_SLOTS; slot++) {
+      mtlk_dlist_cleanup(&wheel->slots[level][slot]);
+    }
+  }
+  mtlk_dlist_cleanup(&wheel->expired);
+}
+
+static void
+_mtlk_wheel_disarm (mtlk_wheel_t *wheel, struct mtlk_component *cmp)
+{
+  if (!cmp->tlist) {
+    return;
+  }
+
+  mtlk_dlist_remove(cmp->tlist, &cmp->tentry);
+  if (cmp->tlist != &wheel->expired && mtlk_dlist_is_empty(cmp->tlist)) {
+    uint32 idx = (uint32)(cmp->tlist - &wheel->slots[0][0]);
+
+    wheel->occupied[idx / MTLK_WHEEL_SLOTS] &= ~(1ULL << (idx % MTLK_WHEEL_SLOTS));
+  }
+  cmp->tlist = NULL;
+}
+
+static void
+_mtlk_wheel_arm (mtlk_wheel_t *wheel, struct mtlk_component *cmp, uint64 deadline)
+{
+  int    level;
+  uint32 slot;
+
+  _mtlk_wheel_disarm(wheel, cmp);
+  cmp->deadline = deadline;
+
+  if (deadline <= wheel->now) {
+    cmp->tlist = &wheel->expired;
+  }
+  else {
+    for (level = 0; level < MTLK_WHEEL_LEVELS; level++) {
+      uint32 shift = (level + 1) * MTLK_WHEEL_BITS;
+
+      if ((deadline >> shift) == (wheel->now >> shift)) {
+        break;
+      }
+    }
+
+    if (level < MTLK_WHEEL_LEVELS) {
+      slot = (uint32)(deadline >> (level * MTLK_WHEEL_BITS)) & MTLK_WHEEL_MASK;
+    }
+    else {
+      /* The top level wraps around: up to a full turn ahead, the farther
+       * deadlines are re-armed after the turn */
+      uint64 cur;
+
+      level = MTLK_WHEEL_LEVELS - 1;
+      cur   = wheel->now >> (level * MTLK_WHEEL_BITS);
+      slot  = (uint32)MIN(deadline >> (level * MTLK_WHEEL_BITS),
+                          cur + MTLK_WHEEL_SLOTS) & MTLK_WHEEL_MASK;
+    }
+
+    cmp->tlist = &wheel->slots[level][slot];
+    wheel->occupied[level] |= 1ULL << slot;
+  }
+
+  mtlk_dlist_push_back(cmp->tlist, &cmp->tentry);
+}
+
+/* Moves the wheel to now: the deadlines of the slots passed are re-armed,
+ * so they either expire or go down to the lower levels */
+static void
+_mtlk_wheel_advance (mtlk_wheel_t *wheel, uint64 now)
+{
+  mtlk_dlist_t        passed;
+  mtlk_dlist_entry_t *entry;
+  int                 level;
+
+  if (now <= wheel->now) {
+    return;
+  }
+
+  mtlk_dlist_init(&passed);
+
+  for (level = 0; level < MTLK_WHEEL_LEVELS; level++) {
+    uint64 from = wheel->now >> (level * MTLK_WHEEL_BITS);
+    uint64 to   = now >> (level * MTLK_WHEEL_BITS);
+    uint64 slots;
+
+    /* Nor will the upper levels move */
+    if (from == to) {
+      break;
+    }
+
+    slots = wheel->occupied[level] & _mtlk_wheel_slot_bits((uint32)from + 1, to - from);
+    wheel->occupied[level] &= ~slots;
+
+    while (slots) {
+      mtlk_dlist_t *slot = &wheel->slots[level][__builtin_ctzll(slots)];
+
+      while ((entry = mtlk_dlist_pop_front(slot)) != NULL) {
+        struct mtlk_component *cmp = MTLK_CONTAINER_OF(entry, struct mtlk_component, tentry);
+
+        cmp->tlist = NULL;
+        mtlk_dlist_push_back(&passed, entry);
+      }
+      slots &= slots - 1;
+    }
+  }
+
+  wheel->now = now;
+
+  while ((entry = mtlk_dlist_pop_front(&passed)) != NULL) {
+    struct mtlk_component *cmp = MTLK_CONTAINER_OF(entry, struct mtlk_component, tentry);
+
+    _mtlk_wheel_arm(wheel, cmp, cmp->deadline);
+  }
+
+  mtlk_dlist_cleanup(&passed);
+}
+
+/* Time (ms) to the next slot holding a deadline. It is exact for the lowest
+ * level, the upper level slots are reached earlier than their deadlines
+ * and only move them down. */
+static uint32
+_mtlk_wheel_timeout (mtlk_wheel_t *wheel)
+{
+  uint64 next = (uint64)-1;
+  int    level;
+
+  if (!mtlk_dlist_is_empty(&wheel->expired)) {
+    return 0;
+  }
+
+  for (level = 0; level < MTLK_WHEEL_LEVELS; level++) {
+    uint64 cur = wheel->now >> (level * MTLK_WHEEL_BITS);
+    uint32 first = (uint32)(cur + 1) & MTLK_WHEEL_MASK;
+    uint64 ahead;
+
+    if (!wheel->occupied[level]) {
+      continue;
+    }
+
+    /* Rotate the slot next to the current one to bit 0 */
+    ahead = (wheel->occupied[level] >> first) |
+            (wheel->occupied[level] << ((MTLK_WHEEL_SLOTS - first) & MTLK_WHEEL_MASK));
+    next = MIN(next, (cur + 1 + __builtin_ctzll(ahead)) << (level * MTLK_WHEEL_BITS));
+  }
+
+  if (next == (uint64)-1) {
+    return MTLK_OSAL_EVENT_INFINITE;
+  }
+
+  return (uint32)MIN(next - wheel->now, (uint64)MTLK_OSAL_EVENT_INFINITE - 1);
+}
+
+/* Iterates the components whose deadlines have expired */
+static void
+_mtlk_wheel_expire (mtlk_wheel_t *wheel)
+{
+  mtlk_dlist_entry_t *entry;
+
+  while ((entry = mtlk_dlist_pop_front(&wheel->expired)) != NULL) {
+    struct mtlk_component *cmp = MTLK_CONTAINER_OF(entry, struct mtlk_component, tentry);
+    uint32                 step;
+
+    cmp->tlist = NULL;
+    step = cmp->api.iterate(cmp->ctx);
+    MTLK_ASSERT(step != 0);
+
+    if (step != MTLK_COMPONENT_NO_DEADLINE) {
+      _mtlk_wheel_arm(wheel, cmp, wheel->now + MAX(step, 1));
+    }
+  }
+}
+
 int  __MTLK_IFUNC
 mtlk_container_init (mtlk_container_t *cont)
 {
   memset(cont, 0, sizeof(*cont));
 
+  if (pipe(cont->wake_pipe_fd)) {
+    ELOG_SD("Failed to create pipe: %s (%d)", strerror(errno), errno);
+    return MTLK_ERR_SYSTEM;
+  }
+  fcntl(cont->wake_pipe_fd[0], F_SETFL, O_NONBLOCK);
+  fcntl(cont->wake_pipe_fd[1], F_SETFL, O_NONBLOCK);
+
   mtlk_dlist_init(&cont->components);
   cont->state |= MTLK_CNT_INITED;
 
@@ -52,6 +288,7 @@ mtlk_container_register (mtlk_container_t       *cont,
 
   MTLK_ASSERT(comp != NULL);
   MTLK_ASSERT(comp->api != NULL);
+  MTLK_ASSERT((comp->api->get_fd == NULL) == (comp->api->fd_ready == NULL));
 
   cmp = (struct mtlk_component *)mtlk_osal_mem_alloc(sizeof(*cmp),
                                                      MTLK_MEM_TAG_CONTAINER);
@@ -63,17 +300,11 @@ mtlk_container_register (mtlk_container_t       *cont,
   memset(cmp, 0, sizeof(*cmp));
   
   cmp->api = *comp->api;
+  cmp->fd  = -1;
 
   wave_strcopy(cmp->name, comp->name, sizeof(cmp->name));
 
-  if (cmp->api.iterate) {
-    /* Push components with iterators to the begin of the list */
-    mtlk_dlist_push_front(&cont->components, &cmp->lentry);
-    cont->state |= MTLK_CNT_MUST_ITERATE;
-  }
-  else {
-    mtlk_dlist_push_back(&cont->components, &cmp->lentry);
-  }
+  mtlk_dlist_push_back(&cont->components, &cmp->lentry);
 
   return MTLK_ERR_OK;
 }
@@ -82,11 +313,17 @@ int  __MTLK_IFUNC
 mtlk_container_run (mtlk_container_t  *cont,
                     mtlk_osal_event_t *close_evt)
 {
-  int                    res = MTLK_ERR_UNKNOWN;
-  mtlk_dlist_entry_t    *head;
-  mtlk_dlist_entry_t    *entry;
-  struct mtlk_component *cmp;
-  uint32                 step_ms;
+  int                     res = MTLK_ERR_UNKNOWN;
+  mtlk_dlist_entry_t     *head;
+  mtlk_dlist_entry_t     *entry;
+  struct mtlk_component  *cmp;
+  struct mtlk_component **fd_cmps = NULL;
+  struct pollfd          *fds = NULL;
+  uint32                  nof_fds = 0;
+  uint32                  i;
+  mtlk_wheel_t            wheel;
+
+  _mtlk_wheel_init(&wheel, mtlk_osal_timestamp());
 
   /* Traverse the components list and Start all the components */
   mtlk_dlist_foreach(&cont->components, entry, head) {
@@ -101,30 +338,88 @@ mtlk_container_run (mtlk_container_t  *cont,
       }
     }
     cmp->state |= MTLK_CMP_STARTED;
-  }
 
-  step_ms = (cont->state & MTLK_CNT_MUST_ITERATE)?MTLK_DEF_ITERATOR_STEP:MTLK_OSAL_EVENT_INFINITE;
-  while (TRUE) {
-    res = mtlk_osal_event_wait(close_evt, step_ms);
+    cmp->fd = cmp->api.get_fd ? cmp->api.get_fd(cmp->ctx) : -1;
+    if (cmp->fd >= 0) {
+      ++nof_fds;
+    }
+    if (cmp->api.iterate) {
+      _mtlk_wheel_arm(&wheel, cmp, wheel.now + MTLK_COMPONENT_DEF_STEP);
+    }
+  }
 
-    if (res == MTLK_ERR_OK) {
-      /* Stop event signaled => exit loop */
-      break;
+  /* The wakeup pipe goes first, then the component descriptors */
+  if (nof_fds) {
+    fds = (struct pollfd *)mtlk_osal_mem_alloc((nof_fds + 1) * sizeof(*fds),
+                                               MTLK_MEM_TAG_CONTAINER);
+    fd_cmps = (struct mtlk_component **)mtlk_osal_mem_alloc(nof_fds * sizeof(*fd_cmps),
+                                                            MTLK_MEM_TAG_CONTAINER);
+    if (!fds || !fd_cmps) {
+      ELOG_D("Can't allocate %u descriptors", nof_fds);
+      res = MTLK_ERR_NO_MEM;
+      goto end;
     }
 
+    memset(fds, 0, (nof_fds + 1) * sizeof(*fds));
+    fds[0].fd     = cont->wake_pipe_fd[0];
+    fds[0].events = POLLIN;
+    i = 0;
     mtlk_dlist_foreach(&cont->components, entry, head) {
       cmp = MTLK_CONTAINER_OF(entry, struct mtlk_component, lentry);
-      if (cmp->api.iterate) {
-        uint32 req_step = cmp->api.iterate(cmp->ctx);
-        MTLK_ASSERT(req_step != 0);
+      if (cmp->fd >= 0) {
+        fd_cmps[i]        = cmp;
+        fds[i + 1].fd     = cmp->fd;
+        fds[i + 1].events = POLLIN;
+        ++i;
+      }
+    }
+  }
+
+  while (TRUE) {
+    uint32 timeout = _mtlk_wheel_timeout(&wheel);
+
+    if (!nof_fds) {
+      res = mtlk_osal_event_wait(close_evt, timeout);
+      if (res == MTLK_ERR_OK) {
+        /* Stop event signaled => exit loop */
+        break;
+      }
+    }
+    else {
+      char buf[64];
 
-        step_ms = MIN(req_step, step_ms);
+      if (mtlk_osal_event_wait(close_evt, 0) == MTLK_ERR_OK) {
+        res = MTLK_ERR_OK;
+        break;
       }
-      else {
-        /* all the components with iterators inserted to the begin of the list */
+
+      if (poll(fds, nof_fds + 1,
+               (timeout == MTLK_OSAL_EVENT_INFINITE) ? -1 : (int)MIN(timeout, INT_MAX)) < 0 &&
+          errno != EINTR) {
+        ELOG_SD("Poll failed: %s (%d)", strerror(errno), errno);
+        res = MTLK_ERR_SYSTEM;
         break;
       }
+
+      if (fds[0].revents) {
+        while (read(fds[0].fd, buf, sizeof(buf)) > 0);
+      }
+
+      for (i = 0; i < nof_fds; i++) {
+        cmp = fd_cmps[i];
+        if (fds[i + 1].revents & POLLNVAL) {
+          WLOG_SD("Component '%s' descriptor %d is invalid, ignored", cmp->name, cmp->fd);
+          fds[i + 1].fd = -1;
+        }
+        else if (fds[i + 1].revents) {
+          cmp->api.fd_ready(cmp->ctx);
+        }
+        fds[i + 1].revents = 0;
+      }
     }
+
+    _mtlk_wheel_advance(&wheel, mtlk_osal_timestamp());
+    _mtlk_wheel_expire(&wheel);
   }
 
 end:
@@ -133,6 +428,8 @@ end:
   mtlk_dlist_foreach(&cont->components, entry, head) {
     cmp = MTLK_CONTAINER_OF(entry, struct mtlk_component, lentry);
 
+    _mtlk_wheel_disarm(&wheel, cmp);
+
     /* Stop the component if required */
     if ((MTLK_CMP_STARTED & cmp->state) && cmp->api.stop) {
       ILOG1_S("Trying to stop component %s...", cmp->name);
@@ -140,11 +437,29 @@ end:
       ILOG1_S("Done! (%s)", cmp->name);
     }
     cmp->state &= ~MTLK_CMP_STARTED;
+    cmp->fd = -1;
+  }
+
+  _mtlk_wheel_cleanup(&wheel);
+  if (fds) {
+    mtlk_osal_mem_free(fds);
+  }
+  if (fd_cmps) {
+    mtlk_osal_mem_free(fd_cmps);
   }
 
   return res;
 }
 
+void __MTLK_IFUNC
+mtlk_container_wakeup (mtlk_container_t *cont)
+{
+  /* Nothing to do if the pipe is full: the container is awake already */
+  if (write(cont->wake_pipe_fd[1], "x", 1) != 1) {
+    return;
+  }
+}
+
 void __MTLK_IFUNC
 mtlk_container_cleanup (mtlk_container_t *cont)
 {
@@ -158,4 +473,305 @@ mtlk_container_cleanup (mtlk_container_t *cont)
   }
 
   mtlk_dlist_cleanup(&cont->components);
+
+  close(cont->wake_pipe_fd[0]);
+  close(cont->wake_pipe_fd[1]);
+}
+
+#ifdef RUN_CONTAINER_UTEST
+/* Unit test of the timer wheel on a simulated clock. The components have
+ * steps crossing all the levels (and beyond a top level turn), the clock
+ * either jumps to the timeout requested or, at random, earlier or later.
+ * Every component must be iterated not before its deadline and, when the
+ * clock follows the timeouts, exactly at it, i.e. in the deadlines order. */
+
+#define CONTAINER_UTEST_NOF_CMPS    64
+#define CONTAINER_UTEST_NOF_WAKES   (1024 * 1024)
+#define CONTAINER_UTEST_MAX_CALLS   10000
+
+typedef struct
+{
+  uint32 step;
+  uint64 deadline;
+  uint32 nof_calls;
+} container_utest_cmp_t;
+
+static const uint32 container_utest_steps[] = {
+  1, 3, 63, 64, 65, 1000, 4095, 4097, 262143, 262145, 20000000
+};
+
+static container_utest_cmp_t container_utest_cmps[CONTAINER_UTEST_NOF_CMPS];
+static uint64                container_utest_start;
+static uint64                container_utest_now;
+static BOOL                  container_utest_exact;
+static uint32                container_utest_errors;
+
+static uint32 __MTLK_IFUNC
+_container_utest_iterate (mtlk_handle_t ctx)
+{
+  container_utest_cmp_t *c = HANDLE_T_PTR(container_utest_cmp_t, ctx);
+
+  if (container_utest_now < c->deadline ||
+      (container_utest_exact && container_utest_now != c->deadline)) {
+    ELOG_DDDD("Component %d (step %u) iterated at +%u ms, deadline +%u ms",
+              (int)(c - container_utest_cmps), c->step,
+              (uint32)(container_utest_now - container_utest_start),
+              (uint32)(c->deadline - container_utest_start));
+    container_utest_errors++;
+  }
+
+  if (++c->nof_calls == CONTAINER_UTEST_MAX_CALLS) {
+    return MTLK_COMPONENT_NO_DEADLINE;
+  }
+
+  c->deadline = container_utest_now + c->step;
+  return c->step;
+}
+
+static BOOL
+_container_utest_wheel (void)
+{
+  struct mtlk_component *cmps;
+  mtlk_wheel_t           wheel;
+  uint32                 seed = 1;
+  uint32                 i;
+  uint32                 nof_iterated = 0;
+
+  cmps = (struct mtlk_component *)mtlk_osal_mem_alloc(sizeof(*cmps) * CONTAINER_UTEST_NOF_CMPS,
+                                                      MTLK_MEM_TAG_CONTAINER);
+  if (!cmps) {
+    ELOG_V("Can't allocate components");
+    return FALSE;
+  }
+  memset(cmps, 0, sizeof(*cmps) * CONTAINER_UTEST_NOF_CMPS);
+  memset(container_utest_cmps, 0, sizeof(container_utest_cmps));
+  container_utest_errors = 0;
+
+  /* Start close to a top level turn so that it wraps around */
+  container_utest_start = (1ULL << (MTLK_WHEEL_LEVELS * MTLK_WHEEL_BITS)) - 12345;
+  container_utest_now  = container_utest_start;
+  _mtlk_wheel_init(&wheel, container_utest_now);
+
+  for (i = 0; i < CONTAINER_UTEST_NOF_CMPS; i++) {
+    container_utest_cmp_t *c = &container_utest_cmps[i];
+
+    c->step     = container_utest_steps[i % ARRAY_SIZE(container_utest_steps)] +
+                  i / ARRAY_SIZE(container_utest_steps);
+    c->deadline = container_utest_now + c->step;
+    cmps[i].ctx         = HANDLE_T(c);
+    cmps[i].api.iterate = _container_utest_iterate;
+    _mtlk_wheel_arm(&wheel, &cmps[i], c->deadline);
+  }
+
+  for (i = 0; i < CONTAINER_UTEST_NOF_WAKES; i++) {
+    uint32 timeout = _mtlk_wheel_timeout(&wheel);
+    uint64 next_deadline = (uint64)-1;
+    uint32 k;
+
+    for (k = 0; k < CONTAINER_UTEST_NOF_CMPS; k++) {
+      if (cmps[k].tlist) {
+        next_deadline = MIN(next_deadline, container_utest_cmps[k].deadline);
+      }
+    }
+
+    if (timeout == MTLK_OSAL_EVENT_INFINITE) {
+      if (next_deadline != (uint64)-1) {
+        ELOG_V("No timeout while a deadline is armed");
+        container_utest_errors++;
+      }
+      break;
+    }
+
+    /* Must never sleep past the nearest deadline */
+    if (container_utest_now + timeout > next_deadline) {
+      ELOG_DD("Timeout %u passes the deadline by %u", timeout,
+              (uint32)(container_utest_now + timeout - next_deadline));
+      container_utest_errors++;
+    }
+
+    /* Mostly exact wake ups, some early (as on a signal) and late ones */
+    seed = seed * 1103515245 + 12345;
+    switch ((seed >> 16) % 8) {
+    case 0:
+      container_utest_now  += timeout / 2;
+      container_utest_exact = FALSE;
+      break;
+    case 1:
+      container_utest_now  += timeout + (seed >> 24);
+      container_utest_exact = FALSE;
+      break;
+    default:
+      container_utest_now  += timeout;
+      container_utest_exact = TRUE;
+      break;
+    }
+
+    _mtlk_wheel_advance(&wheel, container_utest_now);
+    _mtlk_wheel_expire(&wheel);
+  }
+
+  for (i = 0; i < CONTAINER_UTEST_NOF_CMPS; i++) {
+    nof_iterated += container_utest_cmps[i].nof_calls;
+    _mtlk_wheel_disarm(&wheel, &cmps[i]);
+  }
+  _mtlk_wheel_cleanup(&wheel);
+  mtlk_osal_mem_free(cmps);
+
+  ILOG0_DDS("Container timer wheel: %u iterations, %u errors: %s",
+            nof_iterated, container_utest_errors,
+            container_utest_errors ? "FAILED" : "SUCCEED");
+
+  return (0 == container_utest_errors);
+}
+
+/* Descriptors dispatch on a running container. A component writes a byte
+ * to its pipe every ms and reads the pipe when it's ready. Once all the
+ * bytes are read another thread stops the container the way drvhlpr
+ * does. The container has no deadline then, so only mtlk_container_wakeup()
+ * can stop it before the byte the thread writes later as a fallback. */
+
+#define CONTAINER_UTEST_NOF_BYTES   100
+#define CONTAINER_UTEST_STOP_WAIT   5000 /* ms */
+#define CONTAINER_UTEST_FALLBACK    500  /* ms */
+
+static struct
+{
+  int               pipe_fd[2];
+  uint32            nof_written;
+  volatile uint32   nof_read;
+  mtlk_container_t  cont;
+  mtlk_osal_event_t close_evt;
+} container_utest_fd;
+
+static mtlk_handle_t __MTLK_IFUNC
+_container_utest_fd_start (void)
+{
+  return HANDLE_T(&container_utest_fd);
+}
+
+static uint32 __MTLK_IFUNC
+_container_utest_fd_iterate (mtlk_handle_t ctx)
+{
+  if (write(container_utest_fd.pipe_fd[1], "x", 1) == 1) {
+    container_utest_fd.nof_written++;
+  }
+
+  return (container_utest_fd.nof_written == CONTAINER_UTEST_NOF_BYTES) ?
+         MTLK_COMPONENT_NO_DEADLINE : 1;
+}
+
+static int __MTLK_IFUNC
+_container_utest_fd_get_fd (mtlk_handle_t ctx)
+{
+  return container_utest_fd.pipe_fd[0];
+}
+
+static void __MTLK_IFUNC
+_container_utest_fd_ready (mtlk_handle_t ctx)
+{
+  char buf[16];
+  int  n;
+
+  while ((n = read(container_utest_fd.pipe_fd[0], buf, sizeof(buf))) > 0) {
+    container_utest_fd.nof_read += n;
+  }
+}
+
+static const mtlk_component_api_t container_utest_fd_api = {
+  _container_utest_fd_start,
+  _container_utest_fd_iterate,
+  NULL,
+  _container_utest_fd_get_fd,
+  _container_utest_fd_ready
+};
+
+static int32 __MTLK_IFUNC
+_container_utest_fd_stop_proc (mtlk_handle_t ctx)
+{
+  uint32 waited = 0;
+
+  while (container_utest_fd.nof_read < CONTAINER_UTEST_NOF_BYTES &&
+         waited < CONTAINER_UTEST_STOP_WAIT) {
+    mtlk_osal_msleep(10);
+    waited += 10;
+  }
+
+  mtlk_osal_event_set(&container_utest_fd.close_evt);
+  mtlk_container_wakeup(&container_utest_fd.cont);
+
+  mtlk_osal_msleep(CONTAINER_UTEST_FALLBACK);
+  if (write(container_utest_fd.pipe_fd[1], "x", 1) != 1) {
+    return -1;
+  }
+
+  return 0;
+}
+
+static BOOL
+_container_utest_fds (void)
+{
+  static const mtlk_component_t comp = {
+    .api  = &container_utest_fd_api,
+    .name = "utest_fd"
+  };
+  mtlk_osal_thread_t thread;
+  int32              thread_res = 0;
+  BOOL               res = FALSE;
+  int                run_res;
+
+  memset(&container_utest_fd, 0, sizeof(container_utest_fd));
+  if (pipe(container_utest_fd.pipe_fd)) {
+    ELOG_SD("Failed to create pipe: %s (%d)", strerror(errno), errno);
+    return FALSE;
+  }
+  fcntl(container_utest_fd.pipe_fd[0], F_SETFL, O_NONBLOCK);
+
+  if (MTLK_ERR_OK != mtlk_osal_event_init(&container_utest_fd.close_evt)) {
+    ELOG_V("Can't init the close event");
+    goto end_pipe;
+  }
+  if (MTLK_ERR_OK != mtlk_container_init(&container_utest_fd.cont)) {
+    goto end_evt;
+  }
+  if (MTLK_ERR_OK != mtlk_container_register(&container_utest_fd.cont, &comp) ||
+      MTLK_ERR_OK != mtlk_osal_thread_init(&thread)) {
+    goto end_cont;
+  }
+  if (MTLK_ERR_OK != mtlk_osal_thread_run(&thread, _container_utest_fd_stop_proc, HANDLE_T(0))) {
+    ELOG_V("Can't run the stop thread");
+    goto end_thread;
+  }
+
+  run_res = mtlk_container_run(&container_utest_fd.cont, &container_utest_fd.close_evt);
+  mtlk_osal_thread_wait(&thread, &thread_res);
+
+  res = (run_res == MTLK_ERR_OK && thread_res == 0 &&
+         container_utest_fd.nof_written == CONTAINER_UTEST_NOF_BYTES &&
+         container_utest_fd.nof_read == CONTAINER_UTEST_NOF_BYTES);
+
+  ILOG0_DDDS("Container descriptors: %u bytes written, %u read, run returned %d: %s",
+             container_utest_fd.nof_written, container_utest_fd.nof_read, run_res,
+             res ? "SUCCEED" : "FAILED");
+
+end_thread:
+  mtlk_osal_thread_cleanup(&thread);
+end_cont:
+  mtlk_container_cleanup(&container_utest_fd.cont);
+end_evt:
+  mtlk_osal_event_cleanup(&container_utest_fd.close_evt);
+end_pipe:
+  close(container_utest_fd.pipe_fd[0]);
+  close(container_utest_fd.pipe_fd[1]);
+
+  return res;
+}
+
+BOOL __MTLK_IFUNC
+run_container_utest (void)
+{
+  BOOL wheel_ok = _container_utest_wheel();
+  BOOL fds_ok   = _container_utest_fds();
+
+  return wheel_ok && fds_ok;
 }
+#endif /* RUN_CONTAINER_UTEST */
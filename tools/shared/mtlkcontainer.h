@@ -20,13 +20,27 @@
 #define  MTLK_IDEFS_ON
 #include "mtlkidefs.h"
 
+/* Component callbacks, all of them optional:
+ *  iterate  - called when the component deadline expires, returns the
+ *             time (ms) to the next one or MTLK_COMPONENT_NO_DEADLINE.
+ *             The first deadline is MTLK_COMPONENT_DEF_STEP after start.
+ *  get_fd   - called once after start, returns a descriptor the component
+ *             waits on or -1.
+ *  fd_ready - called when the descriptor becomes readable (or fails).
+ * Every callback is called from the thread running the container.
+ */
 typedef struct
 {
   mtlk_handle_t (__MTLK_IFUNC *start)(void);
   uint32        (__MTLK_IFUNC *iterate)(mtlk_handle_t ctx);
   void          (__MTLK_IFUNC *stop)(mtlk_handle_t ctx);
+  int           (__MTLK_IFUNC *get_fd)(mtlk_handle_t ctx);
+  void          (__MTLK_IFUNC *fd_ready)(mtlk_handle_t ctx);
 } __MTLK_IDATA mtlk_component_api_t;
 
+#define MTLK_COMPONENT_NO_DEADLINE MTLK_OSAL_EVENT_INFINITE
+#define MTLK_COMPONENT_DEF_STEP    20 /* ms */
+
 #define MTLK_COMPONENT_NAME_LEN 8
 
 typedef struct
@@ -39,15 +53,30 @@ typedef struct
 {
   mtlk_dlist_t      components;
   uint32            state;
+  int               wake_pipe_fd[2];
 } __MTLK_IDATA mtlk_container_t;
 
 int  __MTLK_IFUNC mtlk_container_init(mtlk_container_t *cont);
 int  __MTLK_IFUNC mtlk_container_register(mtlk_container_t       *cont, 
                                           const mtlk_component_t *comp);
+/* Runs the components until close_evt is set. The thread sleeps until
+ * the nearest component deadline or descriptor readiness. */
 int  __MTLK_IFUNC mtlk_container_run(mtlk_container_t  *cont,
                                      mtlk_osal_event_t *close_evt);
+/* Makes a running container check close_evt. Needed after setting it
+ * when some component waits on a descriptor, may be called from any
+ * thread or a signal handler. */
+void __MTLK_IFUNC mtlk_container_wakeup(mtlk_container_t *cont);
 void __MTLK_IFUNC mtlk_container_cleanup(mtlk_container_t *cont);
 
+#ifdef RUN_CONTAINER_UTEST
+/* Checks the deadlines handling on a simulated clock and the descriptors
+ * dispatch of a running container */
+BOOL __MTLK_IFUNC run_container_utest(void);
+#else
+#define run_container_utest()
+#endif
+
 
 #define  MTLK_IDEFS_OFF
 #include "mtlkidefs.h"
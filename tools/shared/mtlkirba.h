@@ -226,6 +226,8 @@ mtlk_irba_unregister(mtlk_irba_t        *irba,
 
     This functions call the driver with specified event. Driver handlers registered to handle 
     it will be called. The call is \b synchronous.
+    The data is copied to and from a call buffer of the IRBA object, or
+    an allocated one if that is in use or too small.
 
     \param   irba     IRBA object.
     \param   evt      event ID to send (GUID)
@@ -240,6 +242,39 @@ mtlk_irba_call_drv(mtlk_irba_t       *irba,
                    void              *buffer,
                    uint32             size);
 
+/*! \def   MTLK_IRBA_CALL_HEADROOM
+    \brief Size of the space required in front of the data passed to
+           mtlk_irba_call_drv_inplace.
+*/
+#define MTLK_IRBA_CALL_HEADROOM sizeof(struct mtlk_irb_call_hdr)
+
+/*! \brief Call the driver with the event data in place.
+
+    Same as mtlk_irba_call_drv, but the call is built in the
+    MTLK_IRBA_CALL_HEADROOM bytes preceding the data, so the data is neither
+    copied nor allocated. Their contents are restored before the return.
+
+    \param   irba     IRBA object.
+    \param   evt      event ID to send (GUID)
+    \param   buffer   event data to send, preceded by MTLK_IRBA_CALL_HEADROOM
+                      writable bytes
+    \param   size     event data size
+
+    \return  MTLK_ERR... code
+*/
+mtlk_error_t __MTLK_IFUNC
+mtlk_irba_call_drv_inplace(mtlk_irba_t       *irba,
+                           const mtlk_guid_t *evt,
+                           void              *buffer,
+                           uint32             size);
+
+#ifdef RUN_IRBA_UTEST
+/* Driver calls throughput against an ioctl stub */
+BOOL __MTLK_IFUNC run_irba_utest(void);
+#else
+#define run_irba_utest()
+#endif
+
 #define   MTLK_IDEFS_OFF
 #include "mtlkidefs.h"
 
@@ -0,0 +1,457 @@
+/******************************************************************************
+
+         Copyright (c) 2020, MaxLinear, Inc.
+         Copyright 2016 - 2020 Intel Corporation
+         Copyright 2015 - 2016 Lantiq Beteiligungs-GmbH & Co. KG
+         Copyright 2009 - 2014 Lantiq Deutschland GmbH
+         Copyright 2007 - 2008 Infineon Technologies AG
+
+  For licensing information, see the file 'LICENSE' in the root folder of
+  this software module.
+
+*******************************************************************************/
+
+#include "mtlkinc.h"
+#include <stdio.h>
+#include <stddef.h>
+#include <byteswap.h>
+#include <sys/stat.h>
+#ifndef WIN32
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+#include "scdbin.h"
+
+#define LOG_LOCAL_GID   GID_SCDBIN
+#define LOG_LOCAL_FID   1
+
+/* Of the pool data */
+#define SCDBIN_ALIGN(x) (((x) + LOGFMT_PROG_ALIGN - 1) & ~(uint32)(LOGFMT_PROG_ALIGN - 1))
+
+/* The file is little endian */
+#if defined(__BYTE_ORDER) && (__BYTE_ORDER == __BIG_ENDIAN)
+#define SCDBIN_HOST_LE  FALSE
+#else
+#define SCDBIN_HOST_LE  TRUE
+#endif
+
+MTLK_STATIC_ASSERT(sizeof(scdbin_ent_t)                  == 12, scdbin_ent_size);
+MTLK_STATIC_ASSERT(offsetof(scdbin_hdr_t, version)       == 4,  scdbin_hdr_version);
+MTLK_STATIC_ASSERT(offsetof(scdbin_hdr_t, prog_version)  == 6,  scdbin_hdr_prog_version);
+MTLK_STATIC_ASSERT(offsetof(scdbin_hdr_t, file_size)     == 8,  scdbin_hdr_file_size);
+MTLK_STATIC_ASSERT(offsetof(scdbin_hdr_t, sects)         == 12, scdbin_hdr_sects);
+MTLK_STATIC_ASSERT(sizeof(scdbin_hdr_t) == 12 + 8 * SCDBIN_NOF_SECTIONS, scdbin_hdr_size);
+
+static void
+scdbin_hdr_bswap (scdbin_hdr_t *hdr)
+{
+  int i;
+
+  hdr->magic        = bswap_32(hdr->magic);
+  hdr->version      = bswap_16(hdr->version);
+  hdr->prog_version = bswap_16(hdr->prog_version);
+  hdr->file_size    = bswap_32(hdr->file_size);
+  for (i = 0; i < SCDBIN_NOF_SECTIONS; i++) {
+    hdr->sects[i].nof_ents = bswap_32(hdr->sects[i].nof_ents);
+    hdr->sects[i].off      = bswap_32(hdr->sects[i].off);
+  }
+}
+
+static void
+scdbin_ent_bswap (scdbin_ent_t *ent)
+{
+  ent->key  = bswap_32(ent->key);
+  ent->off  = bswap_32(ent->off);
+  ent->size = bswap_32(ent->size);
+}
+
+BOOL __MTLK_IFUNC
+scdbin_is_binary (const char *fname)
+{
+  FILE  *f = fopen(fname, "rb");
+  uint32 magic = 0;
+  BOOL   res;
+
+  if (!f)
+    return FALSE;
+
+  res = (fread(&magic, sizeof(magic), 1, f) == 1 &&
+         (magic == SCDBIN_MAGIC || magic == bswap_32(SCDBIN_MAGIC)));
+  fclose(f);
+
+  return res;
+}
+
+const char * __MTLK_IFUNC
+scdbin_get_error_text (int err)
+{
+  switch (err) {
+  case MTLK_ERR_OK:
+    return "Success";
+  case MTLK_ERR_FILEOP:
+    return "File operation failed";
+  case MTLK_ERR_NO_MEM:
+    return "Out of memory";
+  case MTLK_ERR_ALREADY_EXISTS:
+    return "Duplicate entries";
+  case MTLK_ERR_NOT_SUPPORTED:
+    return "Compiled string-file of another byte order or version, compile it again";
+  default:
+    return "Not a valid compiled string-file";
+  }
+}
+
+static const void *
+scdbin_map (const char *fname, uint32 *size)
+{
+  void       *data = NULL;
+  struct stat st;
+#ifndef WIN32
+  int fd = open(fname, O_RDONLY);
+
+  if (fd < 0)
+    return NULL;
+
+  if (fstat(fd, &st) == 0 && st.st_size >= (off_t)sizeof(scdbin_hdr_t) &&
+      st.st_size <= (off_t)(uint32)-1) {
+    /* Big endian hosts convert a private copy in place */
+    data = mmap(NULL, (size_t)st.st_size,
+                SCDBIN_HOST_LE ? PROT_READ : PROT_READ | PROT_WRITE,
+                SCDBIN_HOST_LE ? MAP_SHARED : MAP_PRIVATE, fd, 0);
+    if (data == MAP_FAILED)
+      data = NULL;
+  }
+  close(fd);
+#else
+  FILE *f = fopen(fname, "rb");
+
+  if (!f)
+    return NULL;
+
+  if (stat(fname, &st) == 0 && st.st_size >= (off_t)sizeof(scdbin_hdr_t)) {
+    data = malloc((size_t)st.st_size);
+    if (data && fread(data, (size_t)st.st_size, 1, f) != 1) {
+      free(data);
+      data = NULL;
+    }
+  }
+  fclose(f);
+#endif
+
+  *size = data ? (uint32)st.st_size : 0;
+  return data;
+}
+
+static void
+scdbin_unmap (const void *data, uint32 size)
+{
+#ifndef WIN32
+  munmap((void *)data, size);
+#else
+  MTLK_UNREFERENCED_PARAM(size);
+  free((void *)data);
+#endif
+}
+
+/* Every entry refers to pool data of its own and the keys are strictly
+ * ascending. Converted to the host byte order on the way. */
+static BOOL
+scdbin_check_section (const scdbin_t *scd, int sect, uint32 pool_off)
+{
+  scdbin_ent_t *ents = (scdbin_ent_t *)scd->ents[sect];
+  uint32 i;
+
+  for (i = 0; i < scd->nof_ents[sect]; i++) {
+    char *data;
+
+    if (!SCDBIN_HOST_LE)
+      scdbin_ent_bswap(&ents[i]);
+    data = (char *)scd->data + ents[i].off;
+
+    if (i && ents[i].key <= ents[i - 1].key)
+      return FALSE;
+    if (ents[i].off < pool_off || ents[i].off > scd->size ||
+        ents[i].size > scd->size - ents[i].off || ents[i].size == 0)
+      return FALSE;
+    /* Nothing is converted twice */
+    if (i && ents[i].off < ents[i - 1].off + ents[i - 1].size)
+      return FALSE;
+
+    if (sect == SCDBIN_FMTS) {
+      if (!SCDBIN_HOST_LE)
+        logfmt_prog_bswap(data, ents[i].size, TRUE);
+      if (!logfmt_prog_check(data, ents[i].size))
+        return FALSE;
+    }
+    else if (data[ents[i].size - 1] != '\0') {
+      return FALSE;
+    }
+  }
+
+  return TRUE;
+}
+
+int __MTLK_IFUNC
+scdbin_open (scdbin_t *scd, const char *fname)
+{
+  scdbin_hdr_t *hdr;
+  uint32 off;
+  int rslt = MTLK_ERR_OK;
+  int i;
+
+  memset(scd, 0, sizeof(*scd));
+
+  scd->data = (const char *)scdbin_map(fname, &scd->size);
+  if (!scd->data) {
+    rslt = MTLK_ERR_FILEOP;
+    goto end;
+  }
+
+  hdr = (scdbin_hdr_t *)scd->data;
+  if (!SCDBIN_HOST_LE)
+    scdbin_hdr_bswap(hdr);
+
+  /* A file of the other byte order is recognized, not taken for garbage */
+  if (hdr->magic != SCDBIN_MAGIC) {
+    rslt = (hdr->magic == bswap_32(SCDBIN_MAGIC)) ? MTLK_ERR_NOT_SUPPORTED :
+                                                    MTLK_ERR_CORRUPTED;
+    goto end;
+  }
+  if (hdr->version != SCDBIN_VERSION || hdr->prog_version != LOGFMT_PROG_VERSION) {
+    rslt = MTLK_ERR_NOT_SUPPORTED;
+    goto end;
+  }
+  if (hdr->file_size != scd->size) {
+    rslt = MTLK_ERR_CORRUPTED;
+    goto end;
+  }
+
+  /* The entry arrays follow the header back to back, then the pool */
+  off = sizeof(*hdr);
+  for (i = 0; i < SCDBIN_NOF_SECTIONS; i++) {
+    uint32 nof_ents = hdr->sects[i].nof_ents;
+
+    if (hdr->sects[i].off != off ||
+        nof_ents > (scd->size - off) / sizeof(scdbin_ent_t)) {
+      rslt = MTLK_ERR_CORRUPTED;
+      goto end;
+    }
+    scd->ents[i]     = (const scdbin_ent_t *)(scd->data + off);
+    scd->nof_ents[i] = nof_ents;
+    off += nof_ents * sizeof(scdbin_ent_t);
+  }
+
+  for (i = 0; i < SCDBIN_NOF_SECTIONS; i++) {
+    if (!scdbin_check_section(scd, i, off)) {
+      rslt = MTLK_ERR_CORRUPTED;
+      goto end;
+    }
+  }
+
+end:
+  if (rslt != MTLK_ERR_OK)
+    scdbin_close(scd);
+  return rslt;
+}
+
+void __MTLK_IFUNC
+scdbin_close (scdbin_t *scd)
+{
+  if (scd->data)
+    scdbin_unmap(scd->data, scd->size);
+  memset(scd, 0, sizeof(*scd));
+}
+
+static const scdbin_ent_t *
+scdbin_find (const scdbin_t *scd, int sect, uint32 key)
+{
+  const scdbin_ent_t *ents = scd->ents[sect];
+  uint32 lo = 0;
+  uint32 hi = scd->nof_ents[sect];
+
+  while (lo < hi) {
+    uint32 mid = lo + (hi - lo) / 2;
+
+    if (ents[mid].key == key)
+      return &ents[mid];
+    if (ents[mid].key < key)
+      lo = mid + 1;
+    else
+      hi = mid;
+  }
+
+  return NULL;
+}
+
+const logfmt_prog_t * __MTLK_IFUNC
+scdbin_get_prog (const scdbin_t *scd, uint32 oid, uint32 gid, uint32 fid, uint32 lid)
+{
+  const scdbin_ent_t *ent = scdbin_find(scd, SCDBIN_FMTS, SCDBIN_FMT_KEY(oid, gid, fid, lid));
+
+  return ent ? (const logfmt_prog_t *)(scd->data + ent->off) : NULL;
+}
+
+const char * __MTLK_IFUNC
+scdbin_get_org_name (const scdbin_t *scd, uint32 oid)
+{
+  const scdbin_ent_t *ent = scdbin_find(scd, SCDBIN_ORGS, SCDBIN_ORG_KEY(oid));
+
+  return ent ? scd->data + ent->off : NULL;
+}
+
+const char * __MTLK_IFUNC
+scdbin_get_grp_name (const scdbin_t *scd, uint32 oid, uint32 gid)
+{
+  const scdbin_ent_t *ent = scdbin_find(scd, SCDBIN_GRPS, SCDBIN_GRP_KEY(oid, gid));
+
+  return ent ? scd->data + ent->off : NULL;
+}
+
+static int
+scdbin_rec_cmp (const void *a, const void *b)
+{
+  uint32 ka = ((const scdbin_rec_t *)a)->key;
+  uint32 kb = ((const scdbin_rec_t *)b)->key;
+
+  return (ka > kb) - (ka < kb);
+}
+
+static BOOL
+scdbin_put (FILE *f, const void *data, uint32 size, BOOL align, uint32 *off)
+{
+  static const char zeros[LOGFMT_PROG_ALIGN];
+  uint32 pad = align ? SCDBIN_ALIGN(*off) - *off : 0;
+
+  if ((pad && fwrite(zeros, pad, 1, f) != 1) ||
+      (size && fwrite(data, size, 1, f) != 1))
+    return FALSE;
+
+  *off += pad + size;
+  return TRUE;
+}
+
+int __MTLK_IFUNC
+scdbin_write (const char *fname, scdbin_rec_t *recs[SCDBIN_NOF_SECTIONS],
+              const uint32 nof_recs[SCDBIN_NOF_SECTIONS])
+{
+  scdbin_hdr_t hdr;
+  scdbin_hdr_t hdr_le;
+  scdbin_ent_t ent;
+  scdbin_ent_t ent_le;
+  char   *tmp_fname = NULL;
+  void   *prog = NULL;
+  size_t  len = strlen(fname) + sizeof(".tmp");
+  FILE   *f = NULL;
+  uint32  off;
+  uint32  data_off;
+  uint32  i;
+  int     sect;
+  int     rslt = MTLK_ERR_OK;
+
+  /* Layout */
+  memset(&hdr, 0, sizeof(hdr));
+  hdr.magic        = SCDBIN_MAGIC;
+  hdr.version      = SCDBIN_VERSION;
+  hdr.prog_version = LOGFMT_PROG_VERSION;
+
+  off = sizeof(hdr);
+  for (sect = 0; sect < SCDBIN_NOF_SECTIONS; sect++) {
+    qsort(recs[sect], nof_recs[sect], sizeof(scdbin_rec_t), scdbin_rec_cmp);
+    for (i = 1; i < nof_recs[sect]; i++) {
+      if (recs[sect][i].key == recs[sect][i - 1].key) {
+        rslt = MTLK_ERR_ALREADY_EXISTS;
+        goto end;
+      }
+    }
+    hdr.sects[sect].nof_ents = nof_recs[sect];
+    hdr.sects[sect].off      = off;
+    off += nof_recs[sect] * sizeof(scdbin_ent_t);
+  }
+
+  data_off = off;
+  for (sect = 0; sect < SCDBIN_NOF_SECTIONS; sect++) {
+    for (i = 0; i < nof_recs[sect]; i++)
+      off = SCDBIN_ALIGN(off) + recs[sect][i].size;
+  }
+  hdr.file_size = off;
+
+  tmp_fname = (char *)malloc(len);
+  if (!tmp_fname) {
+    rslt = MTLK_ERR_NO_MEM;
+    goto end;
+  }
+  snprintf(tmp_fname, len, "%s.tmp", fname);
+
+  f = fopen(tmp_fname, "wb");
+  if (!f) {
+    rslt = MTLK_ERR_FILEOP;
+    goto end;
+  }
+
+  /* Header and entries, then the data in the same order */
+  off = 0;
+  hdr_le = hdr;
+  if (!SCDBIN_HOST_LE)
+    scdbin_hdr_bswap(&hdr_le);
+  if (!scdbin_put(f, &hdr_le, sizeof(hdr_le), FALSE, &off)) {
+    rslt = MTLK_ERR_FILEOP;
+    goto end;
+  }
+
+  ent.off = data_off;
+  for (sect = 0; sect < SCDBIN_NOF_SECTIONS; sect++) {
+    for (i = 0; i < nof_recs[sect]; i++) {
+      ent.key  = recs[sect][i].key;
+      ent.size = recs[sect][i].size;
+      ent.off  = SCDBIN_ALIGN(ent.off);
+      ent_le   = ent;
+      if (!SCDBIN_HOST_LE)
+        scdbin_ent_bswap(&ent_le);
+      if (!scdbin_put(f, &ent_le, sizeof(ent_le), FALSE, &off)) {
+        rslt = MTLK_ERR_FILEOP;
+        goto end;
+      }
+      ent.off += ent.size;
+    }
+  }
+
+  for (sect = 0; sect < SCDBIN_NOF_SECTIONS; sect++) {
+    for (i = 0; i < nof_recs[sect]; i++) {
+      const void *data = recs[sect][i].data;
+
+      /* Programs are converted to little endian by big endian hosts */
+      if (!SCDBIN_HOST_LE && sect == SCDBIN_FMTS) {
+        free(prog);
+        prog = malloc(recs[sect][i].size);
+        if (!prog) {
+          rslt = MTLK_ERR_NO_MEM;
+          goto end;
+        }
+        memcpy(prog, data, recs[sect][i].size);
+        logfmt_prog_bswap(prog, recs[sect][i].size, FALSE);
+        data = prog;
+      }
+      if (!scdbin_put(f, data, recs[sect][i].size, TRUE, &off)) {
+        rslt = MTLK_ERR_FILEOP;
+        goto end;
+      }
+    }
+  }
+
+end:
+  free(prog);
+  if (f && fclose(f) != 0 && rslt == MTLK_ERR_OK)
+    rslt = MTLK_ERR_FILEOP;
+  if (tmp_fname) {
+    /* Readers may have the previous file mapped: replace, never rewrite */
+    if (rslt == MTLK_ERR_OK && rename(tmp_fname, fname) != 0)
+      rslt = MTLK_ERR_FILEOP;
+    if (rslt != MTLK_ERR_OK)
+      remove(tmp_fname);
+    free(tmp_fname);
+  }
+
+  return rslt;
+}
@@ -0,0 +1,134 @@
+/******************************************************************************
+
+         Copyright (c) 2020, MaxLinear, Inc.
+         Copyright 2016 - 2020 Intel Corporation
+         Copyright 2015 - 2016 Lantiq Beteiligungs-GmbH & Co. KG
+         Copyright 2009 - 2014 Lantiq Deutschland GmbH
+         Copyright 2007 - 2008 Infineon Technologies AG
+
+  For licensing information, see the file 'LICENSE' in the root folder of
+  this software module.
+
+*******************************************************************************/
+
+/*
+ * Compiled (binary) SCD file
+ *
+ * The strings of one or more text .scd files with the formats already
+ * compiled by logfmt, ready to be mapped and used in place.
+ * Shared by logserver and logcnv.
+ */
+
+#ifndef __SCDBIN_H__
+#define __SCDBIN_H__
+
+#include "logdefs.h"
+#include "logfmt.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* File layout, every multi-byte field in little endian order:
+ *   scdbin_hdr_t
+ *   a sorted scdbin_ent_t array per section
+ *   pool: zero terminated names and logfmt programs, each one aligned
+ *         to LOGFMT_PROG_ALIGN
+ * The programs are compiled from the format strings decoded by
+ * logfmt_decode(), so they're used as is whatever loads the file.
+ * Entries refer to the pool data by offset from the beginning of the file.
+ * The structures have no padding, their offsets are checked at build time.
+ * Little endian hosts use the file in place, big endian ones convert a
+ * private copy of the mapping when opening it.
+ */
+#define SCDBIN_MAGIC          0x42444353 /* "SCDB" */
+#define SCDBIN_VERSION        3
+
+typedef enum
+{
+  SCDBIN_ORGS,  /* OID names */
+  SCDBIN_GRPS,  /* GID names */
+  SCDBIN_FMTS,  /* formats */
+  SCDBIN_NOF_SECTIONS
+} scdbin_section_e;
+
+#define SCDBIN_ORG_KEY(oid)                 ((uint32)(oid))
+#define SCDBIN_GRP_KEY(oid, gid)            (((uint32)(oid) << 8) | (uint32)(gid))
+#define SCDBIN_FMT_KEY(oid, gid, fid, lid)  LOG_MAKE_INFO_W0(0, (lid), (oid), (gid), (fid))
+
+typedef struct _scdbin_ent_t
+{
+  uint32 key;           /* 0 */
+  uint32 off;           /* 4 */
+  uint32 size;          /* 8 */
+} scdbin_ent_t;
+
+typedef struct _scdbin_hdr_t
+{
+  uint32 magic;         /* 0 */
+  uint16 version;       /* 4 */
+  uint16 prog_version;  /* 6, LOGFMT_PROG_VERSION */
+  uint32 file_size;     /* 8 */
+  struct {
+    uint32 nof_ents;    /* 12 + 8 * section */
+    uint32 off;
+  } sects[SCDBIN_NOF_SECTIONS];
+} scdbin_hdr_t;
+
+/* Mapped file */
+typedef struct _scdbin_t
+{
+  const char         *data;
+  uint32              size;
+  const scdbin_ent_t *ents[SCDBIN_NOF_SECTIONS];
+  uint32              nof_ents[SCDBIN_NOF_SECTIONS];
+} scdbin_t;
+
+/* The file starts with SCDBIN_MAGIC in either byte order, so it must not
+ * be taken for a text one even if it can't be opened */
+BOOL __MTLK_IFUNC
+scdbin_is_binary(const char *fname);
+
+/* Maps the file read-only and validates it as a whole, so the lookups
+ * need no checks. Returns MTLK_ERR_FILEOP if the file can't be read,
+ * MTLK_ERR_NOT_SUPPORTED if it's in the other byte order or of another
+ * version, MTLK_ERR_CORRUPTED if it isn't a valid one. The file must be
+ * replaced (renamed over) rather than rewritten while mapped. */
+int __MTLK_IFUNC
+scdbin_open(scdbin_t *scd, const char *fname);
+
+/* Describes an error returned by scdbin_open() or scdbin_write() */
+const char * __MTLK_IFUNC
+scdbin_get_error_text(int err);
+void __MTLK_IFUNC
+scdbin_close(scdbin_t *scd);
+
+/* Binary search, NULL if not found */
+const logfmt_prog_t * __MTLK_IFUNC
+scdbin_get_prog(const scdbin_t *scd, uint32 oid, uint32 gid, uint32 fid, uint32 lid);
+const char * __MTLK_IFUNC
+scdbin_get_org_name(const scdbin_t *scd, uint32 oid);
+const char * __MTLK_IFUNC
+scdbin_get_grp_name(const scdbin_t *scd, uint32 oid, uint32 gid);
+
+/* Record to be written: a name including the terminating zero, or a
+ * compiled format (logfmt_prog_size() bytes) */
+typedef struct _scdbin_rec_t
+{
+  uint32      key;
+  const void *data;
+  uint32      size;
+} scdbin_rec_t;
+
+/* Writes the records of every section (sorting them in place) to a
+ * temporary file renamed to fname once complete. Keys must be unique
+ * within a section: MTLK_ERR_ALREADY_EXISTS otherwise. */
+int __MTLK_IFUNC
+scdbin_write(const char *fname, scdbin_rec_t *recs[SCDBIN_NOF_SECTIONS],
+             const uint32 nof_recs[SCDBIN_NOF_SECTIONS]);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __SCDBIN_H__ */
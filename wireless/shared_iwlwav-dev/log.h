@@ -52,6 +52,13 @@
 #define LOG_TARGET_REMOTE  (1 << 1)
 #define LOG_TARGET_CAPWAP  (1 << 2)
 
+/* Cheap check done at the log point before the log function is called,
+ * the function still queries mtlk_log_get_flags(). An OS may provide its
+ * own one. */
+#ifndef mtlk_log_enabled
+#define mtlk_log_enabled(level, oid, gid) (1)
+#endif
+
 /*	Driver defined __MTLK_IFUNC outside the scope of shared files,
 	so when it's not defined - as is the case in FW - we need to 
 	define it as white space.
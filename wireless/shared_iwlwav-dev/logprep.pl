@@ -223,8 +223,11 @@ __MTLK_FLOG void
 __$macro_name\_$macro_suffix\_$OriginID(const char *fname, int level, uint8 oid, uint8 gid, uint8 fid, uint16 lid, const char *fmt$func_params_list);
 
 #define $macro_name\_$macro_suffix(fmt$macro_params_list) \\
-  __$macro_name\_$macro_suffix\_$OriginID(LOG_CONSOLE_TEXT_INFO, $log_level, LOG_LOCAL_OID, LOG_LOCAL_GID, LOG_LOCAL_FID, __LINE__, \\
-               (fmt)$pass_params_list)
+  do { \\
+    if (mtlk_log_enabled($log_level, LOG_LOCAL_OID, LOG_LOCAL_GID)) \\
+      __$macro_name\_$macro_suffix\_$OriginID(LOG_CONSOLE_TEXT_INFO, $log_level, LOG_LOCAL_OID, LOG_LOCAL_GID, LOG_LOCAL_FID, __LINE__, \\
+               (fmt)$pass_params_list); \\
+  } while (0)
 #endif /* IWLWAV_RTLOG_MAX_DLEVEL < $log_level */
 END_OF_HEADER
 
@@ -32,6 +32,60 @@ struct logsrv_info
   uint16 log_ver_minor;
 } __MTLK_IDATA;
 
+/* Capture segments written by logserver (-w).
+ * NOTE: all fields are in network order
+ *
+ * An uncompressed segment is the stream sent to the clients: struct
+ * logsrv_info followed by the events. A compressed one starts with
+ * struct logsrv_capture_seg_hdr, followed by blocks each preceded by
+ * struct logsrv_capture_blk_hdr. The blocks decode to the same stream,
+ * the first one holding the logsrv_info.
+ *
+ * Every segment has an index <segment>.idx: struct logsrv_capture_idx_hdr
+ * followed by a struct logsrv_capture_idx_entry per block of events.
+ */
+#define LOGSRV_CAPTURE_SEG_MAGIC    0x4C47435A /* "LGCZ" */
+#define LOGSRV_CAPTURE_IDX_MAGIC    0x4C474349 /* "LGCI" */
+#define LOGSRV_CAPTURE_IDX_VERSION  1
+
+#define LOGSRV_CAPTURE_IDX_COMPRESSED 0x0001
+
+/* Block codecs */
+#define LOGSRV_CAPTURE_CODEC_NONE   0
+#define LOGSRV_CAPTURE_CODEC_LZ4    1
+#define LOGSRV_CAPTURE_CODEC_ZSTD   2
+
+struct logsrv_capture_seg_hdr
+{
+  uint32 magic; /* LOGSRV_CAPTURE_SEG_MAGIC */
+  uint32 block_size; /* max raw size of a block */
+} __MTLK_IDATA;
+
+struct logsrv_capture_blk_hdr
+{
+  uint32 raw_size;
+  uint32 stored_size;
+  uint8  codec; /* LOGSRV_CAPTURE_CODEC_..., NONE if stored as is */
+  uint8  reserved[3];
+} __MTLK_IDATA;
+
+struct logsrv_capture_idx_hdr
+{
+  uint32 magic; /* LOGSRV_CAPTURE_IDX_MAGIC */
+  uint16 version;
+  uint16 flags;
+} __MTLK_IDATA;
+
+struct logsrv_capture_idx_entry
+{
+  uint32 min_ts; /* event timestamps */
+  uint32 max_ts;
+  uint32 offset; /* of the block in the segment file */
+  uint32 raw_offset; /* of its events in the decoded stream */
+  uint32 raw_size;
+  uint32 nof_events;
+} __MTLK_IDATA;
+
 #define   MTLK_IDEFS_OFF
 #include "mtlkidefs.h"
 
@@ -44,9 +44,19 @@ struct mem_obj
 {
   mtlk_objpool_context_t objpool_ctx;
   uint32 size;
+  uint32 sample_weight;  /* MEM_OBJ_SAMPLED only: bytes the sample stands for */
+  uint8  flags;          /* MEM_OBJ_... */
+  uint8  sample_gen;     /* MEM_OBJ_SAMPLED only: sampling it belongs to */
   uint8  front_guard[1]; /* The actual length is FRONT_GUARD_LEN, to have the total struct size MTLK_MEM_ALLOC_ALIGN */
 };
 
+/* Every allocation is tracked (objpool, guards, fill on free) unless the
+ * sampling is on. Then only the sampled ones are recorded and nothing is
+ * checked. The flags are per allocation, so the mode can be switched at
+ * any time. */
+#define MEM_OBJ_TRACKED     0x01
+#define MEM_OBJ_SAMPLED     0x02
+
 #define MIN_BACK_GUARD_SIZE (4)          /* The minimum number of back guard characters */
 #define FREED_MEM_FILL_CHAR (0x0C)
 #define FRONT_GUARD_CHAR    (0xF0)
@@ -115,11 +125,223 @@ guards_check (struct mem_obj *mem)
   }
 }
 
+/********************************************************************************
+ * Sampling
+ *
+ * Every context slot (thread or CPU, see mtlk_osal_get_context_slot())
+ * counts down the bytes it allocates. An allocation the
+ * countdown expires in (once or more) is sampled: its creator is recorded
+ * with sample_bytes bytes per expiration and with as many calls as it
+ * takes to allocate them, so the sums estimate the real totals. The
+ * intervals are randomized within [1/2, 3/2] of sample_bytes against
+ * periodic allocation patterns.
+ ********************************************************************************/
+
+#define MEM_SAMPLES_SIZE    512 /* Creators recorded, must be a power of 2 */
+#define MEM_SAMPLE_CALLS_FRAC 8 /* Fractional bits of the calls estimation */
+#define MEM_SAMPLE_NOF_SLOTS 16 /* Countdowns */
+
+struct mem_sample
+{
+  mtlk_slid_t slid;             /* 0 - free entry */
+  uint64      bytes;            /* Estimated bytes allocated */
+  uint64      calls;            /* Estimated allocations, fixed point */
+  int64       live_bytes;       /* Estimated bytes not freed yet */
+};
+
+static struct
+{
+  mtlk_osal_spinlock_t  lock;
+  volatile uint32       sample_bytes; /* 0 - off */
+  mtlk_osal_timestamp_t start;
+  uint32                nof_dropped;  /* Table full */
+  uint8                 gen;          /* Changed on every restart */
+  struct mem_sample     samples[MEM_SAMPLES_SIZE];
+} mem_sampler;
+
+/* A slot may be shared by several threads (or preempting contexts of a
+ * CPU), so it is updated without a lock: a lost update only perturbs the
+ * sampling. The slots are padded not to share the cache lines. */
+static struct mem_sample_slot
+{
+  uint32 countdown;
+  uint32 seed;
+  uint8  pad[MTLK_MEM_ALLOC_ALIGN - 2 * sizeof(uint32)];
+} mem_sample_slots[MEM_SAMPLE_NOF_SLOTS];
+
+static uint32
+_mem_sample_next_interval (uint32 sample_bytes, uint32 *seed)
+{
+  uint32 x = *seed;
+
+  /* xorshift32 */
+  x ^= x << 13;
+  x ^= x >> 17;
+  x ^= x << 5;
+  *seed = x;
+
+  return sample_bytes / 2 + x % sample_bytes + 1;
+}
+
+/* 64 by 32 bit division by shifts: the 32 bit kernels have no 64 bit
+ * division (__udivdi3) */
+static uint64
+_mem_sample_div (uint64 n, uint32 d)
+{
+  uint64 q = 0;
+  uint64 r = 0;
+  int    i;
+
+  if (!(n >> 32)) {
+    return (uint32)n / d;
+  }
+
+  for (i = 63; i >= 0; i--) {
+    r = (r << 1) | ((n >> i) & 1);
+    if (r >= d) {
+      r -= d;
+      q |= (uint64)1 << i;
+    }
+  }
+
+  return q;
+}
+
+static __INLINE struct mem_sample_slot *
+_mem_sample_get_slot (void)
+{
+#ifdef MTLK_OSAL_HAVE_CONTEXT_SLOT
+  return &mem_sample_slots[mtlk_osal_get_context_slot() % MEM_SAMPLE_NOF_SLOTS];
+#else
+  /* The OSAL doesn't number the contexts (the driver one so far) */
+  return &mem_sample_slots[0];
+#endif
+}
+
+/* Number of the sampling points within the allocation of size bytes */
+static __INLINE uint32
+_mem_sample_tick (uint32 sample_bytes, uint32 size)
+{
+  struct mem_sample_slot *slot = _mem_sample_get_slot();
+  uint32 countdown  = slot->countdown;
+  uint32 seed       = slot->seed;
+  uint32 nof_points = 0;
+
+  if (!seed) {
+    seed = (uint32)(uintptr_t)slot | 1;
+  }
+
+  /* Started or the rate changed */
+  if (!countdown || countdown > 2 * sample_bytes) {
+    countdown = _mem_sample_next_interval(sample_bytes, &seed);
+  }
+
+  /* The bytes past the point count for the next one, or the estimations
+   * would be biased towards the smaller allocations */
+  while (size >= countdown) {
+    size -= countdown;
+    countdown = _mem_sample_next_interval(sample_bytes, &seed);
+    nof_points++;
+  }
+
+  slot->countdown = countdown - size;
+  slot->seed      = seed;
+
+  return nof_points;
+}
+
+/* Must be called with the lock held. NULL if the table is full. */
+static struct mem_sample *
+_mem_sample_find (mtlk_slid_t slid)
+{
+  uint32 i = (uint32)(slid ^ (slid >> 29)) * 0x9E3779B1U;
+  uint32 n;
+
+  for (n = 0, i >>= 23; n < MEM_SAMPLES_SIZE; n++, i = (i + 1) & (MEM_SAMPLES_SIZE - 1)) {
+    struct mem_sample *sample = &mem_sampler.samples[i];
+
+    if (sample->slid == slid) {
+      return sample;
+    }
+    if (!sample->slid) {
+      sample->slid = slid;
+      return sample;
+    }
+  }
+
+  return NULL;
+}
+
+static void
+_mem_sample_record (struct mem_obj *mem, uint32 weight, mtlk_slid_t slid)
+{
+  struct mem_sample *sample;
+
+  mtlk_osal_lock_acquire(&mem_sampler.lock);
+  sample = _mem_sample_find(slid);
+  if (sample) {
+    sample->bytes      += weight;
+    sample->calls      += _mem_sample_div((uint64)weight << MEM_SAMPLE_CALLS_FRAC, MAX(mem->size, 1));
+    sample->live_bytes += weight;
+    mem->objpool_ctx    = slid;
+    mem->sample_weight  = weight;
+    mem->sample_gen     = mem_sampler.gen;
+    mem->flags          = MEM_OBJ_SAMPLED;
+  }
+  else {
+    mem_sampler.nof_dropped++;
+  }
+  mtlk_osal_lock_release(&mem_sampler.lock);
+}
+
+static void
+_mem_sample_release (struct mem_obj *mem)
+{
+  struct mem_sample *sample;
+
+  mtlk_osal_lock_acquire(&mem_sampler.lock);
+  /* The entries are never removed, but cleared on restart */
+  if (mem->sample_gen == mem_sampler.gen) {
+    sample = _mem_sample_find(mem->objpool_ctx);
+    MTLK_ASSERT(sample != NULL);
+    sample->live_bytes -= mem->sample_weight;
+  }
+  mtlk_osal_lock_release(&mem_sampler.lock);
+}
+
+int __MTLK_IFUNC
+mem_leak_init (void)
+{
+  memset(&mem_sampler, 0, sizeof(mem_sampler));
+  return mtlk_osal_lock_init(&mem_sampler.lock);
+}
+
+void __MTLK_IFUNC
+mem_leak_cleanup (void)
+{
+  mtlk_osal_lock_cleanup(&mem_sampler.lock);
+}
+
+void __MTLK_IFUNC
+mem_leak_dbg_set_sampling (uint32 sample_bytes)
+{
+  mtlk_osal_lock_acquire(&mem_sampler.lock);
+  if (sample_bytes != mem_sampler.sample_bytes) {
+    memset(mem_sampler.samples, 0, sizeof(mem_sampler.samples));
+    mem_sampler.nof_dropped  = 0;
+    mem_sampler.start        = mtlk_osal_timestamp();
+    mem_sampler.sample_bytes = sample_bytes;
+    mem_sampler.gen++;
+  }
+  mtlk_osal_lock_release(&mem_sampler.lock);
+}
+
 void * __MTLK_IFUNC
 mem_leak_handle_allocated_buffer (void *mem_dbg_buffer, uint32 size,
                                   mtlk_slid_t caller_slid)
 {
   struct mem_obj *mem = (struct mem_obj *)mem_dbg_buffer;
+  uint32 sample_bytes = mem_sampler.sample_bytes;
 
   if (!mem) {
     return NULL;
@@ -127,6 +349,17 @@ mem_leak_handle_allocated_buffer (void *mem_dbg_buffer, uint32 size,
 
   mem->size = size;
 
+  if (sample_bytes) {
+    uint32 nof_points = _mem_sample_tick(sample_bytes, size);
+
+    mem->flags = 0;
+    if (nof_points) {
+      _mem_sample_record(mem, nof_points * sample_bytes, caller_slid);
+    }
+    return GET_GUARDED_BY_MEM(mem);
+  }
+
+  mem->flags = MEM_OBJ_TRACKED;
   mtlk_objpool_add_object_ex(&g_objpool, &mem->objpool_ctx, MTLK_MEMORY_OBJ,
                              caller_slid, HANDLE_T(mem->size));
   guards_set(mem);
@@ -145,6 +378,14 @@ mem_leak_handle_buffer_to_free (void *buffer)
   if (!buffer) return NULL;
 
   mem = GET_MEM_BY_GUARDED(buffer);
+
+  if (mem->flags != MEM_OBJ_TRACKED) {
+    if (mem->flags & MEM_OBJ_SAMPLED) {
+      _mem_sample_release(mem);
+    }
+    return mem;
+  }
+
   ILOG5_PPD("%p (%p %d)", buffer, mem, mem->size);
 
   mtlk_objpool_remove_object_ex(&g_objpool, &mem->objpool_ctx, MTLK_MEMORY_OBJ, HANDLE_T(mem->size));
@@ -217,4 +458,126 @@ mem_leak_dbg_print_allocators_info (mem_leak_dbg_printf_f printf_func,
   printf_func(printf_ctx, "=============================================");
 }
 
+static uint64
+_mem_sample_get_bytes (const struct mem_sample *sample)
+{
+  return sample->bytes;
+}
+
+static uint64
+_mem_sample_get_calls (const struct mem_sample *sample)
+{
+  return sample->calls;
+}
+
+/* Moves the nof_top greatest samples by key to the front, in order. Few
+ * of them are printed, so a partial selection sort does and it needs no
+ * sorting from the C library or the kernel. */
+static void
+_mem_sample_select_top (struct mem_sample *samples, uint32 nof_samples, uint32 nof_top,
+                        uint64 (*key)(const struct mem_sample *sample))
+{
+  uint32 i, j;
+
+  for (i = 0; i < nof_top; i++) {
+    uint32 max = i;
+
+    for (j = i + 1; j < nof_samples; j++) {
+      if (key(&samples[j]) > key(&samples[max])) {
+        max = j;
+      }
+    }
+
+    if (max != i) {
+      struct mem_sample tmp = samples[i];
+
+      samples[i]   = samples[max];
+      samples[max] = tmp;
+    }
+  }
+}
+
+static void
+_mem_leak_dbg_print_samples (mem_leak_dbg_printf_f    printf_func,
+                             mtlk_handle_t            printf_ctx,
+                             const char              *title,
+                             const struct mem_sample *samples,
+                             uint32                   nof_samples,
+                             uint32                   elapsed_ms)
+{
+  uint32 i;
+
+  printf_func(printf_ctx, "Top allocators by %s:", title);
+  printf_func(printf_ctx, "---------------------------------------------------------------");
+  printf_func(printf_ctx, "|    bytes   |    live    |  calls/s  |        SLID");
+  printf_func(printf_ctx, "---------------------------------------------------------------");
+
+  for (i = 0; i < nof_samples; i++) {
+    printf_func(printf_ctx, "| %10llu | %10lld | %9llu | G:%3d F:%2d L:%5d",
+                (unsigned long long)samples[i].bytes,
+                (long long)samples[i].live_bytes,
+                (unsigned long long)(_mem_sample_div(samples[i].calls * 1000, elapsed_ms) >> MEM_SAMPLE_CALLS_FRAC),
+                mtlk_slid_get_gid(samples[i].slid),
+                mtlk_slid_get_fid(samples[i].slid),
+                mtlk_slid_get_lid(samples[i].slid));
+  }
+}
+
+void __MTLK_IFUNC
+mem_leak_dbg_print_top_allocators (mem_leak_dbg_printf_f printf_func,
+                                   mtlk_handle_t         printf_ctx,
+                                   uint32                nof_top)
+{
+  struct mem_sample *samples;
+  uint32 sample_bytes;
+  uint32 nof_samples = 0;
+  uint32 nof_dropped;
+  uint32 elapsed_ms;
+  uint32 i;
+
+  MTLK_ASSERT(printf_func != NULL);
+
+  /* The table is copied not to stop the allocations while printing */
+  samples = (struct mem_sample *)mtlk_osal_mem_alloc_objpool(sizeof(mem_sampler.samples),
+                                                             MTLK_MEM_TAG_DEBUG_DATA);
+  if (!samples) {
+    printf_func(printf_ctx, "Can't allocate %u bytes for the allocators table",
+                (uint32)sizeof(mem_sampler.samples));
+    return;
+  }
+
+  mtlk_osal_lock_acquire(&mem_sampler.lock);
+  for (i = 0; i < MEM_SAMPLES_SIZE; i++) {
+    if (mem_sampler.samples[i].slid) {
+      samples[nof_samples++] = mem_sampler.samples[i];
+    }
+  }
+  sample_bytes = mem_sampler.sample_bytes;
+  nof_dropped  = mem_sampler.nof_dropped;
+  elapsed_ms   = mtlk_osal_timestamp_to_ms(mtlk_osal_timestamp() - mem_sampler.start);
+  mtlk_osal_lock_release(&mem_sampler.lock);
+
+  if (!sample_bytes) {
+    printf_func(printf_ctx, "Allocations sampling is off");
+    goto end;
+  }
+
+  elapsed_ms = MAX(elapsed_ms, 1);
+  nof_top    = MIN(nof_top, nof_samples);
+
+  printf_func(printf_ctx, "Allocations sampled every %u bytes for %u ms, %u allocators (%u samples dropped)",
+              sample_bytes, elapsed_ms, nof_samples, nof_dropped);
+
+  _mem_sample_select_top(samples, nof_samples, nof_top, _mem_sample_get_bytes);
+  _mem_leak_dbg_print_samples(printf_func, printf_ctx, "bytes", samples, nof_top, elapsed_ms);
+
+  _mem_sample_select_top(samples, nof_samples, nof_top, _mem_sample_get_calls);
+  _mem_leak_dbg_print_samples(printf_func, printf_ctx, "call rate", samples, nof_top, elapsed_ms);
+
+  printf_func(printf_ctx, "===============================================================");
+
+end:
+  mtlk_osal_mem_free_objpool(samples);
+}
+
 #endif /* CPTCFG_IWLWAV_ENABLE_OBJPOOL */
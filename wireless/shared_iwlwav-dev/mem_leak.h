@@ -48,6 +48,11 @@ mem_leak_handle_buffer_to_free(void *buffer);
 uint32 __MTLK_IFUNC
 mem_leak_get_full_allocation_size(uint32 size);
 
+int __MTLK_IFUNC
+mem_leak_init(void);
+void __MTLK_IFUNC
+mem_leak_cleanup(void);
+
 
 /* DEBUG abilities */
 uint32 __MTLK_IFUNC
@@ -71,5 +76,21 @@ void __MTLK_IFUNC
 mem_leak_dbg_print_allocators_info(mem_leak_dbg_printf_f printf_func,
                                    mtlk_handle_t         printf_ctx);
 
+/* Allocations sampling: instead of tracking every allocation (objpool,
+ * guards, fill on free) one in about sample_bytes bytes allocated is
+ * recorded along with its creator SLID, 0 switches back to the full
+ * tracking. The estimations are restarted whenever the rate changes.
+ * The sampled allocations aren't seen by the objpool, i.e. by the memory
+ * alarm and the allocations dump above. */
+void __MTLK_IFUNC
+mem_leak_dbg_set_sampling(uint32 sample_bytes);
+
+/* Prints up to nof_top creators with the most bytes and with the most
+ * calls estimated by the sampling */
+void __MTLK_IFUNC
+mem_leak_dbg_print_top_allocators(mem_leak_dbg_printf_f printf_func,
+                                  mtlk_handle_t         printf_ctx,
+                                  uint32                nof_top);
+
 #endif
 
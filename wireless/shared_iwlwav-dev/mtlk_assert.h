@@ -52,6 +52,10 @@ void __MTLK_IFUNC __mtlk_assert(mtlk_slid_t slid);
 #define ASSERT(expr)      __MTLK_ASSERT(expr, MTLK_SLID)
 #define MTLK_ASSERT(expr) __MTLK_ASSERT(expr, MTLK_SLID)
 
+/* Compile time check, usable at file scope: name must be unique there */
+#define MTLK_STATIC_ASSERT(expr, name) \
+  typedef char __mtlk_static_assert_##name[(expr) ? 1 : -1]
+
 void __MTLK_IFUNC mtlk_assert_log_s(mtlk_slid_t caller_slid, const char *msg);
 void __MTLK_IFUNC mtlk_assert_log_ss(mtlk_slid_t caller_slid, const char *msg1, const char *msg2);
 
@@ -29,23 +29,16 @@
 
 #ifdef CPTCFG_IWLWAV_ENABLE_OBJPOOL
 
-struct _mtlk_objpool_memory_t
-{
-  struct _mtlk_objpool_memory_alarm_t alarm;
-  uint32                              allocated;
-};
-
-struct _mtlk_objpool_t
-{
-  mtlk_osal_spinlock_t          hash_lock;
-  mtlk_hash_t                   objects_hash;
-  struct _mtlk_objpool_memory_t memory;
+/* Objects are counted by the shard of the calling context (thread or CPU,
+ * see mtlk_osal_get_context_slot()), so they don't contend for one lock. An object may be removed by another one
+ * than the one that added it, so the counters of a shard may go negative:
+ * only their sums over all the shards are meaningful. They are merged on
+ * demand (dump, enumeration, memory queries).
+ */
+#define _MTLK_OBJPOOL_NOF_SHARDS        (8)
 
-  MTLK_DECLARE_INIT_STATUS;
-};
-
-#define _MTLK_OBJPOOL_HASH_NOF_BUCKETS  (32)
-#define _MTLK_OBJPOOL_HASH_PRIME_FACTOR (31)
+#define _MTLK_OBJPOOL_HASH_NOF_BUCKETS  (64)
+#define _MTLK_OBJPOOL_HASH_PRIME_FACTOR (0x9E3779B1)
 
 typedef uint64 _mtlk_objpool_hash_key_t;
 #define _MTLK_MAKE_OBJPOOL_HASH_KEY(objtype, slid) ( (((uint64)(objtype)) << 32) | slid )
@@ -53,10 +46,11 @@ typedef uint64 _mtlk_objpool_hash_key_t;
 static __INLINE uint32
 _mtlk_hash_objpool_hashval (const _mtlk_objpool_hash_key_t *key, uint32 nof_buckets)
 {
-  /* Key shortened to 32 bits intentionally because 64 bits modulo      */
-  /* is not supported by all platforms. When it comes to hash balancing */
-  /* this does not make any difference.                                 */
-  return (((uint32)(*key)) * _MTLK_OBJPOOL_HASH_PRIME_FACTOR) % nof_buckets;
+  /* Key folded to 32 bits intentionally because 64 bits modulo         */
+  /* is not supported by all platforms.                                 */
+  uint32 val = ((uint32)(*key) ^ (uint32)(*key >> 32)) * _MTLK_OBJPOOL_HASH_PRIME_FACTOR;
+
+  return (val ^ (val >> 16)) % nof_buckets;
 }
 
 static __INLINE int
@@ -77,8 +71,7 @@ MTLK_HASH_DEFINE_EXTERN(objpool, _mtlk_objpool_hash_key_t,
 MTLK_HASH_DEFINE_OBJPOOL_EXTENSIONS_EXTERN(objpool);
 
 MTLK_INIT_STEPS_LIST_BEGIN(objpool)
-  MTLK_INIT_STEPS_LIST_ENTRY(objpool, HASH_LOCK)
-  MTLK_INIT_STEPS_LIST_ENTRY(objpool, OBJPOOL_HASH)
+  MTLK_INIT_STEPS_LIST_ENTRY(objpool, OBJPOOL_SHARDS)
   MTLK_INIT_STEPS_LIST_ENTRY(objpool, OBJPOOL_DUMP)
 MTLK_INIT_INNER_STEPS_BEGIN(objpool)
 MTLK_INIT_STEPS_LIST_END(objpool);
@@ -91,37 +84,242 @@ typedef struct __mtlk_obj_factory_t
   MTLK_HASH_ENTRY_T(objpool) hentry;
   mtlk_objtypes_t            type;
   mtlk_slid_t                creator_slid;
-  uint32                     objects_number;
-  uint32                     total_size;
+  int32                      objects_number;
+  int32                      total_size;
 } _mtlk_obj_factory_t;
 
+struct _mtlk_objpool_shard_t
+{
+  mtlk_osal_spinlock_t  lock;
+  mtlk_hash_t           objects_hash;
+  _mtlk_obj_factory_t  *last;      /* most recently used */
+  volatile int32        allocated; /* MTLK_MEMORY_OBJ sizes */
+};
+
+struct _mtlk_objpool_t
+{
+  struct _mtlk_objpool_shard_t        shards[_MTLK_OBJPOOL_NOF_SHARDS];
+  struct _mtlk_objpool_memory_alarm_t alarm; /* changed with all the shards locked */
+
+  MTLK_DECLARE_INIT_STATUS;
+  MTLK_DECLARE_INIT_LOOP(OBJPOOL_SHARDS);
+};
+
+static __INLINE struct _mtlk_objpool_shard_t *
+_mtlk_objpool_get_shard (mtlk_objpool_t* objpool)
+{
+#ifdef MTLK_OSAL_HAVE_CONTEXT_SLOT
+  return &objpool->shards[mtlk_osal_get_context_slot() % _MTLK_OBJPOOL_NOF_SHARDS];
+#else
+  /* The OSAL doesn't number the contexts (the driver one so far) */
+  return &objpool->shards[0];
+#endif
+}
+
+static void
+_mtlk_objpool_lock_all (mtlk_objpool_t* objpool)
+{
+  int i;
+
+  for (i = 0; i < _MTLK_OBJPOOL_NOF_SHARDS; i++) {
+    mtlk_osal_lock_acquire(&objpool->shards[i].lock);
+  }
+}
+
+static void
+_mtlk_objpool_unlock_all (mtlk_objpool_t* objpool)
+{
+  int i;
+
+  for (i = _MTLK_OBJPOOL_NOF_SHARDS - 1; i >= 0; i--) {
+    mtlk_osal_lock_release(&objpool->shards[i].lock);
+  }
+}
+
+static int
+_mtlk_objpool_shard_init (struct _mtlk_objpool_shard_t *shard)
+{
+  int res;
+
+  shard->last      = NULL;
+  shard->allocated = 0;
+
+  res = mtlk_osal_lock_init_objpool(&shard->lock);
+  if (MTLK_ERR_OK != res) {
+    return res;
+  }
+
+  res = mtlk_hash_init_objpool_objpool(&shard->objects_hash, _MTLK_OBJPOOL_HASH_NOF_BUCKETS);
+  if (MTLK_ERR_OK != res) {
+    mtlk_osal_lock_cleanup_objpool(&shard->lock);
+  }
+
+  return res;
+}
+
+static void
+_mtlk_objpool_shard_cleanup (struct _mtlk_objpool_shard_t *shard)
+{
+  mtlk_hash_enum_t e;
+  MTLK_HASH_ENTRY_T(objpool) *h;
+
+  /* Factories outlive their objects, free them all */
+  h = mtlk_hash_enum_first_objpool(&shard->objects_hash, &e);
+  while (h) {
+    mtlk_hash_remove_objpool(&shard->objects_hash, h);
+    mtlk_osal_mem_free_objpool(MTLK_CONTAINER_OF(h, _mtlk_obj_factory_t, hentry));
+    h = mtlk_hash_enum_next_objpool(&shard->objects_hash, &e);
+  }
+
+  mtlk_hash_cleanup_objpool_objpool(&shard->objects_hash);
+  mtlk_osal_lock_cleanup_objpool(&shard->lock);
+}
+
+/* Must be called with the shard locked. Factories are never removed while
+ * the objpool is alive: an object type is created at the same places
+ * again and again. */
+static _mtlk_obj_factory_t *
+_mtlk_objpool_shard_get_factory (struct _mtlk_objpool_shard_t *shard,
+                                 mtlk_objtypes_t object_type,
+                                 mtlk_slid_t creator_slid)
+{
+  _mtlk_objpool_hash_key_t    key = _MTLK_MAKE_OBJPOOL_HASH_KEY(object_type, creator_slid);
+  MTLK_HASH_ENTRY_T(objpool) *entry;
+  _mtlk_obj_factory_t        *objfact = shard->last;
+
+  if (objfact && objfact->hentry.key == key) {
+    return objfact;
+  }
+
+  entry = mtlk_hash_find_objpool(&shard->objects_hash, &key);
+  if (entry) {
+    objfact = MTLK_CONTAINER_OF(entry, _mtlk_obj_factory_t, hentry);
+  }
+  else {
+    /* Allocate new object allocator context */
+    objfact = (_mtlk_obj_factory_t*) mtlk_osal_mem_alloc_objpool(sizeof(_mtlk_obj_factory_t), MTLK_MEM_TAG_OBJPOOL);
+    if (NULL == objfact) {
+      mtlk_osal_emergency_print("Failed to allocate object header.");
+      return NULL;
+    }
+
+    /* Fill it */
+    objfact->type = object_type;
+    objfact->creator_slid = creator_slid;
+    objfact->objects_number = 0;
+    objfact->total_size = 0;
+
+    /* Put to hash */
+    mtlk_hash_insert_objpool(&shard->objects_hash, &key, &objfact->hentry);
+  }
+
+  shard->last = objfact;
+  return objfact;
+}
+
+/* Merged counters of the factory over the shards starting from the one
+ * it belongs to. Must be called with all the shards locked.
+ * Returns FALSE if the factory is counted already (found in a preceding
+ * shard). */
+static BOOL
+_mtlk_objpool_merge_factory (mtlk_objpool_t* objpool,
+                             int shard_idx,
+                             const _mtlk_obj_factory_t *objfact,
+                             int32 *objects_number,
+                             int32 *total_size)
+{
+  int i;
+
+  for (i = 0; i < shard_idx; i++) {
+    if (mtlk_hash_find_objpool(&objpool->shards[i].objects_hash, &objfact->hentry.key)) {
+      return FALSE;
+    }
+  }
+
+  *objects_number = objfact->objects_number;
+  *total_size     = objfact->total_size;
+
+  for (i = shard_idx + 1; i < _MTLK_OBJPOOL_NOF_SHARDS; i++) {
+    MTLK_HASH_ENTRY_T(objpool) *h = mtlk_hash_find_objpool(&objpool->shards[i].objects_hash,
+                                                           &objfact->hentry.key);
+    if (h) {
+      const _mtlk_obj_factory_t *other = MTLK_CONTAINER_OF(h, _mtlk_obj_factory_t, hentry);
+
+      *objects_number += other->objects_number;
+      *total_size     += other->total_size;
+    }
+  }
+
+  return TRUE;
+}
+
+typedef void (*_mtlk_objpool_merged_f)(mtlk_objpool_t* objpool,
+                                       const _mtlk_obj_factory_t *objfact,
+                                       int32 objects_number,
+                                       int32 total_size,
+                                       mtlk_handle_t context);
+
+/* Calls clb for every (type, creator) with objects, all the shards locked */
+static void
+_mtlk_objpool_enum_merged (mtlk_objpool_t* objpool,
+                           _mtlk_objpool_merged_f clb,
+                           mtlk_handle_t context)
+{
+  int i;
+
+  _mtlk_objpool_lock_all(objpool);
+
+  for (i = 0; i < _MTLK_OBJPOOL_NOF_SHARDS; i++) {
+    mtlk_hash_enum_t e;
+    MTLK_HASH_ENTRY_T(objpool) *h;
+
+    h = mtlk_hash_enum_first_objpool(&objpool->shards[i].objects_hash, &e);
+    while (h) {
+      _mtlk_obj_factory_t *objfact = MTLK_CONTAINER_OF(h, _mtlk_obj_factory_t, hentry);
+      int32 objects_number, total_size;
+
+      if (_mtlk_objpool_merge_factory(objpool, i, objfact, &objects_number, &total_size) &&
+          (objects_number != 0 || total_size != 0)) {
+        clb(objpool, objfact, objects_number, total_size, context);
+      }
+
+      h = mtlk_hash_enum_next_objpool(&objpool->shards[i].objects_hash, &e);
+    }
+  }
+
+  _mtlk_objpool_unlock_all(objpool);
+}
+
 void __MTLK_IFUNC mtlk_objpool_cleanup(mtlk_objpool_t* objpool)
 {
+  int i;
+
   MTLK_ASSERT(NULL != objpool);
 
   MTLK_CLEANUP_BEGIN(objpool, MTLK_OBJ_PTR(objpool))
     MTLK_CLEANUP_STEP(objpool, OBJPOOL_DUMP, MTLK_OBJ_PTR(objpool),
                       mtlk_objpool_dump, (objpool));
-    MTLK_CLEANUP_STEP(objpool, OBJPOOL_HASH, MTLK_OBJ_PTR(objpool),
-                      mtlk_hash_cleanup_objpool_objpool, (&objpool->objects_hash));
-    MTLK_CLEANUP_STEP(objpool, HASH_LOCK, MTLK_OBJ_PTR(objpool),
-                      mtlk_osal_lock_cleanup_objpool, (&objpool->hash_lock));
+    for (i = 0; MTLK_CLEANUP_ITERATONS_LEFT(MTLK_OBJ_PTR(objpool), OBJPOOL_SHARDS) > 0; i++) {
+      MTLK_CLEANUP_STEP_LOOP(objpool, OBJPOOL_SHARDS, MTLK_OBJ_PTR(objpool),
+                             _mtlk_objpool_shard_cleanup, (&objpool->shards[i]));
+    }
   MTLK_CLEANUP_END(objpool, MTLK_OBJ_PTR(objpool));
 }
 
 int __MTLK_IFUNC mtlk_objpool_init(mtlk_objpool_t* objpool)
 {
+  int i;
+
   MTLK_ASSERT(NULL != objpool);
 
   MTLK_INIT_TRY(objpool, MTLK_OBJ_PTR(objpool))
-    MTLK_INIT_STEP(objpool, HASH_LOCK, MTLK_OBJ_PTR(objpool),
-                   mtlk_osal_lock_init_objpool, (&objpool->hash_lock));
-    MTLK_INIT_STEP(objpool, OBJPOOL_HASH, MTLK_OBJ_PTR(objpool),
-                   mtlk_hash_init_objpool_objpool,
-                   (&objpool->objects_hash, _MTLK_OBJPOOL_HASH_NOF_BUCKETS));
+    for (i = 0; i < _MTLK_OBJPOOL_NOF_SHARDS; i++) {
+      MTLK_INIT_STEP_LOOP(objpool, OBJPOOL_SHARDS, MTLK_OBJ_PTR(objpool),
+                          _mtlk_objpool_shard_init, (&objpool->shards[i]));
+    }
     MTLK_INIT_STEP_VOID(objpool, OBJPOOL_DUMP, MTLK_OBJ_PTR(objpool),
                         MTLK_NOACTION, ());
-    memset(&objpool->memory, 0, sizeof(objpool->memory));
+    memset(&objpool->alarm, 0, sizeof(objpool->alarm));
   MTLK_INIT_FINALLY(objpool, MTLK_OBJ_PTR(objpool))
   MTLK_INIT_RETURN(objpool, MTLK_OBJ_PTR(objpool), mtlk_objpool_cleanup, (objpool))
 }
@@ -165,52 +363,50 @@ mtlk_objpool_get_type_name (mtlk_objtypes_t object_type)
   }
 }
 
-void __MTLK_IFUNC mtlk_objpool_dump(mtlk_objpool_t* objpool)
+static void
+_mtlk_objpool_dump_clb (mtlk_objpool_t* objpool,
+                        const _mtlk_obj_factory_t *objfact,
+                        int32 objects_number,
+                        int32 total_size,
+                        mtlk_handle_t context)
 {
-  mtlk_hash_enum_t e;
-  uint32 obj_counter = 0;
-  MTLK_HASH_ENTRY_T(objpool) *h;
+  int32 *obj_counter = HANDLE_T_PTR(int32, context);
 
-  MTLK_ASSERT(NULL != objpool);
-
-  mtlk_osal_lock_acquire(&objpool->hash_lock);
+  MTLK_UNREFERENCED_PARAM(objpool);
+  MTLK_UNREFERENCED_PARAM(total_size);
 
-  h = mtlk_hash_enum_first_objpool(&objpool->objects_hash, &e);
-  while (h) {
-    _mtlk_obj_factory_t *objfact = MTLK_CONTAINER_OF(h, _mtlk_obj_factory_t, hentry);
+  mtlk_osal_emergency_print("objpool: %d objects of type \"%s\", created at " MTLK_SLID_FMT,
+                            objects_number,
+                            mtlk_objpool_get_type_name(objfact->type),
+                            MTLK_SLID_ARGS(objfact->creator_slid));
+  *obj_counter += objects_number;
+}
 
-    mtlk_osal_emergency_print("objpool: %d objects of type \"%s\", created at " MTLK_SLID_FMT,
-                              objfact->objects_number,
-                              mtlk_objpool_get_type_name(objfact->type),
-                              MTLK_SLID_ARGS(objfact->creator_slid));
-    obj_counter += objfact->objects_number;
+void __MTLK_IFUNC mtlk_objpool_dump(mtlk_objpool_t* objpool)
+{
+  int32 obj_counter = 0;
 
-    h = mtlk_hash_enum_next_objpool(&objpool->objects_hash, &e);
-  }
+  MTLK_ASSERT(NULL != objpool);
 
-  mtlk_osal_lock_release(&objpool->hash_lock);
+  _mtlk_objpool_enum_merged(objpool, _mtlk_objpool_dump_clb, HANDLE_T(&obj_counter));
 
   if (0 != obj_counter) {
     mtlk_osal_emergency_print("objpool: %d object(s) are still in object pool.", obj_counter);
   }
 }
 
-static void
-_mtlk_objpool_on_memory_allocated(struct _mtlk_objpool_memory_t* memory_stats, uint32 size)
+static uint32
+_mtlk_objpool_get_allocated (mtlk_objpool_t* objpool)
 {
-  memory_stats->allocated += size;
-  if (memory_stats->alarm.limit &&
-    memory_stats->allocated >= memory_stats->alarm.limit)
-  {
-      memory_stats->alarm.clb(memory_stats->alarm.usr_ctx, memory_stats->allocated);
+  int32 allocated = 0;
+  int   i;
+
+  for (i = 0; i < _MTLK_OBJPOOL_NOF_SHARDS; i++) {
+    allocated += objpool->shards[i].allocated;
   }
-};
 
-static void
-_mtlk_objpool_on_memory_released(struct _mtlk_objpool_memory_t* memory_stats, uint32 size)
-{
-  memory_stats->allocated -= size;
-};
+  return (uint32)allocated;
+}
 
 void __MTLK_IFUNC
 mtlk_objpool_add_object_ex(mtlk_objpool_t* objpool, 
@@ -219,8 +415,9 @@ mtlk_objpool_add_object_ex(mtlk_objpool_t* objpool,
                            mtlk_slid_t creator_slid,
                            uint32 additional_allocation_size)
 {
-  MTLK_HASH_ENTRY_T(objpool) *entry;
-  _mtlk_objpool_hash_key_t   new_obj_hash_key;
+  struct _mtlk_objpool_shard_t       *shard;
+  _mtlk_obj_factory_t                *objfact;
+  struct _mtlk_objpool_memory_alarm_t alarm;
 
   MTLK_ASSERT(NULL != objpool);
   MTLK_ASSERT(NULL != objpool_ctx_ptr);
@@ -228,44 +425,32 @@ mtlk_objpool_add_object_ex(mtlk_objpool_t* objpool,
   MTLK_ASSERT(object_type > MTLK_OBJTYPES_START);
   MTLK_ASSERT(object_type < MTLK_OBJTYPES_END);
 
-  new_obj_hash_key = _MTLK_MAKE_OBJPOOL_HASH_KEY(object_type, creator_slid);
   *objpool_ctx_ptr = creator_slid;
+  shard = _mtlk_objpool_get_shard(objpool);
 
-  mtlk_osal_lock_acquire(&objpool->hash_lock);
+  mtlk_osal_lock_acquire(&shard->lock);
 
-  entry = mtlk_hash_find_objpool(&objpool->objects_hash, &new_obj_hash_key);
-  if(entry)
-  {
-    _mtlk_obj_factory_t *objfact = MTLK_CONTAINER_OF(entry, _mtlk_obj_factory_t, hentry);
+  objfact = _mtlk_objpool_shard_get_factory(shard, object_type, creator_slid);
+  if (objfact) {
     objfact->objects_number++;
     objfact->total_size += additional_allocation_size;
   }
-  else
-  {
-    /* Allocate new object allocator context */
-    _mtlk_obj_factory_t* objfact = (_mtlk_obj_factory_t*) mtlk_osal_mem_alloc_objpool(sizeof(_mtlk_obj_factory_t), MTLK_MEM_TAG_OBJPOOL);
-    if(NULL != objfact)
-    {
-      /* Fill it */
-      objfact->type = object_type;
-      objfact->creator_slid = creator_slid;
-      objfact->objects_number = 1;
-      objfact->total_size = additional_allocation_size;
-
-      /* Put to hash */
-      entry = mtlk_hash_insert_objpool(&objpool->objects_hash, &new_obj_hash_key, &objfact->hentry);
-    }
-    else
-    {
-      mtlk_osal_emergency_print("Failed to allocate object header.");
-    }
+
+  alarm.limit = 0;
+  if (object_type == MTLK_MEMORY_OBJ) {
+    shard->allocated += additional_allocation_size;
+    alarm = objpool->alarm;
   }
 
-  mtlk_osal_lock_release(&objpool->hash_lock);
+  mtlk_osal_lock_release(&shard->lock);
+
+  /* The total is only needed for the alarm */
+  if (alarm.limit) {
+    uint32 allocated = _mtlk_objpool_get_allocated(objpool);
 
-  if(object_type == MTLK_MEMORY_OBJ)
-  {
-    _mtlk_objpool_on_memory_allocated(&objpool->memory, additional_allocation_size);
+    if (allocated >= alarm.limit) {
+      alarm.clb(alarm.usr_ctx, allocated);
+    }
   }
 }
 
@@ -274,42 +459,33 @@ void __MTLK_IFUNC mtlk_objpool_remove_object_ex(mtlk_objpool_t* objpool,
                                                 mtlk_objtypes_t object_type,
                                                 uint32 additional_allocation_size)
 {
-  MTLK_HASH_ENTRY_T(objpool)  *entry;
-  _mtlk_objpool_hash_key_t   obj_hash_key;
-  _mtlk_obj_factory_t  *objfact;
+  struct _mtlk_objpool_shard_t *shard;
+  _mtlk_obj_factory_t          *objfact;
+
   MTLK_ASSERT(NULL != objpool);
   MTLK_ASSERT(NULL != objpool_ctx_ptr);
   MTLK_ASSERT(0 != *objpool_ctx_ptr);
 
-  obj_hash_key = _MTLK_MAKE_OBJPOOL_HASH_KEY(object_type, *objpool_ctx_ptr);
+  shard = _mtlk_objpool_get_shard(objpool);
 
-  if(object_type == MTLK_MEMORY_OBJ)
-    _mtlk_objpool_on_memory_released(&objpool->memory, additional_allocation_size);
+  mtlk_osal_lock_acquire(&shard->lock);
 
-  mtlk_osal_lock_acquire(&objpool->hash_lock);
-
-  entry = mtlk_hash_find_objpool(&objpool->objects_hash, &obj_hash_key);
-  MTLK_ASSERT(NULL != entry);
-  if(!entry) {
-    mtlk_osal_lock_release(&objpool->hash_lock);
-    ELOG_DD("Can't find entry for object %u:0x%X", object_type, *objpool_ctx_ptr);
-    return;
+  if (object_type == MTLK_MEMORY_OBJ) {
+    shard->allocated -= additional_allocation_size;
   }
 
-  objfact = MTLK_CONTAINER_OF(entry, _mtlk_obj_factory_t, hentry);
-  objfact->objects_number--;
-  MTLK_ASSERT((int32)objfact->objects_number >= 0);
-  objfact->total_size -= additional_allocation_size;
-  MTLK_ASSERT((int32)objfact->total_size >= 0);
-
-  if(0 == objfact->objects_number)
-  {
-    MTLK_ASSERT(0 == objfact->total_size);
-    mtlk_hash_remove_objpool(&objpool->objects_hash, entry);
-    mtlk_osal_mem_free_objpool(objfact);
+  /* The object may have been added to another shard */
+  objfact = _mtlk_objpool_shard_get_factory(shard, object_type, *objpool_ctx_ptr);
+  if (objfact) {
+    objfact->objects_number--;
+    objfact->total_size -= additional_allocation_size;
   }
 
-  mtlk_osal_lock_release(&objpool->hash_lock);
+  mtlk_osal_lock_release(&shard->lock);
+
+  if (!objfact) {
+    ELOG_DD("Can't count removal of object %u:0x%X", object_type, *objpool_ctx_ptr);
+  }
 }
 
 mtlk_slid_t __MTLK_IFUNC
@@ -325,52 +501,66 @@ mtlk_objpool_get_creator_slid (mtlk_objpool_t* objpool,
   return (mtlk_slid_t) *objpool_ctx_ptr;
 }
 
+struct _mtlk_objpool_enum_ctx_t
+{
+  mtlk_objtypes_t     object_type;
+  mtlk_objpool_enum_f clb;
+  mtlk_handle_t       context;
+  BOOL                stop;
+};
+
+static void
+_mtlk_objpool_enum_by_type_clb (mtlk_objpool_t* objpool,
+                                const _mtlk_obj_factory_t *objfact,
+                                int32 objects_number,
+                                int32 total_size,
+                                mtlk_handle_t context)
+{
+  struct _mtlk_objpool_enum_ctx_t *ctx = HANDLE_T_PTR(struct _mtlk_objpool_enum_ctx_t, context);
+
+  if (!ctx->stop && ctx->object_type == objfact->type) {
+    ctx->stop = !ctx->clb(objpool, objfact->creator_slid, (uint32)objects_number,
+                          (uint32)total_size, ctx->context);
+  }
+}
+
 void __MTLK_IFUNC
 mtlk_objpool_enum_by_type (mtlk_objpool_t* objpool,
                            mtlk_objtypes_t object_type,
                            mtlk_objpool_enum_f clb,
                            mtlk_handle_t context)
 {
-  MTLK_HASH_ENTRY_T(objpool) *h;
-  mtlk_hash_enum_t e;
+  struct _mtlk_objpool_enum_ctx_t ctx;
 
   MTLK_ASSERT(NULL != objpool);
   MTLK_ASSERT(NULL != clb);
 
-  mtlk_osal_lock_acquire(&objpool->hash_lock);
-
-  h = mtlk_hash_enum_first_objpool(&objpool->objects_hash, &e);
-  while (h) {
-    _mtlk_obj_factory_t *objfact = MTLK_CONTAINER_OF(h, _mtlk_obj_factory_t, hentry);
-
-    if (object_type == objfact->type) {
-      clb(objpool, objfact->creator_slid, objfact->objects_number, objfact->total_size, context);
-    }
-
-    h = mtlk_hash_enum_next_objpool(&objpool->objects_hash, &e);
-  }
+  ctx.object_type = object_type;
+  ctx.clb         = clb;
+  ctx.context     = context;
+  ctx.stop        = FALSE;
 
-  mtlk_osal_lock_release(&objpool->hash_lock);
+  _mtlk_objpool_enum_merged(objpool, _mtlk_objpool_enum_by_type_clb, HANDLE_T(&ctx));
 }
 
 uint32 __MTLK_IFUNC
 mtlk_objpool_get_memory_allocated (mtlk_objpool_t* objpool)
 {
-  return objpool->memory.allocated;
+  return _mtlk_objpool_get_allocated(objpool);
 }
 
 void __MTLK_IFUNC
 mtlk_objpool_set_memory_alarm (mtlk_objpool_t* objpool, 
                                const mtlk_objpool_memory_alarm_t *alarm_info)
 {
-  mtlk_osal_lock_acquire(&objpool->hash_lock);
+  _mtlk_objpool_lock_all(objpool);
   if (alarm_info) {
-    objpool->memory.alarm = *alarm_info;
+    objpool->alarm = *alarm_info;
   }
   else {
-    memset(&objpool->memory.alarm, 0, sizeof(objpool->memory.alarm));
+    memset(&objpool->alarm, 0, sizeof(objpool->alarm));
   }
-  mtlk_osal_lock_release(&objpool->hash_lock);
+  _mtlk_objpool_unlock_all(objpool);
 }
 
 mtlk_objpool_t g_objpool;
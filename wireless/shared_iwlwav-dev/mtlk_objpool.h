@@ -74,7 +74,9 @@ void __MTLK_IFUNC mtlk_objpool_dump(mtlk_objpool_t* objpool);
 
 const char * __MTLK_IFUNC mtlk_objpool_get_type_name(mtlk_objtypes_t object_type);
 
-/* mtlk_objpool_enum_f return FALSE to stop enumeration, TRUE - to continue it */
+/* mtlk_objpool_enum_f return FALSE to stop enumeration, TRUE - to continue it.
+ * The counters are merged over the per-thread shards, all of them locked
+ * during the enumeration. */
 typedef BOOL (__MTLK_IFUNC *mtlk_objpool_enum_f)(mtlk_objpool_t* objpool,
                                                  mtlk_slid_t creator_slid,
                                                  uint32      objects_number,
@@ -102,6 +104,7 @@ mtlk_slid_t __MTLK_IFUNC
 mtlk_objpool_get_creator_slid (mtlk_objpool_t* objpool,
                                mtlk_objpool_context_t* objpool_ctx_ptr);
 
+/* Sum over the per-thread shards, not locked */
 uint32 __MTLK_IFUNC
 mtlk_objpool_get_memory_allocated(mtlk_objpool_t* objpool);
 
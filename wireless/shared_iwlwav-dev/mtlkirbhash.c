@@ -21,128 +21,515 @@
 #define LOG_LOCAL_GID   GID_MTLKIRBAHASH
 #define LOG_LOCAL_FID   1
 
-MTLK_MHASH_DECLARE_ENTRY_T(irb, mtlk_guid_t);
+/* Dispatch table: an immutable array of immutable events per bucket.
+ * Its size is a power of 2 and grows with the number of events. */
+struct mtlk_irb_handler
+{
+  void *volatile func; /* NULL if removed in place */
+  mtlk_handle_t  context;
+  uint32         owner;
+};
+
+struct mtlk_irb_evt
+{
+  mtlk_guid_t             guid;
+  uint32                  nof_handlers;
+  struct mtlk_irb_handler handlers[1];
+};
+
+struct mtlk_irb_bucket
+{
+  uint32               nof_evts;
+  struct mtlk_irb_evt *evts[1];
+};
 
-struct mtlk_irb_evt_handler
+struct mtlk_irb_table
 {
-  MTLK_MHASH_ENTRY_T(irb) hentry;
-  mtlk_irb_hash_t        *hash;
-  void                   *func;
-  mtlk_handle_t           context;
-  uint32                  owner;
+  uint32                           nof_buckets;
+  uint32                           nof_evts;
+  struct mtlk_irb_bucket *volatile buckets[1];
 };
 
-MTLK_MHASH_DECLARE_STATIC(irb, mtlk_guid_t);
+#define IRB_HASH_MIN_BUCKETS    8
+#define IRB_HASH_OWNER_BUCKETS  16
+
+/* Writer side owner index for unregistration */
+MTLK_HASH_DECLARE_ENTRY_T(irb_owner, uint32);
+
+struct mtlk_irb_owner
+{
+  MTLK_HASH_ENTRY_T(irb_owner) hentry;
+  uint32                       nof_evts;
+  mtlk_guid_t                  evts[IRB_MAX_NOF_EVTS];
+};
 
-#define IRB_HASH_MAX_IDX 10
+MTLK_HASH_DECLARE_INLINE(irb_owner, uint32);
 
 static __INLINE uint32
-_irb_hash_hash_func (const mtlk_guid_t *key, uint32 nof_buckets)
+_irb_owner_hash_func (const uint32 *key, uint32 nof_buckets)
 {
-  MTLK_UNREFERENCED_PARAM(nof_buckets);
+  return *key % nof_buckets;
+}
 
-  return key->data1 % IRB_HASH_MAX_IDX;
+static __INLINE int
+_irb_owner_key_cmp_func (const uint32 *key1,
+                         const uint32 *key2)
+{
+  return (*key1 != *key2);
+}
+
+MTLK_HASH_DEFINE_INLINE(irb_owner,
+                        uint32,
+                        _irb_owner_hash_func,
+                        _irb_owner_key_cmp_func);
+
+/* Parts of the table replaced by a single register/unregister:
+ * an event and its bucket per event of the owner, twice on rollback */
+#define IRB_HASH_MAX_RETIRED    (4 * IRB_MAX_NOF_EVTS)
+
+typedef struct
+{
+  void   *ptrs[IRB_HASH_MAX_RETIRED];
+  uint32  nof_ptrs;
+} irb_retired_t;
+
+/* The contents must be visible before the pointer to them */
+#define IRB_PUBLISH(ptr, val) \
+  do { __sync_synchronize(); (ptr) = (val); } while (0)
+
+static __INLINE uint32
+_irb_guid_hash (const mtlk_guid_t *guid)
+{
+  const uint8 *p = (const uint8 *)guid;
+  uint32       h = 2166136261U; /* FNV-1a */
+  uint32       i;
+
+  for (i = 0; i < sizeof(*guid); i++) {
+    h = (h ^ p[i]) * 16777619U;
+  }
+
+  return h ^ (h >> 16);
+}
+
+static __INLINE struct mtlk_irb_bucket *
+_irb_table_bucket (struct mtlk_irb_table *table, const mtlk_guid_t *guid)
+{
+  return table->buckets[_irb_guid_hash(guid) & (table->nof_buckets - 1)];
 }
 
 static __INLINE int
-_irb_hash_key_cmp_func (const mtlk_guid_t *key1,
-                        const mtlk_guid_t *key2)
+_irb_bucket_find (const struct mtlk_irb_bucket *bucket, const mtlk_guid_t *guid)
+{
+  uint32 i;
+
+  if (bucket) {
+    for (i = 0; i < bucket->nof_evts; i++) {
+      if (!mtlk_guid_compare(&bucket->evts[i]->guid, guid))
+        return (int)i;
+    }
+  }
+
+  return -1;
+}
+
+static __INLINE void
+_irb_retire (irb_retired_t *retired, void *ptr)
+{
+  if (ptr) {
+    MTLK_ASSERT(retired->nof_ptrs < ARRAY_SIZE(retired->ptrs));
+    retired->ptrs[retired->nof_ptrs++] = ptr;
+  }
+}
+
+static struct mtlk_irb_table *
+_irb_table_alloc (uint32 nof_buckets)
+{
+  size_t size = sizeof(struct mtlk_irb_table) +
+                (nof_buckets - 1) * sizeof(struct mtlk_irb_bucket *);
+  struct mtlk_irb_table *table =
+    (struct mtlk_irb_table *)mtlk_osal_mem_alloc(size, MTLK_MEM_TAG_IRB);
+
+  if (table) {
+    memset(table, 0, size);
+    table->nof_buckets = nof_buckets;
+  }
+
+  return table;
+}
+
+static struct mtlk_irb_bucket *
+_irb_bucket_alloc (uint32 nof_evts)
+{
+  struct mtlk_irb_bucket *bucket = (struct mtlk_irb_bucket *)
+    mtlk_osal_mem_alloc(sizeof(*bucket) + (nof_evts - 1) * sizeof(bucket->evts[0]),
+                        MTLK_MEM_TAG_IRB);
+
+  if (bucket)
+    bucket->nof_evts = nof_evts;
+
+  return bucket;
+}
+
+static struct mtlk_irb_evt *
+_irb_evt_alloc (const mtlk_guid_t *guid, uint32 nof_handlers)
 {
-  return mtlk_guid_compare(key1, key2);
+  struct mtlk_irb_evt *evt = (struct mtlk_irb_evt *)
+    mtlk_osal_mem_alloc(sizeof(*evt) + (nof_handlers - 1) * sizeof(evt->handlers[0]),
+                        MTLK_MEM_TAG_IRB);
+
+  if (evt) {
+    evt->guid         = *guid;
+    evt->nof_handlers = nof_handlers;
+  }
+
+  return evt;
 }
 
-MTLK_MHASH_DEFINE_STATIC(irb, 
-                         mtlk_guid_t,
-                         _irb_hash_hash_func,
-                         _irb_hash_key_cmp_func);
+/* Waits for the end of every dispatch that may refer to the parts of the
+ * table replaced before: those counted in the readers[] of the previous
+ * epoch. The dispatches started later see the new epoch and the table. */
+static void
+_irb_hash_synchronize (mtlk_irb_hash_t *irb_hash)
+{
+  uint32 idx = (mtlk_osal_atomic_inc(&irb_hash->epoch) - 1) & 1;
+
+  while (mtlk_osal_atomic_get(&irb_hash->readers[idx]) != 0) {
+    mtlk_osal_msleep(1);
+  }
+}
+
+static __INLINE uint32
+_irb_hash_read_lock (mtlk_irb_hash_t *irb_hash)
+{
+  uint32 epoch;
+
+  /* Retry if the epoch has been flipped before the dispatch got counted:
+   * the writer may not be waiting for this counter anymore */
+  for (;;) {
+    epoch = mtlk_osal_atomic_get(&irb_hash->epoch);
+    mtlk_osal_atomic_inc(&irb_hash->readers[epoch & 1]);
+    if (mtlk_osal_atomic_get(&irb_hash->epoch) == epoch)
+      break;
+    mtlk_osal_atomic_dec(&irb_hash->readers[epoch & 1]);
+  }
+
+  return epoch & 1;
+}
+
+static __INLINE void
+_irb_hash_read_unlock (mtlk_irb_hash_t *irb_hash, uint32 idx)
+{
+  mtlk_osal_atomic_dec(&irb_hash->readers[idx]);
+}
 
+static void
+_irb_hash_free_retired (mtlk_irb_hash_t *irb_hash, irb_retired_t *retired)
+{
+  uint32 i;
+
+  if (!retired->nof_ptrs)
+    return;
+
+  _irb_hash_synchronize(irb_hash);
+  for (i = 0; i < retired->nof_ptrs; i++) {
+    mtlk_osal_mem_free(retired->ptrs[i]);
+  }
+  retired->nof_ptrs = 0;
+}
+
+/* Replaces the table by a bigger one (sharing the events) if there are
+ * more events than buckets. Frees the replaced table on its own. */
 static int
-__mtlk_irb_hash_add_owner_node (mtlk_irb_hash_t       *irb_hash,
-                                mtlk_handle_t          owner,
-                                const mtlk_guid_t     *evt,
-                                void                  *handler,
-                                mtlk_handle_t          context)
+_irb_hash_grow (mtlk_irb_hash_t *irb_hash, uint32 nof_evts)
 {
-  struct mtlk_irb_evt_handler *info =
-      (struct mtlk_irb_evt_handler *)mtlk_osal_mem_alloc(sizeof(*info), MTLK_MEM_TAG_IRB);
+  struct mtlk_irb_table *table = irb_hash->table;
+  struct mtlk_irb_table *new_table;
+  uint32                *counts;
+  uint32                 nof_buckets = table->nof_buckets;
+  uint32                 i, j;
+  int                    res = MTLK_ERR_NO_MEM;
+
+  while (nof_buckets < nof_evts) {
+    nof_buckets <<= 1;
+  }
+  if (nof_buckets == table->nof_buckets)
+    return MTLK_ERR_OK;
 
-  if (!info) {
+  new_table = _irb_table_alloc(nof_buckets);
+  counts = (uint32 *)mtlk_osal_mem_alloc(nof_buckets * sizeof(uint32), MTLK_MEM_TAG_IRB);
+  if (!new_table || !counts)
+    goto end;
+  memset(counts, 0, nof_buckets * sizeof(uint32));
+
+  for (i = 0; i < table->nof_buckets; i++) {
+    struct mtlk_irb_bucket *bucket = table->buckets[i];
+
+    for (j = 0; bucket && j < bucket->nof_evts; j++) {
+      counts[_irb_guid_hash(&bucket->evts[j]->guid) & (nof_buckets - 1)]++;
+    }
+  }
+  for (i = 0; i < nof_buckets; i++) {
+    if (counts[i]) {
+      new_table->buckets[i] = _irb_bucket_alloc(counts[i]);
+      if (!new_table->buckets[i])
+        goto end;
+      new_table->buckets[i]->nof_evts = 0;
+    }
+  }
+  for (i = 0; i < table->nof_buckets; i++) {
+    struct mtlk_irb_bucket *bucket = table->buckets[i];
+
+    for (j = 0; bucket && j < bucket->nof_evts; j++) {
+      struct mtlk_irb_bucket *new_bucket = _irb_table_bucket(new_table, &bucket->evts[j]->guid);
+
+      new_bucket->evts[new_bucket->nof_evts++] = bucket->evts[j];
+    }
+  }
+  new_table->nof_evts = table->nof_evts;
+
+  IRB_PUBLISH(irb_hash->table, new_table);
+  _irb_hash_synchronize(irb_hash);
+  new_table = table;
+  res = MTLK_ERR_OK;
+
+end:
+  /* Either the replaced or the unused table */
+  if (new_table) {
+    for (i = 0; i < new_table->nof_buckets; i++) {
+      if (new_table->buckets[i])
+        mtlk_osal_mem_free(new_table->buckets[i]);
+    }
+    mtlk_osal_mem_free(new_table);
+  }
+  if (counts)
+    mtlk_osal_mem_free(counts);
+
+  return res;
+}
+
+/* Publishes a copy of the bucket with the event at idx (or a new one if
+ * idx is negative) replaced by new_evt, or removed if new_evt is NULL */
+static int
+_irb_hash_replace_evt (mtlk_irb_hash_t     *irb_hash,
+                       const mtlk_guid_t   *guid,
+                       int                  idx,
+                       struct mtlk_irb_evt *new_evt,
+                       irb_retired_t       *retired)
+{
+  struct mtlk_irb_table  *table = irb_hash->table;
+  uint32                  bucket_idx = _irb_guid_hash(guid) & (table->nof_buckets - 1);
+  struct mtlk_irb_bucket *bucket = table->buckets[bucket_idx];
+  struct mtlk_irb_bucket *new_bucket = NULL;
+  uint32                  nof_evts = bucket ? bucket->nof_evts : 0;
+  uint32                  i, n = 0;
+
+  if (idx < 0)
+    nof_evts++;
+  else if (!new_evt)
+    nof_evts--;
+
+  if (nof_evts) {
+    new_bucket = _irb_bucket_alloc(nof_evts);
+    if (!new_bucket)
+      return MTLK_ERR_NO_MEM;
+
+    for (i = 0; bucket && i < bucket->nof_evts; i++) {
+      if ((int)i != idx)
+        new_bucket->evts[n++] = bucket->evts[i];
+      else if (new_evt)
+        new_bucket->evts[n++] = new_evt;
+    }
+    if (idx < 0)
+      new_bucket->evts[n++] = new_evt;
+    MTLK_ASSERT(n == nof_evts);
+  }
+
+  IRB_PUBLISH(table->buckets[bucket_idx], new_bucket);
+  if (idx < 0)
+    table->nof_evts++;
+  else if (!new_evt)
+    table->nof_evts--;
+
+  _irb_retire(retired, bucket);
+  if (idx >= 0)
+    _irb_retire(retired, bucket->evts[idx]);
+
+  return MTLK_ERR_OK;
+}
+
+static int
+_irb_hash_add_handler (mtlk_irb_hash_t   *irb_hash,
+                       uint32             owner,
+                       const mtlk_guid_t *guid,
+                       void              *handler,
+                       mtlk_handle_t      context,
+                       irb_retired_t     *retired)
+{
+  struct mtlk_irb_bucket *bucket = _irb_table_bucket(irb_hash->table, guid);
+  int                     idx = _irb_bucket_find(bucket, guid);
+  struct mtlk_irb_evt    *evt = (idx >= 0) ? bucket->evts[idx] : NULL;
+  struct mtlk_irb_evt    *new_evt;
+  uint32                  nof_handlers = 1;
+  uint32                  i, n = 0;
+  int                     res;
+
+  for (i = 0; evt && i < evt->nof_handlers; i++) {
+    if (evt->handlers[i].func)
+      nof_handlers++;
+  }
+
+  new_evt = _irb_evt_alloc(guid, nof_handlers);
+  if (!new_evt) {
     ELOG_V("Can't allocate IRB node!");
     return MTLK_ERR_NO_MEM;
   }
 
-  memset(info, 0, sizeof(*info));
-  info->func    = handler;
-  info->context = context;
-  info->owner   = owner;
+  /* In the order of registration */
+  for (i = 0; evt && i < evt->nof_handlers; i++) {
+    if (evt->handlers[i].func)
+      new_evt->handlers[n++] = evt->handlers[i];
+  }
+  new_evt->handlers[n].func    = handler;
+  new_evt->handlers[n].context = context;
+  new_evt->handlers[n].owner   = owner;
 
-  mtlk_osal_mutex_acquire(&irb_hash->lock);
-  mtlk_mhash_insert_irb(&irb_hash->hash, evt, &info->hentry);
-  mtlk_osal_mutex_release(&irb_hash->lock);
+  res = _irb_hash_replace_evt(irb_hash, guid, idx, new_evt, retired);
+  if (res != MTLK_ERR_OK) {
+    ELOG_V("Can't allocate IRB node!");
+    mtlk_osal_mem_free(new_evt);
+  }
 
-  return MTLK_ERR_OK;
+  return res;
 }
 
-static  __INLINE void
-__mtlk_irb_hash_remove_all_nodes (mtlk_irb_hash_t *irb_hash)
+static void
+_irb_hash_remove_handlers (mtlk_irb_hash_t   *irb_hash,
+                           uint32             owner,
+                           const mtlk_guid_t *guid,
+                           irb_retired_t     *retired)
 {
-  mtlk_mhash_enum_t        ctx;
-  MTLK_MHASH_ENTRY_T(irb) *h;
+  struct mtlk_irb_bucket *bucket = _irb_table_bucket(irb_hash->table, guid);
+  int                     idx = _irb_bucket_find(bucket, guid);
+  struct mtlk_irb_evt    *evt;
+  struct mtlk_irb_evt    *new_evt = NULL;
+  uint32                  nof_handlers = 0;
+  uint32                  nof_owned = 0;
+  uint32                  i, n = 0;
+
+  if (idx < 0)
+    return;
 
-  h = mtlk_mhash_enum_first_irb(&irb_hash->hash, &ctx);
-  while (h) {
-    struct mtlk_irb_evt_handler *info = 
-      MTLK_CONTAINER_OF(h, struct mtlk_irb_evt_handler, hentry);
-    mtlk_mhash_remove_irb(&irb_hash->hash, &info->hentry);
-    mtlk_osal_mem_free(info);
+  evt = bucket->evts[idx];
+  for (i = 0; i < evt->nof_handlers; i++) {
+    if (!evt->handlers[i].func)
+      continue;
+    if (evt->handlers[i].owner == owner)
+      nof_owned++;
+    else
+      nof_handlers++;
+  }
+  if (!nof_owned)
+    return; /* the event is listed twice */
+
+  if (nof_handlers) {
+    new_evt = _irb_evt_alloc(guid, nof_handlers);
+    if (!new_evt)
+      goto in_place;
+    for (i = 0; i < evt->nof_handlers; i++) {
+      if (evt->handlers[i].func && evt->handlers[i].owner != owner)
+        new_evt->handlers[n++] = evt->handlers[i];
+    }
+  }
+
+  if (_irb_hash_replace_evt(irb_hash, guid, idx, new_evt, retired) == MTLK_ERR_OK)
+    return;
 
-    h = mtlk_mhash_enum_next_irb(&irb_hash->hash, &ctx);
+  if (new_evt)
+    mtlk_osal_mem_free(new_evt);
+
+in_place:
+  /* Unregistration can't fail: the handlers are skipped by the dispatch
+   * and dropped by the next copy of the event */
+  WLOG_V("Can't allocate IRB node, the handlers are removed in place");
+  for (i = 0; i < evt->nof_handlers; i++) {
+    if (evt->handlers[i].owner == owner)
+      evt->handlers[i].func = NULL;
   }
 }
 
-static  __INLINE BOOL
-_mtlk_irb_remove_owner_nodes (mtlk_irb_hash_t *irb_hash, mtlk_handle_t owner)
+static int
+_mtlk_irb_hash_table_init (mtlk_irb_hash_t *irb_hash)
 {
-  mtlk_mhash_enum_t        ctx;
-  MTLK_MHASH_ENTRY_T(irb) *h;
+  irb_hash->table = _irb_table_alloc(IRB_HASH_MIN_BUCKETS);
 
-  h = mtlk_mhash_enum_first_irb(&irb_hash->hash, &ctx);
+  return irb_hash->table ? MTLK_ERR_OK : MTLK_ERR_NO_MEM;
+}
+
+static void
+_mtlk_irb_hash_table_cleanup (mtlk_irb_hash_t *irb_hash)
+{
+  struct mtlk_irb_table        *table = irb_hash->table;
+  mtlk_hash_enum_t              ctx;
+  MTLK_HASH_ENTRY_T(irb_owner) *h;
+  uint32                        i, j;
+
+  h = mtlk_hash_enum_first_irb_owner(&irb_hash->owners, &ctx);
   while (h) {
-    struct mtlk_irb_evt_handler *info = 
-      MTLK_CONTAINER_OF(h, struct mtlk_irb_evt_handler, hentry);
-    if (info->owner == owner) {
-      mtlk_mhash_remove_irb(&irb_hash->hash, &info->hentry);
-      mtlk_osal_mem_free(info);
-      break;
+    struct mtlk_irb_owner *info =
+      MTLK_CONTAINER_OF(h, struct mtlk_irb_owner, hentry);
+    mtlk_hash_remove_irb_owner(&irb_hash->owners, &info->hentry);
+    mtlk_osal_mem_free(info);
+
+    h = mtlk_hash_enum_next_irb_owner(&irb_hash->owners, &ctx);
+  }
+
+  for (i = 0; i < table->nof_buckets; i++) {
+    struct mtlk_irb_bucket *bucket = table->buckets[i];
+
+    if (!bucket)
+      continue;
+    for (j = 0; j < bucket->nof_evts; j++) {
+      mtlk_osal_mem_free(bucket->evts[j]);
     }
-    h = mtlk_mhash_enum_next_irb(&irb_hash->hash, &ctx);
+    mtlk_osal_mem_free(bucket);
   }
+  mtlk_osal_mem_free(table);
+  irb_hash->table = NULL;
+}
 
-  return (h != NULL);
+static void
+_mtlk_irb_remove_owner (mtlk_irb_hash_t       *irb_hash,
+                        uint32                 owner,
+                        const mtlk_guid_t     *evts,
+                        uint32                 nof_evts,
+                        irb_retired_t         *retired)
+{
+  uint32 i;
+
+  for (i = 0; i < nof_evts; i++) {
+    _irb_hash_remove_handlers(irb_hash, owner, &evts[i], retired);
+  }
 }
 
 MTLK_INIT_STEPS_LIST_BEGIN(irb_hash)
   MTLK_INIT_STEPS_LIST_ENTRY(irb_hash, IRB_HASH_LOCK)
-  MTLK_INIT_STEPS_LIST_ENTRY(irb_hash, IRB_HASH_HASH)
-  MTLK_INIT_STEPS_LIST_ENTRY(irb_hash, IRB_HASH_FILL)
+  MTLK_INIT_STEPS_LIST_ENTRY(irb_hash, IRB_HASH_OWNERS)
+  MTLK_INIT_STEPS_LIST_ENTRY(irb_hash, IRB_HASH_TABLE)
 MTLK_INIT_INNER_STEPS_BEGIN(irb_hash)
 MTLK_INIT_STEPS_LIST_END(irb_hash);
 
-static __INLINE int
-__mtlk_irb_hash_nop_init (mtlk_irb_hash_t *irb_hash)
-{
-  return MTLK_ERR_OK;
-}
-
 int __MTLK_IFUNC
 _mtlk_irb_hash_init (mtlk_irb_hash_t *irb_hash)
 {
   MTLK_INIT_TRY(irb_hash, MTLK_OBJ_PTR(irb_hash))
     MTLK_INIT_STEP(irb_hash, IRB_HASH_LOCK, MTLK_OBJ_PTR(irb_hash), mtlk_osal_mutex_init, (&irb_hash->lock));
-    MTLK_INIT_STEP(irb_hash, IRB_HASH_HASH, MTLK_OBJ_PTR(irb_hash), mtlk_mhash_init_irb, (&irb_hash->hash, IRB_HASH_MAX_IDX));
-    MTLK_INIT_STEP(irb_hash, IRB_HASH_FILL, MTLK_OBJ_PTR(irb_hash), __mtlk_irb_hash_nop_init, (irb_hash));
+    MTLK_INIT_STEP(irb_hash, IRB_HASH_OWNERS, MTLK_OBJ_PTR(irb_hash), mtlk_hash_init_irb_owner, (&irb_hash->owners, IRB_HASH_OWNER_BUCKETS));
+    MTLK_INIT_STEP(irb_hash, IRB_HASH_TABLE, MTLK_OBJ_PTR(irb_hash), _mtlk_irb_hash_table_init, (irb_hash));
   MTLK_INIT_FINALLY(irb_hash, MTLK_OBJ_PTR(irb_hash))
     mtlk_osal_atomic_set(&irb_hash->owner_id, 0);
+    mtlk_osal_atomic_set(&irb_hash->epoch, 0);
+    mtlk_osal_atomic_set(&irb_hash->readers[0], 0);
+    mtlk_osal_atomic_set(&irb_hash->readers[1], 0);
   MTLK_INIT_RETURN(irb_hash, MTLK_OBJ_PTR(irb_hash), _mtlk_irb_hash_cleanup, (irb_hash))
 }
 
@@ -150,8 +537,8 @@ void __MTLK_IFUNC
 _mtlk_irb_hash_cleanup (mtlk_irb_hash_t *irb_hash)
 {
   MTLK_CLEANUP_BEGIN(irb_hash, MTLK_OBJ_PTR(irb_hash))
-    MTLK_CLEANUP_STEP(irb_hash, IRB_HASH_FILL, MTLK_OBJ_PTR(irb_hash), __mtlk_irb_hash_remove_all_nodes, (irb_hash));
-    MTLK_CLEANUP_STEP(irb_hash, IRB_HASH_HASH, MTLK_OBJ_PTR(irb_hash), mtlk_mhash_cleanup_irb, (&irb_hash->hash));
+    MTLK_CLEANUP_STEP(irb_hash, IRB_HASH_TABLE, MTLK_OBJ_PTR(irb_hash), _mtlk_irb_hash_table_cleanup, (irb_hash));
+    MTLK_CLEANUP_STEP(irb_hash, IRB_HASH_OWNERS, MTLK_OBJ_PTR(irb_hash), mtlk_hash_cleanup_irb_owner, (&irb_hash->owners));
     MTLK_CLEANUP_STEP(irb_hash, IRB_HASH_LOCK, MTLK_OBJ_PTR(irb_hash), mtlk_osal_mutex_cleanup, (&irb_hash->lock));
   MTLK_CLEANUP_END(irb_hash, MTLK_OBJ_PTR(irb_hash))
 }
@@ -163,8 +550,11 @@ _mtlk_irb_hash_register (mtlk_irb_hash_t   *irb_hash,
                          void              *handler,
                          mtlk_handle_t      context)
 {
-  int    err   = MTLK_ERR_UNKNOWN;
-  uint32 owner;
+  int                    err = MTLK_ERR_OK;
+  uint32                 owner;
+  uint32                 i;
+  struct mtlk_irb_owner *info;
+  irb_retired_t          retired;
 
   MTLK_ASSERT(irb_hash != NULL);
   MTLK_ASSERT(evts != NULL);
@@ -174,27 +564,36 @@ _mtlk_irb_hash_register (mtlk_irb_hash_t   *irb_hash,
   if (!irb_hash || !evts || !nof_evts || !handler || nof_evts > IRB_MAX_NOF_EVTS)
     return HANDLE_T(0);
 
+  info = (struct mtlk_irb_owner *)mtlk_osal_mem_alloc(sizeof(*info), MTLK_MEM_TAG_IRB);
+  if (!info) {
+    ELOG_V("Can't allocate IRB owner!");
+    return HANDLE_T(0);
+  }
+
   owner = mtlk_osal_atomic_inc(&irb_hash->owner_id);
+  memset(info, 0, sizeof(*info));
+  info->nof_evts = nof_evts;
+  memcpy(info->evts, evts, nof_evts * sizeof(evts[0]));
+  retired.nof_ptrs = 0;
 
-  while (nof_evts) {
-    err = __mtlk_irb_hash_add_owner_node(irb_hash,
-                                         owner,
-                                         &evts[0],
-                                         handler,
-                                         context);
-    if (err != MTLK_ERR_OK) {
-      goto end;
-    }
+  mtlk_osal_mutex_acquire(&irb_hash->lock);
 
-    evts++;
-    nof_evts--;
+  err = _irb_hash_grow(irb_hash, irb_hash->table->nof_evts + nof_evts);
+  for (i = 0; err == MTLK_ERR_OK && i < nof_evts; i++) {
+    err = _irb_hash_add_handler(irb_hash, owner, &evts[i], handler, context, &retired);
   }
 
-  err = MTLK_ERR_OK;
+  if (err == MTLK_ERR_OK)
+    mtlk_hash_insert_irb_owner(&irb_hash->owners, &owner, &info->hentry);
+  else
+    _mtlk_irb_remove_owner(irb_hash, owner, evts, i, &retired);
+
+  _irb_hash_free_retired(irb_hash, &retired);
+
+  mtlk_osal_mutex_release(&irb_hash->lock);
 
-end:
   if (err != MTLK_ERR_OK) {
-    _mtlk_irb_hash_unregister(irb_hash, owner);
+    mtlk_osal_mem_free(info);
     owner = 0;
   }
 
@@ -205,15 +604,32 @@ void __MTLK_IFUNC
 _mtlk_irb_hash_unregister (mtlk_irb_hash_t *irb_hash,
                            mtlk_handle_t    owner)
 {
+  uint32                        key = (uint32)owner;
+  MTLK_HASH_ENTRY_T(irb_owner) *h;
+  struct mtlk_irb_owner        *info = NULL;
+  irb_retired_t                 retired;
+
   MTLK_ASSERT(irb_hash);
   if (!irb_hash)
     return;
 
-  if (owner) {
-    mtlk_osal_mutex_acquire(&irb_hash->lock);
-    _mtlk_irb_remove_owner_nodes(irb_hash, owner);
-    mtlk_osal_mutex_release(&irb_hash->lock);
+  if (!owner)
+    return;
+
+  retired.nof_ptrs = 0;
+
+  mtlk_osal_mutex_acquire(&irb_hash->lock);
+  h = mtlk_hash_find_irb_owner(&irb_hash->owners, &key);
+  if (h) {
+    info = MTLK_CONTAINER_OF(h, struct mtlk_irb_owner, hentry);
+    mtlk_hash_remove_irb_owner(&irb_hash->owners, &info->hentry);
+    _mtlk_irb_remove_owner(irb_hash, key, info->evts, info->nof_evts, &retired);
+    _irb_hash_free_retired(irb_hash, &retired);
   }
+  mtlk_osal_mutex_release(&irb_hash->lock);
+
+  if (info)
+    mtlk_osal_mem_free(info);
 }
 
 void __MTLK_IFUNC
@@ -223,23 +639,30 @@ _mtlk_irb_hash_on_evt (mtlk_irb_hash_t   *irb_hash,
                        uint32            *size,
                        mtlk_handle_t      contex)
 {
-  mtlk_mhash_find_t        ctx;
-  MTLK_MHASH_ENTRY_T(irb) *h;
+  struct mtlk_irb_bucket *bucket;
+  uint32                  idx;
+  int                     i;
 
   MTLK_ASSERT(irb_hash);
   MTLK_ASSERT(evt);
   if (!irb_hash || !evt)
     return;
 
-  mtlk_osal_mutex_acquire(&irb_hash->lock);
-  h = mtlk_mhash_find_first_irb(&irb_hash->hash, evt, &ctx);
-  while (h) {
-    struct mtlk_irb_evt_handler *info = 
-      MTLK_CONTAINER_OF(h, struct mtlk_irb_evt_handler, hentry);
-    _mtlk_irb_call_handler(contex, info->func, info->context, evt, buffer, size);
-    h = mtlk_mhash_find_next_irb(&irb_hash->hash, evt, &ctx);
-  }
-  mtlk_osal_mutex_release(&irb_hash->lock);
-}
+  idx = _irb_hash_read_lock(irb_hash);
 
+  bucket = _irb_table_bucket(irb_hash->table, evt);
+  i = _irb_bucket_find(bucket, evt);
+  if (i >= 0) {
+    const struct mtlk_irb_evt *info = bucket->evts[i];
+    uint32                     j;
 
+    for (j = 0; j < info->nof_handlers; j++) {
+      void *func = info->handlers[j].func;
+
+      if (func)
+        _mtlk_irb_call_handler(contex, func, info->handlers[j].context, evt, buffer, size);
+    }
+  }
+
+  _irb_hash_read_unlock(irb_hash, idx);
+}
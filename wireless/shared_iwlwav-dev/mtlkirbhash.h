@@ -30,11 +30,21 @@
 
 #define IRB_MAX_NOF_EVTS (16)
 
+struct mtlk_irb_table;
+
+/* The dispatch table is never modified in place: writers (register and
+ * unregister, serialized by lock) publish modified copies and free the
+ * replaced parts once no event dispatch may still refer to them. Events
+ * are dispatched without locking, so the handlers must not register or
+ * unregister from within the dispatch. */
 struct mtlk_irb_hash_private
 {
-  mtlk_mhash_t      hash;
-  mtlk_atomic_t     owner_id;
-  mtlk_osal_mutex_t lock;
+  struct mtlk_irb_table *volatile table;
+  mtlk_atomic_t          epoch;      /* selects readers[] of a new dispatch */
+  mtlk_atomic_t          readers[2]; /* dispatches in progress */
+  mtlk_hash_t            owners;     /* events of every owner */
+  mtlk_atomic_t          owner_id;
+  mtlk_osal_mutex_t      lock;
   MTLK_DECLARE_INIT_STATUS;
 };
 